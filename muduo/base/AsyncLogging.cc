@@ -1,11 +1,207 @@
 #include <muduo/base/AsyncLogging.h>
+#include <muduo/base/LogDecoder.h>
 #include <muduo/base/LogFile.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ProcessInfo.h>
 #include <muduo/base/Timestamp.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <stdio.h>
 
 using namespace muduo;
 
+namespace
+{
+
+// Secondary on-disk queue used by kSpillOverflow.
+// Written sequentially at the tail and read back in FIFO order, a buffer
+// at a time so that no log record is split, the file is removed once
+// everything has been replayed.
+// A write which fails stops the appending, not the replay of what was
+// written whole before it.
+// Only touched by the backend thread.
+class SpillFile : boost::noncopyable
+{
+ public:
+  explicit SpillFile(const string& filename)
+    : filename_(filename),
+      out_(NULL),
+      in_(NULL),
+      written_(0),
+      read_(0),
+      lost_(0),
+      failed_(false)
+  {
+  }
+
+  ~SpillFile()
+  {
+    close();
+  }
+
+  int64_t pending() const { return written_ - read_; }
+  // of the file on disk, which is only removed once all is replayed
+  int64_t size() const { return written_; }
+  // no more appending until all before is replayed
+  bool failed() const { return failed_; }
+
+  // bytes given up since the last call, those of a spill file unreadable
+  int64_t takeLost()
+  {
+    int64_t lost = lost_;
+    lost_ = 0;
+    return lost;
+  }
+
+  // a buffer, prefixed with its length, returns false if not written whole
+  bool write(const char* data, size_t len)
+  {
+    if (failed_)
+    {
+      return false;
+    }
+    if (!out_)
+    {
+      out_ = ::fopen(filename_.c_str(), "wb");
+      if (!out_)
+      {
+        return false;
+      }
+    }
+    uint32_t len32 = static_cast<uint32_t>(len);
+    if (::fwrite(&len32, 1, sizeof len32, out_) != sizeof len32
+        || ::fwrite(data, 1, len, out_) != len)
+    {
+      // the tail can't be framed, append no more, but replay up to it
+      failed_ = true;
+      return false;
+    }
+    written_ += implicit_cast<int64_t>(sizeof len32 + len);
+    return true;
+  }
+
+  // reads the next buffer of at most len bytes, returns bytes read
+  size_t read(char* buf, size_t len)
+  {
+    if (pending() == 0)
+    {
+      return 0;
+    }
+    ::fflush(out_);
+    if (!in_)
+    {
+      in_ = ::fopen(filename_.c_str(), "rb");
+      if (!in_)
+      {
+        lost_ += pending();
+        close();
+        return 0;
+      }
+    }
+    ::clearerr(in_);
+    uint32_t len32 = 0;
+    size_t n = 0;
+    if (::fread(&len32, 1, sizeof len32, in_) == sizeof len32 && len32 <= len)
+    {
+      n = ::fread(buf, 1, len32, in_);
+    }
+    if (n != len32 || n == 0)
+    {
+      lost_ += pending();
+      close();  // truncated, nothing more to replay
+      return 0;
+    }
+    read_ += implicit_cast<int64_t>(sizeof len32 + n);
+    if (pending() == 0)
+    {
+      close();
+    }
+    return n;
+  }
+
+ private:
+  void close()
+  {
+    if (in_)
+    {
+      ::fclose(in_);
+      in_ = NULL;
+    }
+    if (out_)
+    {
+      ::fclose(out_);
+      out_ = NULL;
+      ::remove(filename_.c_str());
+    }
+    written_ = 0;
+    read_ = 0;
+    failed_ = false;
+  }
+
+  const string filename_;
+  FILE* out_;
+  FILE* in_;
+  int64_t written_;
+  int64_t read_;
+  int64_t lost_;
+  bool failed_;
+};
+
+// formats binary log records first if decoder is not NULL
+void writeChunks(LogFile& output, LogDecoder* decoder, string* decoded,
+                 const StringPiece* chunks, int count)
+{
+  if (!decoder)
+  {
+    output.appendv(chunks, count);
+    return;
+  }
+
+  decoded->clear();
+  for (int i = 0; i < count; ++i)
+  {
+    decoder->decode(chunks[i].data(), chunks[i].size(), decoded);
+  }
+  StringPiece text(decoded->data(), static_cast<int>(decoded->size()));
+  output.appendv(&text, 1);
+}
+
+// the sites defined in dropped buffers, for the records still to come
+void writeLogSites(LogFile& output, LogDecoder* decoder)
+{
+  if (!Logger::binaryFormat())
+  {
+    return;
+  }
+
+  string sites;
+  detail::appendLogSites(&sites);
+  if (decoder)
+  {
+    decoder->addSites(sites.data(), sites.size());
+  }
+  else
+  {
+    output.append(sites.data(), static_cast<int>(sites.size()));
+  }
+}
+
+void reportSpillDropped(LogFile& output, LogDecoder* decoder,
+                        int64_t dropped, const char* reason)
+{
+  char buf[256];
+  snprintf(buf, sizeof buf, "Dropped log messages at %s, %lld bytes, %s\n",
+           Timestamp::now().toFormattedString().c_str(),
+           static_cast<long long>(dropped), reason);
+  fputs(buf, stderr);
+  output.append(buf, static_cast<int>(strlen(buf)));
+  writeLogSites(output, decoder);
+}
+
+}
+
 AsyncLogging::AsyncLogging(const string& basename,
                            size_t rollSize,
                            int flushInterval)
@@ -13,10 +209,16 @@ AsyncLogging::AsyncLogging(const string& basename,
     running_(false),
     basename_(basename),
     rollSize_(rollSize),
+    overflowPolicy_(kDropOverflow),
+    blockMilliSeconds_(100),
+    maxSpillBytes_(implicit_cast<int64_t>(1024)*1024*1024),
+    decodeBinary_(false),
+    rollPeriod_(0),
     thread_(boost::bind(&AsyncLogging::threadFunc, this), "Logging"),
     latch_(1),
     mutex_(),
     cond_(mutex_),
+    notFull_(mutex_),
     currentBuffer_(new Buffer),
     nextBuffer_(new Buffer),
     buffers_()
@@ -29,6 +231,11 @@ AsyncLogging::AsyncLogging(const string& basename,
 void AsyncLogging::append(const char* logline, int len)
 {
   muduo::MutexLockGuard lock(mutex_);
+  if (currentBuffer_->avail() <= len && overflowPolicy_ == kBlockOverflow)
+  {
+    waitForBackend();
+  }
+
   if (currentBuffer_->avail() > len)
   {
     currentBuffer_->append(logline, len);
@@ -50,18 +257,65 @@ void AsyncLogging::append(const char* logline, int len)
   }
 }
 
+void AsyncLogging::waitForBackend()
+{
+  mutex_.assertLocked();
+  Timestamp deadline = addTime(Timestamp::now(), blockMilliSeconds_ / 1000.0);
+  // buffers_ plus currentBuffer_ must stay within kMaxBuffersToWrite
+  while (running_ && buffers_.size() + 2 > kMaxBuffersToWrite)
+  {
+    int64_t remain = deadline.microSecondsSinceEpoch()
+                     - Timestamp::now().microSecondsSinceEpoch();
+    if (remain < 1000)
+    {
+      break;  // give up waiting, the backend will drop
+    }
+    notFull_.waitForMilliSeconds(static_cast<int>(remain / 1000));
+  }
+}
+
 void AsyncLogging::threadFunc()
 {
   assert(running_ == true);
   latch_.countDown();
-  LogFile output(basename_, rollSize_, false);
+  // unbuffered, each round is written with a single writev(2)
+  LogFile output(basename_, rollSize_, false, flushInterval_, 1024, true);
+  if (rollPeriod_ > 0)
+  {
+    output.setRollPeriod(rollPeriod_);
+  }
+  output.setRollCallback(rollCallback_);
+  output.setLogSites(!decodeBinary_);
   BufferPtr newBuffer1(new Buffer);
   BufferPtr newBuffer2(new Buffer);
   newBuffer1->bzero();
   newBuffer2->bzero();
   BufferVector buffersToWrite;
   buffersToWrite.reserve(16);
-  while (running_)
+  std::vector<StringPiece> chunks;
+  chunks.reserve(kMaxBuffersToWrite + 1);
+
+  boost::scoped_ptr<LogDecoder> decoder;
+  string decoded;
+  if (decodeBinary_)
+  {
+    decoder.reset(new LogDecoder);
+  }
+
+  const int kReplayBuffersPerRound = 4;
+  boost::scoped_ptr<SpillFile> spill;
+  std::vector<char> replayBuffer;
+  if (overflowPolicy_ == kSpillOverflow)
+  {
+    char pidbuf[32];
+    snprintf(pidbuf, sizeof pidbuf, ".%d.spill", ProcessInfo::pid());
+    spill.reset(new SpillFile(basename_ + pidbuf));
+    replayBuffer.resize(muduo::detail::kLargeBuffer);
+  }
+
+  // one more round after stop(), for what was appended before it
+  bool stopping = false;
+  while (!stopping)
   {
     assert(newBuffer1 && newBuffer1->length() == 0);
     assert(newBuffer2 && newBuffer2->length() == 0);
@@ -69,10 +323,11 @@ void AsyncLogging::threadFunc()
 
     {
       muduo::MutexLockGuard lock(mutex_);
-      if (buffers_.empty())  // unusual usage!
+      if (buffers_.empty() && running_)  // unusual usage!
       {
         cond_.waitForSeconds(flushInterval_);
       }
+      stopping = !running_;
       buffers_.push_back(currentBuffer_.release());
       currentBuffer_ = boost::ptr_container::move(newBuffer1);
       buffersToWrite.swap(buffers_);
@@ -83,22 +338,90 @@ void AsyncLogging::threadFunc()
     }
 
     assert(!buffersToWrite.empty());
+    notFull_.notifyAll();
 
-    if (buffersToWrite.size() > 25)
+    if (spill && (spill->pending() > 0 || buffersToWrite.size() > kMaxBuffersToWrite))
     {
-      char buf[256];
-      snprintf(buf, sizeof buf, "Dropped log messages at %s, " SSIZET_FMT " larger buffers\n",
-               Timestamp::now().toFormattedString().c_str(),
-               buffersToWrite.size()-2);
-      fputs(buf, stderr);
-      output.append(buf, static_cast<int>(strlen(buf)));
-      buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
+      // keep the order, once spilling everything goes through the spill file
+      size_t start = 0;
+      if (spill->pending() == 0)
+      {
+        StringPiece first[2] = {
+          StringPiece(buffersToWrite[0].data(), buffersToWrite[0].length()),
+          StringPiece(buffersToWrite[1].data(), buffersToWrite[1].length()),
+        };
+        writeChunks(output, decoder.get(), &decoded, first, 2);
+        start = 2;
+      }
+      int64_t dropped = 0;
+      for (size_t i = start; i < buffersToWrite.size(); ++i)
+      {
+        size_t len = buffersToWrite[i].length();
+        if (spill->size() + implicit_cast<int64_t>(len) <= maxSpillBytes_
+            && spill->write(buffersToWrite[i].data(), len))
+        {
+          spilledBytes_.add(len);
+        }
+        else
+        {
+          dropped += len;
+        }
+      }
+      if (dropped > 0)
+      {
+        droppedBytes_.add(dropped);
+        reportSpillDropped(output, decoder.get(), dropped,
+                           spill->failed() ? "spill file write failed" : "spill file full");
+      }
     }
+    else
+    {
+      if (buffersToWrite.size() > kMaxBuffersToWrite)
+      {
+        char buf[256];
+        snprintf(buf, sizeof buf, "Dropped log messages at %s, " SSIZET_FMT " larger buffers\n",
+                 Timestamp::now().toFormattedString().c_str(),
+                 buffersToWrite.size()-2);
+        fputs(buf, stderr);
+        output.append(buf, static_cast<int>(strlen(buf)));
+        writeLogSites(output, decoder.get());
+        int64_t dropped = 0;
+        for (size_t i = 2; i < buffersToWrite.size(); ++i)
+        {
+          dropped += buffersToWrite[i].length();
+        }
+        droppedBytes_.add(dropped);
+        buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
+      }
 
-    for (size_t i = 0; i < buffersToWrite.size(); ++i)
+      chunks.clear();
+      for (size_t i = 0; i < buffersToWrite.size(); ++i)
+      {
+        chunks.push_back(StringPiece(buffersToWrite[i].data(), buffersToWrite[i].length()));
+      }
+      writeChunks(output, decoder.get(), &decoded,
+                  &*chunks.begin(), static_cast<int>(chunks.size()));
+    }
+
+    // replay a bounded amount per round, only when the backend has caught up
+    if (spill && spill->pending() > 0 && buffersToWrite.size() <= 2)
     {
-      // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffersToWrite[i].data(), buffersToWrite[i].length());
+      for (int i = 0; i < kReplayBuffersPerRound && spill->pending() > 0; ++i)
+      {
+        size_t n = spill->read(&*replayBuffer.begin(), replayBuffer.size());
+        if (n == 0)
+        {
+          break;
+        }
+        StringPiece chunk(&*replayBuffer.begin(), static_cast<int>(n));
+        writeChunks(output, decoder.get(), &decoded, &chunk, 1);
+      }
+      int64_t lost = spill->takeLost();
+      if (lost > 0)
+      {
+        droppedBytes_.add(lost);
+        reportSpillDropped(output, decoder.get(), lost, "spill file unreadable");
+      }
     }
 
     if (buffersToWrite.size() > 2)
@@ -124,6 +447,27 @@ void AsyncLogging::threadFunc()
     buffersToWrite.clear();
     output.flush();
   }
+
+  // drain whatever is still spilled before exiting
+  while (spill && spill->pending() > 0)
+  {
+    size_t n = spill->read(&*replayBuffer.begin(), replayBuffer.size());
+    if (n == 0)
+    {
+      break;
+    }
+    StringPiece chunk(&*replayBuffer.begin(), static_cast<int>(n));
+    writeChunks(output, decoder.get(), &decoded, &chunk, 1);
+  }
+  if (spill)
+  {
+    int64_t lost = spill->takeLost();
+    if (lost > 0)
+    {
+      droppedBytes_.add(lost);
+      reportSpillDropped(output, decoder.get(), lost, "spill file unreadable");
+    }
+  }
   output.flush();
 }
 
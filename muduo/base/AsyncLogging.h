@@ -1,12 +1,14 @@
 #ifndef MUDUO_BASE_ASYNCLOGGING_H
 #define MUDUO_BASE_ASYNCLOGGING_H
 
+#include <muduo/base/Atomic.h>
 #include <muduo/base/BlockingQueue.h>
 #include <muduo/base/BoundedBlockingQueue.h>
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Thread.h>
 
+#include <muduo/base/LogFile.h>
 #include <muduo/base/LogStream.h>
 
 #include <boost/bind.hpp>
@@ -20,6 +22,13 @@ namespace muduo
 class AsyncLogging : boost::noncopyable
 {
  public:
+  // What to do when the backend falls behind the producers.
+  enum OverflowPolicy
+  {
+    kDropOverflow,   // keep two buffers, drop the rest (default)
+    kBlockOverflow,  // block producers for a bounded time, then drop
+    kSpillOverflow,  // spill to a secondary file, replay when caught up
+  };
 
   AsyncLogging(const string& basename,
                size_t rollSize,
@@ -35,6 +44,48 @@ class AsyncLogging : boost::noncopyable
 
   void append(const char* logline, int len);
 
+  // must be called before start()
+  void setOverflowPolicy(OverflowPolicy policy, int blockMilliSeconds = 100)
+  {
+    assert(!running_);
+    overflowPolicy_ = policy;
+    blockMilliSeconds_ = blockMilliSeconds;
+  }
+
+  // must be called before start(), caps the spill file on disk, which is
+  // removed only once all of it is replayed, buffers beyond are dropped
+  void setMaxSpillBytes(int64_t maxSpillBytes)
+  {
+    assert(!running_);
+    maxSpillBytes_ = maxSpillBytes;
+  }
+
+  // must be called before start(), formats binary log records
+  // (Logger::setBinaryFormat) on the backend thread before writing
+  void setDecodeBinary(bool on)
+  {
+    assert(!running_);
+    decodeBinary_ = on;
+  }
+
+  // must be called before start(), runs on the backend thread after
+  // each roll, eg. LogCompressor::compress
+  void setRollCallback(const LogFile::RollCallback& cb)
+  {
+    assert(!running_);
+    rollCallback_ = cb;
+  }
+
+  // must be called before start(), see LogFile::setRollPeriod
+  void setRollPeriod(int seconds)
+  {
+    assert(!running_);
+    rollPeriod_ = seconds;
+  }
+
+  int64_t droppedBytes() { return droppedBytes_.get(); }
+  int64_t spilledBytes() { return spilledBytes_.get(); }
+
   void start()
   {
     running_ = true;
@@ -44,7 +95,11 @@ class AsyncLogging : boost::noncopyable
 
   void stop()
   {
-    running_ = false;
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      running_ = false;
+      notFull_.notifyAll();
+    }
     cond_.notify();
     thread_.join();
   }
@@ -56,19 +111,32 @@ class AsyncLogging : boost::noncopyable
   void operator=(const AsyncLogging&);  // ptr_container
 
   void threadFunc();
+  void waitForBackend();
 
   typedef muduo::detail::FixedBuffer<muduo::detail::kLargeBuffer> Buffer;
   typedef boost::ptr_vector<Buffer> BufferVector;
   typedef BufferVector::auto_type BufferPtr;
 
+  // more than this many buffers in one round means the backend is behind
+  static const size_t kMaxBuffersToWrite = 25;
+
   const int flushInterval_;
   bool running_;
   string basename_;
   size_t rollSize_;
+  OverflowPolicy overflowPolicy_;
+  int blockMilliSeconds_;
+  int64_t maxSpillBytes_;
+  bool decodeBinary_;
+  int rollPeriod_;
+  LogFile::RollCallback rollCallback_;
+  AtomicInt64 droppedBytes_;
+  AtomicInt64 spilledBytes_;
   muduo::Thread thread_;
   muduo::CountDownLatch latch_;
   muduo::MutexLock mutex_;
   muduo::Condition cond_;
+  muduo::Condition notFull_;
   BufferPtr currentBuffer_;
   BufferPtr nextBuffer_;
   BufferVector buffers_;
@@ -81,6 +81,12 @@ class AtomicIntegerT : boost::noncopyable
     return value_.exchange(newValue);
   }
 
+  // true if it was expected and now is newValue
+  bool compareAndSet(T expected, T newValue)
+  {
+    return value_.compare_exchange_strong(expected, newValue);
+  }
+
  private:
   std::atomic<T> value_;
 };
@@ -46,16 +46,41 @@ private:
 
 using namespace muduo;
 
-FileUtil::AppendFile::AppendFile(StringArg filename)
-  : 
+FileUtil::AppendFile::AppendFile(StringArg filename, bool unbuffered)
+  : fp_(NULL),
+    fd_(-1),
+    writtenBytes_(0),
+    droppedBytes_(0)
+{
+  if (unbuffered)
+  {
+    // libuv opens with O_CLOEXEC
+    uv_fs_t req;
+    utilities::FSReqAutoCleanup helper(&req);
+    fd_ = uv_fs_open(NULL, &req, filename.c_str(),
+                     O_WRONLY | O_CREAT | O_APPEND, 0644, NULL);
+    if (fd_ < 0)
+    {
+      // reported once, appends only count what they drop
+      fprintf(stderr, "AppendFile::AppendFile() failed %s: %s\n",
+              uv_strerror(fd_), filename.c_str());
+      fd_ = -1;
+    }
+    return;
+  }
+
 #if defined(NATIVE_WIN32)
-    fp_(::fopen(filename.c_str(), "a")),
+  fp_ = ::fopen(filename.c_str(), "a");
 #else
-    fp_(::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
+  fp_ = ::fopen(filename.c_str(), "ae");  // 'e' for O_CLOEXEC
 #endif
-    writtenBytes_(0)
-{
-  assert(fp_);
+  if (!fp_)
+  {
+    // appends drop everything, as with the fd
+    fprintf(stderr, "AppendFile::AppendFile() failed %s: %s\n",
+            strerror_tl(errno), filename.c_str());
+    return;
+  }
 #if defined(NATIVE_WIN32)
   ::setvbuf(fp_, buffer_, _IOFBF, sizeof buffer_);
 #else
@@ -66,11 +91,27 @@ FileUtil::AppendFile::AppendFile(StringArg filename)
 
 FileUtil::AppendFile::~AppendFile()
 {
-  ::fclose(fp_);
+  if (fp_)
+  {
+    ::fclose(fp_);
+  }
+  else if (fd_ >= 0)
+  {
+    uv_fs_t req;
+    utilities::FSReqAutoCleanup helper(&req);
+    uv_fs_close(NULL, &req, fd_, NULL);
+  }
 }
 
 void FileUtil::AppendFile::append(const char* logline, const size_t len)
 {
+  if (!fp_)
+  {
+    StringPiece chunk(logline, static_cast<int>(len));
+    writev(&chunk, 1);
+    return;
+  }
+
   size_t n = write(logline, len);
   size_t remain = len - n;
   while (remain > 0)
@@ -89,12 +130,103 @@ void FileUtil::AppendFile::append(const char* logline, const size_t len)
     remain = len - n; // remain -= x
   }
 
-  writtenBytes_ += len;
+  writtenBytes_ += n;
+  droppedBytes_ += remain;
+}
+
+void FileUtil::AppendFile::appendv(const StringPiece* chunks, int count)
+{
+  if (!fp_)
+  {
+    writev(chunks, count);
+    return;
+  }
+
+  for (int i = 0; i < count; ++i)
+  {
+    append(chunks[i].data(), chunks[i].size());
+  }
 }
 
 void FileUtil::AppendFile::flush()
 {
-  ::fflush(fp_);
+  if (fp_)
+  {
+    ::fflush(fp_);
+  }
+}
+
+// uv_fs_write() with nbufs > 1 is writev(2) on Unix
+void FileUtil::AppendFile::writev(const StringPiece* chunks, int count)
+{
+  if (fd_ < 0)
+  {
+    // not opened, already reported
+    for (int i = 0; i < count; ++i)
+    {
+      droppedBytes_ += chunks[i].size();
+    }
+    return;
+  }
+
+  const int kMaxBufs = 64;  // well below IOV_MAX
+  uv_buf_t bufs[kMaxBufs];
+  int i = 0;
+  while (i < count)
+  {
+    int nbufs = 0;
+    size_t total = 0;
+    for (; i < count && nbufs < kMaxBufs; ++i)
+    {
+      if (chunks[i].size() > 0)
+      {
+        bufs[nbufs++] = uv_buf_init(const_cast<char*>(chunks[i].data()),
+                                    static_cast<unsigned int>(chunks[i].size()));
+        total += chunks[i].size();
+      }
+    }
+
+    uv_buf_t* first = bufs;
+    size_t remain = total;
+    while (remain > 0)
+    {
+      uv_fs_t req;
+      utilities::FSReqAutoCleanup helper(&req);
+      int n = uv_fs_write(NULL, &req, fd_, first, static_cast<unsigned int>(nbufs), -1, NULL);
+      if (n <= 0)
+      {
+        fprintf(stderr, "AppendFile::writev() failed %s\n",
+                n < 0 ? uv_strerror(n) : "nothing written");
+        break;
+      }
+
+      // short write, skip what has been written
+      size_t written = n;
+      remain -= written;
+      while (nbufs > 0 && written >= first->len)
+      {
+        written -= first->len;
+        ++first;
+        --nbufs;
+      }
+      if (nbufs > 0)
+      {
+        first->base += written;
+        first->len -= static_cast<unsigned int>(written);
+      }
+    }
+    writtenBytes_ += total - remain;
+    if (remain > 0)
+    {
+      // give up the rest
+      droppedBytes_ += remain;
+      for (; i < count; ++i)
+      {
+        droppedBytes_ += chunks[i].size();
+      }
+      break;
+    }
+  }
 }
 
 size_t FileUtil::AppendFile::write(const char* logline, size_t len)
@@ -66,23 +66,34 @@ int readFile(StringArg filename,
 class AppendFile : boost::noncopyable
 {
  public:
-  explicit AppendFile(StringArg filename);
+  // unbuffered bypasses stdio, every append goes straight to the fd
+  explicit AppendFile(StringArg filename, bool unbuffered = false);
 
   ~AppendFile();
 
   void append(const char* logline, const size_t len);
 
+  // gather write, one system call for all chunks in unbuffered mode
+  void appendv(const StringPiece* chunks, int count);
+
   void flush();
 
   size_t writtenBytes() const { return writtenBytes_; }
+  // of the appends which failed, or found no file open
+  size_t droppedBytes() const { return droppedBytes_; }
+
+  bool unbuffered() const { return fp_ == NULL; }
 
  private:
 
   size_t write(const char* logline, size_t len);
+  void writev(const StringPiece* chunks, int count);
 
   FILE* fp_;
+  int fd_;
   char buffer_[64*1024];
   size_t writtenBytes_;
+  size_t droppedBytes_;
 };
 }
 
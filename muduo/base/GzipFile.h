@@ -53,6 +53,17 @@ class GzipFile : boost::noncopyable
 
   // int flush(int f) { return ::gzflush(file_, f); }
 
+  // flushes what is buffered, false if that or the close failed
+  bool close()
+  {
+    int err = ::gzclose(file_);
+    file_ = NULL;
+    return err == Z_OK;
+  }
+
+  // compression level 0-9, call before the first write
+  bool setLevel(int level) { return ::gzsetparams(file_, level, Z_DEFAULT_STRATEGY) == Z_OK; }
+
   static GzipFile openForRead(StringArg filename)
   {
     return GzipFile(::gzopen(filename.c_str(), "rbe"));
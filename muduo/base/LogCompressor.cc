@@ -0,0 +1,219 @@
+#include <muduo/base/LogCompressor.h>
+
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/GzipFile.h>
+#include <muduo/base/Logging.h>
+
+#include <boost/bind.hpp>
+#include <uv.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#if !defined(NATIVE_WIN32)
+#include <sys/resource.h>
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+bool endsWith(const string& s, const char* suffix)
+{
+  size_t len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+int64_t fileSize(const string& filename)
+{
+  uv_fs_t req;
+  int64_t size = -1;
+  if (uv_fs_stat(NULL, &req, filename.c_str(), NULL) == 0)
+  {
+    size = static_cast<int64_t>(req.statbuf.st_size);
+  }
+  uv_fs_req_cleanup(&req);
+  return size;
+}
+
+bool removeFile(const string& filename)
+{
+  uv_fs_t req;
+  int err = uv_fs_unlink(NULL, &req, filename.c_str(), NULL);
+  uv_fs_req_cleanup(&req);
+  return err == 0;
+}
+
+}
+
+LogCompressor::LogCompressor(const string& basename,
+                             int maxFiles,
+                             int64_t maxBytes,
+                             int level)
+  : basename_(basename),
+    maxFiles_(maxFiles),
+    maxBytes_(maxBytes),
+    level_(level),
+    running_(false),
+    thread_(boost::bind(&LogCompressor::threadFunc, this), "LogCompress"),
+    archiveBytes_(0)
+{
+  assert(basename.find('/') == string::npos);
+}
+
+LogCompressor::~LogCompressor()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void LogCompressor::start()
+{
+  assert(!running_);
+  running_ = true;
+  thread_.start();
+}
+
+void LogCompressor::stop()
+{
+  assert(running_);
+  running_ = false;
+  queue_.put(string());  // empty name asks the thread to quit
+  thread_.join();
+}
+
+void LogCompressor::compress(const string& filename)
+{
+  assert(!filename.empty());
+  queue_.put(filename);
+}
+
+void LogCompressor::threadFunc()
+{
+#if !defined(NATIVE_WIN32)
+  // the nice value is per thread on Linux, stay out of the way of I/O threads
+  ::setpriority(PRIO_PROCESS, static_cast<id_t>(CurrentThread::tid()), 19);
+#endif
+  scanArchive();
+  trimArchive();
+  while (true)
+  {
+    string filename(queue_.take());
+    if (filename.empty())
+    {
+      break;
+    }
+    int64_t compressed = 0;
+    if (compressFile(filename, &compressed))
+    {
+      archive_.push_back(std::make_pair(filename + ".gz", compressed));
+      archiveBytes_ += compressed;
+      trimArchive();
+    }
+  }
+}
+
+bool LogCompressor::compressFile(const string& filename, int64_t* compressed)
+{
+  FILE* in = ::fopen(filename.c_str(), "rb");
+  if (in == NULL)
+  {
+    LOG_SYSERR << "LogCompressor cannot open " << filename;
+    return false;
+  }
+
+  string gzname(filename + ".gz");
+  bool ok = true;
+  int64_t read = 0;
+  {
+    GzipFile out = GzipFile::openForWriteExclusive(gzname);
+    if (!out.valid())
+    {
+      LOG_SYSERR << "LogCompressor cannot create " << gzname;
+      ::fclose(in);
+      return false;
+    }
+    out.setLevel(level_);
+
+    char buf[64*1024];
+    size_t n = 0;
+    while (ok && (n = ::fread(buf, 1, sizeof buf, in)) > 0)
+    {
+      StringPiece chunk(buf, static_cast<int>(n));
+      ok = out.write(chunk) == chunk.size();
+      read += static_cast<int64_t>(n);
+    }
+    ok = ok && !::ferror(in);
+    // the rest is only written here, e.g. ENOSPC shows up now
+    ok = out.close() && ok;
+  }
+  ::fclose(in);
+
+  int64_t size = fileSize(gzname);
+  if (!ok || size < 0)
+  {
+    // the original is kept
+    LOG_ERROR << "LogCompressor failed on " << filename;
+    removeFile(gzname);
+    return false;
+  }
+  removeFile(filename);
+  bytesIn_.add(read);
+  bytesOut_.add(size);
+  compressedFiles_.increment();
+  *compressed = size;
+  return true;
+}
+
+// picks up .gz files left by earlier runs, file names sort by roll time
+void LogCompressor::scanArchive()
+{
+  string prefix(basename_ + ".");
+  std::vector<string> names;
+  uv_fs_t req;
+  if (uv_fs_scandir(NULL, &req, ".", 0, NULL) >= 0)
+  {
+    uv_dirent_t ent;
+    while (uv_fs_scandir_next(&req, &ent) != UV_EOF)
+    {
+      string name(ent.name);
+      if (name.compare(0, prefix.size(), prefix) == 0 && endsWith(name, ".log.gz"))
+      {
+        names.push_back(name);
+      }
+    }
+  }
+  uv_fs_req_cleanup(&req);
+
+  std::sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); ++i)
+  {
+    int64_t size = fileSize(names[i]);
+    if (size >= 0)
+    {
+      archive_.push_back(std::make_pair(names[i], size));
+      archiveBytes_ += size;
+    }
+  }
+}
+
+void LogCompressor::trimArchive()
+{
+  while (!archive_.empty()
+         && ((maxFiles_ > 0 && archive_.size() > static_cast<size_t>(maxFiles_))
+             || (maxBytes_ > 0 && archiveBytes_ > maxBytes_)))
+  {
+    const std::pair<string, int64_t>& oldest = archive_.front();
+    if (!removeFile(oldest.first))
+    {
+      LOG_WARN << "LogCompressor cannot remove " << oldest.first;
+    }
+    archiveBytes_ -= oldest.second;
+    archive_.pop_front();
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef MUDUO_BASE_LOGCOMPRESSOR_H
+#define MUDUO_BASE_LOGCOMPRESSOR_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/BlockingQueue.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <utility>
+
+namespace muduo
+{
+
+// Gzips rolled log files on a low priority background thread and
+// removes the oldest .gz files of basename beyond a count or size cap.
+//
+//   LogCompressor compressor(basename, 30);
+//   compressor.start();
+//   logFile.setRollCallback(boost::bind(&LogCompressor::compress, &compressor, _1));
+//
+// Binary log files (Logger::setBinaryFormat) each start with all site
+// definitions, those left after removal still decode on their own.
+// Needs zlib, only built when it is found.
+class LogCompressor : boost::noncopyable
+{
+ public:
+  // maxFiles or maxBytes of 0 means unlimited, level is the zlib level,
+  // the fastest one keeps up with a busy logger on a fraction of a core.
+  explicit LogCompressor(const string& basename,
+                         int maxFiles = 0,
+                         int64_t maxBytes = 0,
+                         int level = 1);
+  ~LogCompressor();
+
+  void start();
+  // finishes queued files first
+  void stop();
+
+  // thread safe, only queues the file, never blocks on compression
+  void compress(const string& filename);
+
+  int64_t bytesIn() { return bytesIn_.get(); }
+  int64_t bytesOut() { return bytesOut_.get(); }
+  int compressedFiles() { return compressedFiles_.get(); }
+
+ private:
+  void threadFunc();
+  bool compressFile(const string& filename, int64_t* compressed);
+  void scanArchive();
+  void trimArchive();
+
+  const string basename_;
+  const int maxFiles_;
+  const int64_t maxBytes_;
+  const int level_;
+  bool running_;
+  BlockingQueue<string> queue_;
+  Thread thread_;
+  AtomicInt64 bytesIn_;
+  AtomicInt64 bytesOut_;
+  AtomicInt32 compressedFiles_;
+
+  // owned by the background thread, oldest first
+  std::deque<std::pair<string, int64_t> > archive_;
+  int64_t archiveBytes_;
+};
+
+}
+#endif  // MUDUO_BASE_LOGCOMPRESSOR_H
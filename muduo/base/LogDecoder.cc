@@ -0,0 +1,331 @@
+#include <muduo/base/LogDecoder.h>
+
+#include <muduo/base/Logging.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace muduo
+{
+
+extern const char* LogLevelName[Logger::kNUM_LOG_LEVELS];
+
+namespace
+{
+
+class Reader
+{
+ public:
+  Reader(const char* data, size_t len)
+    : begin_(data),
+      cur_(data),
+      end_(data + len)
+  {
+  }
+
+  template<typename T>
+  bool read(T* value)
+  {
+    return read(value, sizeof(T));
+  }
+
+  bool read(void* buf, size_t len)
+  {
+    if (remaining() < len)
+    {
+      return false;
+    }
+    memcpy(buf, cur_, len);
+    cur_ += len;
+    return true;
+  }
+
+  const char* peek() const { return cur_; }
+  void skip(size_t len) { cur_ += len; }
+  size_t remaining() const { return end_ - cur_; }
+  size_t consumed() const { return cur_ - begin_; }
+
+ private:
+  const char* begin_;
+  const char* cur_;
+  const char* end_;
+};
+
+bool isRecordStart(char c)
+{
+  return static_cast<uint8_t>(c) == detail::kBinaryRecord
+      || static_cast<uint8_t>(c) == detail::kBinarySite;
+}
+
+}
+}
+
+using namespace muduo;
+
+LogDecoder::LogDecoder()
+  : timeZone_(Logger::timeZone()),
+    lastSecond_(0)
+{
+  time_[0] = '\0';
+}
+
+void LogDecoder::decode(const char* data, size_t len, string* output)
+{
+  if (pending_.empty())
+  {
+    size_t n = decodeAll(data, len, output);
+    pending_.assign(data + n, len - n);
+  }
+  else
+  {
+    pending_.append(data, len);
+    size_t n = decodeAll(pending_.data(), pending_.size(), output);
+    pending_.erase(0, n);
+  }
+}
+
+void LogDecoder::addSites(const char* data, size_t len)
+{
+  size_t pos = 0;
+  while (pos < len && static_cast<uint8_t>(data[pos]) == detail::kBinarySite)
+  {
+    size_t n = decodeSite(data + pos, len - pos);
+    if (n == 0)
+    {
+      break;
+    }
+    pos += n;
+  }
+}
+
+size_t LogDecoder::decodeAll(const char* data, size_t len, string* output)
+{
+  size_t pos = 0;
+  while (pos < len)
+  {
+    uint8_t tag = static_cast<uint8_t>(data[pos]);
+    if (tag == detail::kBinaryRecord || tag == detail::kBinarySite)
+    {
+      size_t n = tag == detail::kBinaryRecord
+               ? decodeRecord(data + pos, len - pos, output)
+               : decodeSite(data + pos, len - pos);
+      if (n == 0)
+      {
+        break;  // incomplete
+      }
+      pos += n;
+    }
+    else
+    {
+      size_t start = pos;
+      while (pos < len && !isRecordStart(data[pos]))
+      {
+        ++pos;
+      }
+      output->append(data + start, pos - start);
+    }
+  }
+  return pos;
+}
+
+size_t LogDecoder::decodeSite(const char* data, size_t len)
+{
+  Reader reader(data, len);
+  reader.skip(1);
+  uint32_t id = 0;
+  int32_t line = 0;
+  uint16_t fileLen = 0;
+  uint16_t funcLen = 0;
+  if (!reader.read(&id) || !reader.read(&line) || !reader.read(&fileLen)
+      || reader.remaining() < fileLen)
+  {
+    return 0;
+  }
+  const char* file = reader.peek();
+  reader.skip(fileLen);
+  if (!reader.read(&funcLen) || reader.remaining() < funcLen)
+  {
+    return 0;
+  }
+  const char* func = reader.peek();
+  reader.skip(funcLen);
+
+  if (id >= sites_.size())
+  {
+    sites_.resize(id + 1);
+  }
+  Site& site = sites_[id];
+  site.file.assign(file, fileLen);
+  site.line = line;
+  site.func.assign(func, funcLen);
+  return reader.consumed();
+}
+
+size_t LogDecoder::decodeRecord(const char* data, size_t len, string* output)
+{
+  Reader reader(data, len);
+  reader.skip(1);
+  uint32_t id = 0;
+  int64_t microSecondsSinceEpoch = 0;
+  int32_t tid = 0;
+  uint8_t level = 0;
+  int32_t savedErrno = 0;
+  if (!reader.read(&id) || !reader.read(&microSecondsSinceEpoch) || !reader.read(&tid)
+      || !reader.read(&level) || !reader.read(&savedErrno))
+  {
+    return 0;
+  }
+
+  stream_.resetBuffer();
+  formatTime(microSecondsSinceEpoch);
+  char buf[32];
+  int n = snprintf(buf, sizeof buf, "%5d ", tid);
+  stream_.append(buf, n);
+  if (level < Logger::kNUM_LOG_LEVELS)
+  {
+    stream_.append(LogLevelName[level], 6);
+  }
+  if (savedErrno != 0)
+  {
+    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
+  }
+  const Site* site = findSite(id);
+  if (site && !site->func.empty())
+  {
+    stream_ << site->func << ' ';
+  }
+
+  bool end = false;
+  bool corrupted = false;
+  while (!end)
+  {
+    uint8_t tag = 0;
+    if (!reader.read(&tag))
+    {
+      return 0;
+    }
+    switch (tag)
+    {
+      case detail::kBinaryEnd:
+        end = true;
+        break;
+      case detail::kBinaryInt64:
+        {
+          int64_t v = 0;
+          if (!reader.read(&v))
+            return 0;
+          stream_ << static_cast<long long>(v);
+        }
+        break;
+      case detail::kBinaryUint64:
+        {
+          uint64_t v = 0;
+          if (!reader.read(&v))
+            return 0;
+          stream_ << static_cast<unsigned long long>(v);
+        }
+        break;
+      case detail::kBinaryDouble:
+        {
+          double v = 0;
+          if (!reader.read(&v))
+            return 0;
+          stream_ << v;
+        }
+        break;
+      case detail::kBinaryPointer:
+        {
+          uint64_t v = 0;
+          if (!reader.read(&v))
+            return 0;
+          stream_ << reinterpret_cast<const void*>(static_cast<uintptr_t>(v));
+        }
+        break;
+      case detail::kBinaryChar:
+        {
+          char v = 0;
+          if (!reader.read(&v))
+            return 0;
+          stream_ << v;
+        }
+        break;
+      case detail::kBinaryString:
+        {
+          uint32_t strLen = 0;
+          if (!reader.read(&strLen) || reader.remaining() < strLen)
+            return 0;
+          stream_.append(reader.peek(), strLen);
+          reader.skip(strLen);
+        }
+        break;
+      default:
+        corrupted = true;
+        end = true;
+        break;
+    }
+  }
+
+  // resync at the offending byte
+  size_t consumed = corrupted ? reader.consumed() - 1 : reader.consumed();
+
+  stream_ << " - ";
+  if (site)
+  {
+    stream_ << site->file << ':' << site->line;
+  }
+  else
+  {
+    stream_ << "site#" << id;
+  }
+  stream_ << '\n';
+  output->append(stream_.buffer().data(), stream_.buffer().length());
+  return consumed;
+}
+
+const LogDecoder::Site* LogDecoder::findSite(uint32_t id) const
+{
+  if (id < sites_.size() && sites_[id].line != 0)
+  {
+    return &sites_[id];
+  }
+  return NULL;
+}
+
+// same as Logger::Impl::formatTime()
+void LogDecoder::formatTime(int64_t microSecondsSinceEpoch)
+{
+  time_t seconds = static_cast<time_t>(microSecondsSinceEpoch / Timestamp::kMicroSecondsPerSecond);
+  int microseconds = static_cast<int>(microSecondsSinceEpoch % Timestamp::kMicroSecondsPerSecond);
+  if (seconds != lastSecond_)
+  {
+    lastSecond_ = seconds;
+    struct tm tm_time;
+    if (timeZone_.valid())
+    {
+      tm_time = timeZone_.toLocalTime(seconds);
+    }
+    else
+    {
+      ::gmtime_r(&seconds, &tm_time);
+    }
+
+    int len = snprintf(time_, sizeof(time_), "%4d%02d%02d %02d:%02d:%02d",
+        tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+        tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+    assert(len == 17); (void)len;
+  }
+
+  if (timeZone_.valid())
+  {
+    Fmt us(".%06d ", microseconds);
+    stream_.append(time_, 17);
+    stream_ << us;
+  }
+  else
+  {
+    Fmt us(".%06dZ ", microseconds);
+    stream_.append(time_, 17);
+    stream_ << us;
+  }
+}
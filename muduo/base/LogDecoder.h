@@ -0,0 +1,60 @@
+#ifndef MUDUO_BASE_LOGDECODER_H
+#define MUDUO_BASE_LOGDECODER_H
+
+#include <muduo/base/LogStream.h>
+#include <muduo/base/TimeZone.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+namespace muduo
+{
+
+// Formats binary log records (Logger::setBinaryFormat) into the same
+// text Logger writes in text mode.
+// Plain text between records is passed through.
+// Only sites defined in the stream are known, as every file starts with
+// all of them, a file decodes on its own.
+// Not thread safe, keep one decoder per output stream.
+class LogDecoder : boost::noncopyable
+{
+ public:
+  // in the time zone of Logger::setTimeZone(), if any
+  LogDecoder();
+
+  // An incomplete record at the end of data is kept until the next call.
+  void decode(const char* data, size_t len, string* output);
+
+  // site definitions out of the stream, see detail::appendLogSites()
+  void addSites(const char* data, size_t len);
+
+  void setTimeZone(const TimeZone& tz) { timeZone_ = tz; }
+
+ private:
+  struct Site
+  {
+    Site() : line(0) { }
+
+    string file;
+    int line;
+    string func;
+  };
+
+  // returns bytes consumed, 0 if data is incomplete
+  size_t decodeSite(const char* data, size_t len);
+  size_t decodeRecord(const char* data, size_t len, string* output);
+  size_t decodeAll(const char* data, size_t len, string* output);
+  const Site* findSite(uint32_t id) const;
+  void formatTime(int64_t microSecondsSinceEpoch);
+
+  std::vector<Site> sites_;  // indexed by id
+  string pending_;
+  LogStream stream_;
+  TimeZone timeZone_;
+  time_t lastSecond_;
+  char time_[32];
+};
+
+}
+#endif  // MUDUO_BASE_LOGDECODER_H
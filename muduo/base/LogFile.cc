@@ -1,6 +1,7 @@
 #include <muduo/base/LogFile.h>
 
 #include <muduo/base/FileUtil.h>
+#include <muduo/base/Logging.h>
 #include <muduo/base/ProcessInfo.h>
 
 #include <assert.h>
@@ -13,12 +14,17 @@ LogFile::LogFile(const string& basename,
                  size_t rollSize,
                  bool threadSafe,
                  int flushInterval,
-                 int checkEveryN)
+                 int checkEveryN,
+                 bool unbuffered)
   : basename_(basename),
     rollSize_(rollSize),
     flushInterval_(flushInterval),
     checkEveryN_(checkEveryN),
+    unbuffered_(unbuffered),
     count_(0),
+    rollPeriod_(kRollPerSeconds_),
+    logSites_(true),
+    needLogSites_(true),
     mutex_(threadSafe ? new MutexLock : NULL),
     startOfPeriod_(0),
     lastRoll_(0),
@@ -45,6 +51,19 @@ void LogFile::append(const char* logline, int len)
   }
 }
 
+void LogFile::appendv(const StringPiece* chunks, int count)
+{
+  if (mutex_)
+  {
+    MutexLockGuard lock(*mutex_);
+    appendv_unlocked(chunks, count);
+  }
+  else
+  {
+    appendv_unlocked(chunks, count);
+  }
+}
+
 void LogFile::flush()
 {
   if (mutex_)
@@ -60,20 +79,50 @@ void LogFile::flush()
 
 void LogFile::append_unlocked(const char* logline, int len)
 {
+  if (needLogSites_)
+  {
+    appendLogSites();
+  }
   file_->append(logline, len);
+  checkRoll(1);
+}
 
+void LogFile::appendv_unlocked(const StringPiece* chunks, int count)
+{
+  if (needLogSites_)
+  {
+    appendLogSites();
+  }
+  file_->appendv(chunks, count);
+  checkRoll(count);
+}
+
+// so that the file decodes without those before it
+void LogFile::appendLogSites()
+{
+  if (logSites_ && Logger::binaryFormat())
+  {
+    needLogSites_ = false;
+    string sites;
+    detail::appendLogSites(&sites);
+    file_->append(sites.data(), sites.size());
+  }
+}
+
+void LogFile::checkRoll(int count)
+{
   if (file_->writtenBytes() > rollSize_)
   {
     rollFile();
   }
   else
   {
-    ++count_;
+    count_ += count;
     if (count_ >= checkEveryN_)
     {
       count_ = 0;
       time_t now = ::time(NULL);
-      time_t thisPeriod_ = now / kRollPerSeconds_ * kRollPerSeconds_;
+      time_t thisPeriod_ = now / rollPeriod_ * rollPeriod_;
       if (thisPeriod_ != startOfPeriod_)
       {
         rollFile();
@@ -91,14 +140,21 @@ bool LogFile::rollFile()
 {
   time_t now = 0;
   string filename = getLogFileName(basename_, &now);
-  time_t start = now / kRollPerSeconds_ * kRollPerSeconds_;
+  time_t start = now / rollPeriod_ * rollPeriod_;
 
   if (now > lastRoll_)
   {
     lastRoll_ = now;
     lastFlush_ = now;
     startOfPeriod_ = start;
-    file_.reset(new FileUtil::AppendFile(filename));
+    file_.reset(new FileUtil::AppendFile(filename, unbuffered_));
+    needLogSites_ = true;
+    filename_.swap(filename);
+    // the old file is closed by now
+    if (rollCallback_ && !filename.empty())
+    {
+      rollCallback_(filename);
+    }
     return true;
   }
   return false;
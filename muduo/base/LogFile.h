@@ -2,11 +2,15 @@
 #define MUDUO_BASE_LOGFILE_H
 
 #include <muduo/base/Mutex.h>
+#include <muduo/base/StringPiece.h>
 #include <muduo/base/Types.h>
 
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <assert.h>
+
 namespace muduo
 {
 
@@ -18,19 +22,45 @@ class AppendFile;
 class LogFile : boost::noncopyable
 {
  public:
+  // called with the name of the file just closed by a roll
+  typedef boost::function<void (const string& filename)> RollCallback;
+
   LogFile(const string& basename,
           size_t rollSize,
           bool threadSafe = true,
           int flushInterval = 3,
-          int checkEveryN = 1024);
+          int checkEveryN = 1024,
+          bool unbuffered = false);
   ~LogFile();
 
   void append(const char* logline, int len);
+  // one writev(2) for all chunks if unbuffered
+  void appendv(const StringPiece* chunks, int count);
   void flush();
   bool rollFile();
 
+  // not thread safe, call before appending, see LogCompressor
+  void setRollCallback(const RollCallback& cb)
+  { rollCallback_ = cb; }
+
+  // in binary format (Logger::setBinaryFormat) every file starts with the
+  // definitions of all log sites, on by default, off for decoded output
+  void setLogSites(bool on)
+  { logSites_ = on; }
+
+  // roll at every multiple of seconds (UTC), default daily
+  void setRollPeriod(int seconds)
+  {
+    assert(seconds > 0);
+    rollPeriod_ = seconds;
+    startOfPeriod_ = lastRoll_ / seconds * seconds;
+  }
+
  private:
   void append_unlocked(const char* logline, int len);
+  void appendv_unlocked(const StringPiece* chunks, int count);
+  void checkRoll(int count);
+  void appendLogSites();
 
   static string getLogFileName(const string& basename, time_t* now);
 
@@ -38,8 +68,14 @@ class LogFile : boost::noncopyable
   const size_t rollSize_;
   const int flushInterval_;
   const int checkEveryN_;
+  const bool unbuffered_;
 
   int count_;
+  int rollPeriod_;
+  bool logSites_;
+  bool needLogSites_;  // none written to this file yet
+  string filename_;
+  RollCallback rollCallback_;
 
   boost::scoped_ptr<MutexLock> mutex_;
   time_t startOfPeriod_;
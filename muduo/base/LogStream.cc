@@ -5,9 +5,11 @@
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 using namespace muduo;
 using namespace muduo::detail;
@@ -76,6 +78,259 @@ size_t convertHex(char buf[], uintptr_t value)
   return p - buf;
 }
 
+// exact powers of ten
+const double kPow10[] =
+{
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+BOOST_STATIC_ASSERT(sizeof kPow10 / sizeof kPow10[0] == 23);
+
+// Fast paths are limited to 15 significant digits, where the scaled
+// value is exact enough to decide rounding, see roundToDigits().
+const int kMaxFastDigits = 15;
+
+// x * 10^k with a single rounding, |k| <= 22
+inline bool scale(double x, int k, double* scaled)
+{
+  if (k > 22 || k < -22)
+  {
+    return false;
+  }
+  *scaled = k >= 0 ? x * kPow10[k] : x / kPow10[-k];
+  return true;
+}
+
+// Rounds the integer part of scaled to nearest, gives up if scaled is
+// too close to a tie for the rounding error of scale() to matter.
+inline bool roundScaled(double scaled, uint64_t* m)
+{
+  double integer = floor(scaled);
+  double frac = scaled - integer;
+  if (fabs(frac - 0.5) <= scaled * 4e-16)
+  {
+    return false;
+  }
+  *m = static_cast<uint64_t>(integer) + (frac > 0.5 ? 1 : 0);
+  return true;
+}
+
+// Correctly rounds x > 0 to precision significant digits,
+// x ~= m * 10^(e - precision + 1) with m in [10^(precision-1), 10^precision).
+bool roundToDigits(double x, int precision, uint64_t* m, int* e)
+{
+  assert(x > 0 && precision <= kMaxFastDigits);
+  int binaryExponent = 0;
+  frexp(x, &binaryExponent);
+  int exponent = static_cast<int>(floor((binaryExponent - 1) * 0.30102999566398120));
+  for (int i = 0; i < 3; ++i)
+  {
+    double scaled = 0;
+    if (!scale(x, precision - 1 - exponent, &scaled))
+    {
+      return false;
+    }
+    if (scaled >= kPow10[precision])
+    {
+      ++exponent;
+    }
+    else if (scaled < kPow10[precision - 1])
+    {
+      --exponent;
+    }
+    else
+    {
+      if (!roundScaled(scaled, m))
+      {
+        return false;
+      }
+      if (*m == static_cast<uint64_t>(kPow10[precision]))
+      {
+        *m /= 10;
+        ++exponent;
+      }
+      *e = exponent;
+      return true;
+    }
+  }
+  return false;
+}
+
+// formats m * 10^(e - precision + 1) following the rules of %g
+size_t formatDigits(char buf[], bool negative, uint64_t m, int e, int precision, int sciPrecision)
+{
+  char decimal[32];
+  size_t ndigits = convert(decimal, m);
+  assert(ndigits == static_cast<size_t>(precision)); (void)precision;
+  while (ndigits > 1 && decimal[ndigits - 1] == '0')
+  {
+    --ndigits;
+  }
+
+  char* p = buf;
+  if (negative)
+  {
+    *p++ = '-';
+  }
+  if (e < -4 || e >= sciPrecision)
+  {
+    *p++ = decimal[0];
+    if (ndigits > 1)
+    {
+      *p++ = '.';
+      memcpy(p, decimal + 1, ndigits - 1);
+      p += ndigits - 1;
+    }
+    *p++ = 'e';
+    *p++ = e < 0 ? '-' : '+';
+    int absExponent = e < 0 ? -e : e;
+    if (absExponent < 10)
+    {
+      *p++ = '0';
+    }
+    p += convert(p, absExponent);
+  }
+  else if (e >= 0)
+  {
+    size_t intDigits = e + 1;
+    for (size_t i = 0; i < intDigits; ++i)
+    {
+      *p++ = i < ndigits ? decimal[i] : '0';
+    }
+    if (ndigits > intDigits)
+    {
+      *p++ = '.';
+      memcpy(p, decimal + intDigits, ndigits - intDigits);
+      p += ndigits - intDigits;
+    }
+  }
+  else
+  {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = -1; i > e; --i)
+    {
+      *p++ = '0';
+    }
+    memcpy(p, decimal, ndigits);
+    p += ndigits;
+  }
+  *p = '\0';
+  return p - buf;
+}
+
+size_t formatDouble(char buf[], size_t size, double v, int precision)
+{
+  if (precision == 0)
+  {
+    precision = 1;
+  }
+  if (size >= 32 && precision <= kMaxFastDigits)
+  {
+    if (v == 0)
+    {
+      const char* text = signbit(v) ? "-0" : "0";
+      strcpy(buf, text);
+      return strlen(text);
+    }
+    uint64_t m = 0;
+    int e = 0;
+    if (isfinite(v) && roundToDigits(fabs(v), precision, &m, &e))
+    {
+      return formatDigits(buf, v < 0, m, e, precision, precision);
+    }
+  }
+  return snprintf(buf, size, "%.*g", precision, v);
+}
+
+size_t formatFixed(char buf[], size_t size, double v, int decimals)
+{
+  double scaled = 0;
+  uint64_t m = 0;
+  if (size >= 32 && decimals <= kMaxFastDigits && isfinite(v)
+      && scale(fabs(v), decimals, &scaled) && scaled < kPow10[kMaxFastDigits]
+      && roundScaled(scaled, &m))
+  {
+    char decimal[32];
+    size_t ndigits = convert(decimal, m);
+    char* p = buf;
+    if (signbit(v))
+    {
+      *p++ = '-';
+    }
+    size_t frac = decimals;
+    size_t intDigits = ndigits > frac ? ndigits - frac : 0;
+    if (intDigits == 0)
+    {
+      *p++ = '0';
+    }
+    memcpy(p, decimal, intDigits);
+    p += intDigits;
+    if (frac > 0)
+    {
+      *p++ = '.';
+      for (size_t i = ndigits; i < frac; ++i)
+      {
+        *p++ = '0';
+      }
+      memcpy(p, decimal + intDigits, ndigits - intDigits);
+      p += ndigits - intDigits;
+    }
+    *p = '\0';
+    return p - buf;
+  }
+  return snprintf(buf, size, "%.*f", decimals, v);
+}
+
+size_t formatShortest(char buf[], size_t size, double v)
+{
+  assert(size >= 32);
+  if (v == 0 || !isfinite(v))
+  {
+    return formatDouble(buf, size, v, 17);
+  }
+
+  // A normal double holds 15 decimal digits exactly, so if any representation
+  // of at most 15 digits reads back as v, it is the rounded 15 digits.
+  uint64_t m = 0;
+  int e = 0;
+  double x = fabs(v);
+  double back = 0;
+  int precision = 1;
+  if (x < std::numeric_limits<double>::min())
+  {
+    // a subnormal holds fewer digits exactly, one per 3.32 bits beyond the first
+    int bits = ilogb(x) - ilogb(std::numeric_limits<double>::denorm_min()) + 1;
+    precision = std::max(1, (bits - 1) * 30103 / 100000);
+  }
+  else
+  {
+    precision = kMaxFastDigits;
+    if (roundToDigits(x, kMaxFastDigits, &m, &e)
+        && scale(static_cast<double>(m), e - kMaxFastDigits + 1, &back))
+    {
+      // m is exact, so this is what strtod() would give
+      if (back == x)
+      {
+        return formatDigits(buf, v < 0, m, e, kMaxFastDigits, 17);
+      }
+      precision = kMaxFastDigits + 1;
+    }
+  }
+
+  // noisy values need 16 or 17 digits, leave them to the C library,
+  // the digits held exactly first, more only if they don't read back
+  for (; precision <= 17; ++precision)
+  {
+    int len = snprintf(buf, size, "%.*g", precision, v);
+    if (precision == 17 || strtod(buf, NULL) == v)
+    {
+      return len;
+    }
+  }
+  return 0;
+}
+
 template class FixedBuffer<kSmallBuffer>;
 template class FixedBuffer<kLargeBuffer>;
 
@@ -110,6 +365,21 @@ void LogStream::staticCheck()
 template<typename T>
 void LogStream::formatInteger(T v)
 {
+  if (binary_)
+  {
+    if (std::numeric_limits<T>::is_signed)
+    {
+      int64_t x = static_cast<int64_t>(v);
+      appendBinary(kBinaryInt64, &x, sizeof x);
+    }
+    else
+    {
+      uint64_t x = static_cast<uint64_t>(v);
+      appendBinary(kBinaryUint64, &x, sizeof x);
+    }
+    return;
+  }
+
   if (buffer_.avail() >= kMaxNumericSize)
   {
     size_t len = convert(buffer_.current(), v);
@@ -168,6 +438,13 @@ LogStream& LogStream::operator<<(unsigned long long v)
 LogStream& LogStream::operator<<(const void* p)
 {
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
+  if (binary_)
+  {
+    uint64_t x = v;
+    appendBinary(kBinaryPointer, &x, sizeof x);
+    return *this;
+  }
+
   if (buffer_.avail() >= kMaxNumericSize)
   {
     char* buf = buffer_.current();
@@ -179,26 +456,93 @@ LogStream& LogStream::operator<<(const void* p)
   return *this;
 }
 
-// FIXME: replace this with Grisu3 by Florian Loitsch.
+// same as snprintf("%.12g")
 LogStream& LogStream::operator<<(double v)
 {
+  if (binary_)
+  {
+    appendBinary(kBinaryDouble, &v, sizeof v);
+    return *this;
+  }
+
   if (buffer_.avail() >= kMaxNumericSize)
   {
-    int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
+    size_t len = formatDouble(buffer_.current(), kMaxNumericSize, v, 12);
     buffer_.add(len);
   }
   return *this;
 }
 
+namespace
+{
+
+// "%f", "%g", "%.Nf" and "%.Ng" take the fast path
+bool parseSimpleFormat(const char* fmt, int* precision, char* conversion)
+{
+  if (fmt[0] != '%')
+  {
+    return false;
+  }
+  const char* p = fmt + 1;
+  *precision = 6;
+  if (*p == '.')
+  {
+    ++p;
+    *precision = 0;
+    while (*p >= '0' && *p <= '9' && *precision < 100)
+    {
+      *precision = *precision * 10 + (*p - '0');
+      ++p;
+    }
+  }
+  if ((*p == 'f' || *p == 'g') && p[1] == '\0')
+  {
+    *conversion = *p;
+    return true;
+  }
+  return false;
+}
+
+template<typename T>
+int formatValue(char* buf, size_t size, const char* fmt, T val)
+{
+  return snprintf(buf, size, fmt, val);
+}
+
+int formatValue(char* buf, size_t size, const char* fmt, double val)
+{
+  int precision = 0;
+  char conversion = 0;
+  if (parseSimpleFormat(fmt, &precision, &conversion))
+  {
+    return static_cast<int>(conversion == 'f'
+                            ? formatFixed(buf, size, val, precision)
+                            : formatDouble(buf, size, val, precision));
+  }
+  return snprintf(buf, size, fmt, val);
+}
+
+int formatValue(char* buf, size_t size, const char* fmt, float val)
+{
+  return formatValue(buf, size, fmt, static_cast<double>(val));
+}
+
+}
+
 template<typename T>
 Fmt::Fmt(const char* fmt, T val)
 {
   BOOST_STATIC_ASSERT(boost::is_arithmetic<T>::value == true);
 
-  length_ = snprintf(buf_, sizeof buf_, fmt, val);
+  length_ = formatValue(buf_, sizeof buf_, fmt, val);
   assert(static_cast<size_t>(length_) < sizeof buf_);
 }
 
+Shortest::Shortest(double val)
+  : length_(static_cast<int>(formatShortest(buf_, sizeof buf_, val)))
+{
+}
+
 // Explicit instantiations
 
 template Fmt::Fmt(const char* fmt, char);
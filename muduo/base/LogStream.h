@@ -72,6 +72,39 @@ class FixedBuffer : boost::noncopyable
   char* cur_;
 };
 
+// Binary (deferred formatting) log format, see LogDecoder.
+// All integers are in host byte order.
+//   site:   kBinarySite id:u32 line:i32 fileLen:u16 file funcLen:u16 func
+//   record: kBinaryRecord id:u32 time:i64 tid:i32 level:u8 errno:i32 arg* kBinaryEnd
+//   arg:    kBinaryInt64 i64 | kBinaryUint64 u64 | kBinaryDouble f64
+//         | kBinaryPointer u64 | kBinaryChar u8 | kBinaryString len:u32 bytes
+// kBinarySite and kBinaryRecord never occur in UTF-8, text between them
+// is passed through.  Sites are defined before first use, and again at
+// the head of every file and after dropped buffers (detail::appendLogSites).
+enum BinaryLogTag
+{
+  kBinaryEnd = 0x80,
+  kBinaryInt64,
+  kBinaryUint64,
+  kBinaryDouble,
+  kBinaryPointer,
+  kBinaryChar,
+  kBinaryString,
+  kBinaryRecord = 0xFE,
+  kBinarySite = 0xFF,
+};
+
+// Double formatting without snprintf() for the common cases,
+// the result is the same as the corresponding printf conversion.
+// size must be at least 32 for the fast paths.
+
+// "%.*g"
+size_t formatDouble(char buf[], size_t size, double v, int precision);
+// "%.*f"
+size_t formatFixed(char buf[], size_t size, double v, int decimals);
+// shortest text that reads back as v, "%.17g" with noise digits removed
+size_t formatShortest(char buf[], size_t size, double v);
+
 }
 
 class LogStream : boost::noncopyable
@@ -80,8 +113,18 @@ class LogStream : boost::noncopyable
  public:
   typedef detail::FixedBuffer<detail::kSmallBuffer> Buffer;
 
+  LogStream()
+    : binary_(false)
+  {
+  }
+
   self& operator<<(bool v)
   {
+    if (binary_)
+    {
+      appendBinary(detail::kBinaryChar, v ? "1" : "0", 1);
+      return *this;
+    }
     buffer_.append(v ? "1" : "0", 1);
     return *this;
   }
@@ -107,6 +150,11 @@ class LogStream : boost::noncopyable
 
   self& operator<<(char v)
   {
+    if (binary_)
+    {
+      appendBinary(detail::kBinaryChar, &v, 1);
+      return *this;
+    }
     buffer_.append(&v, 1);
     return *this;
   }
@@ -118,11 +166,11 @@ class LogStream : boost::noncopyable
   {
     if (str)
     {
-      buffer_.append(str, strlen(str));
+      append(str, strlen(str));
     }
     else
     {
-      buffer_.append("(null)", 6);
+      append("(null)", 6);
     }
     return *this;
   }
@@ -134,35 +182,81 @@ class LogStream : boost::noncopyable
 
   self& operator<<(const string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    append(v.c_str(), v.size());
     return *this;
   }
 
 #ifndef MUDUO_STD_STRING
   self& operator<<(const std::string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    append(v.c_str(), v.size());
     return *this;
   }
 #endif
 
   self& operator<<(const StringPiece& v)
   {
-    buffer_.append(v.data(), v.size());
+    append(v.data(), v.size());
     return *this;
   }
 
-  void append(const char* data, int len) { buffer_.append(data, len); }
+  // a string argument in binary mode
+  void append(const char* data, size_t len)
+  {
+    if (binary_)
+    {
+      appendBinaryString(data, len);
+      return;
+    }
+    buffer_.append(data, len);
+  }
+
   const Buffer& buffer() const { return buffer_; }
   void resetBuffer() { buffer_.reset(); }
 
+  // values are recorded as tagged raw bytes instead of being formatted
+  void setBinary(bool on) { binary_ = on; }
+  bool binary() const { return binary_; }
+
+  // bypasses formatting and tagging, for binary record headers
+  void appendRaw(const void* data, size_t len)
+  {
+    buffer_.append(static_cast<const char*>(data), len);
+  }
+
  private:
   void staticCheck();
 
   template<typename T>
   void formatInteger(T);
 
+  // leave room for kBinaryEnd, an argument is either recorded whole or dropped
+  void appendBinary(detail::BinaryLogTag tag, const void* data, size_t len)
+  {
+    if (implicit_cast<size_t>(buffer_.avail()) > len + 2)
+    {
+      char* p = buffer_.current();
+      *p = static_cast<char>(tag);
+      memcpy(p + 1, data, len);
+      buffer_.add(len + 1);
+    }
+  }
+
+  void appendBinaryString(const char* data, size_t len)
+  {
+    if (implicit_cast<size_t>(buffer_.avail()) > len + 6)
+    {
+      uint32_t len32 = static_cast<uint32_t>(len);
+      char* p = buffer_.current();
+      *p = static_cast<char>(detail::kBinaryString);
+      memcpy(p + 1, &len32, sizeof len32);
+      memcpy(p + 5, data, len);
+      buffer_.add(len + 5);
+    }
+  }
+
   Buffer buffer_;
+  bool binary_;
 
   static const int kMaxNumericSize = 32;
 };
@@ -187,6 +281,28 @@ inline LogStream& operator<<(LogStream& s, const Fmt& fmt)
   return s;
 }
 
+// Shortest round-trip text of a double, while operator<<(double)
+// keeps 12 significant digits, eg. 0.1+0.2 is 0.30000000000000004
+// instead of 0.3.
+class Shortest // : boost::noncopyable
+{
+ public:
+  explicit Shortest(double val);
+
+  const char* data() const { return buf_; }
+  int length() const { return length_; }
+
+ private:
+  char buf_[32];
+  int length_;
+};
+
+inline LogStream& operator<<(LogStream& s, const Shortest& v)
+{
+  s.append(v.data(), v.length());
+  return s;
+}
+
 }
 #endif  // MUDUO_BASE_LOGSTREAM_H
 
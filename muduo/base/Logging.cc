@@ -2,6 +2,7 @@
 
 #include <muduo/base/Types.h>
 #include <muduo/base/CurrentThread.h>
+#include <muduo/base/Mutex.h>
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/TimeZone.h>
 
@@ -9,7 +10,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <map>
 #include <sstream>
+#include <vector>
 
 namespace muduo
 {
@@ -54,6 +57,8 @@ Logger::LogLevel initLogLevel()
 
 Logger::LogLevel g_logLevel = initLogLevel();
 
+bool g_logBinary = false;
+
 const char* LogLevelName[Logger::kNUM_LOG_LEVELS] =
 {
   "TRACE ",
@@ -107,17 +112,142 @@ Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
 TimeZone g_logTimeZone;
 
+// see detail::BinaryLogTag for the layout
+void appendSite(uint32_t id, const detail::LogSite& site, string* output)
+{
+  uint16_t fileLen = static_cast<uint16_t>(site.fileLength);
+  uint16_t funcLen = static_cast<uint16_t>(site.func ? strlen(site.func) : 0);
+  int32_t line = site.line;
+  output->push_back(static_cast<char>(detail::kBinarySite));
+  output->append(reinterpret_cast<const char*>(&id), sizeof id);
+  output->append(reinterpret_cast<const char*>(&line), sizeof line);
+  output->append(reinterpret_cast<const char*>(&fileLen), sizeof fileLen);
+  output->append(site.file, fileLen);
+  output->append(reinterpret_cast<const char*>(&funcLen), sizeof funcLen);
+  output->append(site.func ? site.func : "", funcLen);
+}
+
+// All binary log sites seen by this process, indexed by id - 1.
+class LogSiteRegistry : boost::noncopyable
+{
+ public:
+  uint32_t lookup(const Logger::SourceFile& file, int line, const char* func, bool* isNew)
+  {
+    MutexLockGuard lock(mutex_);
+    SiteKey key(file.data_, line);
+    std::map<SiteKey, uint32_t>::iterator it = ids_.find(key);
+    if (it != ids_.end())
+    {
+      *isNew = false;
+      return it->second;
+    }
+    detail::LogSite site = { file.data_, file.size_, line, func };
+    sites_.push_back(site);
+    uint32_t id = static_cast<uint32_t>(sites_.size());
+    ids_[key] = id;
+    *isNew = true;
+    return id;
+  }
+
+  void appendAll(string* output)
+  {
+    MutexLockGuard lock(mutex_);
+    for (size_t i = 0; i < sites_.size(); ++i)
+    {
+      appendSite(static_cast<uint32_t>(i + 1), sites_[i], output);
+    }
+  }
+
+  bool find(uint32_t id, detail::LogSite* site)
+  {
+    MutexLockGuard lock(mutex_);
+    if (id == 0 || id > sites_.size())
+    {
+      return false;
+    }
+    *site = sites_[id-1];
+    return true;
+  }
+
+  static LogSiteRegistry& instance()
+  {
+    static LogSiteRegistry registry;
+    return registry;
+  }
+
+ private:
+  typedef std::pair<const char*, int> SiteKey;
+
+  MutexLock mutex_;
+  std::vector<detail::LogSite> sites_;
+  std::map<SiteKey, uint32_t> ids_;
+};
+
+// direct-mapped per thread cache in front of the registry
+const int kSiteCacheSize = 256;
+thread_local const char* t_siteFile[kSiteCacheSize];
+thread_local int t_siteLine[kSiteCacheSize];
+thread_local uint32_t t_siteId[kSiteCacheSize];
+// The sites this thread has defined in its records, as a record of another
+// thread may reach the output first. Those past the bitmap are defined again
+// on each cache miss.
+const uint32_t kDefinedSites = 4096;
+thread_local uint8_t t_siteDefined[kDefinedSites / 8];
+
+uint32_t detail::lookupLogSite(const Logger::SourceFile& file, int line,
+                               const char* func, bool* isNew)
+{
+  uintptr_t hash = (reinterpret_cast<uintptr_t>(file.data_) >> 3) ^ (line * 2654435761u);
+  int slot = static_cast<int>(hash % kSiteCacheSize);
+  if (t_siteFile[slot] == file.data_ && t_siteLine[slot] == line)
+  {
+    *isNew = false;
+    return t_siteId[slot];
+  }
+
+  bool firstInProcess = false;
+  uint32_t id = LogSiteRegistry::instance().lookup(file, line, func, &firstInProcess);
+  t_siteFile[slot] = file.data_;
+  t_siteLine[slot] = line;
+  t_siteId[slot] = id;
+  *isNew = true;
+  if (id < kDefinedSites)
+  {
+    uint8_t bit = static_cast<uint8_t>(1 << (id % 8));
+    *isNew = (t_siteDefined[id / 8] & bit) == 0;
+    t_siteDefined[id / 8] |= bit;
+  }
+  return id;
+}
+
+bool detail::findLogSite(uint32_t id, LogSite* site)
+{
+  return LogSiteRegistry::instance().find(id, site);
+}
+
+void detail::appendLogSites(string* output)
+{
+  LogSiteRegistry::instance().appendAll(output);
+}
+
 }
 
 using namespace muduo;
 
-Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line)
+Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line,
+                   const char* func)
   : time_(Timestamp::now()),
     stream_(),
     level_(level),
     line_(line),
     basename_(file)
 {
+  if (g_logBinary)
+  {
+    beginRecord(savedErrno, func);
+    return;
+  }
+
   formatTime();
   CurrentThread::tid();
   stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
@@ -126,6 +256,37 @@ Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int l
   {
     stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
   }
+  if (func)
+  {
+    stream_ << func << ' ';
+  }
+}
+
+// see detail::BinaryLogTag for the layout
+void Logger::Impl::beginRecord(int savedErrno, const char* func)
+{
+  bool isNew = false;
+  uint32_t id = detail::lookupLogSite(basename_, line_, func, &isNew);
+  if (isNew)
+  {
+    detail::LogSite site = { basename_.data_, basename_.size_, line_, func };
+    string definition;
+    appendSite(id, site, &definition);
+    stream_.appendRaw(definition.data(), definition.size());
+  }
+
+  int64_t microSecondsSinceEpoch = time_.microSecondsSinceEpoch();
+  int32_t tid = CurrentThread::tid();
+  uint8_t level = static_cast<uint8_t>(level_);
+  int32_t err = savedErrno;
+  char tag = static_cast<char>(detail::kBinaryRecord);
+  stream_.appendRaw(&tag, 1);
+  stream_.appendRaw(&id, sizeof id);
+  stream_.appendRaw(&microSecondsSinceEpoch, sizeof microSecondsSinceEpoch);
+  stream_.appendRaw(&tid, sizeof tid);
+  stream_.appendRaw(&level, sizeof level);
+  stream_.appendRaw(&err, sizeof err);
+  stream_.setBinary(true);
 }
 
 void Logger::Impl::formatTime()
@@ -168,6 +329,12 @@ void Logger::Impl::formatTime()
 
 void Logger::Impl::finish()
 {
+  if (stream_.binary())
+  {
+    char tag = static_cast<char>(detail::kBinaryEnd);
+    stream_.appendRaw(&tag, 1);
+    return;
+  }
   stream_ << " - " << basename_ << ':' << line_ << '\n';
 }
 
@@ -177,9 +344,8 @@ Logger::Logger(SourceFile file, int line)
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level, const char* func)
-  : impl_(level, 0, file, line)
+  : impl_(level, 0, file, line, func)
 {
-  impl_.stream_ << func << ' ';
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level)
@@ -223,3 +389,13 @@ void Logger::setTimeZone(const TimeZone& tz)
 {
   g_logTimeZone = tz;
 }
+
+const TimeZone& Logger::timeZone()
+{
+  return g_logTimeZone;
+}
+
+void Logger::setBinaryFormat(bool on)
+{
+  g_logBinary = on;
+}
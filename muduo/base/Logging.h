@@ -72,6 +72,12 @@ class Logger
   static void setOutput(OutputFunc);
   static void setFlush(FlushFunc);
   static void setTimeZone(const TimeZone& tz);
+  static const TimeZone& timeZone();
+
+  // Binary mode defers formatting, LOG_* records a site id and raw
+  // argument bytes, LogDecoder turns them back into text.
+  static void setBinaryFormat(bool on);
+  static bool binaryFormat();
 
  private:
 
@@ -79,8 +85,10 @@ class Impl
 {
  public:
   typedef Logger::LogLevel LogLevel;
-  Impl(LogLevel level, int old_errno, const SourceFile& file, int line);
+  Impl(LogLevel level, int old_errno, const SourceFile& file, int line,
+       const char* func = NULL);
   void formatTime();
+  void beginRecord(int savedErrno, const char* func);
   void finish();
 
   Timestamp time_;
@@ -95,12 +103,40 @@ class Impl
 };
 
 extern Logger::LogLevel g_logLevel;
+extern bool g_logBinary;
 
 inline Logger::LogLevel Logger::logLevel()
 {
   return g_logLevel;
 }
 
+inline bool Logger::binaryFormat()
+{
+  return g_logBinary;
+}
+
+namespace detail
+{
+
+// a LOG_* call site in binary mode, strings are static
+struct LogSite
+{
+  const char* file;
+  int fileLength;
+  int line;
+  const char* func;
+};
+
+// ids start from 1, isNew is set for the first lookup of a site by a thread
+uint32_t lookupLogSite(const Logger::SourceFile& file, int line,
+                       const char* func, bool* isNew);
+bool findLogSite(uint32_t id, LogSite* site);
+// definitions of all sites seen so far, for the head of a new file
+// or after dropped buffers, so that the rest decodes on its own
+void appendLogSites(string* output);
+
+}
+
 //
 // CAUTION: do not write:
 //
@@ -13,6 +13,7 @@ project "base"
             'Date.cc',
             'Exception.cc',
             'FileUtil.cc',
+            'LogDecoder.cc',
             'LogFile.cc',
             'Logging.cc',
             'LogStream.cc',
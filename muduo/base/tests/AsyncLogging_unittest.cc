@@ -0,0 +1,270 @@
+#include <muduo/base/AsyncLogging.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/FileUtil.h>
+#include <muduo/base/LogDecoder.h>
+#include <muduo/base/Logging.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//#define BOOST_TEST_MODULE AsyncLoggingTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::AsyncLogging;
+
+// more full buffers than the backend writes in one round
+const int kLines = 27 * 4000;
+const size_t kLineSize = 1000;
+
+// in a directory of its own, removed at the end
+class TempDir
+{
+ public:
+  TempDir()
+  {
+    char dir[] = "/tmp/asynclogging_unittest.XXXXXX";
+    BOOST_REQUIRE(::mkdtemp(dir) != NULL);
+    dir_ = dir;
+    BOOST_REQUIRE(::getcwd(cwd_, sizeof cwd_) != NULL);
+    BOOST_REQUIRE(::chdir(dir) == 0);
+  }
+
+  ~TempDir()
+  {
+    std::vector<string> names = files();
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+      ::unlink(names[i].c_str());
+    }
+    if (::chdir(cwd_) == 0)
+    {
+      ::rmdir(dir_.c_str());
+    }
+  }
+
+  std::vector<string> files() const
+  {
+    std::vector<string> names;
+    DIR* dir = ::opendir(".");
+    while (struct dirent* entry = ::readdir(dir))
+    {
+      if (entry->d_name[0] != '.')
+      {
+        names.push_back(entry->d_name);
+      }
+    }
+    ::closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  // all log files, in order
+  string logs() const
+  {
+    std::vector<string> names = files();
+    string content;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+      if (names[i].find(".log") != string::npos)
+      {
+        string file;
+        muduo::FileUtil::readFile(names[i], 1024*1024*1024, &file);
+        content += file;
+      }
+    }
+    return content;
+  }
+
+ private:
+  string dir_;
+  char cwd_[1024];
+};
+
+void appendLines(AsyncLogging* log, int count)
+{
+  char line[kLineSize];
+  memset(line, 'x', sizeof line);
+  line[sizeof line - 1] = '\n';
+  for (int i = 0; i < count; ++i)
+  {
+    snprintf(line, sizeof line, "%08d", i);
+    line[8] = ' ';
+    log->append(line, static_cast<int>(sizeof line));
+  }
+}
+
+struct Lines
+{
+  int numbered;   // lines of appendLines()
+  bool inOrder;
+  int dropNotes;  // "Dropped log messages ..."
+};
+
+Lines scan(const string& content)
+{
+  Lines lines = { 0, true, 0 };
+  int last = -1;
+  size_t start = 0;
+  size_t end = 0;
+  while ((end = content.find('\n', start)) != string::npos)
+  {
+    if (content.compare(start, 8, "Dropped ") == 0)
+    {
+      ++lines.dropNotes;
+    }
+    else
+    {
+      int n = atoi(content.c_str() + start);
+      lines.inOrder = lines.inOrder && n > last;
+      last = n;
+      ++lines.numbered;
+    }
+    start = end + 1;
+  }
+  return lines;
+}
+
+// buffers appended before start() all come in the first round
+
+BOOST_AUTO_TEST_CASE(testDropOverflow)
+{
+  TempDir dir;
+  {
+  AsyncLogging log("drop", 1024*1024*1024);
+  appendLines(&log, kLines);
+  log.start();
+  log.stop();
+  BOOST_CHECK_GT(log.droppedBytes(), 0);
+  BOOST_CHECK_EQUAL(log.spilledBytes(), 0);
+  }
+  Lines lines = scan(dir.logs());
+  BOOST_CHECK_LT(lines.numbered, kLines);
+  BOOST_CHECK_GT(lines.numbered, 0);
+  BOOST_CHECK(lines.inOrder);
+  BOOST_CHECK_EQUAL(lines.dropNotes, 1);
+}
+
+BOOST_AUTO_TEST_CASE(testBlockOverflow)
+{
+  TempDir dir;
+  {
+  AsyncLogging log("block", 1024*1024*1024);
+  log.setOverflowPolicy(AsyncLogging::kBlockOverflow, 60 * 1000);
+  log.start();
+  appendLines(&log, kLines);
+  log.stop();
+  BOOST_CHECK_EQUAL(log.droppedBytes(), 0);
+  }
+  Lines lines = scan(dir.logs());
+  BOOST_CHECK_EQUAL(lines.numbered, kLines);
+  BOOST_CHECK(lines.inOrder);
+  BOOST_CHECK_EQUAL(lines.dropNotes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(testSpillOverflow)
+{
+  TempDir dir;
+  {
+  AsyncLogging log("spill", 1024*1024*1024);
+  log.setOverflowPolicy(AsyncLogging::kSpillOverflow);
+  appendLines(&log, kLines);
+  log.start();
+  log.stop();
+  BOOST_CHECK_EQUAL(log.droppedBytes(), 0);
+  BOOST_CHECK_GT(log.spilledBytes(), 0);
+  }
+  Lines lines = scan(dir.logs());
+  BOOST_CHECK_EQUAL(lines.numbered, kLines);
+  BOOST_CHECK(lines.inOrder);
+  // replayed and removed
+  std::vector<string> files = dir.files();
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    BOOST_CHECK(files[i].find(".spill") == string::npos);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testSpillOverflowCapped)
+{
+  const int64_t kMaxSpill = 3 * muduo::detail::kLargeBuffer;
+  TempDir dir;
+  {
+  AsyncLogging log("capped", 1024*1024*1024);
+  log.setOverflowPolicy(AsyncLogging::kSpillOverflow);
+  log.setMaxSpillBytes(kMaxSpill);
+  appendLines(&log, kLines);
+  log.start();
+  log.stop();
+  BOOST_CHECK_GT(log.droppedBytes(), 0);
+  BOOST_CHECK_GT(log.spilledBytes(), 0);
+  BOOST_CHECK_LE(log.spilledBytes(), kMaxSpill);
+  }
+  Lines lines = scan(dir.logs());
+  BOOST_CHECK_LT(lines.numbered, kLines);
+  BOOST_CHECK(lines.inOrder);
+  // in the log as well, not only on stderr
+  BOOST_CHECK_EQUAL(lines.dropNotes, 1);
+}
+
+AsyncLogging* g_asyncLog = NULL;
+
+void asyncOutput(const char* msg, int len)
+{
+  g_asyncLog->append(msg, len);
+}
+
+void stdoutOutput(const char* msg, int len)
+{
+  fwrite(msg, 1, len, stdout);
+}
+
+void logSite(int i)
+{
+  LOG_WARN << "after " << i;
+}
+
+// a site first used in a dropped buffer is still known to the records
+// after it, the file decodes alone
+BOOST_AUTO_TEST_CASE(testBinaryDropOverflow)
+{
+  TempDir dir;
+  {
+  AsyncLogging log("binary", 1024*1024*1024);
+  g_asyncLog = &log;
+  muduo::Logger::setOutput(asyncOutput);
+  muduo::Logger::setBinaryFormat(true);
+  string line(kLineSize, 'x');
+  for (int i = 0; i < kLines; ++i)
+  {
+    LOG_INFO << line;
+  }
+  logSite(0);  // dropped
+  log.start();
+  while (log.droppedBytes() == 0)
+  {
+    muduo::CurrentThread::sleepUsec(1000);
+  }
+  logSite(1);
+  log.stop();
+  muduo::Logger::setBinaryFormat(false);
+  muduo::Logger::setOutput(stdoutOutput);
+  g_asyncLog = NULL;
+  }
+
+  string binary = dir.logs();
+  muduo::LogDecoder decoder;
+  string text;
+  decoder.decode(binary.data(), binary.size(), &text);
+  BOOST_CHECK_EQUAL(text.find("site#"), string::npos);
+  BOOST_CHECK_EQUAL(text.find("after 0"), string::npos);
+  BOOST_CHECK(text.find("WARN  after 1 - AsyncLogging_unittest.cc:") != string::npos);
+}
@@ -1,6 +1,7 @@
 #include <muduo/base/FileUtil.h>
 
 #include <stdio.h>
+#include <unistd.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
@@ -26,5 +27,20 @@ int main()
   printf("%d %zd %" PRIu64 "\n", err, result.size(), size);
   err = FileUtil::readFile("/dev/zero", 102400, &result, NULL);
   printf("%d %zd %" PRIu64 "\n", err, result.size(), size);
-}
 
+  // nothing written when the file can't be opened, reported once
+  {
+  FileUtil::AppendFile file("/notexist/fileutil_test.log", true);
+  file.append("hello\n", 6);
+  file.append("hello\n", 6);
+  printf("%" PRIu64 " %" PRIu64 "\n", static_cast<uint64_t>(file.writtenBytes()),
+         static_cast<uint64_t>(file.droppedBytes()));
+  }
+  {
+  FileUtil::AppendFile file("/tmp/fileutil_test.log", true);
+  StringPiece chunks[] = { "hello ", "world\n" };
+  file.appendv(chunks, 2);
+  printf("%" PRIu64 "\n", static_cast<uint64_t>(file.writtenBytes()));
+  }
+  ::unlink("/tmp/fileutil_test.log");
+}
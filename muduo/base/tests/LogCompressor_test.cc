@@ -0,0 +1,47 @@
+#include <muduo/base/LogCompressor.h>
+#include <muduo/base/LogFile.h>
+#include <muduo/base/Logging.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+boost::scoped_ptr<muduo::LogFile> g_logFile;
+
+void outputFunc(const char* msg, int len)
+{
+  g_logFile->append(msg, len);
+}
+
+void flushFunc()
+{
+  g_logFile->flush();
+}
+
+int main(int argc, char* argv[])
+{
+  char name[256];
+  snprintf(name, sizeof name, "%s", argv[0]);
+  // keep the 3 newest compressed files
+  muduo::LogCompressor compressor(::basename(name), 3);
+  compressor.start();
+  g_logFile.reset(new muduo::LogFile(::basename(name), 200*1000));
+  g_logFile->setRollCallback(boost::bind(&muduo::LogCompressor::compress, &compressor, _1));
+  muduo::Logger::setOutput(outputFunc);
+  muduo::Logger::setFlush(flushFunc);
+
+  muduo::string line = "1234567890 abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+
+  for (int i = 0; i < 10000; ++i)
+  {
+    LOG_INFO << line << i;
+
+    usleep(1000);
+  }
+
+  compressor.stop();
+  printf("%d files compressed, %jd bytes to %jd bytes\n",
+         compressor.compressedFiles(),
+         static_cast<intmax_t>(compressor.bytesIn()),
+         static_cast<intmax_t>(compressor.bytesOut()));
+}
@@ -0,0 +1,54 @@
+// Formats binary log files written with Logger::setBinaryFormat(true).
+// Every file starts with its site definitions, any of them decodes alone.
+// Times are in UTC, or in the time zone of a zoneinfo file given with -z.
+
+#include <muduo/base/LogDecoder.h>
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char* argv[])
+{
+  int first = 1;
+  muduo::TimeZone tz;
+  if (argc > 2 && strcmp(argv[1], "-z") == 0)
+  {
+    tz = muduo::TimeZone(argv[2]);
+    if (!tz.valid())
+    {
+      fprintf(stderr, "cannot load time zone %s\n", argv[2]);
+      return 1;
+    }
+    first = 3;
+  }
+  if (argc <= first)
+  {
+    printf("Usage: %s [-z zonefile] file...\n", argv[0]);
+    return 0;
+  }
+
+  muduo::string text;
+  char buf[64*1024];
+  for (int i = first; i < argc; ++i)
+  {
+    FILE* fp = ::fopen(argv[i], "rb");
+    if (!fp)
+    {
+      perror(argv[i]);
+      continue;
+    }
+    muduo::LogDecoder decoder;
+    if (tz.valid())
+    {
+      decoder.setTimeZone(tz);
+    }
+    size_t n = 0;
+    while ((n = ::fread(buf, 1, sizeof buf, fp)) > 0)
+    {
+      text.clear();
+      decoder.decode(buf, n, &text);
+      ::fwrite(text.data(), 1, text.size(), stdout);
+    }
+    ::fclose(fp);
+  }
+}
@@ -0,0 +1,262 @@
+#include <muduo/base/LogDecoder.h>
+#include <muduo/base/FileUtil.h>
+#include <muduo/base/LogFile.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/TimeZone.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+//#define BOOST_TEST_MODULE LogDecoderTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+
+string g_output;
+
+void captureOutput(const char* msg, int len)
+{
+  g_output.append(msg, len);
+}
+
+// same call sites for both formats
+void writeLines()
+{
+  LOG_INFO << "Hello " << 42 << ' ' << -7 << ' ' << 3.25 << ' ' << true;
+  LOG_WARN << static_cast<unsigned long long>(18446744073709551615ULL)
+           << reinterpret_cast<void*>(0x1234) << muduo::Fmt("%4.2f", 1.2);
+  LOG_ERROR << string("string") << " " << muduo::StringPiece("piece");
+  errno = ENOENT;
+  LOG_SYSERR << "syserr";
+}
+
+string logLines(bool binary)
+{
+  g_output.clear();
+  muduo::Logger::setOutput(captureOutput);
+  muduo::Logger::setBinaryFormat(binary);
+  writeLines();
+  muduo::Logger::setBinaryFormat(false);
+  return g_output;
+}
+
+// as a file starts, the sites are defined whether or not used before
+string binaryLines()
+{
+  string binary = logLines(true);
+  string sites;
+  muduo::detail::appendLogSites(&sites);
+  return sites + binary;
+}
+
+// drop "20131017 08:04:10.123456Z ", or without the Z in a time zone
+std::vector<string> stripTime(const string& text, size_t timeLength = 26)
+{
+  std::vector<string> lines;
+  size_t start = 0;
+  size_t end = 0;
+  while ((end = text.find('\n', start)) != string::npos)
+  {
+    lines.push_back(text.substr(start + timeLength, end - start - timeLength));
+    start = end + 1;
+  }
+  return lines;
+}
+
+BOOST_AUTO_TEST_CASE(testLogDecoderRoundTrip)
+{
+  string text = logLines(false);
+  string binary = binaryLines();
+  BOOST_CHECK(binary != text);
+
+  muduo::LogDecoder decoder;
+  string decoded;
+  decoder.decode(binary.data(), binary.size(), &decoded);
+  std::vector<string> expected = stripTime(text);
+  std::vector<string> actual = stripTime(decoded);
+  BOOST_CHECK_EQUAL(expected.size(), 4u);
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(testLogDecoderFragmented)
+{
+  string binary = binaryLines();
+  muduo::LogDecoder whole;
+  string expected;
+  whole.decode(binary.data(), binary.size(), &expected);
+  BOOST_CHECK_EQUAL(expected.find("site#"), string::npos);
+
+  muduo::LogDecoder decoder;
+  string decoded;
+  for (size_t i = 0; i < binary.size(); ++i)
+  {
+    decoder.decode(binary.data() + i, 1, &decoded);
+  }
+  BOOST_CHECK_EQUAL(decoded, expected);
+}
+
+BOOST_AUTO_TEST_CASE(testLogDecoderPassThroughText)
+{
+  string binary = binaryLines();
+  string input = "plain text\n" + binary;
+  muduo::LogDecoder decoder;
+  string decoded;
+  decoder.decode(input.data(), input.size(), &decoded);
+  BOOST_CHECK_EQUAL(decoded.substr(0, 11), string("plain text\n"));
+  BOOST_CHECK_EQUAL(stripTime(decoded.substr(11)).size(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(testLogDecoderPassThroughUtf8)
+{
+  // continuation bytes of all kinds, 0x80 to 0xBF
+  string text;
+  for (int c = 0x80; c < 0xC0; ++c)
+  {
+    text += '\xC2';
+    text += static_cast<char>(c);
+  }
+  text += "\xE2\x82\xAC \xF0\x9F\x98\x80\n";
+  string input = text + binaryLines() + text;
+  muduo::LogDecoder decoder;
+  string decoded;
+  decoder.decode(input.data(), input.size(), &decoded);
+  BOOST_CHECK_EQUAL(decoded.substr(0, text.size()), text);
+  BOOST_CHECK_EQUAL(decoded.substr(decoded.size() - text.size()), text);
+  BOOST_CHECK_EQUAL(stripTime(decoded.substr(text.size(), decoded.size() - 2 * text.size())).size(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(testLogDecoderTimeZone)
+{
+  string binary = binaryLines();
+  muduo::Logger::setTimeZone(muduo::TimeZone(8*3600, "CST"));
+  muduo::LogDecoder local;
+  muduo::Logger::setTimeZone(muduo::TimeZone());
+  muduo::LogDecoder utc;
+  string localText;
+  string utcText;
+  local.decode(binary.data(), binary.size(), &localText);
+  utc.decode(binary.data(), binary.size(), &utcText);
+
+  // "20131017 08:04:10.123456 " and "20131017 00:04:10.123456Z "
+  BOOST_CHECK_EQUAL(utcText[24], 'Z');
+  BOOST_CHECK_EQUAL(localText[24], ' ');
+  int localHour = atoi(localText.c_str() + 9);
+  int utcHour = atoi(utcText.c_str() + 9);
+  BOOST_CHECK_EQUAL(localHour, (utcHour + 8) % 24);
+  std::vector<string> expected = stripTime(utcText);
+  std::vector<string> actual = stripTime(localText, 25);
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                actual.begin(), actual.end());
+}
+
+void logFromThread(int index)
+{
+  LOG_INFO << "thread " << index;
+}
+
+// A site first used by one thread, then by another: each record of the
+// second decodes without those of the first, which may reach the output later.
+BOOST_AUTO_TEST_CASE(testLogDecoderThreads)
+{
+  const int kThreads = 3;
+  g_output.clear();
+  muduo::Logger::setOutput(captureOutput);
+  muduo::Logger::setBinaryFormat(true);
+  std::vector<string> outputs;
+  for (int i = 0; i < kThreads; ++i)
+  {
+    muduo::Thread thread(boost::bind(logFromThread, i));
+    thread.start();
+    thread.join();
+    outputs.push_back(g_output);
+    g_output.clear();
+  }
+  muduo::Logger::setBinaryFormat(false);
+
+  for (int i = kThreads - 1; i >= 0; --i)
+  {
+    muduo::LogDecoder decoder;
+    string decoded;
+    decoder.decode(outputs[i].data(), outputs[i].size(), &decoded);
+    BOOST_CHECK_EQUAL(decoded.find("site#"), string::npos);
+    char expected[32];
+    snprintf(expected, sizeof expected, "thread %d", i);
+    BOOST_CHECK(decoded.find(expected) != string::npos);
+  }
+}
+
+muduo::LogFile* g_logFile = NULL;
+
+void fileOutput(const char* msg, int len)
+{
+  g_logFile->append(msg, len);
+}
+
+// a rolled file decodes alone, with a decoder that has seen nothing else
+BOOST_AUTO_TEST_CASE(testLogDecoderRolledFile)
+{
+  logLines(true);  // sites defined before the file, as in a long run
+  string text = logLines(false);
+
+  char dir[] = "/tmp/logdecoder_unittest.XXXXXX";
+  BOOST_REQUIRE(::mkdtemp(dir) != NULL);
+  char cwd[1024];
+  BOOST_REQUIRE(::getcwd(cwd, sizeof cwd) != NULL);
+  BOOST_REQUIRE(::chdir(dir) == 0);
+
+  std::vector<string> rolled;
+  {
+  muduo::LogFile file("decode", 1024*1024*1024, false);
+  g_logFile = &file;
+  muduo::Logger::setOutput(fileOutput);
+  muduo::Logger::setBinaryFormat(true);
+  LOG_INFO << "first file";
+  ::sleep(1);  // file names are by the second
+  BOOST_REQUIRE(file.rollFile());
+  writeLines();
+  muduo::Logger::setBinaryFormat(false);
+  muduo::Logger::setOutput(captureOutput);
+  g_logFile = NULL;
+  }
+
+  DIR* entries = ::opendir(".");
+  while (struct dirent* entry = ::readdir(entries))
+  {
+    if (entry->d_name[0] != '.')
+    {
+      rolled.push_back(entry->d_name);
+    }
+  }
+  ::closedir(entries);
+  std::sort(rolled.begin(), rolled.end());
+  BOOST_REQUIRE_EQUAL(rolled.size(), 2u);
+
+  string binary;
+  muduo::FileUtil::readFile(rolled[1], 1024*1024, &binary);
+  muduo::LogDecoder decoder;
+  string decoded;
+  decoder.decode(binary.data(), binary.size(), &decoded);
+  std::vector<string> expected = stripTime(text);
+  std::vector<string> actual = stripTime(decoded);
+  BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                actual.begin(), actual.end());
+
+  for (size_t i = 0; i < rolled.size(); ++i)
+  {
+    ::unlink(rolled[i].c_str());
+  }
+  BOOST_CHECK(::chdir(cwd) == 0);
+  ::rmdir(dir);
+}
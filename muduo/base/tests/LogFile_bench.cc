@@ -0,0 +1,53 @@
+#include <muduo/base/LogFile.h>
+#include <muduo/base/Timestamp.h>
+
+#include <vector>
+#include <stdio.h>
+
+using namespace muduo;
+
+const int kBufferSize = 4000*1000;  // same as AsyncLogging
+const int kBuffersPerRound = 8;
+const int kRounds = 16;
+
+void bench(const char* name, bool unbuffered)
+{
+  string line = "1234567890 abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+  string buffer;
+  while (buffer.size() + line.size() < static_cast<size_t>(kBufferSize))
+  {
+    buffer += line;
+  }
+
+  std::vector<StringPiece> chunks(kBuffersPerRound,
+                                  StringPiece(buffer.data(), static_cast<int>(buffer.size())));
+
+  LogFile output(name, 1000*1000*1000, false, 3, 1024, unbuffered);
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < kRounds; ++i)
+  {
+    if (unbuffered)
+    {
+      output.appendv(&*chunks.begin(), kBuffersPerRound);
+    }
+    else
+    {
+      for (int j = 0; j < kBuffersPerRound; ++j)
+      {
+        output.append(chunks[j].data(), chunks[j].size());
+      }
+    }
+    output.flush();
+  }
+  Timestamp end(Timestamp::now());
+
+  double seconds = timeDifference(end, start);
+  double total = static_cast<double>(buffer.size()) * kBuffersPerRound * kRounds;
+  printf("%-10s %f seconds, %.2f MiB/s\n", name, seconds, total / seconds / 1024 / 1024);
+}
+
+int main()
+{
+  bench("stdio", false);
+  bench("writev", true);
+}
@@ -1,4 +1,5 @@
 #include <muduo/base/LogStream.h>
+#include <muduo/base/Logging.h>
 #include <muduo/base/Timestamp.h>
 
 #include <sstream>
@@ -55,6 +56,93 @@ void benchLogStream()
   printf("benchLogStream %f\n", timeDifference(end, start));
 }
 
+template<typename T>
+void benchBinaryLogStream()
+{
+  Timestamp start(Timestamp::now());
+  LogStream os;
+  os.setBinary(true);
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << (T)(i);
+    os.resetBuffer();
+  }
+  Timestamp end(Timestamp::now());
+
+  printf("benchBinaryLogStream %f\n", timeDifference(end, start));
+}
+
+// typical latencies and ratios, rather than integers cast to double
+void benchDoubleHeavy()
+{
+  const int kValues = 1024;
+  double values[kValues];
+  for (int i = 0; i < kValues; ++i)
+  {
+    values[i] = (i * 7919 % 100000) / 1000.0 + 1.0 / (i + 3);
+  }
+
+  char buf[32];
+  Timestamp start(Timestamp::now());
+  for (size_t i = 0; i < N; ++i)
+    snprintf(buf, sizeof buf, "%.12g", values[i % kValues]);
+  Timestamp end(Timestamp::now());
+  printf("benchPrintf %f\n", timeDifference(end, start));
+
+  LogStream os;
+  start = Timestamp::now();
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << values[i % kValues];
+    os.resetBuffer();
+  }
+  end = Timestamp::now();
+  printf("benchLogStream %f\n", timeDifference(end, start));
+
+  start = Timestamp::now();
+  for (size_t i = 0; i < N; ++i)
+    snprintf(buf, sizeof buf, "%.3f", values[i % kValues]);
+  end = Timestamp::now();
+  printf("benchPrintf %%.3f %f\n", timeDifference(end, start));
+
+  start = Timestamp::now();
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << Fmt("%.3f", values[i % kValues]);
+    os.resetBuffer();
+  }
+  end = Timestamp::now();
+  printf("benchFmt %%.3f %f\n", timeDifference(end, start));
+
+  start = Timestamp::now();
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << Shortest(values[i % kValues]);
+    os.resetBuffer();
+  }
+  end = Timestamp::now();
+  printf("benchShortest %f\n", timeDifference(end, start));
+}
+
+void nullOutput(const char*, int)
+{
+}
+
+void benchLogger(bool binary)
+{
+  Logger::setOutput(nullOutput);
+  Logger::setBinaryFormat(binary);
+  Timestamp start(Timestamp::now());
+  for (size_t i = 0; i < N; ++i)
+  {
+    LOG_INFO << "request " << i << " took " << 0.25 * (double)i << " ms from " << &start;
+  }
+  Timestamp end(Timestamp::now());
+  Logger::setBinaryFormat(false);
+
+  printf("benchLogger %s %f\n", binary ? "binary" : "text", timeDifference(end, start));
+}
+
 int main()
 {
   benchPrintf<int>("%d");
@@ -63,20 +151,30 @@ int main()
   benchPrintf<int>("%d");
   benchStringStream<int>();
   benchLogStream<int>();
+  benchBinaryLogStream<int>();
 
   puts("double");
   benchPrintf<double>("%.12g");
   benchStringStream<double>();
   benchLogStream<double>();
+  benchBinaryLogStream<double>();
 
   puts("int64_t");
   benchPrintf<int64_t>("%" PRId64);
   benchStringStream<int64_t>();
   benchLogStream<int64_t>();
+  benchBinaryLogStream<int64_t>();
 
   puts("void*");
   benchPrintf<void*>("%p");
   benchStringStream<void*>();
   benchLogStream<void*>();
+  benchBinaryLogStream<void*>();
+
+  puts("double heavy");
+  benchDoubleHeavy();
 
+  puts("Logger");
+  benchLogger(false);
+  benchLogger(true);
 }
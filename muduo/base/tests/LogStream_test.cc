@@ -2,6 +2,7 @@
 
 #include <limits>
 #include <stdint.h>
+#include <stdio.h>
 
 //#define BOOST_TEST_MODULE LogStreamTest
 #define BOOST_TEST_MAIN
@@ -169,6 +170,45 @@ BOOST_AUTO_TEST_CASE(testLogStreamFloats)
   os.resetBuffer();
 }
 
+BOOST_AUTO_TEST_CASE(testLogStreamFloatsLikePrintf)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+
+  const double values[] = { 0.0, -0.0, 1e-5, 1.5e-5, 123456789012.0, 1234567890123.0,
+                            0.1 + 0.2, 2.5, -0.000123456789, 1e100, 5e-324 };
+  for (size_t i = 0; i < sizeof values / sizeof values[0]; ++i)
+  {
+    char expected[64];
+    snprintf(expected, sizeof expected, "%.12g", values[i]);
+    os << values[i];
+    BOOST_CHECK_EQUAL(buf.asString(), string(expected));
+    os.resetBuffer();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamShortest)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+
+  os << muduo::Shortest(0.1);
+  BOOST_CHECK_EQUAL(buf.asString(), string("0.1"));
+  os.resetBuffer();
+
+  os << muduo::Shortest(0.1 + 0.2);
+  BOOST_CHECK_EQUAL(buf.asString(), string("0.30000000000000004"));
+  os.resetBuffer();
+
+  os << muduo::Shortest(-1.5e-10);
+  BOOST_CHECK_EQUAL(buf.asString(), string("-1.5e-10"));
+  os.resetBuffer();
+
+  os << muduo::Shortest(5e-324);
+  BOOST_CHECK_EQUAL(buf.asString(), string("5e-324"));
+  os.resetBuffer();
+}
+
 BOOST_AUTO_TEST_CASE(testLogStreamVoid)
 {
   muduo::LogStream os;
@@ -212,6 +252,14 @@ BOOST_AUTO_TEST_CASE(testLogStreamFmts)
   os << muduo::Fmt("%4.2f", 1.2) << muduo::Fmt("%4d", 43);
   BOOST_CHECK_EQUAL(buf.asString(), string("1.20  43"));
   os.resetBuffer();
+
+  os << muduo::Fmt("%.2f", 1.005) << ' ' << muduo::Fmt("%.3f", -0.0004);
+  BOOST_CHECK_EQUAL(buf.asString(), string("1.00 -0.000"));
+  os.resetBuffer();
+
+  os << muduo::Fmt("%.3g", 1234.5) << ' ' << muduo::Fmt("%g", 0.5f);
+  BOOST_CHECK_EQUAL(buf.asString(), string("1.23e+03 0.5"));
+  os.resetBuffer();
 }
 
 BOOST_AUTO_TEST_CASE(testLogStreamLong)
@@ -45,6 +45,7 @@ class TcpConnection;
 class Timer;
 class UdpSocket;
 class InetAddress;
+struct UdpDatagram;
 typedef boost::shared_ptr<TcpConnection> TcpConnectionPtr;
 typedef boost::shared_ptr<Timer> TimerPtr;
 typedef boost::shared_ptr<UdpSocket> UdpSocketPtr;
@@ -72,6 +73,17 @@ typedef boost::function<void (const UdpSocketPtr&,
                               Buffer*,
                               const InetAddress&, 
                               Timestamp)> UdpMessageCallback;
+// the datagrams read at once, valid during the call only
+typedef boost::function<void (const UdpSocketPtr&,
+                              const UdpDatagram*,
+                              int,
+                              Timestamp)> UdpBatchMessageCallback;
+// datagrams of the size given back to back, the last one may be shorter
+typedef boost::function<void (const UdpSocketPtr&,
+                              Buffer*,
+                              size_t,
+                              const InetAddress&,
+                              Timestamp)> UdpSegmentMessageCallback;
 
 void defaultUdpMessageCallback(const UdpSocketPtr& socket,
                                Buffer* buffer,
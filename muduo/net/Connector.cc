@@ -37,7 +37,8 @@ Connector::Connector(EventLoop* loop, const InetAddress& serverAddr)
 Connector::~Connector()
 {
   LOG_DEBUG << "dtor[" << this << "]";
-  assert(state_ == kDisconnected);
+  // kConnected once the socket has been handed over to TcpConnection
+  assert(state_ != kConnecting);
 }
 
 void Connector::start()
@@ -134,13 +135,16 @@ void Connector::onConnectCallback( uv_connect_t *req, int status )
       else
       {
         connector->setState(kConnected);
+        // no longer ours, a restart connects on a new one
+        uv_tcp_t* socket = connector->socket_;
+        connector->socket_ = nullptr;
         if (connector->connect_)
         {
-          connector->newConnectionCallback_(connector->socket_);
+          connector->newConnectionCallback_(socket);
         }
         else
         {
-          connector->loop_->closeSocketInLoop(connector->socket_);
+          connector->loop_->closeSocketInLoop(socket);
         }
       }
     }
@@ -167,6 +171,10 @@ void Connector::handleConnectError( int err )
     case UV_ECONNREFUSED:
     case UV_ENETUNREACH:
       retry();
+      if (connectFailedCallback_)
+      {
+        connectFailedCallback_(err);
+      }
       break;
 
     case UV_EACCES:
@@ -179,13 +187,20 @@ void Connector::handleConnectError( int err )
       LOG_SYSERR << "Connect error:" << uv_err_name(err);
       loop_->closeSocketInLoop(socket_);
       socket_ = nullptr;
+      if (connectFailedCallback_)
+      {
+        connectFailedCallback_(err);
+      }
       break;
 
     default:
       LOG_SYSERR << "Unexpected error:" << uv_err_name(err);
       loop_->closeSocketInLoop(socket_);
       socket_ = nullptr;
-      // connectErrorCallback_();
+      if (connectFailedCallback_)
+      {
+        connectFailedCallback_(err);
+      }
     break;
   }
 }
@@ -30,6 +30,8 @@ class Connector : boost::noncopyable,
 {
  public:
   typedef boost::function<void (uv_tcp_t*)> NewConnectionCallback;
+  // for every failed attempt, with the libuv error, retried or not
+  typedef boost::function<void (int err)> ConnectFailedCallback;
 
   Connector(EventLoop* loop, const InetAddress& serverAddr);
   ~Connector();
@@ -38,6 +40,8 @@ class Connector : boost::noncopyable,
   { newConnectionCallback_ = cb; }
   void setNewConnectionCallback(NewConnectionCallback&& cb)
   { newConnectionCallback_ = std::move(cb); }
+  void setConnectFailedCallback(const ConnectFailedCallback& cb)
+  { connectFailedCallback_ = cb; }
 
   void start();  // can be called in any thread
   void restart();  // must be called in loop thread
@@ -77,6 +81,7 @@ class Connector : boost::noncopyable,
   States state_;  // FIXME: use atomic variable
   uv_tcp_t *socket_;
   NewConnectionCallback newConnectionCallback_;
+  ConnectFailedCallback connectFailedCallback_;
   int retryDelayMs_;
 };
 
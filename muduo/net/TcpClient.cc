@@ -68,7 +68,6 @@ TcpClient::TcpClient(EventLoop* loop,
 {
   connector_->setNewConnectionCallback(
       boost::bind(&TcpClient::newConnection, this, _1));
-  // FIXME setConnectFailedCallback
   LOG_INFO << "TcpClient::TcpClient[" << name_
            << "] - connector " << get_pointer(connector_);
 }
@@ -104,6 +103,11 @@ TcpClient::~TcpClient()
   }
 }
 
+void TcpClient::setConnectFailedCallback(const boost::function<void (int err)>& cb)
+{
+  connector_->setConnectFailedCallback(cb);
+}
+
 void TcpClient::connect()
 {
   // FIXME: check state
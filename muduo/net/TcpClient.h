@@ -63,6 +63,11 @@ class TcpClient : boost::noncopyable
   void setWriteCompleteCallback(const WriteCompleteCallback& cb)
   { writeCompleteCallback_ = cb; }
 
+  /// Set connect failed callback, run for every failed attempt with the
+  /// libuv error, whether or not it is retried.  It may destroy the client.
+  /// Not thread safe.
+  void setConnectFailedCallback(const boost::function<void (int err)>& cb);
+
   void setConnectionCallback(ConnectionCallback&& cb)
   { connectionCallback_ = std::move(cb); }
   void setMessageCallback(MessageCallback&& cb)
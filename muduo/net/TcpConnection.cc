@@ -15,8 +15,14 @@
 
 #include <boost/bind.hpp>
 
+#include <algorithm>
 #include <list>
 
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/sendfile.h>
+#endif
+
 namespace muduo
 {
 namespace net
@@ -49,14 +55,37 @@ class OutputBuffer : boost::noncopyable
     return beginWrite;
   }
 
+  // room for len bytes after the readable ones, commit() makes them readable
+  char* reserve(size_t len)
+  {
+    reserved_ = findAvaliableBuffer(len);
+    (*reserved_).ensureWritableBytes(len);
+    return (*reserved_).beginWrite();
+  }
+
+  // the first len bytes of what reserve() returned
+  char* commit(size_t len)
+  {
+    char* beginWrite = (*reserved_).beginWrite();
+    (*reserved_).hasWritten(len);
+    writeBuffer_ = reserved_;
+    readableBytes_ += len;
+    return beginWrite;
+  }
+
   void retrieve(size_t len)
   {
     (*readBuffer_).retrieve(len);
-    if ((*readBuffer_).readableBytes() == 0)
+    readableBytes_ -= len;
+    // an empty writeBuffer_ is written again, so reading starts there
+    if (readableBytes_ == 0)
+    {
+      readBuffer_ = writeBuffer_;
+    }
+    else if ((*readBuffer_).readableBytes() == 0)
     {
       readBuffer_ = next(readBuffer_);
     }
-    readableBytes_ -= len;
   }
 
  private:
@@ -87,12 +116,128 @@ class OutputBuffer : boost::noncopyable
  private:
   BufferList::iterator readBuffer_;
   BufferList::iterator writeBuffer_;
+  BufferList::iterator reserved_;
 
   size_t readableBytes_;
   BufferList outputBuffers_;
   
 };
 
+// Files of sendFile() in order, each with the data sent after it, which
+// must wait until the file is out.
+class FileQueue : boost::noncopyable
+{
+ public:
+  struct Transfer
+  {
+    int file;
+    int64_t offset;
+    int64_t remaining;
+    Buffer after;
+  };
+
+  // sendfile(2) from a worker thread
+  struct Sendfile
+  {
+    uv_work_t work;
+    int out;
+    int in;
+    int64_t offset;
+    size_t length;
+    ssize_t result;  // bytes or a UV_E* error
+  };
+
+  FileQueue()
+  {
+    readReq_.data = NULL;
+    sendfile_.work.data = NULL;
+  }
+
+  ~FileQueue()
+  {
+    closeAll();
+  }
+
+  bool empty() const { return transfers_.empty(); }
+  bool busy() const { return inFlight_ != NULL; }
+
+  Transfer& front() { return transfers_.front(); }
+
+  void push(int file, int64_t offset, int64_t length)
+  {
+    transfers_.push_back(Transfer());
+    Transfer& t = transfers_.back();
+    t.file = file;
+    t.offset = offset;
+    t.remaining = length;
+  }
+
+  void appendAfter(const void* data, size_t len)
+  {
+    transfers_.back().after.append(data, len);
+  }
+
+  // closes the front file, *after is what comes next on the wire
+  void pop(Buffer* after)
+  {
+    closeFile(transfers_.front().file);
+    after->swap(transfers_.front().after);
+    transfers_.pop_front();
+  }
+
+  void closeAll()
+  {
+    while (!transfers_.empty())
+    {
+      closeFile(transfers_.front().file);
+      transfers_.pop_front();
+    }
+  }
+
+  // the read or sendfile in flight holds the connection, and so the
+  // socket, until it is called back
+  uv_fs_t* startRead(const TcpConnectionPtr& conn)
+  {
+    assert(!busy());
+    inFlight_ = conn;
+    readReq_.data = conn.get();
+    return &readReq_;
+  }
+
+  Sendfile* startSendfile(const TcpConnectionPtr& conn)
+  {
+    assert(!busy());
+    inFlight_ = conn;
+    sendfile_.work.data = conn.get();
+    return &sendfile_;
+  }
+
+  Sendfile* sendfileRequest() { return &sendfile_; }
+
+  TcpConnectionPtr finish()
+  {
+    TcpConnectionPtr conn;
+    conn.swap(inFlight_);
+    return conn;
+  }
+
+  Buffer* chunk() { return &chunk_; }
+
+ private:
+  static void closeFile(int file)
+  {
+    uv_fs_t req;
+    uv_fs_close(NULL, &req, file, NULL);
+    uv_fs_req_cleanup(&req);
+  }
+
+  std::list<Transfer> transfers_;
+  uv_fs_t readReq_;
+  Sendfile sendfile_;
+  TcpConnectionPtr inFlight_;
+  Buffer chunk_;  // reads when there is no sendfile(2)
+};
+
 } // namespace net
 } // namespace muduo
 
@@ -127,7 +272,11 @@ TcpConnection::TcpConnection(const string& nameArg,
     peerAddr_(peerAddr),
     highWaterMark_(64*1024*1024),
     outputBuffer_(new OutputBuffer),
-    isClosing_(false)
+    pendingWrites_(0),
+    files_(new FileQueue),
+    isClosing_(false),
+    shutdownPending_(false),
+    writeShutdown_(false)
 {
   assert(socket->loop);
   assert(socket->loop->data);
@@ -239,19 +388,110 @@ void TcpConnection::sendInLoop(const StringPiece& message)
   sendInLoop(message.data(), message.size());
 }
 
+void TcpConnection::send(const boost::shared_ptr<const string>& blob)
+{
+  if (state_ == kConnected)
+  {
+    if (loop_->isInLoopThread())
+    {
+      sendBlobInLoop(blob);
+    }
+    else
+    {
+      loop_->runInLoop(
+          boost::bind(&TcpConnection::sendBlobInLoop,
+                      this,     // FIXME
+                      blob));
+    }
+  }
+}
+
+void TcpConnection::sendFile(int file, int64_t offset, int64_t length)
+{
+  if (loop_->isInLoopThread())
+  {
+    sendFileInLoop(file, offset, length);
+  }
+  else
+  {
+    loop_->runInLoop(
+        boost::bind(&TcpConnection::sendFileInLoop,
+                    this,     // FIXME
+                    file, offset, length));
+  }
+}
+
 void TcpConnection::sendInLoop(const void* data, size_t len)
 {
   loop_->assertInLoopThread();
-  ssize_t nwrote = 0;
-  size_t remaining = len;
-  bool faultError = false;
+  if (!files_->empty())
+  {
+    files_->appendAfter(data, len);
+    return;
+  }
+  writeInLoop(data, len, boost::shared_ptr<const string>());
+}
+
+void TcpConnection::sendBlobInLoop(const boost::shared_ptr<const string>& blob)
+{
+  loop_->assertInLoopThread();
+  if (!files_->empty())
+  {
+    files_->appendAfter(blob->data(), blob->size());
+    return;
+  }
+  writeInLoop(blob->data(), blob->size(), blob);
+}
+
+// blob is set if data is in it and outlives the write
+void TcpConnection::writeInLoop(const void* data, size_t len,
+                                const boost::shared_ptr<const string>& blob)
+{
   if (state_ == kDisconnected)
   {
     LOG_WARN << "disconnected, give up writing";
     return;
   }
 
-  if (socket_->getWriteQueueSize() == 0 && outputBuffer_->readableBytes() == 0) 
+  bool faultError = false;
+  size_t nwrote = tryWriteInLoop(data, len, &faultError);
+  size_t remaining = len - nwrote;
+  assert(remaining <= len);
+
+  if (!faultError && remaining > 0)
+  {
+    WriteRequest *writeReq = getFreeWriteReq();
+    writeReq->req.data = writeReq;
+    writeReq->conn = shared_from_this();
+    if (blob)
+    {
+      writeReq->blob = blob;
+      writeReq->buf = uv_buf_init(
+        const_cast<char*>(static_cast<const char*>(data)) + nwrote,
+        static_cast<unsigned int>(remaining));
+    }
+    else
+    {
+      size_t oldLen = outputBuffer_->readableBytes();
+      if (oldLen + remaining >= highWaterMark_ &&
+          oldLen < highWaterMark_ &&
+          highWaterMarkCallback_)
+      {
+        loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+      }
+      writeReq->buf = uv_buf_init(
+        outputBuffer_->append(static_cast<const char*>(data)+nwrote, remaining),
+        static_cast<unsigned int>(remaining));
+    }
+    startWrite(writeReq);
+  }
+}
+
+// writes what the socket takes now, if nothing is queued before it
+size_t TcpConnection::tryWriteInLoop(const void* data, size_t len, bool* faultError)
+{
+  ssize_t nwrote = 0;
+  if (pendingWrites_ == 0)
   {
     uv_buf_t buf = uv_buf_init(
       static_cast<char*>(const_cast<void*>(data)), 
@@ -259,8 +499,7 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     nwrote = socket_->tryWrite(&buf, 1);
     if (nwrote >= 0)
     {
-      remaining = len - nwrote;
-      if (remaining == 0 && writeCompleteCallback_) 
+      if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_) 
       {
         loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
       }
@@ -274,39 +513,64 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         LOG_SYSERR << uv_strerror(err) << " in TcpConnection::SendInLoop";
         if (err == UV_EPIPE || err == UV_ECONNRESET)
         {
-          faultError = true;
+          *faultError = true;
         }
       }
     }
   }
+  return static_cast<size_t>(nwrote);
+}
 
-  assert(remaining <= len);
+void TcpConnection::startWrite(WriteRequest* writeReq)
+{
+  ++pendingWrites_;
+  int err = socket_->write(&writeReq->req, &writeReq->buf, 1, &TcpConnection::writeCallback);
+  if (err)
+  {
+    LOG_SYSFATAL << uv_strerror(err) << " in TcpConnection::sendInLoop";
+  }
+}
 
-  if (!faultError && remaining > 0)
+char* TcpConnection::reserveOutput(size_t len)
+{
+  loop_->assertInLoopThread();
+  if (state_ != kConnected || !files_->empty())
   {
-    size_t oldLen = outputBuffer_->readableBytes();
-    if (oldLen + remaining >= highWaterMark_ && 
-        oldLen < highWaterMark_ && 
+    return NULL;
+  }
+  return outputBuffer_->reserve(len);
+}
+
+void TcpConnection::commitOutput(size_t len)
+{
+  loop_->assertInLoopThread();
+  size_t oldLen = outputBuffer_->readableBytes();
+  char* data = outputBuffer_->commit(len);
+  bool faultError = false;
+  size_t nwrote = tryWriteInLoop(data, len, &faultError);
+  if (nwrote > 0 || faultError)
+  {
+    // nothing was queued, so the bytes are at the front of the output
+    outputBuffer_->retrieve(faultError ? len : nwrote);
+  }
+  size_t remaining = faultError ? 0 : len - nwrote;
+
+  if (remaining > 0)
+  {
+    if (oldLen + remaining >= highWaterMark_ &&
+        oldLen < highWaterMark_ &&
         highWaterMarkCallback_)
     {
       loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
     }
-    
     WriteRequest *writeReq = getFreeWriteReq();
     writeReq->req.data = writeReq;
     writeReq->conn = shared_from_this();
-    writeReq->buf = uv_buf_init(
-      outputBuffer_->append(static_cast<const char*>(data)+nwrote, remaining),
-      static_cast<unsigned int>(remaining));
-    int err = socket_->write(&writeReq->req, &writeReq->buf, 1, &TcpConnection::writeCallback);
-    if (err)
-    {
-      LOG_SYSFATAL << uv_strerror(err) << " in TcpConnection::sendInLoop";
-    }
+    writeReq->buf = uv_buf_init(data + nwrote, static_cast<unsigned int>(remaining));
+    startWrite(writeReq);
   }
 }
 
-
 void TcpConnection::writeCallback( uv_write_t *handle, int status )
 {
   assert(handle->data);
@@ -320,12 +584,17 @@ void TcpConnection::writeCallback( uv_write_t *handle, int status )
 
   if (conn)
   {
-    conn->outputBuffer_->retrieve(writeReq->buf.len);
+    if (!writeReq->blob)
+    {
+      conn->outputBuffer_->retrieve(writeReq->buf.len);
+    }
+    --conn->pendingWrites_;
     conn->releaseWriteReq(writeReq);
     if (conn->writeCompleteCallback_)
     {
       conn->loop_->queueInLoop(boost::bind(conn->writeCompleteCallback_, conn));
     }
+    conn->startFileIfReady();
     if (conn->state_ == kDisconnecting)
     {
       conn->shutdownInLoop();
@@ -338,6 +607,179 @@ void TcpConnection::writeCallback( uv_write_t *handle, int status )
   }
 }
 
+void TcpConnection::sendFileInLoop(int file, int64_t offset, int64_t length)
+{
+  loop_->assertInLoopThread();
+  files_->push(file, offset, length);
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN << "disconnected, give up sending file";
+    files_->closeAll();
+    return;
+  }
+  startFileIfReady();
+}
+
+// the front file goes out once everything before it is written
+void TcpConnection::startFileIfReady()
+{
+  if (!files_->empty() && !files_->busy() && pendingWrites_ == 0
+      && state_ != kDisconnected)
+  {
+    continueFile();
+  }
+}
+
+void TcpConnection::continueFile()
+{
+  FileQueue::Transfer& t = files_->front();
+  if (t.remaining == 0)
+  {
+    finishFile();
+    return;
+  }
+#if defined(__linux__)
+  // The socket is non-blocking, sendfile(2) writes what fits and returns.
+  // On EAGAIN one chunk goes by read and uv_write(), which waits for the
+  // socket to drain.  uv_fs_sendfile() is not used, it tries
+  // copy_file_range(2) first and copies in user space when that fails,
+  // as it does for sockets.
+  const int64_t kSendfileChunk = 4*1024*1024;
+  FileQueue::Sendfile* sf = files_->startSendfile(shared_from_this());
+  sf->out = socket_->fd();
+  sf->in = t.file;
+  sf->offset = t.offset;
+  sf->length = static_cast<size_t>(std::min(t.remaining, kSendfileChunk));
+  sf->result = 0;
+  int err = uv_queue_work(loop_->getUVLoop(), &sf->work,
+                          &TcpConnection::sendfileWork,
+                          &TcpConnection::sendfileCallback);
+  if (err)
+  {
+    files_->finish();
+    LOG_SYSERR << uv_strerror(err) << " in TcpConnection::continueFile";
+    files_->closeAll();
+    forceCloseInLoop();
+  }
+#else
+  readFileChunk();
+#endif
+}
+
+void TcpConnection::readFileChunk()
+{
+  const int64_t kReadChunk = 64*1024;
+  FileQueue::Transfer& t = files_->front();
+  Buffer* chunk = files_->chunk();
+  chunk->ensureWritableBytes(static_cast<size_t>(kReadChunk));
+  uv_buf_t buf = uv_buf_init(chunk->beginWrite(),
+                             static_cast<unsigned int>(std::min(t.remaining, kReadChunk)));
+  int err = uv_fs_read(loop_->getUVLoop(), files_->startRead(shared_from_this()),
+                       t.file, &buf, 1, t.offset, &TcpConnection::readFileCallback);
+  if (err)
+  {
+    files_->finish();
+    LOG_SYSERR << uv_strerror(err) << " in TcpConnection::readFileChunk";
+    files_->closeAll();
+    forceCloseInLoop();
+  }
+}
+
+// in a worker thread
+void TcpConnection::sendfileWork(uv_work_t *req)
+{
+#if defined(__linux__)
+  assert(req->data);
+  TcpConnection* conn = static_cast<TcpConnection*>(req->data);
+  FileQueue::Sendfile* sf = conn->files_->sendfileRequest();
+  off_t offset = static_cast<off_t>(sf->offset);
+  ssize_t n = 0;
+  do
+  {
+    n = ::sendfile(sf->out, sf->in, &offset, sf->length);
+  } while (n < 0 && errno == EINTR);
+  sf->result = n >= 0 ? n : uv_translate_sys_error(errno);
+#endif
+}
+
+void TcpConnection::sendfileCallback(uv_work_t *req, int status)
+{
+  assert(req->data);
+  TcpConnection* conn = static_cast<TcpConnection*>(req->data);
+  TcpConnectionPtr guardThis(conn->files_->finish());
+  ssize_t result = status ? status : conn->files_->sendfileRequest()->result;
+  conn->handleFileResult(result, true);
+}
+
+void TcpConnection::readFileCallback(uv_fs_t *req)
+{
+  assert(req->data);
+  TcpConnection* conn = static_cast<TcpConnection*>(req->data);
+  TcpConnectionPtr guardThis(conn->files_->finish());
+  ssize_t result = req->result;
+  uv_fs_req_cleanup(req);
+  conn->handleFileResult(result, false);
+}
+
+void TcpConnection::handleFileResult(ssize_t result, bool sentfile)
+{
+  if (state_ == kDisconnected)
+  {
+    files_->closeAll();
+    return;
+  }
+  FileQueue::Transfer& t = files_->front();
+  if (result > 0)
+  {
+    t.offset += result;
+    t.remaining -= result;
+    if (!sentfile)
+    {
+      writeInLoop(files_->chunk()->beginWrite(), static_cast<size_t>(result),
+                  boost::shared_ptr<const string>());
+    }
+    // a read waits for its write, sendfile goes on
+    startFileIfReady();
+  }
+  else if (result == UV_EAGAIN && sentfile)
+  {
+    readFileChunk();
+  }
+  else
+  {
+    if (result == 0)
+    {
+      LOG_ERROR << "TcpConnection::handleFileResult [" << name_
+                << "] - file ends " << t.remaining << " bytes early";
+    }
+    else
+    {
+      LOG_SYSERR << uv_strerror(static_cast<int>(result)) << " in TcpConnection::handleFileResult";
+    }
+    files_->closeAll();
+    forceCloseInLoop();
+  }
+}
+
+void TcpConnection::finishFile()
+{
+  Buffer after;
+  files_->pop(&after);
+  if (after.readableBytes() > 0)
+  {
+    writeInLoop(after.peek(), after.readableBytes(), boost::shared_ptr<const string>());
+  }
+  else if (files_->empty() && pendingWrites_ == 0 && writeCompleteCallback_)
+  {
+    loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
+  }
+  startFileIfReady();
+  if (files_->empty() && state_ == kDisconnecting)
+  {
+    shutdownInLoop();
+  }
+}
+
 void TcpConnection::shutdown()
 {
   // FIXME: use compare and swap
@@ -352,13 +794,41 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
   loop_->assertInLoopThread();
+  if (pendingWrites_ > 0 || !files_->empty())
+  {
+    // writeCallback() or finishFile() comes back here once the output
+    // is drained, uv_shutdown() twice is an error
+    return;
+  }
+
+  // we are not writing
+  isClosing_ = false;
+  shutdownWrite();
+}
 
+void TcpConnection::shutdownWrite()
+{
+  if (writeShutdown_)
+  {
+    return;
+  }
   ShutdownRequest *shutdownReq = new ShutdownRequest;
   shutdownReq->conn = shared_from_this();
   shutdownReq->req.data = shutdownReq;
-  isClosing_ = false;
-  // we are not writing
-  socket_->shutdownWrite(&shutdownReq->req, &TcpConnection::shutdownCallback);
+  writeShutdown_ = true;
+  shutdownPending_ = true;
+  int err = socket_->shutdownWrite(&shutdownReq->req, &TcpConnection::shutdownCallback);
+  if (err)
+  {
+    // ENOTCONN after the peer reset the connection, nothing to shut down
+    LOG_SYSERR << uv_strerror(err) << " in TcpConnection::shutdownWrite";
+    delete shutdownReq;
+    shutdownPending_ = false;
+    if (isClosing_)
+    {
+      closeAfterShutdown();
+    }
+  }
 }
 
 void TcpConnection::shutdownCallback( uv_shutdown_t *req, int status )
@@ -373,15 +843,24 @@ void TcpConnection::shutdownCallback( uv_shutdown_t *req, int status )
     LOG_SYSERR << uv_strerror(status) << " in TcpConnection::shutdownCallback";
   }
 
-  if (connection && connection->isClosing_)
+  if (connection)
   {
-    TcpConnectionPtr guardThis(connection->shared_from_this());
-    connection->connectionCallback_(guardThis);
-    // must be the last line
-    connection->closeCallback_(guardThis);
+    connection->shutdownPending_ = false;
+    if (connection->isClosing_)
+    {
+      connection->closeAfterShutdown();
+    }
   }
 }
 
+void TcpConnection::closeAfterShutdown()
+{
+  TcpConnectionPtr guardThis(shared_from_this());
+  connectionCallback_(guardThis);
+  // must be the last line
+  closeCallback_(guardThis);
+}
+
 
 // void TcpConnection::shutdownAndForceCloseAfter(double seconds)
 // {
@@ -519,11 +998,17 @@ void TcpConnection::disableReadWrite(bool closeAfterDisable)
     LOG_ERROR << uv_strerror(err) << " in TcpConnection::disableReadWrite";
   }
 
-  ShutdownRequest *shutdownReq = new ShutdownRequest;
-  shutdownReq->conn = shared_from_this();
-  shutdownReq->req.data = shutdownReq;
   isClosing_ = closeAfterDisable;
-  socket_->shutdownWrite(&shutdownReq->req, &TcpConnection::shutdownCallback);
+  if (!writeShutdown_)
+  {
+    shutdownWrite();
+  }
+  else if (!shutdownPending_ && closeAfterDisable)
+  {
+    // the write side went down in shutdown() already, the peer has
+    // closed too; a second uv_shutdown() would fail with ENOTCONN
+    closeAfterShutdown();
+  }
 }
 
 void TcpConnection::connectDestroyed()
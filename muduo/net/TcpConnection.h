@@ -36,6 +36,7 @@ namespace net
 class EventLoop;
 class TcpSocket;
 class OutputBuffer;
+class FileQueue;
 
 ///
 /// TCP connection, for both client and server usage.
@@ -69,6 +70,13 @@ class TcpConnection : boost::noncopyable,
   void send(const StringPiece& message);
   // void send(Buffer&& message); // C++11
   void send(Buffer* message);  // this one will swap data
+  /// Sends blob without copying it, a reference is held until it is written.
+  void send(const boost::shared_ptr<const string>& blob);
+  /// Sends length bytes of file from offset, in order with the data sent
+  /// before and after.  Uses sendfile(2) on Linux, reads into the output
+  /// buffer elsewhere.
+  /// Takes ownership of file, it is closed when done.
+  void sendFile(int file, int64_t offset, int64_t length);
   void shutdown(); // NOT thread safe, no simultaneous calling
   // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no simultaneous calling
   void forceClose();
@@ -103,6 +111,15 @@ class TcpConnection : boost::noncopyable,
   //Buffer* outputBuffer()
   //{ return &outputBuffer_; }
 
+  /// Advanced interface, in the loop thread only.
+  /// Room for len bytes at the end of the output, so a message can be
+  /// written in place rather than copied in by send().  Fill it, then pass
+  /// the bytes used to commitOutput() before anything else is sent.
+  /// Returns NULL if the connection is not connected or a sendFile() is
+  /// under way, use send() then.
+  char* reserveOutput(size_t len);
+  void commitOutput(size_t len);
+
   /// Internal use only.
   void setCloseCallback(const CloseCallback& cb)
   { closeCallback_ = cb; }
@@ -120,6 +137,7 @@ class TcpConnection : boost::noncopyable,
     boost::weak_ptr<TcpConnection> conn;
     uv_write_t req;
     uv_buf_t buf;
+    boost::shared_ptr<const string> blob;  // not in outputBuffer_ if set
   } WriteRequest;
 
   typedef struct ShutdownRequest
@@ -132,14 +150,30 @@ class TcpConnection : boost::noncopyable,
   static void readCallback(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf);
   static void writeCallback(uv_write_t *handle, int status);
   static void shutdownCallback(uv_shutdown_t *req, int status);
+  static void sendfileWork(uv_work_t *req);
+  static void sendfileCallback(uv_work_t *req, int status);
+  static void readFileCallback(uv_fs_t *req);
 
   void disableReadWrite(bool closeAfterDisable);
+  void shutdownWrite();
+  void closeAfterShutdown();
   void handleRead(Timestamp receiveTime);
   void handleClose();
   void handleError(int err);
   // void sendInLoop(string&& message);
   void sendInLoop(const StringPiece& message);
   void sendInLoop(const void* message, size_t len);
+  void sendBlobInLoop(const boost::shared_ptr<const string>& blob);
+  void writeInLoop(const void* message, size_t len,
+                   const boost::shared_ptr<const string>& blob);
+  size_t tryWriteInLoop(const void* data, size_t len, bool* faultError);
+  void startWrite(WriteRequest* writeReq);
+  void sendFileInLoop(int file, int64_t offset, int64_t length);
+  void startFileIfReady();
+  void continueFile();
+  void readFileChunk();
+  void handleFileResult(ssize_t result, bool sentfile);
+  void finishFile();
   void shutdownInLoop();
   // void shutdownAndForceCloseInLoop(double seconds);
   void forceCloseInLoop();
@@ -167,8 +201,12 @@ class TcpConnection : boost::noncopyable,
   Buffer inputBuffer_;
   std::list<WriteRequest*> freeWriteReqList_;
   boost::scoped_ptr<OutputBuffer> outputBuffer_;
+  int pendingWrites_;  // uv_write()s not called back yet
+  boost::scoped_ptr<FileQueue> files_;
   boost::any context_;
   bool isClosing_;
+  bool shutdownPending_;
+  bool writeShutdown_;
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
 };
@@ -189,6 +227,7 @@ TcpConnection::WriteRequest* TcpConnection::getFreeWriteReq()
 
 void TcpConnection::releaseWriteReq( WriteRequest *req )
 {
+  req->blob.reset();
   freeWriteReqList_.push_back(req);
 }
 
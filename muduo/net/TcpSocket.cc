@@ -140,13 +140,9 @@ int TcpSocket::accept( uv_tcp_t *client, InetAddress* peeraddr )
   return err;
 }
 
-void TcpSocket::shutdownWrite(uv_shutdown_t *req, uv_shutdown_cb cb)
+int TcpSocket::shutdownWrite(uv_shutdown_t *req, uv_shutdown_cb cb)
 {
-  int err = uv_shutdown(req, reinterpret_cast<uv_stream_t*>(socket_), cb);
-  if (err) 
-  {
-    LOG_SYSFATAL << uv_strerror(err) << " in Socket::shutdownWrite";
-  }
+  return uv_shutdown(req, reinterpret_cast<uv_stream_t*>(socket_), cb);
 }
 
 void TcpSocket::setTcpNoDelay(bool on)
@@ -67,7 +67,8 @@ class TcpSocket : boost::noncopyable
   /// WARNING: client must be initialized before this function called
   int accept(uv_tcp_t *client, InetAddress* peeraddr);
 
-  void shutdownWrite(uv_shutdown_t *req, uv_shutdown_cb cb);
+  /// Returns a UV_E* error, cb is not called then.
+  int shutdownWrite(uv_shutdown_t *req, uv_shutdown_cb cb);
 
   void setSimultaneousAccept(bool on);
 
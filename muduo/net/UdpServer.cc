@@ -17,7 +17,10 @@ UdpServer::UdpServer(EventLoop* loop,
     hostport_(listenAddr.toIpPort()),
     name_(nameArg),
     socket_(new UdpSocket(loop, listenAddr, option == kReuseAddr)),
-    messageCallback_(defaultUdpMessageCallback)
+    messageCallback_(defaultUdpMessageCallback),
+    batchDatagrams_(0),
+    batchDatagramSize_(2048),
+    gro_(false)
 {
 }
 
@@ -36,6 +39,13 @@ void UdpServer::start()
     socket_->setWriteCompleteCallback(writeCompleteCallback_);
     socket_->setHighWatermarkCallback(highWaterMarkCallback_);
     socket_->setStartedRecvCallback(startedRecvCallback_);
+    socket_->setBatchMessageCallback(batchMessageCallback_);
+    socket_->setBatching(batchDatagrams_, batchDatagramSize_);
+    socket_->setSegmentMessageCallback(segmentMessageCallback_);
+    if (gro_)
+    {
+      socket_->setGro(true);
+    }
     loop_->runInLoop(boost::bind(&UdpSocket::startRecv, get_pointer(socket_)));
   }
 }
@@ -80,6 +80,33 @@ class UdpServer : boost::noncopyable
   void setStartedRecvCallback(UdpStartedRecvCallback&& cb)
   { startedRecvCallback_ = std::move(cb); }
 
+  /// Batched I/O of the socket, see UdpSocket::setBatching().
+  /// Not thread safe, before start().
+  void setBatching(int maxDatagrams, size_t maxDatagramSize = 2048)
+  { batchDatagrams_ = maxDatagrams; batchDatagramSize_ = maxDatagramSize; }
+
+  /// Set batch message callback, for batched I/O.
+  /// Not thread safe.
+  void setBatchMessageCallback(const UdpBatchMessageCallback& cb)
+  { batchMessageCallback_ = cb; }
+
+  void setBatchMessageCallback(UdpBatchMessageCallback&& cb)
+  { batchMessageCallback_ = std::move(cb); }
+
+  /// Receive offload of the socket, see UdpSocket::setGro().  Where it is
+  /// not supported datagrams go to the message callback.
+  /// Not thread safe, before start().
+  void setGro(bool on)
+  { gro_ = on; }
+
+  /// Set segment message callback, for receive offload.
+  /// Not thread safe.
+  void setSegmentMessageCallback(const UdpSegmentMessageCallback& cb)
+  { segmentMessageCallback_ = cb; }
+
+  void setSegmentMessageCallback(UdpSegmentMessageCallback&& cb)
+  { segmentMessageCallback_ = std::move(cb); }
+
  private:
   EventLoop* loop_;  // the acceptor loop
   const string hostport_;
@@ -89,6 +116,11 @@ class UdpServer : boost::noncopyable
   UdpWriteCompleteCallback writeCompleteCallback_;
   UdpHighWaterMarkCallback highWaterMarkCallback_;
   UdpStartedRecvCallback startedRecvCallback_;
+  UdpBatchMessageCallback batchMessageCallback_;
+  UdpSegmentMessageCallback segmentMessageCallback_;
+  int batchDatagrams_;
+  size_t batchDatagramSize_;
+  bool gro_;
   AtomicInt32 started_;
 };
 
@@ -6,9 +6,153 @@
 
 #include <boost/bind.hpp>
 
+#include <algorithm>
+#include <vector>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+  const size_t kMaxSegments = 64;      // UDP_MAX_SEGMENTS
+  const size_t kMaxGsoBytes = 65507;   // of IPv4
+  const int kMaxGroReads = 32;         // per poll, as libuv reads
+
+#if defined(__linux__)
+  socklen_t sockaddrLength(const InetAddress& addr)
+  {
+    return addr.sa_family() == AF_INET6 ? static_cast<socklen_t>(sizeof(struct sockaddr_in6))
+                                        : static_cast<socklen_t>(sizeof(struct sockaddr_in));
+  }
+#endif
+}
+
+#if defined(__linux__)
+// The vectors of recvmmsg(2) and sendmmsg(2), set up once.
+struct UdpSocket::Batch : boost::noncopyable
+{
+  struct Outgoing
+  {
+    size_t offset;  // in sendBuf
+    size_t len;
+    InetAddress addr;
+    int messageId;
+  };
+
+  Batch(int maxDatagramsArg, size_t maxDatagramSize)
+    : maxDatagrams(maxDatagramsArg),
+      slotSize(maxDatagramSize),
+      recvBuf(static_cast<size_t>(maxDatagramsArg - 1) * maxDatagramSize),
+      recvMsgs(maxDatagramsArg - 1),
+      recvIovs(maxDatagramsArg - 1),
+      recvAddrs(maxDatagramsArg - 1),
+      flushQueued(false)
+  {
+    for (size_t i = 0; i < recvMsgs.size(); ++i)
+    {
+      recvIovs[i].iov_base = &recvBuf[i * slotSize];
+      recvIovs[i].iov_len = slotSize;
+      struct msghdr& hdr = recvMsgs[i].msg_hdr;
+      memset(&hdr, 0, sizeof hdr);
+      hdr.msg_name = &recvAddrs[i];
+      hdr.msg_iov = &recvIovs[i];
+      hdr.msg_iovlen = 1;
+    }
+  }
+
+  // up to maxDatagrams - 1 waiting datagrams, 0 for none
+  int receive(int fd)
+  {
+    if (recvMsgs.empty())
+    {
+      return 0;
+    }
+    for (size_t i = 0; i < recvMsgs.size(); ++i)
+    {
+      recvMsgs[i].msg_hdr.msg_namelen = sizeof recvAddrs[i];
+    }
+    int n = 0;
+    do
+    {
+      n = ::recvmmsg(fd, &recvMsgs[0], static_cast<unsigned int>(recvMsgs.size()),
+                     MSG_DONTWAIT, NULL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        LOG_SYSERR << uv_strerror(uv_translate_sys_error(errno)) << " in UdpSocket::receiveBatch";
+      }
+      n = 0;
+    }
+    return n;
+  }
+
+  // the outgoing datagrams [first, end) written, error of the first if none
+  int send(int fd, size_t first, int* err)
+  {
+    size_t n = outgoing.size() - first;
+    sendMsgs.resize(n);
+    sendIovs.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      const Outgoing& out = outgoing[first + i];
+      sendIovs[i].iov_base = const_cast<char*>(sendBuf.peek() + out.offset);
+      sendIovs[i].iov_len = out.len;
+      struct msghdr& hdr = sendMsgs[i].msg_hdr;
+      memset(&hdr, 0, sizeof hdr);
+      hdr.msg_name = const_cast<struct sockaddr*>(&out.addr.getSockAddr());
+      hdr.msg_namelen = sockaddrLength(out.addr);
+      hdr.msg_iov = &sendIovs[i];
+      hdr.msg_iovlen = 1;
+    }
+    int sent = 0;
+    do
+    {
+      sent = ::sendmmsg(fd, &sendMsgs[0], static_cast<unsigned int>(n), MSG_DONTWAIT);
+    } while (sent < 0 && errno == EINTR);
+    *err = sent < 0 ? errno : 0;
+    return sent < 0 ? 0 : sent;
+  }
+
+  const int maxDatagrams;
+  const size_t slotSize;
+
+  std::vector<char> recvBuf;
+  std::vector<struct mmsghdr> recvMsgs;
+  std::vector<struct iovec> recvIovs;
+  std::vector<struct sa> recvAddrs;
+  std::vector<UdpDatagram> datagrams;
+
+  Buffer sendBuf;
+  std::vector<Outgoing> outgoing;
+  std::vector<struct mmsghdr> sendMsgs;
+  std::vector<struct iovec> sendIovs;
+  bool flushQueued;
+};
+#else
+struct UdpSocket::Batch
+{
+};
+#endif
+
+// Polls a dup(2) of the socket, so that the segment size comes with what
+// is read: recvmsg(2) of libuv takes no control messages.
+struct UdpSocket::GroReader : boost::noncopyable
+{
+  uv_poll_t poll;
+  int fd;
+  UdpSocket* owner;  // NULL once closing
+};
+
 
 void muduo::net::defaultUdpMessageCallback(const UdpSocketPtr& socket, 
                                            Buffer* buffer, 
@@ -24,7 +168,10 @@ UdpSocket::UdpSocket(EventLoop* loop)
     bytesInSend_(0),
     highWaterMark_(64*1024*1024),
     connectModel_(false),
-    receiving_(false)
+    receiving_(false),
+    gso_(true),
+    gro_(false),
+    groReader_(NULL)
 {
   socket_ = loop_->getFreeUdpSocket();
   socket_->data = this;
@@ -36,7 +183,10 @@ UdpSocket::UdpSocket( EventLoop* loop, const InetAddress& bindAddr, bool reuseAd
     bytesInSend_(0),
     highWaterMark_(64*1024*1024),
     connectModel_(false),
-    receiving_(false)
+    receiving_(false),
+    gso_(true),
+    gro_(false),
+    groReader_(NULL)
 {
   socket_ = loop_->getFreeUdpSocket();
   socket_->data = this;
@@ -47,6 +197,11 @@ UdpSocket::~UdpSocket()
 {
   socket_->data = nullptr;
   //stopRecv();
+  if (groReader_)
+  {
+    groReader_->owner = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(&groReader_->poll), &UdpSocket::groCloseCallback);
+  }
   loop_->closeSocketInLoop(socket_);
   releaseAllSendReq();
 }
@@ -146,6 +301,29 @@ int UdpSocket::send(const InetAddress& addr, Buffer* buf)
   return messageId;
 }
 
+int UdpSocket::sendSegments(const InetAddress& addr,
+                            const StringPiece& message,
+                            size_t segmentSize)
+{
+  assert(segmentSize > 0);
+  int messageId = messageId_.incrementAndGet();
+  if (loop_->isInLoopThread())
+  {
+    sendSegmentsInLoop(messageId, addr, message, segmentSize);
+  }
+  else
+  {
+    loop_->runInLoop(
+      boost::bind(&UdpSocket::sendSegmentsInLoop,
+                  this, // FIXME
+                  messageId,
+                  InetAddress(addr),
+                  message.as_string(),
+                  segmentSize));
+  }
+  return messageId;
+}
+
 void UdpSocket::sendInLoop(int messageId, const InetAddress& addr, const StringPiece& message)
 {
   sendInLoop(messageId, addr, message.data(), message.size());
@@ -154,6 +332,18 @@ void UdpSocket::sendInLoop(int messageId, const InetAddress& addr, const StringP
 void UdpSocket::sendInLoop(int messageId, const InetAddress& addr, const void* data, size_t len)
 {
   loop_->assertInLoopThread();
+  if (batch_)
+  {
+    queueSend(messageId, addr, data, len);
+  }
+  else
+  {
+    sendOne(messageId, addr, data, len);
+  }
+}
+
+void UdpSocket::sendOne(int messageId, const InetAddress& addr, const void* data, size_t len)
+{
   uv_buf_t buf = uv_buf_init(static_cast<char*>(const_cast<void*>(data)), static_cast<unsigned int>(len));
   ssize_t nwrite = uv_udp_try_send(socket_, &buf, 1, &addr.getSockAddr());
   bool faultError = false;
@@ -163,7 +353,7 @@ void UdpSocket::sendInLoop(int messageId, const InetAddress& addr, const void* d
     {
       LOG_ERROR << "UDP data send truncated: " << len << "B to " << nwrite << "B";
     }
-    if (writeCompleteCallback_)
+    if (writeCompleteCallback_ && messageId)
     {
       loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this(), messageId));
     }
@@ -209,6 +399,208 @@ void UdpSocket::sendInLoop(int messageId, const InetAddress& addr, const void* d
   }
 }
 
+void UdpSocket::setBatching(int maxDatagrams, size_t maxDatagramSize)
+{
+  assert(!receiving_);
+  assert(0 <= maxDatagrams && maxDatagrams <= kMaxBatch);
+  assert(maxDatagramSize > 0);
+#if defined(__linux__)
+  assert(!batch_ || !batch_->flushQueued);
+  batch_.reset(maxDatagrams > 0 ? new Batch(maxDatagrams, maxDatagramSize) : NULL);
+#else
+  if (maxDatagrams > 0)
+  {
+    LOG_WARN << "UdpSocket::setBatching - no recvmmsg/sendmmsg, one datagram at a time";
+  }
+#endif
+}
+
+int UdpSocket::batching() const
+{
+#if defined(__linux__)
+  return batch_ ? batch_->maxDatagrams : 0;
+#else
+  return 0;
+#endif
+}
+
+void UdpSocket::queueSend(int messageId, const InetAddress& addr, const void* data, size_t len)
+{
+#if defined(__linux__)
+  Batch* batch = get_pointer(batch_);
+  if (batch->outgoing.size() >= static_cast<size_t>(batch->maxDatagrams))
+  {
+    flushSends();
+  }
+  Batch::Outgoing out = { batch->sendBuf.readableBytes(), len, addr, messageId };
+  batch->sendBuf.append(data, len);
+  batch->outgoing.push_back(out);
+  if (!batch->flushQueued)
+  {
+    // after the callbacks of this iteration, with what they sent
+    batch->flushQueued = true;
+    loop_->queueInLoop(boost::bind(&UdpSocket::flushSends, shared_from_this()));
+  }
+#endif
+}
+
+void UdpSocket::flushSends()
+{
+#if defined(__linux__)
+  loop_->assertInLoopThread();
+  Batch* batch = get_pointer(batch_);
+  if (batch == NULL)
+  {
+    return;
+  }
+  batch->flushQueued = false;
+  const size_t n = batch->outgoing.size();
+  size_t next = 0;
+  uv_os_fd_t fd = -1;
+  // Not while some wait in libuv, so that datagrams keep their order.
+  // There is no fd before the first send binds the socket.
+  if (bytesInSend_ == 0 &&
+      uv_fileno(reinterpret_cast<uv_handle_t*>(socket_), &fd) == 0)
+  {
+    while (next < n)
+    {
+      int err = 0;
+      size_t sent = static_cast<size_t>(batch->send(fd, next, &err));
+      if (writeCompleteCallback_)
+      {
+        for (size_t i = next; i < next + sent; ++i)
+        {
+          loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this(),
+                                         batch->outgoing[i].messageId));
+        }
+      }
+      next += sent;
+      if (err == EAGAIN || err == EWOULDBLOCK || (err == 0 && sent == 0))
+      {
+        break;
+      }
+      else if (err)
+      {
+        // the first one failed, it is dropped as uv_udp_try_send() would
+        LOG_SYSERR << uv_strerror(uv_translate_sys_error(err)) << " in UdpSocket::flushSends";
+        ++next;
+      }
+    }
+  }
+  // the rest wait in libuv
+  for (size_t i = next; i < n; ++i)
+  {
+    const Batch::Outgoing& out = batch->outgoing[i];
+    sendOne(out.messageId, out.addr, batch->sendBuf.peek() + out.offset, out.len);
+  }
+  batch->outgoing.clear();
+  batch->sendBuf.retrieveAll();
+#endif
+}
+
+void UdpSocket::sendSegmentsInLoop(int messageId,
+                                   const InetAddress& addr,
+                                   const StringPiece& message,
+                                   size_t segmentSize)
+{
+  loop_->assertInLoopThread();
+  const char* data = message.data();
+  const size_t len = static_cast<size_t>(message.size());
+  if (len <= segmentSize)
+  {
+    sendInLoop(messageId, addr, data, len);
+    return;
+  }
+  if (batch_)
+  {
+    // those queued go first
+    flushSends();
+  }
+  size_t offset = 0;
+  if (gso_ && bytesInSend_ == 0)
+  {
+    offset = sendGso(addr, data, len, segmentSize);
+    if (offset == len && writeCompleteCallback_)
+    {
+      loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this(), messageId));
+    }
+  }
+  // the rest one by one, the last one completes the message
+  while (offset < len)
+  {
+    size_t n = std::min(segmentSize, len - offset);
+    sendOne(offset + n < len ? 0 : messageId, addr, data + offset, n);
+    offset += n;
+  }
+}
+
+// Bytes of data written with UDP_SEGMENT, up to where the socket would block.
+size_t UdpSocket::sendGso(const InetAddress& addr, const char* data, size_t len, size_t segmentSize)
+{
+  size_t offset = 0;
+#if defined(UDP_SEGMENT)
+  uv_os_fd_t fd = -1;
+  const size_t perCall = std::min(kMaxSegments, kMaxGsoBytes / segmentSize) * segmentSize;
+  if (perCall == 0 || uv_fileno(reinterpret_cast<uv_handle_t*>(socket_), &fd) != 0)
+  {
+    return 0;
+  }
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  while (offset < len)
+  {
+    size_t chunk = std::min(len - offset, perCall);
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data + offset);
+    iov.iov_len = chunk;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.msg_name = const_cast<struct sockaddr*>(&addr.getSockAddr());
+    hdr.msg_namelen = sockaddrLength(addr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    if (chunk > segmentSize)
+    {
+      memset(control, 0, sizeof control);
+      hdr.msg_control = control;
+      hdr.msg_controllen = sizeof control;
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t size = static_cast<uint16_t>(segmentSize);
+      memcpy(CMSG_DATA(cmsg), &size, sizeof size);
+    }
+    ssize_t n = 0;
+    do
+    {
+      n = ::sendmsg(fd, &hdr, MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+      int err = errno;
+      if (err == EIO || err == ENOPROTOOPT || err == EOPNOTSUPP)
+      {
+        // no checksum offload on the way out, or an old kernel
+        LOG_WARN << uv_strerror(uv_translate_sys_error(err))
+                 << " in UdpSocket::sendGso, datagrams go one by one from now on";
+        gso_ = false;
+      }
+      else if (err != EAGAIN && err != EWOULDBLOCK && err != EINVAL)
+      {
+        // dropped, as uv_udp_try_send() would
+        LOG_SYSERR << uv_strerror(uv_translate_sys_error(err)) << " in UdpSocket::sendGso";
+        offset += chunk;
+        continue;
+      }
+      // EINVAL for segments larger than the path takes, one by one then
+      break;
+    }
+    offset += chunk;
+  }
+#endif
+  return offset;
+}
+
 void UdpSocket::sendCallback( uv_udp_send_t *req, int status )
 {
   assert(req->data);
@@ -224,7 +616,7 @@ void UdpSocket::sendCallback( uv_udp_send_t *req, int status )
   {
     socket->bytesInSend_ -= sendRequest->buf.readableBytes();
     sendRequest->buf.retrieveAll();
-    if (socket->writeCompleteCallback_)
+    if (socket->writeCompleteCallback_ && sendRequest->messageId)
     {
       socket->loop_->queueInLoop(
         boost::bind(socket->writeCompleteCallback_, socket, sendRequest->messageId));
@@ -243,8 +635,16 @@ void UdpSocket::startRecv()
   loop_->assertInLoopThread();
   if (!receiving_)
   {
-    int err = uv_udp_recv_start(
-      socket_, &UdpSocket::allocCallback, &UdpSocket::recvCallback);
+    int err = 0;
+    if (gro_)
+    {
+      err = startGroReader();
+    }
+    else
+    {
+      err = uv_udp_recv_start(
+        socket_, &UdpSocket::allocCallback, &UdpSocket::recvCallback);
+    }
     if (err && err != UV_EALREADY)
     {
       LOG_SYSFATAL << uv_strerror(err) << " in UdpSocket::startRecv";
@@ -260,7 +660,7 @@ void UdpSocket::startRecv()
 void UdpSocket::stopRecv()
 {
   loop_->assertInLoopThread();
-  int err = uv_udp_recv_stop(socket_);
+  int err = groReader_ ? uv_poll_stop(&groReader_->poll) : uv_udp_recv_stop(socket_);
   if (err)
   {
     LOG_SYSFATAL << uv_strerror(err) << " in UdpSocket::stopRecv";
@@ -268,6 +668,174 @@ void UdpSocket::stopRecv()
   receiving_ = false;
 }
 
+bool UdpSocket::setGro(bool on)
+{
+  assert(!receiving_);
+  int err = UV_ENOTSUP;
+#if defined(UDP_GRO)
+  uv_os_fd_t fd = -1;
+  err = uv_fileno(reinterpret_cast<uv_handle_t*>(socket_), &fd);
+  int optval = on ? 1 : 0;
+  if (err == 0 && ::setsockopt(fd, SOL_UDP, UDP_GRO, &optval, sizeof optval) < 0)
+  {
+    err = uv_translate_sys_error(errno);
+  }
+#endif
+  if (err)
+  {
+    LOG_WARN << uv_strerror(err) << " in UdpSocket::setGro";
+    gro_ = false;
+    return !on;
+  }
+  gro_ = on;
+  return true;
+}
+
+int UdpSocket::startGroReader()
+{
+  int err = UV_ENOTSUP;
+#if defined(UDP_GRO)
+  if (groReader_ == NULL)
+  {
+    uv_os_fd_t fd = -1;
+    err = uv_fileno(reinterpret_cast<uv_handle_t*>(socket_), &fd);
+    int dupFd = err ? -1 : ::dup(fd);
+    if (err == 0 && dupFd < 0)
+    {
+      err = uv_translate_sys_error(errno);
+    }
+    if (err)
+    {
+      return err;
+    }
+    groReader_ = new GroReader;
+    groReader_->fd = dupFd;
+    groReader_->owner = this;
+    groReader_->poll.data = groReader_;
+    err = uv_poll_init(loop_->getUVLoop(), &groReader_->poll, dupFd);
+    if (err)
+    {
+      ::close(dupFd);
+      delete groReader_;
+      groReader_ = NULL;
+      return err;
+    }
+  }
+  err = uv_poll_start(&groReader_->poll, UV_READABLE, &UdpSocket::groCallback);
+#endif
+  return err;
+}
+
+void UdpSocket::groCallback(uv_poll_t* handle, int status, int events)
+{
+  assert(handle->data);
+  GroReader* reader = static_cast<GroReader*>(handle->data);
+  if (reader->owner == NULL)
+  {
+    return;
+  }
+  if (status < 0)
+  {
+    LOG_SYSERR << uv_strerror(status) << " in UdpSocket::groCallback";
+    return;
+  }
+  reader->owner->receiveGro(reader->fd);
+}
+
+void UdpSocket::groCloseCallback(uv_handle_t* handle)
+{
+  GroReader* reader = static_cast<GroReader*>(handle->data);
+#if defined(UDP_GRO)
+  ::close(reader->fd);
+#endif
+  delete reader;
+}
+
+// Each read is one datagram, or datagrams of a flow coalesced, with the
+// size of their segments in a control message.
+void UdpSocket::receiveGro(int fd)
+{
+#if defined(UDP_GRO)
+  UdpSocketPtr guardThis(shared_from_this());
+  Timestamp receiveTime = loop_->pollReturnTime();
+  const size_t kMaxRead = 65536;
+  Buffer segment;
+  for (int i = 0; i < kMaxGroReads && receiving_; ++i)
+  {
+    assert(inputBuffer_.readableBytes() == 0);
+    inputBuffer_.ensureWritableBytes(kMaxRead);
+    struct iovec iov;
+    iov.iov_base = inputBuffer_.beginWrite();
+    iov.iov_len = kMaxRead;
+    struct sa srcAddr;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.msg_name = &srcAddr;
+    hdr.msg_namelen = sizeof srcAddr;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof control;
+    ssize_t n = 0;
+    do
+    {
+      n = ::recvmsg(fd, &hdr, MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        LOG_SYSERR << uv_strerror(uv_translate_sys_error(errno)) << " in UdpSocket::receiveGro";
+      }
+      break;
+    }
+    if (hdr.msg_flags & MSG_TRUNC)
+    {
+      LOG_ERROR << "Input buffer is no big enough to hold the UDP package in UdpSocket::receiveGro";
+    }
+    size_t segmentSize = static_cast<size_t>(n);
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+      {
+        int size = 0;
+        memcpy(&size, CMSG_DATA(cmsg), sizeof size);
+        segmentSize = static_cast<size_t>(size);
+      }
+    }
+    InetAddress srcAddress(srcAddr);
+    if (connectModel_ && peerAddr_ != srcAddress)
+    {
+      LOG_INFO << "Ignore UDP data from " << srcAddress.toIpPort();
+      continue;
+    }
+    inputBuffer_.hasWritten(static_cast<size_t>(n));
+    if (segmentMessageCallback_)
+    {
+      segmentMessageCallback_(guardThis, &inputBuffer_, segmentSize, srcAddress, receiveTime);
+    }
+    else if (inputBuffer_.readableBytes() <= segmentSize)
+    {
+      messageCallback_(guardThis, &inputBuffer_, srcAddress, receiveTime);
+    }
+    else
+    {
+      // cut back into the datagrams sent, one by one
+      while (inputBuffer_.readableBytes() > 0)
+      {
+        size_t len = std::min(segmentSize, inputBuffer_.readableBytes());
+        segment.retrieveAll();
+        segment.append(inputBuffer_.peek(), len);
+        inputBuffer_.retrieve(len);
+        messageCallback_(guardThis, &segment, srcAddress, receiveTime);
+      }
+    }
+    inputBuffer_.retrieveAll();
+  }
+#endif
+}
+
 void UdpSocket::allocCallback( uv_handle_t *handle, size_t suggestedSize, uv_buf_t *buf )
 {
   assert(handle->data);
@@ -307,12 +875,24 @@ void UdpSocket::recvCallback(uv_udp_t *handle,
     else
     {
       InetAddress srcAddress(*src);
-      if (socket->connectModel_ && socket->peerAddr_ != srcAddress)
+      bool ignored = socket->connectModel_ && socket->peerAddr_ != srcAddress;
+      if (ignored)
       {
         LOG_INFO << "Ignore UDP data from " << srcAddress.toIpPort();
+      }
+      else
+      {
+        socket->inputBuffer_.hasWritten(nread);
+      }
+      if (socket->batch_)
+      {
+        socket->receiveBatch(srcAddress, !ignored);
+        return;
+      }
+      else if (ignored)
+      {
         return;
       }
-      socket->inputBuffer_.hasWritten(nread);
       socket->messageCallback_(
         socket->shared_from_this(),
         &socket->inputBuffer_, 
@@ -322,6 +902,72 @@ void UdpSocket::recvCallback(uv_udp_t *handle,
   }
 }
 
+// The first datagram is in inputBuffer_ if kept, those waiting behind it
+// are read with one recvmmsg(2).
+void UdpSocket::receiveBatch(const InetAddress& firstAddr, bool keepFirst)
+{
+#if defined(__linux__)
+  Batch* batch = get_pointer(batch_);
+  UdpSocketPtr guardThis(shared_from_this());
+  Timestamp receiveTime = loop_->pollReturnTime();
+  batch->datagrams.clear();
+  if (keepFirst)
+  {
+    if (batchMessageCallback_)
+    {
+      UdpDatagram first = { StringPiece(inputBuffer_.peek(),
+                                        static_cast<int>(inputBuffer_.readableBytes())),
+                            firstAddr };
+      batch->datagrams.push_back(first);
+    }
+    else
+    {
+      messageCallback_(guardThis, &inputBuffer_, firstAddr, receiveTime);
+    }
+  }
+
+  uv_os_fd_t fd = -1;
+  int n = 0;
+  if (uv_fileno(reinterpret_cast<uv_handle_t*>(socket_), &fd) == 0)
+  {
+    n = batch->receive(fd);
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    const struct mmsghdr& msg = batch->recvMsgs[i];
+    if (msg.msg_hdr.msg_flags & MSG_TRUNC)
+    {
+      LOG_ERROR << "Batch slot of " << batch->slotSize
+                << "B is not big enough to hold the UDP package in UdpSocket::receiveBatch";
+    }
+    InetAddress srcAddress(batch->recvAddrs[i]);
+    if (connectModel_ && peerAddr_ != srcAddress)
+    {
+      LOG_INFO << "Ignore UDP data from " << srcAddress.toIpPort();
+      continue;
+    }
+    StringPiece data(&batch->recvBuf[i * batch->slotSize], static_cast<int>(msg.msg_len));
+    if (batchMessageCallback_)
+    {
+      UdpDatagram datagram = { data, srcAddress };
+      batch->datagrams.push_back(datagram);
+    }
+    else
+    {
+      inputBuffer_.retrieveAll();
+      inputBuffer_.append(data.data(), data.size());
+      messageCallback_(guardThis, &inputBuffer_, srcAddress, receiveTime);
+    }
+  }
+  if (!batch->datagrams.empty())
+  {
+    batchMessageCallback_(guardThis, &batch->datagrams[0],
+                          static_cast<int>(batch->datagrams.size()), receiveTime);
+  }
+  inputBuffer_.retrieveAll();
+#endif
+}
+
 void UdpSocket::setBroadcast( bool on )
 {
   int err = uv_udp_set_broadcast(socket_, on ? 1 : 0);
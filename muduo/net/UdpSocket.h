@@ -23,6 +23,13 @@ namespace net
 
 class EventLoop;
 
+/// A datagram of a batch, read into the buffers of its UdpSocket.
+struct UdpDatagram
+{
+  StringPiece data;
+  InetAddress peerAddr;
+};
+
 ///
 /// TCP server, supports single-threaded and thread-pool models.
 ///
@@ -61,6 +68,12 @@ class UdpSocket : boost::noncopyable,
   // void send(const InetAddress& peerAddr, Buffer&& message); // C++11
   int send(const InetAddress& addr, Buffer* message);  // this one will swap data
 
+  /// Generic segmentation offload, Linux 4.18 and later: message is cut by
+  /// the kernel into datagrams of segmentSize bytes, the last one may be
+  /// shorter, with one system call per 64 of them.  Where UDP_SEGMENT is
+  /// not supported, or the socket would block, they go one by one.
+  int sendSegments(const InetAddress& addr, const StringPiece& message, size_t segmentSize);
+
   // TODO(cbj): add multicast
   void setBroadcast(bool on);
   void setMulticastLoop(bool on);
@@ -86,6 +99,38 @@ class UdpSocket : boost::noncopyable,
   void setStartedRecvCallback(const UdpStartedRecvCallback& cb)
   { startedRecvCallback_ = cb; }
 
+  /// Batched I/O, Linux only: after each datagram libuv reads, up to
+  /// maxDatagrams - 1 more are read with one recvmmsg(2), into slots of
+  /// maxDatagramSize bytes, larger ones are truncated.  They go to the
+  /// batch message callback at once, or one by one to the message callback
+  /// without one.  Datagrams sent are queued in the loop and written with
+  /// sendmmsg(2) once per iteration, up to maxDatagrams at a time, through
+  /// libuv as usual when the socket would block.  0 for one datagram at a
+  /// time, the default.
+  /// Not thread safe, before startRecv().
+  void setBatching(int maxDatagrams, size_t maxDatagramSize = 2048);
+  int batching() const;
+
+  /// Set batch message callback, for batched I/O.
+  /// Not thread safe.
+  void setBatchMessageCallback(const UdpBatchMessageCallback& cb)
+  { batchMessageCallback_ = cb; }
+
+  /// Generic receive offload, Linux 5.0 and later: datagrams of a flow are
+  /// read at once, up to 64KiB, and go to the segment message callback with
+  /// the size of their segments, or one by one to the message callback
+  /// without one.  Returns false where UDP_GRO is not supported, datagrams
+  /// then go to the message callback as usual.  Comes before batching for
+  /// receiving.
+  /// Not thread safe, on a bound socket, before startRecv().
+  bool setGro(bool on);
+  bool gro() const { return gro_; }
+
+  /// Set segment message callback, for receive offload.
+  /// Not thread safe.
+  void setSegmentMessageCallback(const UdpSegmentMessageCallback& cb)
+  { segmentMessageCallback_ = cb; }
+
   bool receiving() const { return receiving_; }
 
  private:
@@ -97,6 +142,10 @@ class UdpSocket : boost::noncopyable,
     int messageId;
   } SendRequest;
 
+  struct Batch;
+  struct GroReader;
+  static const int kMaxBatch = 1024;  // UIO_MAXIOV
+
   static void allocCallback(uv_handle_t *handle, size_t suggestedSize, uv_buf_t *buf);
   static void recvCallback(uv_udp_t *handle, 
                            ssize_t nread, 
@@ -109,6 +158,17 @@ class UdpSocket : boost::noncopyable,
 
   void sendInLoop(int messageId, const InetAddress &addr, const StringPiece& message);
   void sendInLoop(int messageId, const InetAddress &addr, const void* message, size_t len);
+  void sendOne(int messageId, const InetAddress &addr, const void* message, size_t len);
+  void queueSend(int messageId, const InetAddress &addr, const void* message, size_t len);
+  void flushSends();
+  void receiveBatch(const InetAddress& firstAddr, bool keepFirst);
+  void sendSegmentsInLoop(int messageId, const InetAddress& addr,
+                          const StringPiece& message, size_t segmentSize);
+  size_t sendGso(const InetAddress& addr, const char* data, size_t len, size_t segmentSize);
+  static void groCallback(uv_poll_t* handle, int status, int events);
+  static void groCloseCallback(uv_handle_t* handle);
+  int startGroReader();
+  void receiveGro(int fd);
 
   inline SendRequest* getFreeSendReq();
   inline void releaseSendReq(SendRequest *req);
@@ -119,6 +179,8 @@ class UdpSocket : boost::noncopyable,
   Buffer inputBuffer_;
   std::list<SendRequest*> freeSendReqList_;
   UdpMessageCallback messageCallback_;
+  UdpBatchMessageCallback batchMessageCallback_;
+  UdpSegmentMessageCallback segmentMessageCallback_;
   UdpWriteCompleteCallback writeCompleteCallback_;
   UdpStartedRecvCallback startedRecvCallback_;
   UdpHighWaterMarkCallback highWaterMarkCallback_;
@@ -128,6 +190,10 @@ class UdpSocket : boost::noncopyable,
   bool connectModel_;
   AtomicInt32 messageId_;
   bool receiving_;
+  boost::scoped_ptr<Batch> batch_;
+  bool gso_;                // until the kernel says otherwise
+  bool gro_;
+  GroReader* groReader_;    // closed by the loop
 };
 
 typedef boost::shared_ptr<UdpSocket> UdpSocketPtr;
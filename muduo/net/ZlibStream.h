@@ -49,13 +49,19 @@ class ZlibInputStream : boost::noncopyable
 class ZlibOutputStream : boost::noncopyable
 {
  public:
-  explicit ZlibOutputStream(Buffer* output)
+  // windowBits 15 writes the zlib format, 15+16 gzip, -15 raw deflate
+  explicit ZlibOutputStream(Buffer* output,
+                            int level = Z_DEFAULT_COMPRESSION,
+                            int windowBits = 15)
     : output_(output),
       zerror_(Z_OK),
-      bufferSize_(1024)
+      bufferSize_(1024),
+      live_(false)
   {
     bzero(&zstream_, sizeof zstream_);
-    zerror_ = deflateInit(&zstream_, Z_DEFAULT_COMPRESSION);
+    zerror_ = deflateInit2(&zstream_, level, Z_DEFLATED, windowBits,
+                           8, Z_DEFAULT_STRATEGY);
+    live_ = zerror_ == Z_OK;
   }
 
   ~ZlibOutputStream()
@@ -110,6 +116,19 @@ class ZlibOutputStream : boost::noncopyable
   }
 
   bool finish()
+  {
+    if (!live_)
+      return false;
+
+    bool ok = zerror_ == Z_STREAM_END || finishStream();
+    live_ = false;
+    ok = deflateEnd(&zstream_) == Z_OK && ok;
+    zerror_ = Z_STREAM_END;
+    return ok;
+  }
+
+  // Ends the stream like finish(), but keeps the state for reset().
+  bool finishStream()
   {
     if (zerror_ != Z_OK)
       return false;
@@ -118,10 +137,21 @@ class ZlibOutputStream : boost::noncopyable
     {
       zerror_ = compress(Z_FINISH);
     }
-    zerror_ = deflateEnd(&zstream_);
-    bool ok = zerror_ == Z_OK;
-    zerror_ = Z_STREAM_END;
-    return ok;
+    return zerror_ == Z_STREAM_END;
+  }
+
+  // Starts a new stream into output with the same level and format,
+  // deflateReset() reuses what deflateInit() allocated.
+  bool reset(Buffer* output)
+  {
+    if (!live_)
+      return false;
+
+    output_ = output;
+    zstream_.next_in = NULL;
+    zstream_.avail_in = 0;
+    zerror_ = deflateReset(&zstream_);
+    return zerror_ == Z_OK;
   }
 
  private:
@@ -143,6 +173,7 @@ class ZlibOutputStream : boost::noncopyable
   z_stream zstream_;
   int zerror_;
   int bufferSize_;
+  bool live_;  // deflateEnd() not called yet
 };
 
 }
@@ -0,0 +1,657 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpClient.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/http/HttpClientContext.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+const char kCRLF[] = "\r\n";
+const char kCRLFCRLF[] = "\r\n\r\n";
+// a status line and headers longer than this are rejected
+const size_t kMaxResponseHeaderBytes = 64*1024;
+
+// status line and headers, all in [begin, end), end points past the empty line
+bool processResponseHeaders(const char* begin, const char* end, HttpClientContext* context)
+{
+  const char* crlf = std::search(begin, end, kCRLF, kCRLF+2);
+  if (!context->receiveStatusLine(begin, crlf))
+  {
+    return false;
+  }
+  const char* start = crlf + 2;
+  while (start < end - 2)
+  {
+    crlf = std::search(start, end, kCRLF, kCRLF+2);
+    const char* colon = std::find(start, crlf, ':');
+    if (colon == crlf)
+    {
+      return false;
+    }
+    context->response().addHeader(start, colon, crlf);
+    start = crlf + 2;
+  }
+  return context->receiveHeaders();
+}
+
+// stops after one whole response, the next stays in buf
+// return false if any error
+bool parseResponse(Buffer* buf, HttpClientContext* context)
+{
+  bool ok = true;
+  bool hasMore = true;
+  while (hasMore)
+  {
+    if (context->expectStatusLine())
+    {
+      const char* start = buf->peek() + context->scanned();
+      const char* limit = buf->beginWrite();
+      const char* end = std::search(start, limit, kCRLFCRLF, kCRLFCRLF+4);
+      if (end == limit)
+      {
+        size_t readable = buf->readableBytes();
+        context->setScanned(readable > 3 ? readable - 3 : 0);
+        ok = readable <= kMaxResponseHeaderBytes;
+        hasMore = false;
+        continue;
+      }
+      end += 4;
+      ok = processResponseHeaders(buf->peek(), end, context);
+      buf->retrieveUntil(end);
+      context->setScanned(0);
+      hasMore = ok && !context->gotAll();
+    }
+    else if (context->expectBody() || context->expectClose())
+    {
+      size_t n = buf->readableBytes();
+      if (context->expectBody())
+      {
+        n = std::min(n, context->bodyRemaining());
+      }
+      if (n > 0)
+      {
+        context->receiveBody(buf->peek(), n);
+        buf->retrieve(n);
+        hasMore = !context->gotAll() && !context->expectClose();
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (context->expectChunkSize())
+    {
+      const char* crlf = buf->findCRLF();
+      if (crlf)
+      {
+        ok = context->receiveChunkSize(buf->peek(), crlf);
+        buf->retrieveUntil(crlf + 2);
+        hasMore = ok;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (context->expectChunkEnd())
+    {
+      if (buf->readableBytes() >= 2)
+      {
+        ok = buf->peek()[0] == '\r' && buf->peek()[1] == '\n';
+        buf->retrieve(2);
+        context->receiveChunkEnd();
+        hasMore = ok;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (context->expectTrailers())
+    {
+      // trailer fields are discarded
+      const char* crlf = buf->findCRLF();
+      if (crlf)
+      {
+        if (crlf == buf->peek())
+        {
+          context->receiveTrailers();
+          hasMore = false;
+        }
+        buf->retrieveUntil(crlf + 2);
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else
+    {
+      hasMore = false;
+    }
+  }
+  return ok;
+}
+
+}
+}
+}
+
+namespace
+{
+
+const double kCheckInterval = 0.1;
+// sent once more if the connection closes before the response
+const int kMaxAttempts = 2;
+
+const char* methodName(HttpRequest::Method method)
+{
+  switch (method)
+  {
+    case HttpRequest::kGet:
+      return "GET";
+    case HttpRequest::kPost:
+      return "POST";
+    case HttpRequest::kHead:
+      return "HEAD";
+    case HttpRequest::kPut:
+      return "PUT";
+    case HttpRequest::kDelete:
+      return "DELETE";
+    default:
+      return "GET";
+  }
+}
+
+bool idempotent(HttpRequest::Method method)
+{
+  return method != HttpRequest::kPost;
+}
+
+}
+
+struct HttpClient::Call
+{
+  HttpRequest::Method method;
+  string request;  // rendered
+  ResponseCallback cb;
+  Timestamp deadline;  // invalid for none
+  int attempts;
+};
+
+// One keep-alive connection of a host, with the calls sent on it.
+class HttpClient::Connection : boost::noncopyable
+{
+ public:
+  Connection(HttpClient* owner, Host* host, const string& name)
+    : owner_(owner),
+      host_(host),
+      client_(owner->loop_, host->server, name),
+      connected_(false),
+      closed_(false),
+      reusable_(true),
+      timedOut_(false),
+      started_(Timestamp::now()),
+      idleSince_(started_)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Connection::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&Connection::onMessage, this, _1, _2, _3));
+    client_.setConnectFailedCallback(
+        boost::bind(&Connection::onConnectFailed, this, _1));
+  }
+
+  ~Connection()
+  {
+    if (conn_)
+    {
+      // the connection may outlive us, in TcpClient's hands
+      conn_->setConnectionCallback(defaultConnectionCallback);
+      conn_->setMessageCallback(defaultMessageCallback);
+      conn_->forceClose();
+    }
+  }
+
+  // keeps a removed connection until the callback it runs from has returned
+  static void release(const ConnectionPtr&)
+  {
+  }
+
+  void connect()
+  {
+    client_.connect();
+  }
+
+  // calls in flight are handed back when the close is seen
+  void close()
+  {
+    reusable_ = false;
+    if (conn_)
+    {
+      conn_->forceClose();
+    }
+  }
+
+  bool connecting() const
+  { return !connected_ && !closed_; }
+
+  bool closed() const
+  { return closed_; }
+
+  size_t inFlight() const
+  { return inFlight_.size(); }
+
+  bool canTake(const Call& call, int depth) const
+  {
+    if (!connected_ || !reusable_)
+    {
+      return false;
+    }
+    return inFlight_.empty()
+        || (static_cast<int>(inFlight_.size()) < depth
+            && idempotent(call.method)
+            && idempotent(inFlight_.back()->method));
+  }
+
+  void send(const CallPtr& call)
+  {
+    assert(conn_);
+    if (inFlight_.empty())
+    {
+      context_.reset(call->method == HttpRequest::kHead);
+    }
+    ++call->attempts;
+    inFlight_.push_back(call);
+    conn_->send(call->request);
+  }
+
+  // for the timer, returns false if the connection is to be dropped now
+  bool check(Timestamp now, double connectTimeout, double idleTimeout)
+  {
+    if (connecting())
+    {
+      return connectTimeout <= 0 || timeDifference(now, started_) < connectTimeout;
+    }
+    if (!inFlight_.empty())
+    {
+      Timestamp deadline = inFlight_.front()->deadline;
+      if (deadline.valid() && deadline < now)
+      {
+        // the calls pipelined behind it come back on close, and what is
+        // left of its response must not pass for the next one's
+        CallPtr call(inFlight_.front());
+        inFlight_.pop_front();
+        timedOut_ = true;
+        context_.reset(false);
+        close();
+        HttpClientResponse response(HttpClientResponse::kTimeout);
+        owner_->complete(call, &response);
+      }
+    }
+    else if (connected_ && idleTimeout > 0 && timeDifference(now, idleSince_) > idleTimeout)
+    {
+      close();
+    }
+    return true;
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn_ = conn;
+      connected_ = true;
+      idleSince_ = Timestamp::now();
+      conn->setTcpNoDelay(true);
+      owner_->dispatch(host_);
+    }
+    else
+    {
+      conn_.reset();
+      connected_ = false;
+      closed_ = true;
+      std::deque<CallPtr> calls;
+      calls.swap(inFlight_);
+      if (!calls.empty() && context_.receiveClose())
+      {
+        // a response that ends with the connection
+        CallPtr call(calls.front());
+        calls.pop_front();
+        owner_->complete(call, &context_.response());
+      }
+      Host* host = host_;
+      HttpClient* owner = owner_;
+      owner->removeConnection(host, this);
+      owner->retryOrFail(host, calls);
+    }
+  }
+
+  // rather than retrying until the connect timeout
+  void onConnectFailed(int err)
+  {
+    LOG_WARN << "HttpClient - cannot connect to " << host_->server.toIpPort()
+             << ", " << uv_strerror(err);
+    closed_ = true;
+    Host* host = host_;
+    HttpClient* owner = owner_;
+    owner->removeConnection(host, this);
+    owner->connectFailed(host);
+  }
+
+  void onMessage(const TcpConnectionPtr&, Buffer* buf, Timestamp)
+  {
+    if (timedOut_)
+    {
+      buf->retrieveAll();  // closing
+      return;
+    }
+    while (buf->readableBytes() > 0)
+    {
+      if (inFlight_.empty())
+      {
+        LOG_ERROR << "HttpClient - unexpected data from " << host_->server.toIpPort();
+        buf->retrieveAll();
+        close();
+        return;
+      }
+      if (!detail::parseResponse(buf, &context_))
+      {
+        LOG_ERROR << "HttpClient - bad response from " << host_->server.toIpPort();
+        CallPtr call(inFlight_.front());
+        inFlight_.pop_front();
+        buf->retrieveAll();
+        close();
+        HttpClientResponse response(HttpClientResponse::kBadResponse);
+        owner_->complete(call, &response);
+        return;
+      }
+      if (!context_.gotAll())
+      {
+        break;
+      }
+
+      CallPtr call(inFlight_.front());
+      inFlight_.pop_front();
+      HttpClientResponse response;
+      response.swap(context_.response());
+      if (!context_.keepAlive())
+      {
+        // what was pipelined behind it comes back on close
+        close();
+      }
+      context_.reset(!inFlight_.empty() && inFlight_.front()->method == HttpRequest::kHead);
+      if (inFlight_.empty())
+      {
+        idleSince_ = Timestamp::now();
+      }
+      owner_->complete(call, &response);
+      if (!reusable_)
+      {
+        return;
+      }
+    }
+    owner_->dispatch(host_);
+  }
+
+  HttpClient* owner_;
+  Host* host_;
+  TcpClient client_;
+  TcpConnectionPtr conn_;
+  HttpClientContext context_;
+  std::deque<CallPtr> inFlight_;
+  bool connected_;
+  bool closed_;
+  bool reusable_;
+  bool timedOut_;
+  Timestamp started_;
+  Timestamp idleSince_;
+};
+
+HttpClient::HttpClient(EventLoop* loop, const string& name)
+  : loop_(CHECK_NOTNULL(loop)),
+    name_(name),
+    maxConnectionsPerHost_(kDefaultMaxConnectionsPerHost),
+    pipelineDepth_(1),
+    timeout_(30),
+    idleTimeout_(60),
+    nextConnId_(1),
+    pending_(0)
+{
+  // TimerQueue is not thread safe, the client may be built in another thread
+  loop_->runInLoop(boost::bind(&HttpClient::startTimer, this));
+}
+
+HttpClient::~HttpClient()
+{
+  loop_->assertInLoopThread();
+  loop_->cancel(timer_);
+  if (pending_ > 0)
+  {
+    LOG_WARN << "HttpClient::~HttpClient [" << name_ << "] - "
+             << pending_ << " requests dropped";
+  }
+}
+
+void HttpClient::request(const InetAddress& server,
+                         HttpRequest::Method method,
+                         const string& path,
+                         const string& headers,
+                         const string& body,
+                         const ResponseCallback& cb)
+{
+  CallPtr call(new Call);
+  call->method = method;
+  call->cb = cb;
+  call->attempts = 0;
+  string& request = call->request;
+  request.reserve(path.size() + headers.size() + body.size() + 64);
+  request += methodName(method);
+  request += ' ';
+  request += path;
+  request += " HTTP/1.1\r\nHost: ";
+  request += server.toIpPort();
+  request += "\r\n";
+  request += headers;
+  if (!body.empty() || method == HttpRequest::kPost || method == HttpRequest::kPut)
+  {
+    char length[32];
+    snprintf(length, sizeof length, "Content-Length: %zu\r\n", body.size());
+    request += length;
+  }
+  request += "\r\n";
+  request += body;
+  loop_->runInLoop(boost::bind(&HttpClient::requestInLoop, this, server, call));
+}
+
+void HttpClient::startTimer()
+{
+  timer_ = loop_->runEvery(kCheckInterval, boost::bind(&HttpClient::onTimer, this));
+}
+
+void HttpClient::requestInLoop(const InetAddress& server, const CallPtr& call)
+{
+  loop_->assertInLoopThread();
+  if (timeout_ > 0)
+  {
+    call->deadline = addTime(Timestamp::now(), timeout_);
+  }
+  Host& host = hosts_[server.toIpPort()];
+  if (host.connections.empty() && host.waiting.empty())
+  {
+    host.server = server;
+  }
+  ++pending_;
+  host.waiting.push_back(call);
+  dispatch(&host);
+}
+
+void HttpClient::dispatch(Host* host)
+{
+  while (!host->waiting.empty())
+  {
+    const CallPtr& call = host->waiting.front();
+    Connection* best = NULL;
+    size_t connecting = 0;
+    for (size_t i = 0; i < host->connections.size(); ++i)
+    {
+      Connection* c = get_pointer(host->connections[i]);
+      if (c->connecting())
+      {
+        ++connecting;
+      }
+      else if (c->canTake(*call, pipelineDepth_)
+               && (best == NULL || c->inFlight() < best->inFlight()))
+      {
+        best = c;
+      }
+    }
+
+    if (best)
+    {
+      CallPtr next(call);
+      host->waiting.pop_front();
+      best->send(next);
+    }
+    else
+    {
+      if (static_cast<int>(host->connections.size()) < maxConnectionsPerHost_
+          && host->waiting.size() > connecting * std::max(pipelineDepth_, 1))
+      {
+        char buf[32];
+        snprintf(buf, sizeof buf, "#%d", nextConnId_);
+        ++nextConnId_;
+        ConnectionPtr connection(new Connection(this, host, name_ + buf));
+        host->connections.push_back(connection);
+        connection->connect();
+      }
+      break;
+    }
+  }
+}
+
+void HttpClient::retryOrFail(Host* host, const std::deque<CallPtr>& calls)
+{
+  for (std::deque<CallPtr>::const_iterator it = calls.begin(); it != calls.end(); ++it)
+  {
+    if (!idempotent((*it)->method) || (*it)->attempts >= kMaxAttempts)
+    {
+      HttpClientResponse response(HttpClientResponse::kConnectionClosed);
+      complete(*it, &response);
+    }
+  }
+  // in front of the others, in the order they were sent
+  for (std::deque<CallPtr>::const_reverse_iterator it = calls.rbegin(); it != calls.rend(); ++it)
+  {
+    if (idempotent((*it)->method) && (*it)->attempts < kMaxAttempts)
+    {
+      host->waiting.push_front(*it);
+    }
+  }
+  dispatch(host);
+}
+
+void HttpClient::complete(const CallPtr& call, HttpClientResponse* response)
+{
+  --pending_;
+  if (call->cb)
+  {
+    call->cb(*response);
+  }
+}
+
+void HttpClient::removeConnection(Host* host, Connection* connection)
+{
+  for (size_t i = 0; i < host->connections.size(); ++i)
+  {
+    if (get_pointer(host->connections[i]) == connection)
+    {
+      loop_->queueInLoop(boost::bind(&Connection::release, host->connections[i]));
+      host->connections.erase(host->connections.begin() + i);
+      break;
+    }
+  }
+}
+
+void HttpClient::connectFailed(Host* host)
+{
+  for (size_t i = 0; i < host->connections.size(); ++i)
+  {
+    if (!host->connections[i]->closed())
+    {
+      return;  // the waiting calls can still go there
+    }
+  }
+
+  std::deque<CallPtr> calls;
+  calls.swap(host->waiting);
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    HttpClientResponse response(HttpClientResponse::kConnectFailed);
+    complete(calls[i], &response);
+  }
+}
+
+void HttpClient::onTimer()
+{
+  Timestamp now(Timestamp::now());
+  for (std::map<string, Host>::iterator it = hosts_.begin(); it != hosts_.end(); ++it)
+  {
+    Host* host = &it->second;
+    // check() may complete calls, whose callbacks may add connections
+    std::vector<ConnectionPtr> connections(host->connections);
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+      if (!connections[i]->check(now, timeout_, idleTimeout_))
+      {
+        LOG_WARN << "HttpClient [" << name_ << "] - cannot connect to "
+                 << host->server.toIpPort();
+        removeConnection(host, get_pointer(connections[i]));
+      }
+    }
+
+    std::deque<CallPtr> expired;
+    std::deque<CallPtr>::iterator call = host->waiting.begin();
+    while (call != host->waiting.end())
+    {
+      if ((*call)->deadline.valid() && (*call)->deadline < now)
+      {
+        expired.push_back(*call);
+        call = host->waiting.erase(call);
+      }
+      else
+      {
+        ++call;
+      }
+    }
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      HttpClientResponse response(HttpClientResponse::kTimeout);
+      complete(expired[i], &response);
+    }
+    dispatch(host);
+  }
+}
@@ -0,0 +1,249 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENT_H
+#define MUDUO_NET_HTTP_HTTPCLIENT_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TimerId.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+
+/// A response received by HttpClient, or why there is none.
+class HttpClientResponse : public muduo::copyable
+{
+ public:
+  enum Error
+  {
+    kOk,
+    kTimeout,           // no whole response within HttpClient::setTimeout()
+    kConnectionClosed,  // lost before the response, and not retried
+    kBadResponse,       // malformed, the connection is dropped
+    kConnectFailed,     // refused or unreachable, with no other connection up
+  };
+
+  explicit HttpClientResponse(Error error = kOk)
+    : error_(error),
+      version_(HttpRequest::kUnknown),
+      statusCode_(0)
+  {
+  }
+
+  Error error() const { return error_; }
+  bool ok() const { return error_ == kOk; }
+
+  HttpRequest::Version version() const { return version_; }
+  int statusCode() const { return statusCode_; }
+  const string& statusMessage() const { return statusMessage_; }
+
+  // case-insensitive, the first match wins, empty if not found
+  StringPiece findHeader(StringPiece field) const
+  {
+    for (size_t i = 0; i < headers_.size(); ++i)
+    {
+      if (HttpRequest::equalsIgnoreCase(headerField(i), field))
+      {
+        return headerValue(i);
+      }
+    }
+    return StringPiece();
+  }
+
+  int headerCount() const { return static_cast<int>(headers_.size()); }
+
+  StringPiece headerField(size_t i) const
+  { return StringPiece(headerData_.data() + headers_[i].field, headers_[i].fieldLength); }
+
+  StringPiece headerValue(size_t i) const
+  { return StringPiece(headerData_.data() + headers_[i].value, headers_[i].valueLength); }
+
+  const string& body() const { return body_; }
+
+  // for the parser
+
+  void setStatus(HttpRequest::Version version, int code, const char* start, const char* end)
+  {
+    version_ = version;
+    statusCode_ = code;
+    statusMessage_.assign(start, end);
+  }
+
+  void addHeader(const char* start, const char* colon, const char* end)
+  {
+    const char* value = colon + 1;
+    while (value < end && isspace(*value))
+    {
+      ++value;
+    }
+    while (end > value && isspace(end[-1]))
+    {
+      --end;
+    }
+    Header h;
+    h.field = static_cast<int>(headerData_.size());
+    h.fieldLength = static_cast<int>(colon - start);
+    headerData_.append(start, colon);
+    h.value = static_cast<int>(headerData_.size());
+    h.valueLength = static_cast<int>(end - value);
+    headerData_.append(value, end);
+    headers_.push_back(h);
+  }
+
+  void appendBody(const char* start, size_t len)
+  { body_.append(start, len); }
+
+  void swap(HttpClientResponse& that)
+  {
+    std::swap(error_, that.error_);
+    std::swap(version_, that.version_);
+    std::swap(statusCode_, that.statusCode_);
+    statusMessage_.swap(that.statusMessage_);
+    headerData_.swap(that.headerData_);
+    headers_.swap(that.headers_);
+    body_.swap(that.body_);
+  }
+
+ private:
+  // offsets into headerData_
+  struct Header
+  {
+    int field;
+    int fieldLength;
+    int value;
+    int valueLength;
+  };
+
+  Error error_;
+  HttpRequest::Version version_;
+  int statusCode_;
+  string statusMessage_;
+  string headerData_;
+  std::vector<Header> headers_;
+  string body_;
+};
+
+/// An asynchronous HTTP/1.1 client running in one EventLoop.
+///
+/// Each server gets a pool of keep-alive connections, up to
+/// setMaxConnectionsPerHost().  A request goes to the least busy
+/// connection that can take it, a new connection is opened while the pool
+/// is short, otherwise it waits in the queue of its host.  With
+/// setPipelineDepth() above 1, idempotent requests are pipelined, the
+/// others only go to an idle connection and nothing is sent behind them.
+/// Idempotent requests on a connection that closes before their response
+/// are sent once more.  When a connect fails and no other connection to
+/// the server is up or on its way, the requests waiting for it fail at once.
+///
+/// Timeouts are checked by one timer of the loop, setTimeout() runs from
+/// request() to the end of the response, so includes the time spent
+/// waiting for a connection.
+///
+/// request() is thread safe, everything else must be called in the loop
+/// thread.  Callbacks run in the loop thread.  Like TcpClient, destroy it
+/// while the loop still runs, its connections close in the loop.
+class HttpClient : boost::noncopyable
+{
+ public:
+  typedef boost::function<void (const HttpClientResponse&)> ResponseCallback;
+
+  static const int kDefaultMaxConnectionsPerHost = 8;
+
+  HttpClient(EventLoop* loop, const string& name);
+  ~HttpClient();
+
+  EventLoop* getLoop() const { return loop_; }
+
+  void setMaxConnectionsPerHost(int n)
+  { maxConnectionsPerHost_ = n; }
+
+  /// Requests in flight on one connection, 1 (the default) for no pipelining.
+  void setPipelineDepth(int depth)
+  { pipelineDepth_ = depth; }
+
+  /// Seconds for a whole response, 0 for none, default 30.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  /// Keep-alive connections idle for this long are closed, default 60.
+  void setIdleTimeout(double seconds)
+  { idleTimeout_ = seconds; }
+
+  /// path may carry a query.  headers are whole lines, each with its CRLF,
+  /// Host and Content-Length are added.  Thread safe.
+  void request(const InetAddress& server,
+               HttpRequest::Method method,
+               const string& path,
+               const string& headers,
+               const string& body,
+               const ResponseCallback& cb);
+
+  void get(const InetAddress& server, const string& path, const ResponseCallback& cb)
+  { request(server, HttpRequest::kGet, path, string(), string(), cb); }
+
+  /// Requests queued or in flight.
+  int pending() const { return pending_; }
+
+ private:
+  struct Call;
+  class Connection;
+  typedef boost::shared_ptr<Call> CallPtr;
+  typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+  struct Host
+  {
+    InetAddress server;
+    std::vector<ConnectionPtr> connections;
+    std::deque<CallPtr> waiting;
+  };
+
+  void requestInLoop(const InetAddress& server, const CallPtr& call);
+  void dispatch(Host* host);
+  void retryOrFail(Host* host, const std::deque<CallPtr>& calls);
+  void complete(const CallPtr& call, HttpClientResponse* response);
+  void removeConnection(Host* host, Connection* connection);
+  void connectFailed(Host* host);
+  void startTimer();
+  void onTimer();
+
+  EventLoop* loop_;
+  const string name_;
+  int maxConnectionsPerHost_;
+  int pipelineDepth_;
+  double timeout_;
+  double idleTimeout_;
+  int nextConnId_;
+  int pending_;
+  TimerId timer_;
+  std::map<string, Host> hosts_;  // by ip:port
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENT_H
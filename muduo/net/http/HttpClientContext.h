@@ -0,0 +1,289 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+#define MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+
+#include <muduo/net/http/HttpClient.h>
+
+#include <algorithm>
+
+namespace muduo
+{
+namespace net
+{
+
+// The response side of HttpContext, same states, plus reading to the end
+// of the connection for a response with neither length nor chunks.
+class HttpClientContext : public muduo::copyable
+{
+ public:
+  enum HttpResponseParseState
+  {
+    kExpectStatusLine,
+    kExpectHeaders,
+    kExpectBody,        // Content-Length bytes, or the data of one chunk
+    kExpectChunkSize,
+    kExpectChunkEnd,    // CRLF after the data of a chunk
+    kExpectTrailers,
+    kExpectClose,       // everything up to the end of the connection
+    kGotAll,
+  };
+
+  HttpClientContext()
+    : state_(kExpectStatusLine),
+      chunked_(false),
+      noBody_(false),
+      keepAlive_(true),
+      bodyRemaining_(0),
+      scanned_(0)
+  {
+  }
+
+  // default copy-ctor, dtor and assignment are fine
+
+  bool expectStatusLine() const
+  { return state_ == kExpectStatusLine; }
+
+  bool expectBody() const
+  { return state_ == kExpectBody; }
+
+  bool expectChunkSize() const
+  { return state_ == kExpectChunkSize; }
+
+  bool expectChunkEnd() const
+  { return state_ == kExpectChunkEnd; }
+
+  bool expectTrailers() const
+  { return state_ == kExpectTrailers; }
+
+  bool expectClose() const
+  { return state_ == kExpectClose; }
+
+  bool gotAll() const
+  { return state_ == kGotAll; }
+
+  // "HTTP/1.1 200 OK", returns false for a malformed line
+  bool receiveStatusLine(const char* start, const char* end)
+  {
+    if (end - start < 12 || !std::equal(start, start + 7, "HTTP/1.")
+        || (start[7] != '0' && start[7] != '1') || start[8] != ' ')
+    {
+      return false;
+    }
+    int code = 0;
+    for (const char* p = start + 9; p < start + 12; ++p)
+    {
+      if (*p < '0' || *p > '9')
+      {
+        return false;
+      }
+      code = code * 10 + (*p - '0');
+    }
+    const char* message = start + 12;
+    if (message < end && *message == ' ')
+    {
+      ++message;
+    }
+    response_.setStatus(start[7] == '1' ? HttpRequest::kHttp11 : HttpRequest::kHttp10,
+                        code, message, end);
+    state_ = kExpectHeaders;
+    return true;
+  }
+
+  // decides how the body is framed, returns false for a malformed response
+  bool receiveHeaders()
+  {
+    StringPiece connection = response_.findHeader("Connection");
+    keepAlive_ = response_.version() == HttpRequest::kHttp11
+        ? !HttpRequest::equalsIgnoreCase(connection, "close")
+        : HttpRequest::equalsIgnoreCase(connection, "Keep-Alive");
+
+    int code = response_.statusCode();
+    if (code / 100 == 1)
+    {
+      // 100 Continue and such, the real response follows
+      HttpClientResponse dummy;
+      response_.swap(dummy);
+      state_ = kExpectStatusLine;
+      return code != 101;
+    }
+
+    StringPiece encoding = response_.findHeader("Transfer-Encoding");
+    StringPiece length = response_.findHeader("Content-Length");
+    if (noBody_ || code == 204 || code == 304)
+    {
+      state_ = kGotAll;
+    }
+    else if (!encoding.empty())
+    {
+      if (encoding.size() < 7
+          || !HttpRequest::equalsIgnoreCase(
+                 StringPiece(encoding.end() - 7, 7), "chunked"))
+      {
+        // RFC 7230 3.3.3: a response may end with the connection instead
+        keepAlive_ = false;
+        state_ = kExpectClose;
+      }
+      else
+      {
+        chunked_ = true;
+        state_ = kExpectChunkSize;
+      }
+    }
+    else if (!length.empty())
+    {
+      int64_t n = parseLength(length.begin(), length.end(), 10);
+      if (n < 0)
+      {
+        return false;
+      }
+      bodyRemaining_ = n;
+      state_ = n > 0 ? kExpectBody : kGotAll;
+    }
+    else
+    {
+      keepAlive_ = false;
+      state_ = kExpectClose;
+    }
+    return true;
+  }
+
+  // chunk-size [ ";" chunk-ext ], returns false for a malformed line
+  bool receiveChunkSize(const char* start, const char* end)
+  {
+    const char* ext = std::find(start, end, ';');
+    while (ext > start && (ext[-1] == ' ' || ext[-1] == '\t'))
+    {
+      --ext;
+    }
+    int64_t n = parseLength(start, ext, 16);
+    if (n < 0)
+    {
+      return false;
+    }
+    bodyRemaining_ = n;
+    state_ = n > 0 ? kExpectBody : kExpectTrailers;
+    return true;
+  }
+
+  // number of body bytes still expected in the current state
+  size_t bodyRemaining() const
+  { return static_cast<size_t>(bodyRemaining_); }
+
+  void receiveBody(const char* data, size_t len)
+  {
+    assert(expectBody() || expectClose());
+    response_.appendBody(data, len);
+    if (expectBody())
+    {
+      assert(len <= bodyRemaining());
+      bodyRemaining_ -= static_cast<int64_t>(len);
+      if (bodyRemaining_ == 0)
+      {
+        state_ = chunked_ ? kExpectChunkEnd : kGotAll;
+      }
+    }
+  }
+
+  void receiveChunkEnd()
+  { state_ = kExpectChunkSize; }
+
+  void receiveTrailers()
+  { state_ = kGotAll; }
+
+  // the connection has ended, true if that completes the response
+  bool receiveClose()
+  {
+    if (expectClose())
+    {
+      state_ = kGotAll;
+    }
+    return gotAll();
+  }
+
+  // whether the connection may carry another response
+  bool keepAlive() const
+  { return keepAlive_; }
+
+  // where to resume looking for the end of the header block
+  size_t scanned() const
+  { return scanned_; }
+
+  void setScanned(size_t n)
+  { scanned_ = n; }
+
+  // for the next response, noBody for a response to HEAD
+  void reset(bool noBody)
+  {
+    state_ = kExpectStatusLine;
+    chunked_ = false;
+    noBody_ = noBody;
+    bodyRemaining_ = 0;
+    scanned_ = 0;
+    HttpClientResponse dummy;
+    response_.swap(dummy);
+  }
+
+  const HttpClientResponse& response() const
+  { return response_; }
+
+  HttpClientResponse& response()
+  { return response_; }
+
+ private:
+  // non-negative number in base 10 or 16, -1 if malformed or too large
+  static int64_t parseLength(const char* start, const char* end, int base)
+  {
+    if (start == end || end - start > 15)
+    {
+      return -1;
+    }
+    int64_t n = 0;
+    for (const char* p = start; p != end; ++p)
+    {
+      int digit = -1;
+      if (*p >= '0' && *p <= '9')
+      {
+        digit = *p - '0';
+      }
+      else if (base == 16 && *p >= 'a' && *p <= 'f')
+      {
+        digit = *p - 'a' + 10;
+      }
+      else if (base == 16 && *p >= 'A' && *p <= 'F')
+      {
+        digit = *p - 'A' + 10;
+      }
+      if (digit < 0)
+      {
+        return -1;
+      }
+      n = n * base + digit;
+    }
+    return n;
+  }
+
+  HttpResponseParseState state_;
+  bool chunked_;
+  bool noBody_;
+  bool keepAlive_;
+  int64_t bodyRemaining_;
+  size_t scanned_;
+  HttpClientResponse response_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
@@ -0,0 +1,203 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpCompressor.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/ZlibStream.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+AtomicInt64 g_bodies;
+AtomicInt64 g_bytesIn;
+AtomicInt64 g_bytesOut;
+AtomicInt64 g_microSeconds;
+
+// the deflate streams of one thread
+class Deflaters : boost::noncopyable
+{
+ public:
+  Deflaters()
+  {
+    levels_[0] = levels_[1] = 0;
+  }
+
+  // a fresh stream writing into buffer()
+  ZlibOutputStream* stream(HttpCompressor::Encoding encoding, int level)
+  {
+    int i = encoding == HttpCompressor::kGzip ? 0 : 1;
+    if (!streams_[i] || levels_[i] != level || !streams_[i]->reset(&buffer_))
+    {
+      const int kWindowBits = 15;
+      streams_[i].reset(new ZlibOutputStream(
+          &buffer_, level,
+          encoding == HttpCompressor::kGzip ? kWindowBits + 16 : kWindowBits));
+      levels_[i] = level;
+    }
+    return streams_[i].get();
+  }
+
+  Buffer* buffer() { return &buffer_; }
+
+ private:
+  Buffer buffer_;
+  boost::scoped_ptr<ZlibOutputStream> streams_[2];
+  int levels_[2];
+};
+
+StringPiece trim(const char* begin, const char* end)
+{
+  while (begin < end && (*begin == ' ' || *begin == '\t'))
+  {
+    ++begin;
+  }
+  while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+  {
+    --end;
+  }
+  return StringPiece(begin, static_cast<int>(end - begin));
+}
+
+// "q=0", "q=0.0" and so on
+bool refused(StringPiece params)
+{
+  const char* q = std::find(params.begin(), params.end(), 'q');
+  if (q == params.end() || q + 1 == params.end() || q[1] != '=')
+  {
+    return false;
+  }
+  StringPiece value = trim(q + 2, std::find(q + 2, params.end(), ';'));
+  for (const char* p = value.begin(); p != value.end(); ++p)
+  {
+    if (*p != '0' && *p != '.')
+    {
+      return false;
+    }
+  }
+  return !value.empty();
+}
+
+}
+
+bool HttpCompressor::worthCompressing(StringPiece contentType, size_t size) const
+{
+  if (size < minSize_)
+  {
+    return false;
+  }
+  static const char* const kTypes[] = { "json", "javascript", "xml", "svg" };
+  if (contentType.starts_with("text/"))
+  {
+    return true;
+  }
+  for (size_t i = 0; i < sizeof kTypes / sizeof kTypes[0]; ++i)
+  {
+    StringPiece type(kTypes[i]);
+    if (std::search(contentType.begin(), contentType.end(), type.begin(), type.end())
+        != contentType.end())
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+HttpCompressor::Encoding HttpCompressor::negotiate(StringPiece acceptEncoding)
+{
+  bool gzip = false;
+  bool deflate = false;
+  const char* p = acceptEncoding.begin();
+  while (p < acceptEncoding.end())
+  {
+    const char* comma = std::find(p, acceptEncoding.end(), ',');
+    const char* semicolon = std::find(p, comma, ';');
+    StringPiece coding = trim(p, semicolon);
+    if (!refused(StringPiece(semicolon, static_cast<int>(comma - semicolon))))
+    {
+      if (HttpRequest::equalsIgnoreCase(coding, "gzip")
+          || HttpRequest::equalsIgnoreCase(coding, "x-gzip")
+          || coding == "*")
+      {
+        gzip = true;
+      }
+      else if (HttpRequest::equalsIgnoreCase(coding, "deflate"))
+      {
+        deflate = true;
+      }
+    }
+    p = comma + 1;
+  }
+  return gzip ? kGzip : (deflate ? kDeflate : kIdentity);
+}
+
+const char* HttpCompressor::encodingName(Encoding encoding)
+{
+  switch (encoding)
+  {
+    case kGzip:
+      return "gzip";
+    case kDeflate:
+      return "deflate";
+    default:
+      return "identity";
+  }
+}
+
+bool HttpCompressor::compress(Encoding encoding, StringPiece body, string* output) const
+{
+  assert(encoding != kIdentity);
+  Timestamp start(Timestamp::now());
+  Deflaters& deflaters = ThreadLocalSingleton<Deflaters>::instance();
+  Buffer* buf = deflaters.buffer();
+  buf->retrieveAll();
+  ZlibOutputStream* stream = deflaters.stream(encoding, level_);
+  bool smaller = stream->write(body)
+      && stream->finishStream()
+      && buf->readableBytes() < static_cast<size_t>(body.size());
+  if (smaller)
+  {
+    output->append(buf->peek(), buf->readableBytes());
+  }
+
+  g_bodies.increment();
+  g_bytesIn.add(body.size());
+  g_bytesOut.add(smaller ? static_cast<int64_t>(buf->readableBytes()) : body.size());
+  g_microSeconds.add(Timestamp::now().microSecondsSinceEpoch()
+                     - start.microSecondsSinceEpoch());
+  buf->retrieveAll();
+  return smaller;
+}
+
+string HttpCompressor::stats()
+{
+  int64_t in = g_bytesIn.get();
+  int64_t out = g_bytesOut.get();
+  char buf[256];
+  snprintf(buf, sizeof buf,
+           "bodies %lld\nin %lld\nout %lld\nsaved %lld\nusec %lld\n",
+           static_cast<long long>(g_bodies.get()),
+           static_cast<long long>(in),
+           static_cast<long long>(out),
+           static_cast<long long>(in - out),
+           static_cast<long long>(g_microSeconds.get()));
+  return buf;
+}
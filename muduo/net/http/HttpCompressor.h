@@ -0,0 +1,78 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+#define MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+/// gzip and deflate Content-Encoding of response bodies.
+///
+/// The deflate streams live in the calling thread, one per encoding, and
+/// are reset between bodies instead of deflateInit() each time.  So an
+/// HttpServer thread, and its EventLoop, compresses with its own contexts.
+/// The counters are process wide, see stats().
+class HttpCompressor : boost::noncopyable
+{
+ public:
+  enum Encoding
+  {
+    kIdentity, kGzip, kDeflate
+  };
+
+  static const int kDefaultLevel = 6;
+  static const size_t kDefaultMinSize = 1024;
+
+  HttpCompressor()
+    : level_(0),
+      minSize_(kDefaultMinSize)
+  {
+  }
+
+  /// zlib level 1 to 9, 0 turns compression off, which is the default.
+  void setLevel(int level) { level_ = level; }
+  int level() const { return level_; }
+
+  /// Smaller bodies are sent as they are.
+  void setMinSize(size_t bytes) { minSize_ = bytes; }
+
+  bool enabled() const { return level_ > 0; }
+
+  /// Text, JSON, JavaScript, XML and SVG of at least minSize bytes.
+  bool worthCompressing(StringPiece contentType, size_t size) const;
+
+  /// gzip, or else deflate, if the Accept-Encoding value takes it.
+  static Encoding negotiate(StringPiece acceptEncoding);
+  static const char* encodingName(Encoding encoding);
+
+  /// Appends the compressed body to *output, returns false and leaves
+  /// *output alone if it would not get smaller.
+  bool compress(Encoding encoding, StringPiece body, string* output) const;
+
+  /// "bodies N\nin N\nout N\nsaved N\nusec N\n"
+  static string stats();
+
+ private:
+  int level_;
+  size_t minSize_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
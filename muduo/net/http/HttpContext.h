@@ -12,9 +12,14 @@
 #define MUDUO_NET_HTTP_HTTPCONTEXT_H
 
 #include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
 
 #include <muduo/net/http/HttpRequest.h>
 
+#include <boost/function.hpp>
+
+#include <algorithm>
+
 namespace muduo
 {
 namespace net
@@ -23,16 +28,31 @@ namespace net
 class HttpContext : public muduo::copyable
 {
  public:
+  typedef boost::function<void (const HttpRequest&, StringPiece)> BodyCallback;
+
   enum HttpRequestParseState
   {
     kExpectRequestLine,
     kExpectHeaders,
-    kExpectBody,
+    kExpectBody,        // Content-Length bytes, or the data of one chunk
+    kExpectChunkSize,
+    kExpectChunkEnd,    // CRLF after the data of a chunk
+    kExpectTrailers,
     kGotAll,
   };
 
   HttpContext()
-    : state_(kExpectRequestLine)
+    : state_(kExpectRequestLine),
+      chunked_(false),
+      expectContinue_(false),
+      bodyTooLarge_(false),
+      zeroCopy_(false),
+      bodyRemaining_(0),
+      bodySize_(0),
+      maxBodySize_(0),
+      heldBytes_(0),
+      scanned_(0),
+      trailerBytes_(0)
   {
   }
 
@@ -47,18 +67,198 @@ class HttpContext : public muduo::copyable
   bool expectBody() const
   { return state_ == kExpectBody; }
 
+  bool expectChunkSize() const
+  { return state_ == kExpectChunkSize; }
+
+  bool expectChunkEnd() const
+  { return state_ == kExpectChunkEnd; }
+
+  bool expectTrailers() const
+  { return state_ == kExpectTrailers; }
+
   bool gotAll() const
   { return state_ == kGotAll; }
 
   void receiveRequestLine()
   { state_ = kExpectHeaders; }
 
-  void receiveHeaders()
-  { state_ = kGotAll; }  // FIXME
+  // decides how the body is framed, returns false for a malformed request
+  bool receiveHeaders()
+  {
+    StringPiece encoding = request_.findHeader("Transfer-Encoding");
+    StringPiece length = request_.findHeader("Content-Length");
+    if (!encoding.empty())
+    {
+      // RFC 7230 3.3.3: chunked must be the final coding, and wins over Content-Length
+      if (encoding.size() < 7
+          || !HttpRequest::equalsIgnoreCase(
+                 StringPiece(encoding.end() - 7, 7), "chunked"))
+      {
+        return false;
+      }
+      chunked_ = true;
+      state_ = kExpectChunkSize;
+    }
+    else if (!length.empty())
+    {
+      int64_t n = parseLength(length.begin(), length.end(), 10);
+      if (n < 0)
+      {
+        return false;
+      }
+      if (tooLarge(n))
+      {
+        return false;  // 413 before any of it is read, no 100 Continue
+      }
+      bodyRemaining_ = n;
+      state_ = n > 0 ? kExpectBody : kGotAll;
+    }
+    else
+    {
+      state_ = kGotAll;
+    }
+    expectContinue_ = !gotAll()
+        && request_.getVersion() == HttpRequest::kHttp11
+        && HttpRequest::equalsIgnoreCase(request_.findHeader("Expect"), "100-continue");
+    return true;
+  }
+
+  // chunk-size [ ";" chunk-ext ], returns false for a malformed line
+  bool receiveChunkSize(const char* start, const char* end)
+  {
+    const char* ext = std::find(start, end, ';');
+    while (ext > start && (ext[-1] == ' ' || ext[-1] == '\t'))
+    {
+      --ext;
+    }
+    int64_t n = parseLength(start, ext, 16);
+    if (n < 0 || tooLarge(bodySize_ + n))
+    {
+      return false;
+    }
+    bodyRemaining_ = n;
+    state_ = n > 0 ? kExpectBody : kExpectTrailers;
+    return true;
+  }
+
+  // number of body bytes still expected in the current state
+  size_t bodyRemaining() const
+  { return static_cast<size_t>(bodyRemaining_); }
+
+  // returns false if the body exceeds the limit
+  bool receiveBody(const char* data, size_t len)
+  {
+    assert(expectBody());
+    assert(len <= bodyRemaining());
+    bodyRemaining_ -= static_cast<int64_t>(len);
+    bodySize_ += static_cast<int64_t>(len);
+    if (bodyCallback_)
+    {
+      if (len > 0)
+      {
+        bodyCallback_(request_, StringPiece(data, static_cast<int>(len)));
+      }
+    }
+    else if (tooLarge(bodySize_))
+    {
+      return false;
+    }
+    else
+    {
+      request_.appendBody(data, data + len);
+    }
+    if (bodyRemaining_ == 0)
+    {
+      state_ = chunked_ ? kExpectChunkEnd : kGotAll;
+    }
+    return true;
+  }
+
+  // the whole body is in the input buffer, no copy
+  void receiveWholeBody(const char* data)
+  {
+    assert(expectBody() && !chunked_ && !bodyCallback_);
+    request_.setBody(data, data + bodyRemaining());
+    bodySize_ = bodyRemaining_;
+    bodyRemaining_ = 0;
+    state_ = kGotAll;
+  }
+
+  void receiveChunkEnd()
+  { state_ = kExpectChunkSize; }
+
+  void receiveTrailers()
+  { state_ = kGotAll; }
+
+  // of the trailer lines so far, CRLFs included
+  size_t trailerBytes() const
+  { return trailerBytes_; }
+
+  void addTrailerBytes(size_t n)
+  { trailerBytes_ += n; }
+
+  // true once per request that sent "Expect: 100-continue"
+  bool takeExpectContinue()
+  {
+    bool result = expectContinue_;
+    expectContinue_ = false;
+    return result;
+  }
+
+  bool bodyTooLarge() const
+  { return bodyTooLarge_; }
+
+  // slices of the body go to cb instead of HttpRequest::body(),
+  // they point into the input buffer and are valid during the call only
+  void setBodyCallback(const BodyCallback& cb)
+  { bodyCallback_ = cb; }
+
+  // 0 for unlimited, does not apply with a BodyCallback
+  void setMaxBodySize(int64_t maxBodySize)
+  { maxBodySize_ = maxBodySize; }
+
+  int64_t maxBodySize() const
+  { return maxBodySize_; }
+
+  bool hasBodyCallback() const
+  { return static_cast<bool>(bodyCallback_); }
+
+  bool chunked() const
+  { return chunked_; }
+
+  // leave a request that arrived in whole in the input buffer,
+  // HttpRequest holds views into it, see HttpServer::setZeroCopy
+  void setZeroCopy(bool on)
+  { zeroCopy_ = on; }
+
+  bool zeroCopy() const
+  { return zeroCopy_; }
+
+  // bytes of the current request still in the input buffer,
+  // to be retrieved once the request has been handled
+  size_t heldBytes() const
+  { return heldBytes_; }
+
+  void holdBytes(size_t n)
+  { heldBytes_ += n; }
+
+  // where to resume looking for the end of the header block
+  size_t scanned() const
+  { return scanned_; }
+
+  void setScanned(size_t n)
+  { scanned_ = n; }
 
   void reset()
   {
     state_ = kExpectRequestLine;
+    chunked_ = false;
+    expectContinue_ = false;
+    bodyRemaining_ = 0;
+    bodySize_ = 0;
+    heldBytes_ = 0;
+    scanned_ = 0;
+    trailerBytes_ = 0;
     HttpRequest dummy;
     request_.swap(dummy);
   }
@@ -70,7 +270,58 @@ class HttpContext : public muduo::copyable
   { return request_; }
 
  private:
+  // sets bodyTooLarge() if a body of size would exceed the limit,
+  // which doesn't apply when the body goes to a callback
+  bool tooLarge(int64_t size)
+  {
+    bodyTooLarge_ = !bodyCallback_ && maxBodySize_ > 0 && size > maxBodySize_;
+    return bodyTooLarge_;
+  }
+
+  // non-negative number in base 10 or 16, -1 if malformed or too large
+  static int64_t parseLength(const char* start, const char* end, int base)
+  {
+    if (start == end || end - start > 15)
+    {
+      return -1;
+    }
+    int64_t n = 0;
+    for (const char* p = start; p != end; ++p)
+    {
+      int digit = -1;
+      if (*p >= '0' && *p <= '9')
+      {
+        digit = *p - '0';
+      }
+      else if (base == 16 && *p >= 'a' && *p <= 'f')
+      {
+        digit = *p - 'a' + 10;
+      }
+      else if (base == 16 && *p >= 'A' && *p <= 'F')
+      {
+        digit = *p - 'A' + 10;
+      }
+      if (digit < 0)
+      {
+        return -1;
+      }
+      n = n * base + digit;
+    }
+    return n;
+  }
+
   HttpRequestParseState state_;
+  bool chunked_;
+  bool expectContinue_;
+  bool bodyTooLarge_;
+  bool zeroCopy_;
+  int64_t bodyRemaining_;
+  int64_t bodySize_;
+  int64_t maxBodySize_;
+  size_t heldBytes_;
+  size_t scanned_;
+  size_t trailerBytes_;
+  BodyCallback bodyCallback_;
   HttpRequest request_;
 };
 
@@ -0,0 +1,531 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpFileHandler.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <uv.h>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+// Parses the value of a Range header against a file of size bytes.
+// Returns 1 and [*first, *last] for a satisfiable single range, -1 if it
+// is unsatisfiable (416), 0 to ignore it and send the whole file, which
+// is what happens to malformed and multiple ranges.
+int parseByteRange(StringPiece value, int64_t size, int64_t* first, int64_t* last)
+{
+  if (!value.starts_with("bytes="))
+  {
+    return 0;
+  }
+  value.remove_prefix(6);
+  const char* p = value.begin();
+  const char* end = value.end();
+  const int kMaxDigits = 18;
+
+  int64_t start = -1;
+  int digits = 0;
+  for (; p != end && *p >= '0' && *p <= '9' && digits < kMaxDigits; ++p, ++digits)
+  {
+    start = (start < 0 ? 0 : start * 10) + (*p - '0');
+  }
+  if (p == end || *p != '-')
+  {
+    return 0;
+  }
+  ++p;
+  int64_t stop = -1;
+  digits = 0;
+  for (; p != end && *p >= '0' && *p <= '9' && digits < kMaxDigits; ++p, ++digits)
+  {
+    stop = (stop < 0 ? 0 : stop * 10) + (*p - '0');
+  }
+  if (p != end || (start < 0 && stop < 0))
+  {
+    return 0;
+  }
+
+  if (start < 0)
+  {
+    // "bytes=-500", the last 500 bytes
+    if (stop == 0 || size == 0)
+    {
+      return -1;
+    }
+    *first = stop < size ? size - stop : 0;
+    *last = size - 1;
+    return 1;
+  }
+  if (stop >= 0 && stop < start)
+  {
+    return 0;
+  }
+  if (start >= size)
+  {
+    return -1;
+  }
+  *first = start;
+  *last = stop < 0 || stop >= size ? size - 1 : stop;
+  return 1;
+}
+
+}
+}
+}
+
+namespace
+{
+
+bool endsWith(StringPiece s, StringPiece suffix)
+{
+  return s.size() >= suffix.size()
+      && std::equal(suffix.begin(), suffix.end(), s.end() - suffix.size());
+}
+
+bool contains(StringPiece s, StringPiece x)
+{
+  return std::search(s.begin(), s.end(), x.begin(), x.end()) != s.end();
+}
+
+const char* contentType(StringPiece filename)
+{
+  static const struct
+  {
+    const char* extension;
+    const char* type;
+  } kTypes[] = {
+    { ".html", "text/html; charset=utf-8" },
+    { ".htm", "text/html; charset=utf-8" },
+    { ".css", "text/css" },
+    { ".js", "application/javascript" },
+    { ".json", "application/json" },
+    { ".txt", "text/plain; charset=utf-8" },
+    { ".xml", "text/xml" },
+    { ".png", "image/png" },
+    { ".jpg", "image/jpeg" },
+    { ".jpeg", "image/jpeg" },
+    { ".gif", "image/gif" },
+    { ".svg", "image/svg+xml" },
+    { ".ico", "image/x-icon" },
+    { ".pdf", "application/pdf" },
+    { ".wasm", "application/wasm" },
+  };
+  for (size_t i = 0; i < sizeof kTypes / sizeof kTypes[0]; ++i)
+  {
+    if (endsWith(filename, kTypes[i].extension))
+    {
+      return kTypes[i].type;
+    }
+  }
+  return "application/octet-stream";
+}
+
+// no "..", no NUL, no backslash which is a separator on Windows
+bool safePath(StringPiece path)
+{
+  if (std::find(path.begin(), path.end(), '\0') != path.end()
+      || std::find(path.begin(), path.end(), '\\') != path.end())
+  {
+    return false;
+  }
+  const char* segment = path.begin();
+  while (segment < path.end())
+  {
+    const char* slash = std::find(segment, path.end(), '/');
+    if (StringPiece(segment, static_cast<int>(slash - segment)) == "..")
+    {
+      return false;
+    }
+    segment = slash + 1;
+  }
+  return true;
+}
+
+struct FileStat
+{
+  int64_t size;
+  int64_t modifyTime;
+};
+
+bool statRegularFile(const string& filename, FileStat* st)
+{
+  uv_fs_t req;
+  int err = uv_fs_stat(NULL, &req, filename.c_str(), NULL);
+  bool regular = err == 0 && (req.statbuf.st_mode & S_IFMT) == S_IFREG;
+  if (regular)
+  {
+    st->size = static_cast<int64_t>(req.statbuf.st_size);
+    st->modifyTime = static_cast<int64_t>(req.statbuf.st_mtim.tv_sec);
+  }
+  uv_fs_req_cleanup(&req);
+  return regular;
+}
+
+int openFile(const string& filename)
+{
+  uv_fs_t req;
+  int fd = uv_fs_open(NULL, &req, filename.c_str(), O_RDONLY, 0, NULL);
+  uv_fs_req_cleanup(&req);
+  return fd;
+}
+
+void closeFile(int fd)
+{
+  uv_fs_t req;
+  uv_fs_close(NULL, &req, fd, NULL);
+  uv_fs_req_cleanup(&req);
+}
+
+// appends size bytes of filename to *out, false if it is not all there
+bool readWholeFile(const string& filename, int64_t size, string* out)
+{
+  int fd = openFile(filename);
+  if (fd < 0)
+  {
+    return false;
+  }
+  size_t begin = out->size();
+  out->resize(begin + static_cast<size_t>(size));
+  int64_t offset = 0;
+  while (offset < size)
+  {
+    uv_buf_t buf = uv_buf_init(&(*out)[begin + static_cast<size_t>(offset)],
+                               static_cast<unsigned int>(size - offset));
+    uv_fs_t req;
+    int n = uv_fs_read(NULL, &req, fd, &buf, 1, offset, NULL);
+    uv_fs_req_cleanup(&req);
+    if (n <= 0)
+    {
+      break;
+    }
+    offset += n;
+  }
+  closeFile(fd);
+  return offset == size;
+}
+
+// W/ is not needed, the tag changes with the size or the mtime
+string entityTag(const FileStat& st)
+{
+  char buf[64];
+  snprintf(buf, sizeof buf, "\"%llx-%llx\"",
+           static_cast<unsigned long long>(st.modifyTime),
+           static_cast<unsigned long long>(st.size));
+  return buf;
+}
+
+bool matchEntityTag(StringPiece ifNoneMatch, const string& etag)
+{
+  return ifNoneMatch == "*" || contains(ifNoneMatch, etag);
+}
+
+void appendHeader(string* out, StringPiece field, StringPiece value)
+{
+  out->append(field.data(), field.size());
+  out->append(": ", 2);
+  out->append(value.data(), value.size());
+  out->append("\r\n", 2);
+}
+
+void appendContentLength(string* out, int64_t length)
+{
+  char buf[32];
+  snprintf(buf, sizeof buf, "%lld", static_cast<long long>(length));
+  appendHeader(out, "Content-Length", buf);
+}
+
+}  // namespace
+
+HttpFileHandler::HttpFileHandler(const string& root, const string& prefix)
+  : root_(!root.empty() && root[root.size() - 1] == '/'
+          ? root.substr(0, root.size() - 1) : root),
+    prefix_(prefix),
+    maxCachedFileSize_(kDefaultMaxCachedFileSize),
+    cacheCapacity_(kDefaultCacheCapacity),
+    cachedBytes_(0)
+{
+}
+
+HttpFileHandler::~HttpFileHandler()
+{
+}
+
+void HttpFileHandler::setCacheCapacity(size_t bytes)
+{
+  MutexLockGuard lock(mutex_);
+  cacheCapacity_ = bytes;
+  while (cachedBytes_ > cacheCapacity_)
+  {
+    cachedBytes_ -= lru_.back().bytes();
+    index_.erase(lru_.back().filename);
+    lru_.pop_back();
+  }
+}
+
+size_t HttpFileHandler::cachedBytes() const
+{
+  MutexLockGuard lock(mutex_);
+  return cachedBytes_;
+}
+
+// set by setCacheCapacity() from any thread
+size_t HttpFileHandler::cacheCapacity() const
+{
+  MutexLockGuard lock(mutex_);
+  return cacheCapacity_;
+}
+
+bool HttpFileHandler::findCached(const string& filename,
+                                 int64_t size,
+                                 int64_t modifyTime,
+                                 Entry* found)
+{
+  MutexLockGuard lock(mutex_);
+  std::map<string, EntryList::iterator>::iterator it = index_.find(filename);
+  if (it != index_.end())
+  {
+    EntryList::iterator entry = it->second;
+    if (entry->size == size && entry->modifyTime == modifyTime)
+    {
+      lru_.splice(lru_.begin(), lru_, entry);
+      *found = *entry;
+      return true;
+    }
+    // changed on disk
+    cachedBytes_ -= entry->bytes();
+    lru_.erase(entry);
+    index_.erase(it);
+  }
+  return false;
+}
+
+void HttpFileHandler::insertCached(const Entry& entry)
+{
+  MutexLockGuard lock(mutex_);
+  if (entry.bytes() > cacheCapacity_
+      || index_.find(entry.filename) != index_.end())
+  {
+    return;
+  }
+  lru_.push_front(entry);
+  index_[entry.filename] = lru_.begin();
+  cachedBytes_ += entry.bytes();
+  while (cachedBytes_ > cacheCapacity_)
+  {
+    cachedBytes_ -= lru_.back().bytes();
+    index_.erase(lru_.back().filename);
+    lru_.pop_back();
+  }
+}
+
+bool HttpFileHandler::handle(const HttpRequest& req, HttpResponse* resp)
+{
+  StringPiece path = req.pathView();
+  if (!path.starts_with(prefix_))
+  {
+    return false;
+  }
+  path.remove_prefix(static_cast<int>(prefix_.size()));
+
+  if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+  {
+    resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+    resp->addHeader("Allow", "GET, HEAD");
+    return true;
+  }
+  FileStat st;
+  string filename = root_ + "/" + path.as_string();
+  if (path.empty() || endsWith(path, "/"))
+  {
+    filename += "index.html";
+  }
+  if (!safePath(path) || !statRegularFile(filename, &st))
+  {
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    return true;
+  }
+
+  string etag = entityTag(st);
+  // the gzip variant has a tag of its own, "mtime-size-gz"
+  string gzipEtag = etag.substr(0, etag.size() - 1) + "-gz\"";
+  char lastModified[detail::kHttpDateLength];
+  detail::formatHttpDate(st.modifyTime, lastModified);
+  StringPiece modified(lastModified, detail::kHttpDateLength);
+  const char* type = contentType(filename);
+  const bool cacheable = cacheCapacity() > 0
+      && st.size <= static_cast<int64_t>(maxCachedFileSize_);
+  // compressed once, when the file enters the cache
+  const bool compressible = cacheable && compressor_.enabled()
+      && compressor_.worthCompressing(type, static_cast<size_t>(st.size));
+
+  // revalidation, If-Modified-Since only counts without If-None-Match and
+  // must match exactly, as with nginx's default
+  StringPiece ifNoneMatch = req.findHeader("If-None-Match");
+  StringPiece ifModifiedSince = req.findHeader("If-Modified-Since");
+  bool gzipMatch = !ifNoneMatch.empty() && matchEntityTag(ifNoneMatch, gzipEtag);
+  if (ifNoneMatch.empty()
+      ? ifModifiedSince == modified
+      : gzipMatch || matchEntityTag(ifNoneMatch, etag))
+  {
+    resp->setStatusCode(HttpResponse::k304NotModified);
+    resp->addHeader("ETag", gzipMatch ? gzipEtag : etag);
+    resp->addHeader("Last-Modified", modified);
+    if (compressible)
+    {
+      resp->addHeader("Vary", "Accept-Encoding");
+    }
+    static const boost::shared_ptr<const string> kNoBody(new string("\r\n"));
+    resp->setRenderedTail(kNoBody);
+    return true;
+  }
+
+  int64_t first = 0;
+  int64_t last = st.size - 1;
+  int range = 0;
+  StringPiece rangeHeader = req.findHeader("Range");
+  StringPiece ifRange = req.findHeader("If-Range");
+  if (!rangeHeader.empty() && (ifRange.empty() || ifRange == etag || ifRange == modified))
+  {
+    range = detail::parseByteRange(rangeHeader, st.size, &first, &last);
+  }
+  if (range < 0)
+  {
+    char contentRange[48];
+    snprintf(contentRange, sizeof contentRange, "bytes */%lld",
+             static_cast<long long>(st.size));
+    resp->setStatusCode(HttpResponse::k416RangeNotSatisfiable);
+    resp->addHeader("Content-Range", contentRange);
+    return true;
+  }
+  const bool head = req.method() == HttpRequest::kHead;
+
+  if (range == 0 && cacheable)
+  {
+    Entry entry;
+    if (findCached(filename, st.size, st.modifyTime, &entry))
+    {
+      cacheHits_.increment();
+    }
+    else
+    {
+      cacheMisses_.increment();
+      entry.filename = filename;
+      entry.size = st.size;
+      entry.modifyTime = st.modifyTime;
+      entry.gzipHeaderLength = 0;
+      string* response = new string;
+      entry.response.reset(response);
+      appendHeader(response, "Content-Type", type);
+      appendHeader(response, "Last-Modified", modified);
+      appendHeader(response, "ETag", etag);
+      appendHeader(response, "Accept-Ranges", "bytes");
+      if (compressible)
+      {
+        appendHeader(response, "Vary", "Accept-Encoding");
+      }
+      appendContentLength(response, st.size);
+      response->append("\r\n", 2);
+      entry.headerLength = response->size();
+      if (!readWholeFile(filename, st.size, response))
+      {
+        resp->setStatusCode(HttpResponse::k404NotFound);
+        return true;
+      }
+      string compressed;
+      if (compressible
+          && compressor_.compress(HttpCompressor::kGzip,
+                                  StringPiece(response->data() + entry.headerLength,
+                                              static_cast<int>(st.size)),
+                                  &compressed))
+      {
+        string* gzipResponse = new string;
+        entry.gzipResponse.reset(gzipResponse);
+        appendHeader(gzipResponse, "Content-Type", type);
+        appendHeader(gzipResponse, "Last-Modified", modified);
+        appendHeader(gzipResponse, "ETag", gzipEtag);
+        appendHeader(gzipResponse, "Vary", "Accept-Encoding");
+        appendHeader(gzipResponse, "Content-Encoding", "gzip");
+        appendContentLength(gzipResponse, static_cast<int64_t>(compressed.size()));
+        gzipResponse->append("\r\n", 2);
+        entry.gzipHeaderLength = gzipResponse->size();
+        gzipResponse->append(compressed);
+      }
+      insertCached(entry);
+    }
+
+    boost::shared_ptr<const string> cached = entry.response;
+    size_t headerLength = entry.headerLength;
+    if (entry.gzipResponse
+        && HttpCompressor::negotiate(req.findHeader("Accept-Encoding")) == HttpCompressor::kGzip)
+    {
+      cached = entry.gzipResponse;
+      headerLength = entry.gzipHeaderLength;
+    }
+    resp->setStatusCode(HttpResponse::k200Ok);
+    if (head)
+    {
+      cached.reset(new string(cached->data(), headerLength));
+    }
+    resp->setRenderedTail(cached);
+    return true;
+  }
+
+  resp->setStatusCode(range > 0 ? HttpResponse::k206PartialContent : HttpResponse::k200Ok);
+  resp->setContentType(type);
+  resp->addHeader("Last-Modified", modified);
+  resp->addHeader("ETag", etag);
+  resp->addHeader("Accept-Ranges", "bytes");
+  if (compressible)
+  {
+    resp->addHeader("Vary", "Accept-Encoding");
+  }
+  if (range > 0)
+  {
+    char contentRange[80];
+    snprintf(contentRange, sizeof contentRange, "bytes %lld-%lld/%lld",
+             static_cast<long long>(first),
+             static_cast<long long>(last),
+             static_cast<long long>(st.size));
+    resp->addHeader("Content-Range", contentRange);
+  }
+  int64_t length = last - first + 1;
+  if (head)
+  {
+    string* tail = new string;
+    appendContentLength(tail, length);
+    tail->append("\r\n", 2);
+    resp->setRenderedTail(boost::shared_ptr<const string>(tail));
+    return true;
+  }
+  int fd = openFile(filename);
+  if (fd < 0)
+  {
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    return true;
+  }
+  resp->setBodyFile(fd, first, length);
+  return true;
+}
@@ -0,0 +1,117 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPFILEHANDLER_H
+#define MUDUO_NET_HTTP_HTTPFILEHANDLER_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/http/HttpCompressor.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <map>
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpRequest;
+class HttpResponse;
+
+/// Serves the files under a directory from an HttpServer::HttpCallback.
+///
+/// Small files are kept in an LRU cache as rendered headers plus body,
+/// which HttpServer sends without a copy.  Larger files go out with
+/// sendfile(2).  GET and HEAD, single byte ranges, If-None-Match,
+/// If-Modified-Since and If-Range are handled.  With a compression level
+/// set, textual files are gzipped as they enter the cache, and that copy
+/// goes to clients that accept gzip.
+///
+/// Thread safe.
+class HttpFileHandler : boost::noncopyable
+{
+ public:
+  static const size_t kDefaultCacheCapacity = 64*1024*1024;
+  static const size_t kDefaultMaxCachedFileSize = 256*1024;
+
+  /// URL paths starting with prefix map to the files under root,
+  /// "/static/a.css" to "root/a.css" for prefix "/static/".
+  HttpFileHandler(const string& root, const string& prefix);
+  ~HttpFileHandler();
+
+  /// Bytes of cached responses, 0 disables the cache.
+  void setCacheCapacity(size_t bytes);
+
+  /// Larger files are always read from disk.
+  void setMaxCachedFileSize(size_t bytes)
+  { maxCachedFileSize_ = bytes; }
+
+  /// zlib level for the gzip copies, 0 (the default) for none.
+  void setCompressionLevel(int level)
+  { compressor_.setLevel(level); }
+
+  /// Smaller files are not compressed.
+  void setCompressionMinSize(size_t bytes)
+  { compressor_.setMinSize(bytes); }
+
+  /// Returns false and leaves resp alone if the path is not under prefix.
+  bool handle(const HttpRequest& req, HttpResponse* resp);
+
+  int64_t cacheHits() { return cacheHits_.get(); }
+  int64_t cacheMisses() { return cacheMisses_.get(); }
+  size_t cachedBytes() const;
+
+ private:
+  struct Entry
+  {
+    string filename;
+    int64_t size;
+    int64_t modifyTime;
+    boost::shared_ptr<const string> response;  // headers after Date, and body
+    size_t headerLength;
+    boost::shared_ptr<const string> gzipResponse;  // may be NULL
+    size_t gzipHeaderLength;
+
+    size_t bytes() const
+    { return response->size() + (gzipResponse ? gzipResponse->size() : 0); }
+  };
+  typedef std::list<Entry> EntryList;
+
+  bool findCached(const string& filename,
+                  int64_t size,
+                  int64_t modifyTime,
+                  Entry* found);
+  void insertCached(const Entry& entry);
+  size_t cacheCapacity() const;
+
+  const string root_;
+  const string prefix_;
+  size_t maxCachedFileSize_;
+  HttpCompressor compressor_;
+  AtomicInt64 cacheHits_;
+  AtomicInt64 cacheMisses_;
+
+  mutable MutexLock mutex_;
+  size_t cacheCapacity_;
+  size_t cachedBytes_;
+  EntryList lru_;  // most recently used first
+  std::map<string, EntryList::iterator> index_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPFILEHANDLER_H
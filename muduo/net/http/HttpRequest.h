@@ -12,11 +12,15 @@
 #define MUDUO_NET_HTTP_HTTPREQUEST_H
 
 #include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/Types.h>
 
+#include <algorithm>
 #include <map>
+#include <vector>
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 
 namespace muduo
@@ -24,6 +28,14 @@ namespace muduo
 namespace net
 {
 
+/// path(), query(), headers() and body() are strings owned by the request.
+/// Beside them pathView(), queryView(), findHeader(), header(i) and
+/// bodyView() are StringPiece views, into a copy of the header block
+/// owned by the request.
+/// With HttpServer::setZeroCopy(true), a request that arrived in whole is
+/// left in the connection's input Buffer: only the views are set, they
+/// are valid until the HttpCallback returns, and the strings are empty.
+/// A copy of such a request owns its data and has the strings too.
 class HttpRequest : public muduo::copyable
 {
  public:
@@ -36,10 +48,59 @@ class HttpRequest : public muduo::copyable
     kUnknown, kHttp10, kHttp11
   };
 
+  struct Header
+  {
+    StringPiece field;
+    StringPiece value;
+  };
+
+  // headers beyond this many go to the heap
+  static const int kInlineHeaders = 24;
+
   HttpRequest()
     : method_(kInvalid),
-      version_(kUnknown)
+      version_(kUnknown),
+      numHeaders_(0)
+  {
+  }
+
+  HttpRequest(const HttpRequest& that)
+    : method_(kInvalid),
+      version_(kUnknown),
+      numHeaders_(0)
+  {
+    *this = that;
+  }
+
+  // views into the storage of that are moved over to our own copy
+  HttpRequest& operator=(const HttpRequest& that)
   {
+    if (this != &that)
+    {
+      method_ = that.method_;
+      version_ = that.version_;
+      path_ = that.path_;
+      query_ = that.query_;
+      receiveTime_ = that.receiveTime_;
+      numHeaders_ = that.numHeaders_;
+      std::copy(that.headers_, that.headers_ + numHeaders_, headers_);
+      moreHeaders_ = that.moreHeaders_;
+      body_ = that.body_;
+      bodyStorage_ = that.bodyStorage_;
+      pathString_ = that.pathString_;
+      queryString_ = that.queryString_;
+      headerMap_ = that.headerMap_;
+      if (that.block_.empty())
+      {
+        storage_.clear();
+        block_.clear();
+      }
+      else
+      {
+        keepHeaderBlock(that.block_.begin(), that.block_.end());
+      }
+    }
+    return *this;
   }
 
   void setVersion(Version v)
@@ -53,7 +114,7 @@ class HttpRequest : public muduo::copyable
   bool setMethod(const char* start, const char* end)
   {
     assert(method_ == kInvalid);
-    string m(start, end);
+    StringPiece m(start, static_cast<int>(end - start));
     if (m == "GET")
     {
       method_ = kGet;
@@ -110,20 +171,61 @@ class HttpRequest : public muduo::copyable
     return result;
   }
 
+  // the input the views point into, left in place
+  void setHeaderBlock(const char* start, const char* end)
+  {
+    block_.set(start, static_cast<int>(end - start));
+  }
+
+  // copies the request line and headers in one go,
+  // views into [start, end) are moved over to the copy,
+  // and the strings are filled from them
+  void keepHeaderBlock(const char* start, const char* end)
+  {
+    size_t len = static_cast<size_t>(end - start);
+    // never in the SSO buffer, so views survive swap()
+    string storage;
+    storage.reserve(std::max<size_t>(len, 32));
+    storage.assign(start, end);
+    storage_.swap(storage);
+    rebase(start, len, storage_.data());
+    block_ = storage_;
+    if (!body_.empty())
+    {
+      // a body left in place, see HttpServer::setZeroCopy
+      bodyStorage_.assign(body_.data(), body_.size());
+      body_.clear();
+    }
+    pathString_.assign(path_.data(), path_.size());
+    queryString_.assign(query_.data(), query_.size());
+    headerMap_.clear();
+    for (int i = 0; i < headerCount(); ++i)
+    {
+      const Header& h = header(i);
+      headerMap_[h.field.as_string()] = h.value.as_string();
+    }
+  }
+
   void setPath(const char* start, const char* end)
   {
-    path_.assign(start, end);
+    path_.set(start, static_cast<int>(end - start));
   }
 
   const string& path() const
+  { return pathString_; }
+
+  StringPiece pathView() const
   { return path_; }
 
   void setQuery(const char* start, const char* end)
   {
-    query_.assign(start, end);
+    query_.set(start, static_cast<int>(end - start));
   }
 
   const string& query() const
+  { return queryString_; }
+
+  StringPiece queryView() const
   { return query_; }
 
   void setReceiveTime(Timestamp t)
@@ -134,50 +236,174 @@ class HttpRequest : public muduo::copyable
 
   void addHeader(const char* start, const char* colon, const char* end)
   {
-    string field(start, colon);
+    Header h;
+    h.field.set(start, static_cast<int>(colon - start));
     ++colon;
     while (colon < end && isspace(*colon))
     {
       ++colon;
     }
-    string value(colon, end);
-    while (!value.empty() && isspace(value[value.size()-1]))
+    while (end > colon && isspace(end[-1]))
+    {
+      --end;
+    }
+    h.value.set(colon, static_cast<int>(end - colon));
+    if (numHeaders_ < kInlineHeaders)
     {
-      value.resize(value.size()-1);
+      headers_[numHeaders_++] = h;
+    }
+    else
+    {
+      moreHeaders_.push_back(h);
     }
-    headers_[field] = value;
   }
 
-  string getHeader(const string& field) const
+  // trailer fields of a chunked body, appended to the header block
+  // the request owns
+  void addTrailer(const char* start, const char* colon, const char* end)
   {
-    string result;
-    std::map<string, string>::const_iterator it = headers_.find(field);
-    if (it != headers_.end())
+    size_t len = storage_.size();
+    string storage;
+    storage.reserve(len + (end - start));
+    storage.assign(storage_);
+    storage.append(start, end);
+    rebase(storage_.data(), len, storage.data());
+    storage_.swap(storage);
+    block_ = storage_;
+    const char* line = storage_.data() + len;
+    addHeader(line, line + (colon - start), line + (end - start));
+    const Header& h = header(headerCount() - 1);
+    headerMap_[h.field.as_string()] = h.value.as_string();
+  }
+
+  // case-insensitive, the first match wins, empty if not found
+  StringPiece findHeader(StringPiece field) const
+  {
+    for (int i = 0; i < headerCount(); ++i)
     {
-      result = it->second;
+      const Header& h = header(i);
+      if (equalsIgnoreCase(h.field, field))
+      {
+        return h.value;
+      }
     }
-    return result;
+    return StringPiece();
   }
 
+  // case-insensitive as findHeader()
+  string getHeader(const string& field) const
+  {
+    return findHeader(field).as_string();
+  }
+
+  // the last of the same field wins
   const std::map<string, string>& headers() const
-  { return headers_; }
+  { return headerMap_; }
+
+  int headerCount() const
+  { return numHeaders_ + static_cast<int>(moreHeaders_.size()); }
+
+  // in the order received
+  const Header& header(int i) const
+  {
+    assert(0 <= i && i < headerCount());
+    return i < numHeaders_ ? headers_[i] : moreHeaders_[i - numHeaders_];
+  }
+
+  void setBody(const char* start, const char* end)
+  {
+    bodyStorage_.clear();
+    body_.set(start, static_cast<int>(end - start));
+  }
+
+  void appendBody(const char* start, const char* end)
+  {
+    body_.clear();
+    bodyStorage_.append(start, end);
+  }
+
+  // empty if the server streams bodies through a BodyCallback
+  const string& body() const
+  { return bodyStorage_; }
+
+  StringPiece bodyView() const
+  { return body_.empty() ? StringPiece(bodyStorage_) : body_; }
+
+  static bool equalsIgnoreCase(StringPiece a, StringPiece b)
+  {
+    if (a.size() != b.size())
+    {
+      return false;
+    }
+    for (int i = 0; i < a.size(); ++i)
+    {
+      if (a[i] != b[i] && tolower(a[i]) != tolower(b[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
 
   void swap(HttpRequest& that)
   {
     std::swap(method_, that.method_);
-    path_.swap(that.path_);
-    query_.swap(that.query_);
+    std::swap(version_, that.version_);
+    std::swap(path_, that.path_);
+    std::swap(query_, that.query_);
     receiveTime_.swap(that.receiveTime_);
-    headers_.swap(that.headers_);
+    std::swap(numHeaders_, that.numHeaders_);
+    for (int i = 0; i < kInlineHeaders; ++i)
+    {
+      std::swap(headers_[i], that.headers_[i]);
+    }
+    moreHeaders_.swap(that.moreHeaders_);
+    storage_.swap(that.storage_);
+    std::swap(block_, that.block_);
+    std::swap(body_, that.body_);
+    bodyStorage_.swap(that.bodyStorage_);
+    pathString_.swap(that.pathString_);
+    queryString_.swap(that.queryString_);
+    headerMap_.swap(that.headerMap_);
   }
 
  private:
+  static void rebase(StringPiece* piece, const char* from, size_t len, const char* to)
+  {
+    if (piece->data() >= from && piece->end() <= from + len && len > 0)
+    {
+      piece->set(to + (piece->data() - from), piece->size());
+    }
+  }
+
+  void rebase(const char* from, size_t len, const char* to)
+  {
+    rebase(&path_, from, len, to);
+    rebase(&query_, from, len, to);
+    rebase(&body_, from, len, to);
+    for (int i = 0; i < headerCount(); ++i)
+    {
+      Header& h = i < numHeaders_ ? headers_[i] : moreHeaders_[i - numHeaders_];
+      rebase(&h.field, from, len, to);
+      rebase(&h.value, from, len, to);
+    }
+  }
+
   Method method_;
   Version version_;
-  string path_;
-  string query_;
+  StringPiece path_;
+  StringPiece query_;
   Timestamp receiveTime_;
-  std::map<string, string> headers_;
+  int numHeaders_;
+  Header headers_[kInlineHeaders];
+  std::vector<Header> moreHeaders_;
+  string storage_;
+  StringPiece block_;
+  StringPiece body_;
+  string bodyStorage_;
+  string pathString_;
+  string queryString_;
+  std::map<string, string> headerMap_;
 };
 
 }
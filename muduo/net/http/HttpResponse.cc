@@ -9,19 +9,228 @@
 
 #include <muduo/net/http/HttpResponse.h>
 #include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+
+#include <muduo/base/ThreadLocalSingleton.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
 
 #include <stdio.h>
+#include <time.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
-void HttpResponse::appendToBuffer(Buffer* output) const
+namespace
+{
+
+#define STATUS_LINE(code, reason) \
+  case code: { static const char line[] = "HTTP/1.1 " #code " " reason "\r\n"; \
+               return StringPiece(line, sizeof line - 1); }
+
+StringPiece renderedStatusLine(int code)
+{
+  switch (code)
+  {
+    STATUS_LINE(100, "Continue")
+    STATUS_LINE(200, "OK")
+    STATUS_LINE(201, "Created")
+    STATUS_LINE(204, "No Content")
+    STATUS_LINE(206, "Partial Content")
+    STATUS_LINE(301, "Moved Permanently")
+    STATUS_LINE(302, "Found")
+    STATUS_LINE(304, "Not Modified")
+    STATUS_LINE(400, "Bad Request")
+    STATUS_LINE(401, "Unauthorized")
+    STATUS_LINE(403, "Forbidden")
+    STATUS_LINE(404, "Not Found")
+    STATUS_LINE(405, "Method Not Allowed")
+    STATUS_LINE(408, "Request Timeout")
+    STATUS_LINE(413, "Payload Too Large")
+    STATUS_LINE(416, "Range Not Satisfiable")
+    STATUS_LINE(500, "Internal Server Error")
+    STATUS_LINE(501, "Not Implemented")
+    STATUS_LINE(503, "Service Unavailable")
+    default:
+      return StringPiece();
+  }
+}
+
+#undef STATUS_LINE
+
+char* twoDigits(char* p, int n)
+{
+  *p++ = static_cast<char>('0' + n / 10);
+  *p++ = static_cast<char>('0' + n % 10);
+  return p;
+}
+
+// Rendered once a second by a timer in the loop of the thread, or by
+// ::time() in a thread without one.  The timer holds the only reference
+// to a token, which expires with the loop, so a later loop of the thread
+// gets a timer of its own, even at the same address.
+class DateHeader : boost::noncopyable
+{
+ public:
+  DateHeader()
+    : loop_(NULL),
+      second_(0)
+  {
+    render(::time(NULL));
+    attach();
+  }
+
+  ~DateHeader()
+  {
+    // the timer is gone with its loop otherwise
+    if (!token_.expired() && EventLoop::getEventLoopOfCurrentThread() == loop_)
+    {
+      loop_->cancel(timerId_);
+    }
+  }
+
+  StringPiece header()
+  {
+    if (token_.expired() || EventLoop::getEventLoopOfCurrentThread() != loop_)
+    {
+      time_t now = ::time(NULL);
+      if (now != second_)
+      {
+        render(now);
+      }
+      attach();
+    }
+    return StringPiece(buf_, kLength);
+  }
+
+ private:
+  void attach()
+  {
+    EventLoop* loop = EventLoop::getEventLoopOfCurrentThread();
+    if (loop && token_.expired())
+    {
+      loop_ = loop;
+      boost::shared_ptr<int> token(new int(0));
+      token_ = token;
+      scheduleTick(token);
+    }
+  }
+
+  // on the next second boundary, rescheduled each time as runEvery()
+  // would drift, and the loop may fire it a few milliseconds early
+  void scheduleTick(const boost::shared_ptr<int>& token)
+  {
+    Timestamp now(Timestamp::now());
+    int64_t usec = Timestamp::kMicroSecondsPerSecond
+        - now.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond;
+    time_t second = static_cast<time_t>(now.secondsSinceEpoch() + 1);
+    timerId_ = loop_->runAfter(static_cast<double>(usec) / Timestamp::kMicroSecondsPerSecond,
+                               boost::bind(&DateHeader::tick, this, token, second));
+  }
+
+  void tick(const boost::shared_ptr<int>& token, time_t second)
+  {
+    render(std::max(::time(NULL), second));
+    scheduleTick(token);
+  }
+
+  void render(time_t now)
+  {
+    std::copy("Date: ", "Date: " + 6, buf_);
+    detail::formatHttpDate(now, buf_ + 6);
+    std::copy("\r\n", "\r\n" + 2, buf_ + 6 + detail::kHttpDateLength);
+    second_ = now;
+  }
+
+  static const int kLength = 37;  // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+
+  EventLoop* loop_;
+  TimerId timerId_;
+  boost::weak_ptr<int> token_;
+  char buf_[kLength];
+  time_t second_;
+};
+
+// no snprintf()
+void appendDecimal(Buffer* output, size_t n)
 {
   char buf[32];
-  snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
-  output->append(buf);
-  output->append(statusMessage_);
-  output->append("\r\n");
+  char* end = buf + sizeof buf;
+  char* p = end;
+  do
+  {
+    *--p = static_cast<char>('0' + n % 10);
+    n /= 10;
+  } while (n != 0);
+  output->append(p, end - p);
+}
+
+}
+
+StringPiece detail::statusLine(int code)
+{
+  return renderedStatusLine(code);
+}
+
+StringPiece detail::dateHeader()
+{
+  return ThreadLocalSingleton<DateHeader>::instance().header();
+}
+
+// IMF-fixdate of RFC 7231, without strftime() and its locale
+void detail::formatHttpDate(int64_t secondsSinceEpoch, char buf[kHttpDateLength])
+{
+  static const char kDays[][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char kMonths[][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+  time_t seconds = static_cast<time_t>(secondsSinceEpoch);
+  struct tm tm;
+  ::gmtime_r(&seconds, &tm);
+  char* p = buf;
+  p = std::copy(kDays[tm.tm_wday], kDays[tm.tm_wday] + 3, p);
+  *p++ = ',';
+  *p++ = ' ';
+  p = twoDigits(p, tm.tm_mday);
+  *p++ = ' ';
+  p = std::copy(kMonths[tm.tm_mon], kMonths[tm.tm_mon] + 3, p);
+  *p++ = ' ';
+  int year = tm.tm_year + 1900;
+  p = twoDigits(p, year / 100);
+  p = twoDigits(p, year % 100);
+  *p++ = ' ';
+  p = twoDigits(p, tm.tm_hour);
+  *p++ = ':';
+  p = twoDigits(p, tm.tm_min);
+  *p++ = ':';
+  p = twoDigits(p, tm.tm_sec);
+  p = std::copy(" GMT", " GMT" + 4, p);
+  assert(p == buf + kHttpDateLength);
+}
+
+void HttpResponse::appendToBuffer(Buffer* output) const
+{
+  StringPiece line = detail::statusLine(statusCode_);
+  // "HTTP/1.1 200 " is 13 bytes, then the reason phrase and CRLF
+  if (!line.empty()
+      && (statusMessage_.empty()
+          || StringPiece(line.data() + 13, line.size() - 15) == statusMessage_))
+  {
+    output->append(line.data(), line.size());
+  }
+  else
+  {
+    output->append("HTTP/1.1 ");
+    appendDecimal(output, statusCode_);
+    output->append(" ");
+    output->append(statusMessage_);
+    output->append("\r\n");
+  }
+  StringPiece date = detail::dateHeader();
+  output->append(date.data(), date.size());
 
   if (closeConnection_)
   {
@@ -29,21 +238,25 @@ void HttpResponse::appendToBuffer(Buffer* output) const
   }
   else
   {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->append(buf);
     output->append("Connection: Keep-Alive\r\n");
   }
-
-  for (std::map<string, string>::const_iterator it = headers_.begin();
-       it != headers_.end();
-       ++it)
+  if (bodyFile_ >= 0)
+  {
+    output->append("Content-Length: ");
+    appendDecimal(output, static_cast<size_t>(fileLength_));
+    output->append("\r\n");
+  }
+  else if (!tail_ && !closeConnection_)
   {
-    output->append(it->first);
-    output->append(": ");
-    output->append(it->second);
+    output->append("Content-Length: ");
+    appendDecimal(output, body_.size());
     output->append("\r\n");
   }
 
-  output->append("\r\n");
-  output->append(body_);
+  output->append(headers_);
+  if (!tail_)
+  {
+    output->append("\r\n");
+    output->append(body_);
+  }
 }
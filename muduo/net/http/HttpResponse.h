@@ -12,9 +12,10 @@
 #define MUDUO_NET_HTTP_HTTPRESPONSE_H
 
 #include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
 #include <muduo/base/Types.h>
 
-#include <map>
+#include <boost/shared_ptr.hpp>
 
 namespace muduo
 {
@@ -22,29 +23,54 @@ namespace net
 {
 
 class Buffer;
+
+/// Headers are rendered as they are added, appendToBuffer() is a few
+/// memcpy()s: a pre-rendered status line, the cached Date header of
+/// this thread, the headers and the body.
 class HttpResponse : public muduo::copyable
 {
  public:
   enum HttpStatusCode
   {
     kUnknown,
+    k100Continue = 100,
     k200Ok = 200,
+    k201Created = 201,
+    k204NoContent = 204,
+    k206PartialContent = 206,
     k301MovedPermanently = 301,
+    k302Found = 302,
+    k304NotModified = 304,
     k400BadRequest = 400,
+    k401Unauthorized = 401,
+    k403Forbidden = 403,
     k404NotFound = 404,
+    k405MethodNotAllowed = 405,
+    k408RequestTimeout = 408,
+    k413PayloadTooLarge = 413,
+    k416RangeNotSatisfiable = 416,
+    k500InternalServerError = 500,
+    k501NotImplemented = 501,
+    k503ServiceUnavailable = 503,
   };
 
   explicit HttpResponse(bool close)
     : statusCode_(kUnknown),
-      closeConnection_(close)
+      contentTypeEnd_(0),
+      contentTypeLength_(0),
+      closeConnection_(close),
+      bodyFile_(-1),
+      fileOffset_(0),
+      fileLength_(0)
   {
   }
 
   void setStatusCode(HttpStatusCode code)
   { statusCode_ = code; }
 
-  void setStatusMessage(const string& message)
-  { statusMessage_ = message; }
+  /// Optional for the codes above, their standard reason phrase is used.
+  void setStatusMessage(StringPiece message)
+  { message.CopyToString(&statusMessage_); }
 
   void setCloseConnection(bool on)
   { closeConnection_ = on; }
@@ -52,27 +78,88 @@ class HttpResponse : public muduo::copyable
   bool closeConnection() const
   { return closeConnection_; }
 
-  void setContentType(const string& contentType)
-  { addHeader("Content-Type", contentType); }
+  void setContentType(StringPiece contentType)
+  {
+    addHeader("Content-Type", contentType);
+    // the value just rendered, before its CRLF
+    contentTypeEnd_ = headers_.size() - 2;
+    contentTypeLength_ = contentType.size();
+  }
 
-  // FIXME: replace string with StringPiece
-  void addHeader(const string& key, const string& value)
-  { headers_[key] = value; }
+  StringPiece contentType() const
+  {
+    return StringPiece(headers_.data() + contentTypeEnd_ - contentTypeLength_,
+                       static_cast<int>(contentTypeLength_));
+  }
+
+  /// Not checked for duplicates, add each field once.
+  void addHeader(StringPiece key, StringPiece value)
+  {
+    headers_.append(key.data(), key.size());
+    headers_.append(": ", 2);
+    headers_.append(value.data(), value.size());
+    headers_.append("\r\n", 2);
+  }
 
   void setBody(const string& body)
   { body_ = body; }
 
+  const string& body() const
+  { return body_; }
+
+  void swapBody(string* body)
+  { body_.swap(*body); }
+
+  /// The body is length bytes of file from offset, HttpServer sends it with
+  /// TcpConnection::sendFile() after the headers and closes file.
+  void setBodyFile(int file, int64_t offset, int64_t length)
+  {
+    bodyFile_ = file;
+    fileOffset_ = offset;
+    fileLength_ = length;
+  }
+
+  /// Everything after the headers added here: the remaining headers,
+  /// Content-Length if any, the blank line and the body.  Shared by the
+  /// responses for one resource, HttpServer sends it without a copy.
+  void setRenderedTail(const boost::shared_ptr<const string>& tail)
+  { tail_ = tail; }
+
+  int bodyFile() const { return bodyFile_; }
+  int64_t fileOffset() const { return fileOffset_; }
+  int64_t fileLength() const { return fileLength_; }
+  const boost::shared_ptr<const string>& renderedTail() const { return tail_; }
+
+  /// Up to the body, which is left to the caller with a file or tail.
   void appendToBuffer(Buffer* output) const;
 
  private:
-  std::map<string, string> headers_;
+  string headers_;  // rendered "key: value\r\n" lines
   HttpStatusCode statusCode_;
+  size_t contentTypeEnd_;
+  size_t contentTypeLength_;
   // FIXME: add http version
   string statusMessage_;
   bool closeConnection_;
   string body_;
+  int bodyFile_;
+  int64_t fileOffset_;
+  int64_t fileLength_;
+  boost::shared_ptr<const string> tail_;
 };
 
+namespace detail
+{
+// "HTTP/1.1 200 OK\r\n", empty for codes not in HttpStatusCode
+StringPiece statusLine(int code);
+// "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n" for now, cached per thread
+// and refreshed every second by a timer on the thread's EventLoop
+StringPiece dateHeader();
+// "Sun, 06 Nov 1994 08:49:37 GMT", as in Date and Last-Modified
+const int kHttpDateLength = 29;
+void formatHttpDate(int64_t secondsSinceEpoch, char buf[kHttpDateLength]);
+}
+
 }
 }
 
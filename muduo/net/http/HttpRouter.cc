@@ -0,0 +1,399 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpRouter.h>
+
+#include <muduo/net/http/HttpResponse.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const int kMethods = HttpRequest::kDelete + 1;
+
+const char* const kMethodNames[kMethods] =
+{
+  "", "GET", "POST", "HEAD", "PUT", "DELETE"
+};
+
+}
+
+// Nodes are kept in one vector and refer to each other by index.  A static
+// node matches its text, the children after it are found by their first
+// byte in indices.  A node has at most one ":name" child and one "*name"
+// child, each holding the name in text.
+struct HttpRouter::Tree
+{
+  enum Kind
+  {
+    kStatic, kParam, kCatchAll
+  };
+
+  struct Node
+  {
+    Node(Kind k, const string& t)
+      : kind(k),
+        text(t),
+        param(-1),
+        catchAll(-1)
+    {
+      std::fill(handlers, handlers + kMethods, -1);
+    }
+
+    Kind kind;
+    string text;
+    string indices;
+    std::vector<int> children;
+    int param;
+    int catchAll;
+    int handlers[kMethods];  // into Tree::handlers, [kInvalid] for any method
+  };
+
+  std::vector<Node> nodes;  // nodes[0] is the root
+  std::vector<Handler> handlers;
+
+  Tree()
+  {
+    nodes.push_back(Node(kStatic, string()));
+  }
+
+  bool insert(HttpRequest::Method method, StringPiece pattern, const Handler& handler);
+  int insertStatic(int n, const char* p, const char* end);
+
+  // the handler for method under nodes[n], whose text is matched up to p
+  int match(int n, const char* p, const char* end,
+            HttpRequest::Method method, Params* params, unsigned* allowed) const;
+
+  int handlerOf(const Node& node, HttpRequest::Method method, unsigned* allowed) const
+  {
+    int h = node.handlers[method];
+    if (h < 0)
+    {
+      h = node.handlers[HttpRequest::kInvalid];
+    }
+    if (h < 0)
+    {
+      for (int m = 1; m < kMethods; ++m)
+      {
+        if (node.handlers[m] >= 0)
+        {
+          *allowed |= 1u << m;
+        }
+      }
+    }
+    return h;
+  }
+};
+
+bool HttpRouter::Tree::insert(HttpRequest::Method method,
+                              StringPiece pattern,
+                              const Handler& handler)
+{
+  if (pattern.empty() || pattern[0] != '/')
+  {
+    return false;
+  }
+  int n = 0;
+  int numParams = 0;
+  const char* p = pattern.begin();
+  const char* end = pattern.end();
+  while (p < end)
+  {
+    if (*p == ':' || *p == '*')
+    {
+      Kind kind = *p == ':' ? kParam : kCatchAll;
+      const char* nameEnd = std::find(p + 1, end, '/');
+      string name(p + 1, nameEnd);
+      if (name.empty()
+          || name.find_first_of(":*") != string::npos
+          || (kind == kCatchAll && nameEnd != end)
+          || ++numParams > Params::kMaxParams)
+      {
+        return false;
+      }
+      int child = kind == kParam ? nodes[n].param : nodes[n].catchAll;
+      if (child < 0)
+      {
+        child = static_cast<int>(nodes.size());
+        nodes.push_back(Node(kind, name));
+        (kind == kParam ? nodes[n].param : nodes[n].catchAll) = child;
+      }
+      else if (nodes[child].text != name)
+      {
+        return false;
+      }
+      n = child;
+      p = nameEnd;
+    }
+    else
+    {
+      const char* textEnd = p;
+      while (textEnd < end && *textEnd != ':' && *textEnd != '*')
+      {
+        ++textEnd;
+      }
+      n = insertStatic(n, p, textEnd);
+      p = textEnd;
+    }
+  }
+
+  int& slot = nodes[n].handlers[method];
+  if (slot < 0)
+  {
+    slot = static_cast<int>(handlers.size());
+    handlers.push_back(handler);
+  }
+  else
+  {
+    handlers[slot] = handler;
+  }
+  return true;
+}
+
+int HttpRouter::Tree::insertStatic(int n, const char* p, const char* end)
+{
+  while (p < end)
+  {
+    size_t i = nodes[n].indices.find(*p);
+    if (i == string::npos)
+    {
+      int child = static_cast<int>(nodes.size());
+      nodes.push_back(Node(kStatic, string(p, end)));
+      nodes[n].indices.push_back(*p);
+      nodes[n].children.push_back(child);
+      return child;
+    }
+
+    int child = nodes[n].children[i];
+    string text = nodes[child].text;
+    size_t common = 0;
+    while (common < text.size() && p + common < end && text[common] == p[common])
+    {
+      ++common;
+    }
+    if (common < text.size())
+    {
+      // split, a new node takes the common bytes and child keeps the rest
+      int middle = static_cast<int>(nodes.size());
+      nodes.push_back(Node(kStatic, text.substr(0, common)));
+      nodes[middle].indices.push_back(text[common]);
+      nodes[middle].children.push_back(child);
+      nodes[child].text = text.substr(common);
+      nodes[n].children[i] = middle;
+      child = middle;
+    }
+    n = child;
+    p += common;
+  }
+  return n;
+}
+
+int HttpRouter::Tree::match(int n, const char* p, const char* end,
+                            HttpRequest::Method method,
+                            Params* params,
+                            unsigned* allowed) const
+{
+  const Node& node = nodes[n];
+  if (p == end)
+  {
+    int h = handlerOf(node, method, allowed);
+    if (h >= 0)
+    {
+      return h;
+    }
+  }
+  else
+  {
+    size_t i = 0;
+    while (i < node.indices.size() && node.indices[i] != *p)
+    {
+      ++i;
+    }
+    if (i < node.indices.size())
+    {
+      int child = node.children[i];
+      const string& text = nodes[child].text;
+      if (static_cast<size_t>(end - p) >= text.size()
+          && memcmp(p, text.data(), text.size()) == 0)
+      {
+        int h = match(child, p + text.size(), end, method, params, allowed);
+        if (h >= 0)
+        {
+          return h;
+        }
+      }
+    }
+
+    if (node.param >= 0 && *p != '/')
+    {
+      const char* valueEnd = std::find(p, end, '/');
+      params->push(nodes[node.param].text, StringPiece(p, static_cast<int>(valueEnd - p)));
+      int h = match(node.param, valueEnd, end, method, params, allowed);
+      if (h >= 0)
+      {
+        return h;
+      }
+      params->pop();
+    }
+  }
+
+  if (node.catchAll >= 0)
+  {
+    const Node& rest = nodes[node.catchAll];
+    int h = handlerOf(rest, method, allowed);
+    if (h >= 0)
+    {
+      params->push(rest.text, StringPiece(p, static_cast<int>(end - p)));
+      return h;
+    }
+  }
+  return -1;
+}
+
+HttpRouter::HttpRouter()
+  : tree_(new Tree)
+{
+}
+
+HttpRouter::~HttpRouter()
+{
+}
+
+bool HttpRouter::add(HttpRequest::Method method,
+                     const string& pattern,
+                     const Handler& handler)
+{
+  Route route = { method, pattern, handler };
+  MutexLockGuard lock(mutex_);
+  std::vector<Route> routes(routes_);
+  size_t i = 0;
+  while (i < routes.size() && (routes[i].method != method || routes[i].pattern != pattern))
+  {
+    ++i;
+  }
+  if (i < routes.size())
+  {
+    routes[i] = route;
+  }
+  else
+  {
+    routes.push_back(route);
+  }
+  if (publish(routes))
+  {
+    routes_.swap(routes);
+    return true;
+  }
+  return false;
+}
+
+bool HttpRouter::remove(HttpRequest::Method method, const string& pattern)
+{
+  MutexLockGuard lock(mutex_);
+  std::vector<Route> routes;
+  routes.reserve(routes_.size());
+  for (size_t i = 0; i < routes_.size(); ++i)
+  {
+    if (routes_[i].method != method || routes_[i].pattern != pattern)
+    {
+      routes.push_back(routes_[i]);
+    }
+  }
+  if (routes.size() == routes_.size())
+  {
+    return false;
+  }
+  bool ok = publish(routes);
+  assert(ok); (void)ok;
+  routes_.swap(routes);
+  return true;
+}
+
+// called with mutex_ held
+bool HttpRouter::publish(const std::vector<Route>& routes)
+{
+  boost::shared_ptr<Tree> tree(new Tree);
+  for (size_t i = 0; i < routes.size(); ++i)
+  {
+    if (!tree->insert(routes[i].method, routes[i].pattern, routes[i].handler))
+    {
+      return false;
+    }
+  }
+  tree_ = tree;
+  version_.increment();
+  return true;
+}
+
+bool HttpRouter::route(const HttpRequest& req, HttpResponse* resp) const
+{
+  Snapshot& snapshot = snapshot_.value();
+  int32_t version = version_.get();
+  // a handler routing again must not free the tree it runs from
+  if (snapshot.version != version && snapshot.depth == 0)
+  {
+    MutexLockGuard lock(mutex_);
+    snapshot.tree = tree_;
+    snapshot.version = version;
+  }
+  const Tree& tree = *snapshot.tree;
+
+  Params params;
+  unsigned allowed = 0;
+  StringPiece path = req.pathView();
+  int h = tree.match(0, path.begin(), path.end(), req.method(), &params, &allowed);
+  if (h >= 0)
+  {
+    ++snapshot.depth;
+    tree.handlers[h](req, params, resp);
+    --snapshot.depth;
+    return true;
+  }
+  else if (allowed)
+  {
+    string methods;
+    for (int m = 1; m < kMethods; ++m)
+    {
+      if (allowed & (1u << m))
+      {
+        if (!methods.empty())
+        {
+          methods += ", ";
+        }
+        methods += kMethodNames[m];
+      }
+    }
+    resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+    resp->setStatusMessage("Method Not Allowed");
+    resp->addHeader("Allow", methods);
+    return true;
+  }
+  return false;
+}
+
+void HttpRouter::onRequest(const HttpRequest& req, HttpResponse* resp) const
+{
+  if (!route(req, resp))
+  {
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+  }
+}
+
+size_t HttpRouter::size() const
+{
+  MutexLockGuard lock(mutex_);
+  return routes_.size();
+}
@@ -0,0 +1,160 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPROUTER_H
+#define MUDUO_NET_HTTP_HTTPROUTER_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/copyable.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/ThreadLocal.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpResponse;
+
+/// Dispatches requests to handlers by path and method, with a radix tree.
+///
+/// A pattern is a path with named parts: ":name" matches up to the next
+/// '/', "*name" matches the rest of the path and must come last, as in
+/// "/users/:id/posts" and "/static/*file".  Static text wins over ":name",
+/// which wins over "*name".  A route added for HttpRequest::kInvalid takes
+/// any method.
+///
+/// add() and remove() compile the routes into a new immutable tree and
+/// publish it.  route() takes no lock, each thread keeps the tree it used
+/// last and swaps it for the new one when the version has moved.  A tree
+/// is freed once no thread holds it.
+///
+/// Thread safe.
+class HttpRouter : boost::noncopyable
+{
+ public:
+  /// Values of the named parts, views into the request path.
+  class Params : public muduo::copyable
+  {
+   public:
+    static const int kMaxParams = 8;
+
+    Params()
+      : size_(0)
+    {
+    }
+
+    /// Empty if there is no part called name.
+    StringPiece get(StringPiece name) const
+    {
+      for (int i = 0; i < size_; ++i)
+      {
+        if (this->name(i) == name)
+        {
+          return value(i);
+        }
+      }
+      return StringPiece();
+    }
+
+    int size() const { return size_; }
+    StringPiece name(int i) const { return StringPiece(parts_[i].name, parts_[i].nameLength); }
+    StringPiece value(int i) const { return StringPiece(parts_[i].value, parts_[i].valueLength); }
+
+    void push(StringPiece name, StringPiece value)
+    {
+      assert(size_ < kMaxParams);
+      Part& part = parts_[size_++];
+      part.name = name.data();
+      part.nameLength = name.size();
+      part.value = value.data();
+      part.valueLength = value.size();
+    }
+
+    void pop() { --size_; }
+
+   private:
+    // plain data, left uninitialised past size_
+    struct Part
+    {
+      const char* name;
+      int nameLength;
+      const char* value;
+      int valueLength;
+    };
+
+    int size_;
+    Part parts_[kMaxParams];
+  };
+
+  typedef boost::function<void (const HttpRequest&,
+                                const Params&,
+                                HttpResponse*)> Handler;
+
+  HttpRouter();
+  ~HttpRouter();
+
+  /// Replaces the handler of the same method and pattern.  Returns false
+  /// if pattern is malformed, or names a part differently from a route
+  /// already added at the same place.
+  bool add(HttpRequest::Method method, const string& pattern, const Handler& handler);
+  bool remove(HttpRequest::Method method, const string& pattern);
+
+  /// Calls the handler of the request.  If the path only has routes for
+  /// other methods, responds 405 with an Allow header.  Returns false and
+  /// leaves resp alone if no route matches the path.
+  bool route(const HttpRequest& req, HttpResponse* resp) const;
+
+  /// An HttpServer::HttpCallback, responds 404 to requests route() turns down.
+  void onRequest(const HttpRequest& req, HttpResponse* resp) const;
+
+  size_t size() const;
+
+ private:
+  struct Tree;
+
+  struct Route
+  {
+    HttpRequest::Method method;
+    string pattern;
+    Handler handler;
+  };
+
+  // the tree a thread routes with
+  struct Snapshot
+  {
+    Snapshot() : version(-1), depth(0) { }
+    int32_t version;
+    int depth;  // route() calls of this thread in progress
+    boost::shared_ptr<const Tree> tree;
+  };
+
+  bool publish(const std::vector<Route>& routes);
+
+  mutable MutexLock mutex_;
+  std::vector<Route> routes_;
+  boost::shared_ptr<const Tree> tree_;
+  mutable AtomicInt32 version_;
+  mutable ThreadLocal<Snapshot> snapshot_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPROUTER_H
@@ -10,9 +10,11 @@
 #include <muduo/net/http/HttpServer.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
 #include <muduo/net/http/HttpContext.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/WebSocketContext.h>
 
 #include <boost/bind.hpp>
 
@@ -26,6 +28,11 @@ namespace net
 namespace detail
 {
 
+const char kCRLF[] = "\r\n";
+const char kCRLFCRLF[] = "\r\n\r\n";
+// a request line and headers longer than this are rejected
+const size_t kMaxHeaderBytes = 64*1024;
+
 // FIXME: move to HttpContext class
 bool processRequestLine(const char* begin, const char* end, HttpContext* context)
 {
@@ -71,6 +78,30 @@ bool processRequestLine(const char* begin, const char* end, HttpContext* context
   return succeed;
 }
 
+// request line and headers, all in [begin, end), end points past the empty line
+bool processHeaderBlock(const char* begin, const char* end, HttpContext* context)
+{
+  const char* crlf = std::search(begin, end, kCRLF, kCRLF+2);
+  if (!processRequestLine(begin, crlf, context))
+  {
+    return false;
+  }
+  context->receiveRequestLine();
+  const char* start = crlf + 2;
+  while (start < end - 2)
+  {
+    crlf = std::search(start, end, kCRLF, kCRLF+2);
+    const char* colon = std::find(start, crlf, ':');
+    if (colon == crlf)
+    {
+      return false;
+    }
+    context->request().addHeader(start, colon, crlf);
+    start = crlf + 2;
+  }
+  return context->receiveHeaders();
+}
+
 // FIXME: move to HttpContext class
 // return false if any error
 bool parseRequest(Buffer* buf, HttpContext* context, Timestamp receiveTime)
@@ -81,57 +112,136 @@ bool parseRequest(Buffer* buf, HttpContext* context, Timestamp receiveTime)
   {
     if (context->expectRequestLine())
     {
-      const char* crlf = buf->findCRLF();
-      if (crlf)
+      // wait for the whole header block, then parse it in one pass
+      const char* start = buf->peek() + context->scanned();
+      const char* limit = buf->beginWrite();
+      const char* end = std::search(start, limit, kCRLFCRLF, kCRLFCRLF+4);
+      if (end == limit)
       {
-        ok = processRequestLine(buf->peek(), crlf, context);
-        if (ok)
-        {
-          context->request().setReceiveTime(receiveTime);
-          buf->retrieveUntil(crlf + 2);
-          context->receiveRequestLine();
-        }
-        else
+        size_t readable = buf->readableBytes();
+        context->setScanned(readable > 3 ? readable - 3 : 0);
+        ok = readable <= kMaxHeaderBytes;
+        hasMore = false;
+        continue;
+      }
+      end += 4;
+      size_t len = static_cast<size_t>(end - buf->peek());
+      context->request().setReceiveTime(receiveTime);
+      ok = processHeaderBlock(buf->peek(), end, context);
+      if (!ok)
+      {
+        hasMore = false;
+      }
+      else if (context->zeroCopy()
+               && !context->chunked()
+               && !context->hasBodyCallback()
+               && buf->readableBytes() >= len + context->bodyRemaining()
+               && (context->maxBodySize() == 0
+                   || static_cast<int64_t>(context->bodyRemaining()) <= context->maxBodySize()))
+      {
+        // the whole request is here, leave it in the buffer
+        context->holdBytes(len);
+        context->request().setHeaderBlock(buf->peek(), end + context->bodyRemaining());
+        if (context->expectBody())
         {
-          hasMore = false;
+          context->holdBytes(context->bodyRemaining());
+          context->receiveWholeBody(end);
         }
+        hasMore = false;
+      }
+      else
+      {
+        context->request().keepHeaderBlock(buf->peek(), end);
+        buf->retrieve(len);
+        hasMore = !context->gotAll();
+      }
+    }
+    else if (context->expectBody())
+    {
+      // hand out what has arrived, straight from the buffer
+      size_t n = std::min(buf->readableBytes(), context->bodyRemaining());
+      if (n > 0)
+      {
+        ok = context->receiveBody(buf->peek(), n);
+        buf->retrieve(n);
+        hasMore = ok && !context->gotAll();
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (context->expectChunkSize())
+    {
+      // a chunk extension is no excuse for an endless line
+      const char* crlf = buf->findCRLF();
+      if (crlf)
+      {
+        ok = static_cast<size_t>(crlf - buf->peek()) <= kMaxHeaderBytes
+            && context->receiveChunkSize(buf->peek(), crlf);
+        buf->retrieveUntil(crlf + 2);
+        hasMore = ok;
       }
       else
       {
+        ok = buf->readableBytes() <= kMaxHeaderBytes;
         hasMore = false;
       }
     }
-    else if (context->expectHeaders())
+    else if (context->expectChunkEnd())
     {
+      if (buf->readableBytes() >= 2)
+      {
+        ok = buf->peek()[0] == '\r' && buf->peek()[1] == '\n';
+        buf->retrieve(2);
+        context->receiveChunkEnd();
+        hasMore = ok;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (context->expectTrailers())
+    {
+      // trailer fields join the headers, all of them within the limit of headers
       const char* crlf = buf->findCRLF();
       if (crlf)
       {
+        context->addTrailerBytes(crlf + 2 - buf->peek());
         const char* colon = std::find(buf->peek(), crlf, ':');
-        if (colon != crlf)
+        if (context->trailerBytes() > kMaxHeaderBytes)
+        {
+          ok = false;
+          hasMore = false;
+        }
+        else if (colon != crlf)
         {
-          context->request().addHeader(buf->peek(), colon, crlf);
+          context->request().addTrailer(buf->peek(), colon, crlf);
         }
         else
         {
-          // empty line, end of header
-          context->receiveHeaders();
-          hasMore = !context->gotAll();
+          context->receiveTrailers();
+          hasMore = false;
         }
         buf->retrieveUntil(crlf + 2);
       }
       else
       {
+        ok = context->trailerBytes() + buf->readableBytes() <= kMaxHeaderBytes;
         hasMore = false;
       }
     }
-    else if (context->expectBody())
+    else
     {
-      // FIXME:
+      hasMore = false;
     }
   }
   return ok;
 }
 
+bool parseFrame(Buffer* buf, WebSocketContext* context);
+
 void defaultHttpCallback(const HttpRequest&, HttpResponse* resp)
 {
   resp->setStatusCode(HttpResponse::k404NotFound);
@@ -148,7 +258,10 @@ HttpServer::HttpServer(EventLoop* loop,
                        const string& name,
                        TcpServer::Option option)
   : server_(loop, listenAddr, name, option),
-    httpCallback_(detail::defaultHttpCallback)
+    httpCallback_(detail::defaultHttpCallback),
+    maxBodySize_(kDefaultMaxBodySize),
+    maxWebSocketMessageSize_(kDefaultMaxWebSocketMessageSize),
+    zeroCopy_(false)
 {
   server_.setConnectionCallback(
       boost::bind(&HttpServer::onConnection, this, _1));
@@ -171,7 +284,16 @@ void HttpServer::onConnection(const TcpConnectionPtr& conn)
 {
   if (conn->connected())
   {
-    conn->setContext(HttpContext());
+    HttpContext context;
+    context.setBodyCallback(bodyCallback_);
+    context.setMaxBodySize(maxBodySize_);
+    context.setZeroCopy(zeroCopy_);
+    conn->setContext(context);
+  }
+  else if (webSocketCloseCallback_
+           && boost::any_cast<WebSocketContext>(conn->getMutableContext()))
+  {
+    webSocketCloseCallback_(conn);
   }
 }
 
@@ -180,33 +302,225 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
                            Timestamp receiveTime)
 {
   HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (!context)
+  {
+    onWebSocketMessage(conn, buf, receiveTime);
+    return;
+  }
+  // handles every complete request that has arrived, pipelined ones included,
+  // and sends all responses with one write
+  Buffer* output = &ThreadLocalSingleton<Buffer>::instance();
+  bool close = false;
+  bool upgraded = false;
+  while (!close && !upgraded)
+  {
+    if (!detail::parseRequest(buf, context, receiveTime))
+    {
+      if (context->bodyTooLarge())
+      {
+        output->append("HTTP/1.1 413 Payload Too Large\r\n\r\n");
+      }
+      else
+      {
+        output->append("HTTP/1.1 400 Bad Request\r\n\r\n");
+      }
+      close = true;
+    }
+    else
+    {
+      if (context->takeExpectContinue())
+      {
+        output->append("HTTP/1.1 100 Continue\r\n\r\n");
+      }
+      if (!context->gotAll())
+      {
+        break;
+      }
+      if (webSocketMessageCallback_ && websocket::isUpgrade(context->request()))
+      {
+        upgraded = upgrade(conn, context->request(), output);
+        close = !upgraded;
+      }
+      else
+      {
+        close = onRequest(conn, context->request(), output);
+      }
+      buf->retrieve(context->heldBytes());
+      context->reset();
+    }
+  }
 
-  if (!detail::parseRequest(buf, context, receiveTime))
+  if (output->readableBytes() > 0)
+  {
+    conn->send(output);
+    output->retrieveAll();  // send() leaves it alone once disconnected
+  }
+  if (close)
   {
-    conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+    // requests after the last response are ignored
+    buf->retrieveAll();
     conn->shutdown();
   }
-
-  if (context->gotAll())
+  else if (upgraded)
   {
-    onRequest(conn, context->request());
-    context->reset();
+    // frames may have come right behind the request
+    conn->setContext(WebSocketContext(maxWebSocketMessageSize_));
+    if (buf->readableBytes() > 0)
+    {
+      onWebSocketMessage(conn, buf, receiveTime);
+    }
   }
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
+// returns true if the connection is to be closed
+bool HttpServer::onRequest(const TcpConnectionPtr& conn,
+                           const HttpRequest& req,
+                           Buffer* output)
 {
-  const string& connection = req.getHeader("Connection");
-  bool close = connection == "close" ||
-    (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
+  StringPiece connection = req.findHeader("Connection");
+  bool close = HttpRequest::equalsIgnoreCase(connection, "close") ||
+    (req.getVersion() == HttpRequest::kHttp10
+     && !HttpRequest::equalsIgnoreCase(connection, "Keep-Alive"));
   HttpResponse response(close);
   httpCallback_(req, &response);
-  Buffer buf;
-  response.appendToBuffer(&buf);
-  conn->send(&buf);
-  if (response.closeConnection())
+  if (compressor_.enabled())
   {
-    conn->shutdown();
+    compress(req, &response);
+  }
+  response.appendToBuffer(output);
+
+  // a memcpy() is cheaper than a write of its own for small tails
+  const size_t kCopyTailBelow = 4096;
+  const boost::shared_ptr<const string>& tail = response.renderedTail();
+  if (tail && tail->size() < kCopyTailBelow)
+  {
+    output->append(*tail);
+  }
+  else if (tail || response.bodyFile() >= 0)
+  {
+    conn->send(output);
+    output->retrieveAll();
+    if (tail)
+    {
+      conn->send(tail);
+    }
+  }
+  if (response.bodyFile() >= 0)
+  {
+    conn->sendFile(response.bodyFile(), response.fileOffset(), response.fileLength());
+  }
+  return response.closeConnection();
+}
+
+void HttpServer::compress(const HttpRequest& req, HttpResponse* response)
+{
+  if (response->bodyFile() >= 0 || response->renderedTail()
+      || !compressor_.worthCompressing(response->contentType(), response->body().size()))
+  {
+    return;
+  }
+  response->addHeader("Vary", "Accept-Encoding");
+  HttpCompressor::Encoding encoding =
+      HttpCompressor::negotiate(req.findHeader("Accept-Encoding"));
+  string compressed;
+  if (encoding != HttpCompressor::kIdentity
+      && compressor_.compress(encoding, response->body(), &compressed))
+  {
+    response->addHeader("Content-Encoding", HttpCompressor::encodingName(encoding));
+    response->swapBody(&compressed);
   }
 }
 
+// answers the handshake, returns true if the connection is upgraded
+bool HttpServer::upgrade(const TcpConnectionPtr& conn,
+                         const HttpRequest& req,
+                         Buffer* output)
+{
+  StringPiece key = req.findHeader("Sec-WebSocket-Key");
+  if (req.getVersion() != HttpRequest::kHttp11 || key.size() != 24)
+  {
+    output->append("HTTP/1.1 400 Bad Request\r\n\r\n");
+    return false;
+  }
+  if (req.findHeader("Sec-WebSocket-Version") != "13")
+  {
+    output->append("HTTP/1.1 426 Upgrade Required\r\n"
+                   "Sec-WebSocket-Version: 13\r\n\r\n");
+    return false;
+  }
+  if (webSocketUpgradeCallback_ && !webSocketUpgradeCallback_(conn, req))
+  {
+    output->append("HTTP/1.1 403 Forbidden\r\n\r\n");
+    return false;
+  }
+  output->append("HTTP/1.1 101 Switching Protocols\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: ");
+  output->append(websocket::acceptKey(key));
+  output->append("\r\n\r\n");
+  return true;
+}
+
+void HttpServer::onWebSocketMessage(const TcpConnectionPtr& conn,
+                                    Buffer* buf,
+                                    Timestamp receiveTime)
+{
+  WebSocketContext* context = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+  assert(context);
+  // pongs and the Close echo go out with one write, ahead of what the
+  // message callback sends
+  Buffer* output = &ThreadLocalSingleton<Buffer>::instance();
+  bool close = false;
+  while (!close)
+  {
+    if (!detail::parseFrame(buf, context))
+    {
+      websocket::appendClose(output, context->closeCode());
+      close = true;
+      break;
+    }
+    if (context->expectFrame())
+    {
+      break;
+    }
+    StringPiece payload = context->payload();
+    if (context->gotMessage())
+    {
+      // after our Close, the peer's messages are dropped
+      if (conn->connected())
+      {
+        // pongs so far go first, the callback may send straight away
+        if (output->readableBytes() > 0)
+        {
+          conn->send(output);
+          output->retrieveAll();
+        }
+        webSocketMessageCallback_(conn, context->opcode(), payload, receiveTime);
+      }
+    }
+    else if (context->opcode() == websocket::kPing)
+    {
+      websocket::appendFrame(output, websocket::kPong, payload.data(), payload.size());
+    }
+    else if (context->opcode() == websocket::kClose)
+    {
+      // echo the status code, if any
+      websocket::appendFrame(output, websocket::kClose, payload.data(),
+                             std::min(payload.size(), 2));
+      close = true;
+    }
+    context->next(buf);
+  }
+
+  if (output->readableBytes() > 0)
+  {
+    conn->send(output);
+    output->retrieveAll();
+  }
+  if (close)
+  {
+    buf->retrieveAll();
+    conn->shutdown();
+  }
+}
@@ -11,7 +11,10 @@
 #ifndef MUDUO_NET_HTTP_HTTPSERVER_H
 #define MUDUO_NET_HTTP_HTTPSERVER_H
 
+#include <muduo/base/StringPiece.h>
 #include <muduo/net/TcpServer.h>
+#include <muduo/net/http/HttpCompressor.h>
+#include <muduo/net/http/WebSocket.h>
 #include <boost/noncopyable.hpp>
 
 namespace muduo
@@ -31,6 +34,18 @@ class HttpServer : boost::noncopyable
  public:
   typedef boost::function<void (const HttpRequest&,
                                 HttpResponse*)> HttpCallback;
+  typedef boost::function<void (const HttpRequest&,
+                                StringPiece)> BodyCallback;
+  typedef boost::function<bool (const TcpConnectionPtr&,
+                                const HttpRequest&)> WebSocketUpgradeCallback;
+  typedef boost::function<void (const TcpConnectionPtr&,
+                                websocket::Opcode,
+                                StringPiece,
+                                Timestamp)> WebSocketMessageCallback;
+  typedef boost::function<void (const TcpConnectionPtr&)> WebSocketCloseCallback;
+
+  static const int64_t kDefaultMaxBodySize = 64*1024*1024;
+  static const size_t kDefaultMaxWebSocketMessageSize = 16*1024*1024;
 
   HttpServer(EventLoop* loop,
              const InetAddress& listenAddr,
@@ -47,6 +62,76 @@ class HttpServer : boost::noncopyable
     httpCallback_ = cb;
   }
 
+  /// Not thread safe, callback be registered before calling start().
+  /// Request bodies (Content-Length or chunked) are passed to cb slice by
+  /// slice as they arrive, instead of being collected in HttpRequest::body().
+  /// Slices point into the input buffer and are valid during the call only,
+  /// HttpCallback runs after the last one.
+  void setBodyCallback(const BodyCallback& cb)
+  {
+    bodyCallback_ = cb;
+  }
+
+  /// Larger bodies are rejected with 413, 0 for unlimited.
+  /// Does not apply with a BodyCallback.
+  void setMaxBodySize(int64_t maxBodySize)
+  {
+    maxBodySize_ = maxBodySize;
+  }
+
+  /// Requests that arrive in whole are parsed in place, HttpRequest then
+  /// holds views into the input buffer instead of a copy of the headers.
+  /// The views are valid until HttpCallback returns, and path(), query(),
+  /// headers() and body() of such a request are empty, use pathView() etc.
+  void setZeroCopy(bool on)
+  {
+    zeroCopy_ = on;
+  }
+
+  /// Bodies of textual Content-Types are sent with gzip or deflate as
+  /// Accept-Encoding allows, at this zlib level.  0 is off, the default.
+  void setCompressionLevel(int level)
+  {
+    compressor_.setLevel(level);
+  }
+
+  /// Smaller bodies are not compressed.
+  void setCompressionMinSize(size_t bytes)
+  {
+    compressor_.setMinSize(bytes);
+  }
+
+  /// Not thread safe, callback be registered before calling start().
+  /// Enables WebSocket, requests to upgrade are accepted and cb gets every
+  /// text or binary message, fragments put together.  The message is valid
+  /// during the call only.  Pings are answered, a Close is echoed and the
+  /// connection shut down.  Reply with websocket::send().
+  void setWebSocketMessageCallback(const WebSocketMessageCallback& cb)
+  {
+    webSocketMessageCallback_ = cb;
+  }
+
+  /// Not thread safe, callback be registered before calling start().
+  /// An upgrade is refused with 403 when cb returns false.  It runs before
+  /// the 101 response is sent, so must not send on conn itself.
+  void setWebSocketUpgradeCallback(const WebSocketUpgradeCallback& cb)
+  {
+    webSocketUpgradeCallback_ = cb;
+  }
+
+  /// Not thread safe, callback be registered before calling start().
+  /// Called when an upgraded connection goes down.
+  void setWebSocketCloseCallback(const WebSocketCloseCallback& cb)
+  {
+    webSocketCloseCallback_ = cb;
+  }
+
+  /// Larger messages fail the connection with 1009, 0 for unlimited.
+  void setMaxWebSocketMessageSize(size_t maxMessageSize)
+  {
+    maxWebSocketMessageSize_ = maxMessageSize;
+  }
+
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
@@ -59,10 +144,27 @@ class HttpServer : boost::noncopyable
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
-  void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  bool onRequest(const TcpConnectionPtr& conn,
+                 const HttpRequest&,
+                 Buffer* output);
+  void compress(const HttpRequest& req, HttpResponse* response);
+  bool upgrade(const TcpConnectionPtr& conn,
+               const HttpRequest& req,
+               Buffer* output);
+  void onWebSocketMessage(const TcpConnectionPtr& conn,
+                          Buffer* buf,
+                          Timestamp receiveTime);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  BodyCallback bodyCallback_;
+  WebSocketUpgradeCallback webSocketUpgradeCallback_;
+  WebSocketMessageCallback webSocketMessageCallback_;
+  WebSocketCloseCallback webSocketCloseCallback_;
+  int64_t maxBodySize_;
+  size_t maxWebSocketMessageSize_;
+  bool zeroCopy_;
+  HttpCompressor compressor_;
 };
 
 }
@@ -0,0 +1,681 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/WebSocket.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/WebSocketContext.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <limits.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MUDUO_WEBSOCKET_SSE2 1
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define MUDUO_WEBSOCKET_AVX2 1
+#endif
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const char kGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// SHA-1 of data, only the handshake needs it
+void sha1(const char* data, size_t len, unsigned char digest[20])
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  std::vector<unsigned char> msg(data, data + len);
+  msg.push_back(0x80);
+  while (msg.size() % 64 != 56)
+  {
+    msg.push_back(0);
+  }
+  uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 7; i >= 0; --i)
+  {
+    msg.push_back(static_cast<unsigned char>(bits >> (i * 8)));
+  }
+
+  for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+  {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+    {
+      const unsigned char* p = &msg[chunk + i * 4];
+      w[i] = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+           | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+    for (int i = 16; i < 80; ++i)
+    {
+      uint32_t x = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+      w[i] = (x << 1) | (x >> 31);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i)
+    {
+      uint32_t f, k;
+      if (i < 20)
+      {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      }
+      else if (i < 40)
+      {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      }
+      else if (i < 60)
+      {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      }
+      else
+      {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = (b << 30) | (b >> 2);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 20; ++i)
+  {
+    digest[i] = static_cast<unsigned char>(h[i / 4] >> (24 - (i % 4) * 8));
+  }
+}
+
+string base64(const unsigned char* data, size_t len)
+{
+  static const char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string result;
+  for (size_t i = 0; i < len; i += 3)
+  {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < len)
+    {
+      n |= data[i + 1] << 8;
+    }
+    if (i + 2 < len)
+    {
+      n |= data[i + 2];
+    }
+    result += kAlphabet[(n >> 18) & 63];
+    result += kAlphabet[(n >> 12) & 63];
+    result += i + 1 < len ? kAlphabet[(n >> 6) & 63] : '=';
+    result += i + 2 < len ? kAlphabet[n & 63] : '=';
+  }
+  return result;
+}
+
+// whether the comma separated list has token, "keep-alive, Upgrade"
+bool hasToken(StringPiece list, StringPiece token)
+{
+  const char* p = list.begin();
+  while (p < list.end())
+  {
+    const char* comma = std::find(p, list.end(), ',');
+    const char* start = p;
+    const char* end = comma;
+    while (start < end && (*start == ' ' || *start == '\t'))
+    {
+      ++start;
+    }
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+      --end;
+    }
+    if (HttpRequest::equalsIgnoreCase(StringPiece(start, static_cast<int>(end - start)), token))
+    {
+      return true;
+    }
+    p = comma + 1;
+  }
+  return false;
+}
+
+// The key repeats every 4 bytes, so it is widened to a word and data is
+// XORed a word at a time.  Blocks are multiples of 4 bytes, the key stays
+// aligned with data from one loop to the next.
+
+void maskScalar(char* data, size_t len, uint32_t key)
+{
+  uint64_t key64 = (static_cast<uint64_t>(key) << 32) | key;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    w ^= key64;
+    memcpy(data + i, &w, 8);
+  }
+  char k[4];
+  memcpy(k, &key, 4);
+  for (; i < len; ++i)
+  {
+    data[i] ^= k[i & 3];
+  }
+}
+
+#ifdef MUDUO_WEBSOCKET_SSE2
+void maskSse2(char* data, size_t len, uint32_t key)
+{
+  const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i* p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), k));
+  }
+  maskScalar(data + i, len - i, key);
+}
+#endif
+
+#ifdef MUDUO_WEBSOCKET_AVX2
+__attribute__((target("avx2")))
+void maskAvx2(char* data, size_t len, uint32_t key)
+{
+  const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64)
+  {
+    __m256i* p = reinterpret_cast<__m256i*>(data + i);
+    __m256i a = _mm256_loadu_si256(p);
+    __m256i b = _mm256_loadu_si256(p + 1);
+    _mm256_storeu_si256(p, _mm256_xor_si256(a, k));
+    _mm256_storeu_si256(p + 1, _mm256_xor_si256(b, k));
+  }
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i* p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), k));
+  }
+  maskScalar(data + i, len - i, key);
+}
+#endif
+
+typedef void (*MaskFunc)(char*, size_t, uint32_t);
+
+MaskFunc chooseMask()
+{
+#ifdef MUDUO_WEBSOCKET_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return maskAvx2;
+  }
+#endif
+#ifdef MUDUO_WEBSOCKET_SSE2
+  return maskSse2;
+#else
+  return maskScalar;
+#endif
+}
+
+const MaskFunc g_mask = chooseMask();
+
+// returns the length of the header
+size_t encodeHeader(unsigned char header[10], websocket::Opcode opcode, size_t len, bool fin)
+{
+  header[0] = static_cast<unsigned char>((fin ? 0x80 : 0) | opcode);
+  if (len < 126)
+  {
+    header[1] = static_cast<unsigned char>(len);
+    return 2;
+  }
+  else if (len <= 0xFFFF)
+  {
+    header[1] = 126;
+    header[2] = static_cast<unsigned char>(len >> 8);
+    header[3] = static_cast<unsigned char>(len);
+    return 4;
+  }
+  else
+  {
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i)
+    {
+      header[2 + i] = static_cast<unsigned char>(static_cast<uint64_t>(len) >> (56 - i * 8));
+    }
+    return 10;
+  }
+}
+
+// a whole Text message must be UTF-8, RFC 6455 8.1
+// RFC 6455 7.4, those an endpoint may send
+bool validCloseCode(uint16_t code)
+{
+  return (code >= 1000 && code <= 1003)
+      || (code >= 1007 && code <= 1014)
+      || (code >= 3000 && code <= 4999);
+}
+
+bool checkMessage(WebSocketContext* context)
+{
+  if (context->gotMessage()
+      && context->opcode() == websocket::kText
+      && !websocket::isValidUtf8(context->payload()))
+  {
+    context->setCloseCode(websocket::kInvalidPayload);
+    return false;
+  }
+  if (context->gotControl() && context->opcode() == websocket::kClose)
+  {
+    // empty, or a status code and a UTF-8 reason
+    StringPiece payload = context->payload();
+    if (payload.size() == 1
+        || (payload.size() >= 2
+            && !validCloseCode(static_cast<uint16_t>(
+                   (static_cast<unsigned char>(payload[0]) << 8)
+                   | static_cast<unsigned char>(payload[1])))))
+    {
+      context->setCloseCode(websocket::kProtocolError);
+      return false;
+    }
+    if (payload.size() > 2
+        && !websocket::isValidUtf8(StringPiece(payload.data() + 2, payload.size() - 2)))
+    {
+      context->setCloseCode(websocket::kInvalidPayload);
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+bool websocket::isUpgrade(const HttpRequest& req)
+{
+  return req.method() == HttpRequest::kGet
+      && HttpRequest::equalsIgnoreCase(req.findHeader("Upgrade"), "websocket")
+      && hasToken(req.findHeader("Connection"), "Upgrade");
+}
+
+bool websocket::isValidUtf8(StringPiece text)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+  const unsigned char* end = p + text.size();
+  while (p < end)
+  {
+    // ASCII eight bytes at a time
+    if (end - p >= 8)
+    {
+      uint64_t word;
+      memcpy(&word, p, 8);
+      if ((word & 0x8080808080808080ULL) == 0)
+      {
+        p += 8;
+        continue;
+      }
+    }
+    unsigned char c = *p;
+    if (c < 0x80)
+    {
+      ++p;
+      continue;
+    }
+    int n = 0;
+    // the range of the second byte rules out overlong forms, surrogates
+    // and beyond U+10FFFF
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+      n = 1;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+      n = 2;
+      low = (c == 0xE0) ? 0xA0 : 0x80;
+      high = (c == 0xED) ? 0x9F : 0xBF;
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+      n = 3;
+      low = (c == 0xF0) ? 0x90 : 0x80;
+      high = (c == 0xF4) ? 0x8F : 0xBF;
+    }
+    else
+    {
+      return false;
+    }
+    if (end - p <= n || p[1] < low || p[1] > high)
+    {
+      return false;
+    }
+    for (int i = 2; i <= n; ++i)
+    {
+      if ((p[i] & 0xC0) != 0x80)
+      {
+        return false;
+      }
+    }
+    p += n + 1;
+  }
+  return true;
+}
+
+string websocket::acceptKey(StringPiece key)
+{
+  string text = key.as_string() + kGuid;
+  unsigned char digest[20];
+  sha1(text.data(), text.size(), digest);
+  return base64(digest, sizeof digest);
+}
+
+void websocket::appendFrame(Buffer* output, Opcode opcode, const void* data, size_t len, bool fin)
+{
+  unsigned char header[10];
+  size_t headerLength = encodeHeader(header, opcode, len, fin);
+  output->ensureWritableBytes(headerLength + len);
+  output->append(header, headerLength);
+  output->append(data, len);
+}
+
+void websocket::appendClose(Buffer* output, uint16_t code, StringPiece reason)
+{
+  char payload[125];
+  payload[0] = static_cast<char>(code >> 8);
+  payload[1] = static_cast<char>(code);
+  size_t n = std::min(static_cast<size_t>(reason.size()), sizeof payload - 2);
+  memcpy(payload + 2, reason.data(), n);
+  appendFrame(output, kClose, payload, n + 2);
+}
+
+void websocket::applyMask(char* data, size_t len, const char key[4], size_t offset)
+{
+  char k[4];
+  for (int i = 0; i < 4; ++i)
+  {
+    k[i] = key[(offset + i) & 3];
+  }
+  uint32_t word;
+  memcpy(&word, k, 4);
+  if (len < 16)
+  {
+    maskScalar(data, len, word);
+  }
+  else
+  {
+    g_mask(data, len, word);
+  }
+}
+
+void websocket::send(const TcpConnectionPtr& conn, Opcode opcode, StringPiece message)
+{
+  Buffer frame(message.size() + 10);
+  appendFrame(&frame, opcode, message.data(), message.size());
+  conn->send(&frame);
+}
+
+void websocket::close(const TcpConnectionPtr& conn, uint16_t code, StringPiece reason)
+{
+  Buffer frame;
+  appendClose(&frame, code, reason);
+  conn->send(&frame);
+  conn->shutdown();
+}
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+// Takes frames off buf until a whole message or a control frame is ready
+// in context, or more input is needed.  The payload is unmasked in place.
+// Returns false on a protocol error, with the close code set.
+bool parseFrame(Buffer* buf, WebSocketContext* context)
+{
+  assert(context->expectFrame());
+  while (buf->readableBytes() >= 2)
+  {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(buf->peek());
+    bool fin = p[0] & 0x80;
+    websocket::Opcode opcode = static_cast<websocket::Opcode>(p[0] & 0x0F);
+    bool masked = p[1] & 0x80;
+    size_t headerLength = 2;
+    uint64_t len = p[1] & 0x7F;
+    if (len == 126)
+    {
+      headerLength += 2;
+    }
+    else if (len == 127)
+    {
+      headerLength += 8;
+    }
+    headerLength += 4;
+
+    // no extensions are negotiated, and a client must mask
+    if ((p[0] & 0x70) || !masked)
+    {
+      context->setCloseCode(websocket::kProtocolError);
+      return false;
+    }
+    if (opcode & 0x8)
+    {
+      if (!fin || len > 125
+          || (opcode != websocket::kClose && opcode != websocket::kPing
+              && opcode != websocket::kPong))
+      {
+        context->setCloseCode(websocket::kProtocolError);
+        return false;
+      }
+    }
+    else if (opcode > websocket::kBinary
+             || (opcode == websocket::kContinuation) != context->fragmented())
+    {
+      context->setCloseCode(websocket::kProtocolError);
+      return false;
+    }
+    if (buf->readableBytes() < headerLength)
+    {
+      break;
+    }
+
+    if (headerLength > 6)
+    {
+      len = 0;
+      for (size_t i = 2; i < headerLength - 4; ++i)
+      {
+        len = (len << 8) | p[i];
+      }
+      // the most significant bit must be 0, and a frame must fit in a
+      // StringPiece, whatever the message size limit
+      if (len & (1ULL << 63))
+      {
+        context->setCloseCode(websocket::kProtocolError);
+        return false;
+      }
+      if (len > static_cast<uint64_t>(INT_MAX - headerLength))
+      {
+        context->setCloseCode(websocket::kMessageTooBig);
+        return false;
+      }
+    }
+    size_t message = (opcode == websocket::kContinuation) ? context->fragmentBytes() : 0;
+    if (context->maxMessageSize() > 0 && len > context->maxMessageSize() - message)
+    {
+      context->setCloseCode(websocket::kMessageTooBig);
+      return false;
+    }
+    size_t frameBytes = headerLength + static_cast<size_t>(len);
+    if (buf->readableBytes() < frameBytes)
+    {
+      break;
+    }
+
+    char* payload = const_cast<char*>(buf->peek()) + headerLength;
+    const char* key = payload - 4;
+    websocket::applyMask(payload, static_cast<size_t>(len), key);
+    if ((opcode & 0x8) || (fin && opcode != websocket::kContinuation))
+    {
+      context->receiveFrame(opcode, StringPiece(payload, static_cast<int>(len)), frameBytes);
+      return checkMessage(context);
+    }
+    context->receiveFragment(opcode, payload, static_cast<size_t>(len), fin);
+    buf->retrieve(frameBytes);
+    if (!context->expectFrame())
+    {
+      return checkMessage(context);
+    }
+  }
+  return true;
+}
+
+}
+}
+}
+
+struct WebSocketBroadcaster::Group
+{
+  explicit Group(EventLoop* l)
+    : loop(l)
+  {
+  }
+
+  void add(const TcpConnectionPtr& conn)
+  {
+    if (std::find(connections.begin(), connections.end(), conn) == connections.end())
+    {
+      connections.push_back(conn);
+      size.increment();
+    }
+  }
+
+  void remove(const TcpConnectionPtr& conn)
+  {
+    std::vector<TcpConnectionPtr>::iterator it =
+        std::find(connections.begin(), connections.end(), conn);
+    if (it != connections.end())
+    {
+      std::swap(*it, connections.back());
+      connections.pop_back();
+      size.decrement();
+    }
+  }
+
+  void send(const boost::shared_ptr<const string>& frame)
+  {
+    size_t i = 0;
+    while (i < connections.size())
+    {
+      if (connections[i]->connected())
+      {
+        connections[i]->send(frame);
+        ++i;
+      }
+      else
+      {
+        std::swap(connections[i], connections.back());
+        connections.pop_back();
+        size.decrement();
+      }
+    }
+  }
+
+  EventLoop* const loop;
+  std::vector<TcpConnectionPtr> connections;  // in loop only
+  AtomicInt32 size;
+};
+
+WebSocketBroadcaster::WebSocketBroadcaster()
+{
+}
+
+WebSocketBroadcaster::~WebSocketBroadcaster()
+{
+}
+
+WebSocketBroadcaster::GroupPtr WebSocketBroadcaster::groupOf(EventLoop* loop)
+{
+  MutexLockGuard lock(mutex_);
+  GroupPtr& group = groups_[loop];
+  if (!group)
+  {
+    group.reset(new Group(loop));
+  }
+  return group;
+}
+
+void WebSocketBroadcaster::add(const TcpConnectionPtr& conn)
+{
+  GroupPtr group = groupOf(conn->getLoop());
+  group->loop->runInLoop(boost::bind(&Group::add, group, conn));
+}
+
+void WebSocketBroadcaster::remove(const TcpConnectionPtr& conn)
+{
+  GroupPtr group = groupOf(conn->getLoop());
+  group->loop->runInLoop(boost::bind(&Group::remove, group, conn));
+}
+
+void WebSocketBroadcaster::broadcast(websocket::Opcode opcode, StringPiece message)
+{
+  unsigned char header[10];
+  size_t headerLength = encodeHeader(header, opcode, message.size(), true);
+  boost::shared_ptr<string> rendered(new string);
+  rendered->reserve(headerLength + message.size());
+  rendered->append(reinterpret_cast<char*>(header), headerLength);
+  rendered->append(message.data(), message.size());
+  boost::shared_ptr<const string> frame(rendered);
+
+  std::vector<GroupPtr> groups;
+  {
+    MutexLockGuard lock(mutex_);
+    groups.reserve(groups_.size());
+    for (std::map<EventLoop*, GroupPtr>::const_iterator it = groups_.begin();
+         it != groups_.end(); ++it)
+    {
+      groups.push_back(it->second);
+    }
+  }
+  for (size_t i = 0; i < groups.size(); ++i)
+  {
+    groups[i]->loop->runInLoop(boost::bind(&Group::send, groups[i], frame));
+  }
+}
+
+int WebSocketBroadcaster::size() const
+{
+  int n = 0;
+  MutexLockGuard lock(mutex_);
+  for (std::map<EventLoop*, GroupPtr>::const_iterator it = groups_.begin();
+       it != groups_.end(); ++it)
+  {
+    n += it->second->size.get();
+  }
+  return n;
+}
@@ -0,0 +1,123 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_WEBSOCKET_H
+#define MUDUO_NET_HTTP_WEBSOCKET_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/Callbacks.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <map>
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+class EventLoop;
+class HttpRequest;
+
+/// RFC 6455 framing, the server side.  HttpServer does the handshake and
+/// reads frames, see HttpServer::setWebSocketMessageCallback().
+namespace websocket
+{
+
+enum Opcode
+{
+  kContinuation = 0x0,
+  kText = 0x1,
+  kBinary = 0x2,
+  kClose = 0x8,
+  kPing = 0x9,
+  kPong = 0xA,
+};
+
+enum CloseCode
+{
+  kNormalClosure = 1000,
+  kGoingAway = 1001,
+  kProtocolError = 1002,
+  kUnsupportedData = 1003,
+  kInvalidPayload = 1007,  // e.g. a Text message that is not UTF-8
+  kMessageTooBig = 1009,
+};
+
+/// Whether req asks for a WebSocket, any version.
+bool isUpgrade(const HttpRequest& req);
+
+/// The Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+string acceptKey(StringPiece key);
+
+/// Whether text is well-formed UTF-8, no overlong forms, surrogates or
+/// code points beyond U+10FFFF.
+bool isValidUtf8(StringPiece text);
+
+/// Appends a frame as a server sends it, unmasked.
+void appendFrame(Buffer* output, Opcode opcode, const void* data, size_t len,
+                 bool fin = true);
+
+/// Appends a Close frame, reason is cut to fit in a control frame.
+void appendClose(Buffer* output, uint16_t code, StringPiece reason = StringPiece());
+
+/// XORs data with the 4-byte masking key, offset is where data starts
+/// within the payload.  Masks and unmasks alike.  Uses SSE2, or AVX2 where
+/// the CPU has it.
+void applyMask(char* data, size_t len, const char key[4], size_t offset = 0);
+
+/// Sends message as one frame.  Thread safe.
+void send(const TcpConnectionPtr& conn, Opcode opcode, StringPiece message);
+
+/// Starts the closing handshake, the connection is shut down after the
+/// Close frame.  Not thread safe, like TcpConnection::shutdown().
+void close(const TcpConnectionPtr& conn, uint16_t code = kNormalClosure,
+           StringPiece reason = StringPiece());
+
+}  // namespace websocket
+
+/// Sends one message to many WebSocket connections.  The frame is rendered
+/// once and every connection writes from the same copy.
+///
+/// Connections are kept in groups by their EventLoop, a group is only
+/// touched in its own loop, so broadcast() posts one functor per loop
+/// rather than one per connection.  Closed connections are dropped at the
+/// next broadcast.  Thread safe.
+class WebSocketBroadcaster : boost::noncopyable
+{
+ public:
+  WebSocketBroadcaster();
+  ~WebSocketBroadcaster();
+
+  void add(const TcpConnectionPtr& conn);
+  void remove(const TcpConnectionPtr& conn);
+
+  void broadcast(websocket::Opcode opcode, StringPiece message);
+
+  /// Connections added and not yet removed or found closed.
+  int size() const;
+
+ private:
+  struct Group;
+  typedef boost::shared_ptr<Group> GroupPtr;
+
+  GroupPtr groupOf(EventLoop* loop);
+
+  mutable MutexLock mutex_;
+  std::map<EventLoop*, GroupPtr> groups_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_WEBSOCKET_H
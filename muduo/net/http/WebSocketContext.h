@@ -0,0 +1,134 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
+#define MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <muduo/net/Buffer.h>
+#include <muduo/net/http/WebSocket.h>
+
+namespace muduo
+{
+namespace net
+{
+
+// The state of an upgraded connection, takes the place of HttpContext.
+// A frame is unmasked in place and handed out from the input buffer, only
+// fragmented messages are collected in a string of their own.
+class WebSocketContext : public muduo::copyable
+{
+ public:
+  enum WebSocketParseState
+  {
+    kExpectFrame,
+    kGotMessage,        // a whole text or binary message
+    kGotControl,        // a ping, pong or close frame
+  };
+
+  explicit WebSocketContext(size_t maxMessageSize)
+    : state_(kExpectFrame),
+      opcode_(websocket::kContinuation),
+      fragmentOpcode_(websocket::kContinuation),
+      closeCode_(websocket::kNormalClosure),
+      maxMessageSize_(maxMessageSize),
+      frameBytes_(0)
+  {
+  }
+
+  // default copy-ctor, dtor and assignment are fine
+
+  bool expectFrame() const
+  { return state_ == kExpectFrame; }
+
+  bool gotMessage() const
+  { return state_ == kGotMessage; }
+
+  bool gotControl() const
+  { return state_ == kGotControl; }
+
+  websocket::Opcode opcode() const
+  { return opcode_; }
+
+  // valid until next()
+  StringPiece payload() const
+  { return payload_; }
+
+  // frameBytes of the input buffer are consumed by next()
+  void receiveFrame(websocket::Opcode opcode, StringPiece payload, size_t frameBytes)
+  {
+    state_ = (opcode & 0x8) ? kGotControl : kGotMessage;
+    opcode_ = opcode;
+    payload_ = payload;
+    frameBytes_ = frameBytes;
+  }
+
+  // a frame of a fragmented message, the first one carries its opcode
+  void receiveFragment(websocket::Opcode opcode, const char* data, size_t len, bool fin)
+  {
+    if (opcode != websocket::kContinuation)
+    {
+      fragmentOpcode_ = opcode;
+    }
+    fragments_.append(data, len);
+    if (fin)
+    {
+      receiveFrame(fragmentOpcode_, fragments_, 0);
+      fragmentOpcode_ = websocket::kContinuation;
+    }
+  }
+
+  bool fragmented() const
+  { return fragmentOpcode_ != websocket::kContinuation; }
+
+  size_t fragmentBytes() const
+  { return fragments_.size(); }
+
+  // done with the message or control frame
+  void next(Buffer* buf)
+  {
+    buf->retrieve(frameBytes_);
+    frameBytes_ = 0;
+    if (gotMessage() && payload_.data() == fragments_.data())
+    {
+      fragments_.clear();
+    }
+    payload_.clear();
+    state_ = kExpectFrame;
+  }
+
+  size_t maxMessageSize() const
+  { return maxMessageSize_; }
+
+  // why the connection is failed, after a parse error
+  uint16_t closeCode() const
+  { return closeCode_; }
+
+  void setCloseCode(uint16_t code)
+  { closeCode_ = code; }
+
+ private:
+  WebSocketParseState state_;
+  websocket::Opcode opcode_;
+  websocket::Opcode fragmentOpcode_;
+  uint16_t closeCode_;
+  size_t maxMessageSize_;
+  size_t frameBytes_;
+  StringPiece payload_;
+  string fragments_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
@@ -0,0 +1,168 @@
+// Benchmark of HttpClient against an HttpServer in the same process, the
+// server runs in its own loop thread.
+//
+// Usage: httpclient_bench [requests] [concurrency] [connections] [depth]
+//
+// Runs once with no pipelining, then again with the given depth if it is
+// above 1, and prints requests per second and latency percentiles.
+
+#include <muduo/net/http/HttpClient.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpServer.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18080;
+
+void onRequest(const HttpRequest& req, HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  resp->setBody("hello, world!\n");
+}
+
+// the server must go away in its own loop
+void stopServer(HttpServer* server, CountDownLatch* stopped)
+{
+  delete server;
+  stopped->countDown();
+}
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* loop, int requests, int concurrency, int connections, int depth)
+    : loop_(loop),
+      client_(new HttpClient(loop, "HttpClientBench")),
+      server_(AF_INET, kPort, true),
+      requests_(requests),
+      concurrency_(concurrency),
+      sent_(0),
+      errors_(0)
+  {
+    client_->setMaxConnectionsPerHost(connections);
+    client_->setPipelineDepth(depth);
+    latencies_.reserve(requests);
+  }
+
+  void run()
+  {
+    start_ = Timestamp::now();
+    for (int i = 0; i < concurrency_ && sent_ < requests_; ++i)
+    {
+      send();
+    }
+    loop_->loop();
+  }
+
+  void report(const char* name)
+  {
+    double seconds = timeDifference(Timestamp::now(), start_);
+    std::sort(latencies_.begin(), latencies_.end());
+    size_t n = latencies_.size();
+    printf("%-12s %8.0f req/s  p50 %6.0fus  p99 %6.0fus  max %6.0fus  errors %d\n",
+           name, static_cast<double>(n) / seconds,
+           latencies_[n / 2] * 1e6, latencies_[n * 99 / 100] * 1e6,
+           latencies_[n - 1] * 1e6, errors_);
+  }
+
+ private:
+  void send()
+  {
+    ++sent_;
+    client_->get(server_, "/hello",
+                boost::bind(&Bench::onResponse, this, Timestamp::now(), _1));
+  }
+
+  void onResponse(Timestamp sent, const HttpClientResponse& response)
+  {
+    if (!response.ok() || response.statusCode() != 200)
+    {
+      ++errors_;
+    }
+    latencies_.push_back(timeDifference(Timestamp::now(), sent));
+    if (sent_ < requests_)
+    {
+      send();
+    }
+    else if (static_cast<int>(latencies_.size()) == requests_)
+    {
+      loop_->queueInLoop(boost::bind(&Bench::stop, this));
+    }
+  }
+
+  // the connections close in the loop, so it runs a little longer
+  void stop()
+  {
+    client_.reset();
+    loop_->runAfter(0.1, boost::bind(&EventLoop::quit, loop_));
+  }
+
+  EventLoop* loop_;
+  boost::scoped_ptr<HttpClient> client_;
+  InetAddress server_;
+  const int requests_;
+  const int concurrency_;
+  int sent_;
+  int errors_;
+  Timestamp start_;
+  std::vector<double> latencies_;
+};
+
+int main(int argc, char* argv[])
+{
+  int requests = argc > 1 ? atoi(argv[1]) : 100000;
+  int concurrency = argc > 2 ? atoi(argv[2]) : 64;
+  int connections = argc > 3 ? atoi(argv[3]) : 4;
+  int depth = argc > 4 ? atoi(argv[4]) : 16;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread serverThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  HttpServer* server =
+      new HttpServer(serverLoop, InetAddress(AF_INET, kPort, true), "HttpClientBench");
+  server->setHttpCallback(onRequest);
+  CountDownLatch started(1);
+  serverLoop->runInLoop(boost::bind(&HttpServer::start, server));
+  serverLoop->runInLoop(boost::bind(&CountDownLatch::countDown, &started));
+  started.wait();
+
+  printf("requests %d, concurrency %d, connections %d\n",
+         requests, concurrency, connections);
+  {
+    EventLoop loop;
+    Bench bench(&loop, requests, concurrency, connections, 1);
+    bench.run();
+    bench.report("depth 1");
+  }
+  if (depth > 1)
+  {
+    EventLoop loop;
+    Bench bench(&loop, requests, concurrency, connections, depth);
+    bench.run();
+    char name[32];
+    snprintf(name, sizeof name, "depth %d", depth);
+    bench.report(name);
+  }
+
+  CountDownLatch stopped(1);
+  serverLoop->runInLoop(boost::bind(stopServer, server, &stopped));
+  stopped.wait();
+}
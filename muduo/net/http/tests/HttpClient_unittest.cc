@@ -0,0 +1,232 @@
+#include <muduo/net/http/HttpClient.h>
+#include <muduo/net/http/HttpClientContext.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+//#define BOOST_TEST_MODULE HttpClientTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::Timestamp;
+using muduo::net::Buffer;
+using muduo::net::HttpClient;
+using muduo::net::HttpClientContext;
+using muduo::net::HttpClientResponse;
+using muduo::net::HttpRequest;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+bool parseResponse(Buffer* buf, HttpClientContext* context);
+}
+}
+}
+
+using muduo::net::detail::parseResponse;
+
+BOOST_AUTO_TEST_CASE(testParseResponseContentLength)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/plain\r\n"
+               "Content-Length: 5\r\n"
+               "\r\n"
+               "hel");
+
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(!context.gotAll());
+  input.append("lo");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  const HttpClientResponse& response = context.response();
+  BOOST_CHECK_EQUAL(response.version(), HttpRequest::kHttp11);
+  BOOST_CHECK_EQUAL(response.statusCode(), 200);
+  BOOST_CHECK_EQUAL(response.statusMessage(), "OK");
+  BOOST_CHECK_EQUAL(response.findHeader("content-type").as_string(), "text/plain");
+  BOOST_CHECK_EQUAL(response.body(), "hello");
+  BOOST_CHECK(context.keepAlive());
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponsePipelined)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 100 Continue\r\n\r\n"
+               "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\na"
+               "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+               "3\r\nabc\r\n2;x=y\r\nde\r\n0\r\nTrailer: 1\r\n\r\n"
+               "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n"
+               "HTTP/1.0 200 OK\r\nContent-Length: 100\r\n\r\n");
+
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.response().body(), "a");
+
+  context.reset(false);
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.response().body(), "abcde");
+
+  context.reset(false);
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.response().statusCode(), 304);
+
+  // a response to HEAD
+  context.reset(true);
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK(context.response().body().empty());
+  BOOST_CHECK(!context.keepAlive());
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseUntilClose)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nsome");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(!context.gotAll());
+  input.append(" more");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.receiveClose());
+  BOOST_CHECK_EQUAL(context.response().body(), "some more");
+  BOOST_CHECK(!context.keepAlive());
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseBad)
+{
+  const char* bad[] =
+  {
+    "HTTP/2 200 OK\r\n\r\n",
+    "HTTP/1.1 2x0 OK\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nno colon\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+  };
+  for (size_t i = 0; i < sizeof bad / sizeof bad[0]; ++i)
+  {
+    HttpClientContext context;
+    Buffer input;
+    input.append(bad[i]);
+    BOOST_CHECK_MESSAGE(!parseResponse(&input, &context), bad[i]);
+  }
+}
+
+void onResponse(HttpClientResponse::Error* error, muduo::CountDownLatch* latch,
+                const HttpClientResponse& response)
+{
+  *error = response.error();
+  latch->countDown();
+}
+
+void destroy(boost::scoped_ptr<HttpClient>* client, muduo::CountDownLatch* latch)
+{
+  client->reset();
+  latch->countDown();
+}
+
+// built off the loop thread, fails as soon as the connect is refused
+BOOST_AUTO_TEST_CASE(testConnectRefused)
+{
+  muduo::net::EventLoopThread loopThread;
+  muduo::net::EventLoop* loop = loopThread.startLoop();
+  boost::scoped_ptr<HttpClient> client(new HttpClient(loop, "refused"));
+  client->setTimeout(20);
+
+  // nothing listens on port 1
+  HttpClientResponse::Error error = HttpClientResponse::kOk;
+  muduo::CountDownLatch latch(1);
+  Timestamp start(Timestamp::now());
+  client->get(muduo::net::InetAddress(AF_INET, 1, true), "/",
+              boost::bind(onResponse, &error, &latch, _1));
+  latch.wait();
+  BOOST_CHECK_EQUAL(error, HttpClientResponse::kConnectFailed);
+  BOOST_CHECK_LT(muduo::timeDifference(Timestamp::now(), start), 5.0);
+  muduo::CountDownLatch destroyed(1);
+  loop->runInLoop(boost::bind(destroy, &client, &destroyed));
+  destroyed.wait();
+}
+
+// the start of a response which never ends, once per connection
+void onPartialRequest(const muduo::net::TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  buf->retrieveAll();
+  if (conn->getContext().empty())
+  {
+    conn->setContext(true);
+    conn->send("HTTP/1.1 200 OK\r\n\r\npartial");
+  }
+}
+
+void startServer(boost::scoped_ptr<muduo::net::TcpServer>* server, muduo::net::EventLoop* loop,
+                 muduo::CountDownLatch* latch)
+{
+  server->reset(new muduo::net::TcpServer(loop, muduo::net::InetAddress(AF_INET, 18103, true),
+                                          "partial"));
+  (*server)->setMessageCallback(onPartialRequest);
+  (*server)->start();
+  latch->countDown();
+}
+
+void stopServer(boost::scoped_ptr<muduo::net::TcpServer>* server, muduo::CountDownLatch* latch)
+{
+  server->reset();
+  latch->countDown();
+}
+
+// What arrived of a response that timed out doesn't complete the call
+// pipelined behind it, when the connection closes.
+BOOST_AUTO_TEST_CASE(testTimeoutPipelined)
+{
+  muduo::net::EventLoopThread serverThread;
+  muduo::net::EventLoop* serverLoop = serverThread.startLoop();
+  boost::scoped_ptr<muduo::net::TcpServer> server;
+  muduo::CountDownLatch started(1);
+  serverLoop->runInLoop(boost::bind(startServer, &server, serverLoop, &started));
+  started.wait();
+
+  muduo::net::EventLoopThread loopThread;
+  muduo::net::EventLoop* loop = loopThread.startLoop();
+  boost::scoped_ptr<HttpClient> client(new HttpClient(loop, "timeout"));
+  client->setMaxConnectionsPerHost(1);
+  client->setPipelineDepth(2);
+  client->setTimeout(0.3);
+
+  HttpClientResponse::Error errors[2] = { HttpClientResponse::kOk, HttpClientResponse::kOk };
+  muduo::CountDownLatch latch(2);
+  for (int i = 0; i < 2; ++i)
+  {
+    client->get(muduo::net::InetAddress(AF_INET, 18103, true), "/",
+                boost::bind(onResponse, &errors[i], &latch, _1));
+  }
+  latch.wait();
+  BOOST_CHECK_EQUAL(errors[0], HttpClientResponse::kTimeout);
+  BOOST_CHECK_NE(errors[1], HttpClientResponse::kOk);
+
+  muduo::CountDownLatch destroyed(1);
+  loop->runInLoop(boost::bind(destroy, &client, &destroyed));
+  destroyed.wait();
+  muduo::CountDownLatch stopped(1);
+  serverLoop->runInLoop(boost::bind(stopServer, &server, &stopped));
+  stopped.wait();
+  for (int i = 0; i < 2; ++i)
+  {
+    muduo::CountDownLatch synced(1);
+    serverLoop->runInLoop(boost::bind(&muduo::CountDownLatch::countDown, &synced));
+    synced.wait();
+  }
+}
@@ -0,0 +1,192 @@
+// A wrk-style load generator, each connection keeps a fixed number of
+// pipelined requests in flight.
+//
+// Usage: httppipeline_bench ip port [connections] [depth] [seconds] [path]
+
+#include <muduo/net/TcpClient.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+int64_t g_responses = 0;
+int64_t g_bytes = 0;
+int g_errors = 0;
+bool g_running = true;
+
+class Session : boost::noncopyable
+{
+ public:
+  Session(EventLoop* loop,
+          const InetAddress& serverAddr,
+          const string& name,
+          const string& request,
+          int depth)
+    : client_(loop, serverAddr, name),
+      request_(request),
+      depth_(depth)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Session::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&Session::onMessage, this, _1, _2, _3));
+  }
+
+  void start()
+  {
+    client_.connect();
+  }
+
+  void stop()
+  {
+    TcpConnectionPtr conn(client_.connection());
+    if (conn)
+    {
+      conn->forceClose();
+    }
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      sendRequests(conn, depth_);
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+  {
+    int completed = 0;
+    int64_t length = 0;
+    while ((length = responseLength(buf)) > 0)
+    {
+      buf->retrieve(static_cast<size_t>(length));
+      g_bytes += length;
+      ++completed;
+    }
+    if (length < 0)
+    {
+      ++g_errors;
+      conn->shutdown();
+      return;
+    }
+    g_responses += completed;
+    if (g_running)
+    {
+      sendRequests(conn, completed);
+    }
+  }
+
+  // all requests of one round go out in one write
+  void sendRequests(const TcpConnectionPtr& conn, int n)
+  {
+    for (int i = 0; i < n; ++i)
+    {
+      output_.append(request_);
+    }
+    conn->send(&output_);
+  }
+
+  // size of the first complete response in buf, 0 if incomplete, -1 for error
+  static int64_t responseLength(Buffer* buf)
+  {
+    const char* begin = buf->peek();
+    const char* end = begin + buf->readableBytes();
+    const char kHeaderEnd[] = "\r\n\r\n";
+    const char* headerEnd = std::search(begin, end, kHeaderEnd, kHeaderEnd + 4);
+    if (headerEnd == end)
+    {
+      return 0;
+    }
+    if (end - begin < 12 || !std::equal(begin, begin + 9, "HTTP/1.1 ") || begin[9] != '2')
+    {
+      return -1;
+    }
+    const char kLength[] = "\r\ncontent-length:";
+    const char* field = std::search(begin, headerEnd, kLength, kLength + sizeof kLength - 1,
+                                    equalsIgnoreCase);
+    if (field == headerEnd)
+    {
+      return -1;
+    }
+    int64_t bodyLength = atoll(field + sizeof kLength - 1);
+    int64_t total = (headerEnd + 4 - begin) + bodyLength;
+    return end - begin >= total ? total : 0;
+  }
+
+  static bool equalsIgnoreCase(char x, char y)
+  {
+    return tolower(x) == tolower(y);
+  }
+
+  TcpClient client_;
+  const string request_;
+  const int depth_;
+  Buffer output_;
+};
+
+void report(EventLoop* loop, double seconds, boost::ptr_vector<Session>* sessions)
+{
+  g_running = false;
+  printf("%.0f requests/sec, %.2f MiB/sec, %d errors\n",
+         static_cast<double>(g_responses) / seconds,
+         static_cast<double>(g_bytes) / seconds / 1024 / 1024,
+         g_errors);
+  fflush(stdout);
+  for (size_t i = 0; i < sessions->size(); ++i)
+  {
+    (*sessions)[i].stop();
+  }
+  // let the connections close
+  loop->runAfter(1.0, boost::bind(&EventLoop::quit, loop));
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    printf("Usage: %s ip port [connections] [depth] [seconds] [path]\n", argv[0]);
+    return 0;
+  }
+
+  Logger::setLogLevel(Logger::kWARN);
+  const char* ip = argv[1];
+  uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+  int connections = argc > 3 ? atoi(argv[3]) : 10;
+  int depth = argc > 4 ? atoi(argv[4]) : 16;
+  double seconds = argc > 5 ? atof(argv[5]) : 10;
+  string path = argc > 6 ? argv[6] : "/hello";
+
+  string request = "GET " + path + " HTTP/1.1\r\n"
+                   "Host: " + string(ip) + "\r\n"
+                   "\r\n";
+  printf("%d connections, %d requests in flight each, %.0f seconds\n",
+         connections, depth, seconds);
+
+  EventLoop loop;
+  InetAddress serverAddr(AF_INET, ip, port);
+  boost::ptr_vector<Session> sessions;
+  for (int i = 0; i < connections; ++i)
+  {
+    char name[32];
+    snprintf(name, sizeof name, "Session%d", i);
+    sessions.push_back(new Session(&loop, serverAddr, name, request, depth));
+    sessions.back().start();
+  }
+  loop.runAfter(seconds, boost::bind(report, &loop, seconds, &sessions));
+  loop.loop();
+}
@@ -1,6 +1,9 @@
+#include <muduo/net/http/HttpCompressor.h>
 #include <muduo/net/http/HttpContext.h>
 #include <muduo/net/Buffer.h>
 
+#include <boost/bind.hpp>
+
 //#define BOOST_TEST_MODULE BufferTest
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
@@ -9,6 +12,7 @@
 using muduo::string;
 using muduo::Timestamp;
 using muduo::net::Buffer;
+using muduo::net::HttpCompressor;
 using muduo::net::HttpContext;
 using muduo::net::HttpRequest;
 
@@ -19,11 +23,13 @@ namespace net
 namespace detail
 {
 bool parseRequest(Buffer* buf, HttpContext* context, Timestamp receiveTime);
+int parseByteRange(muduo::StringPiece value, int64_t size, int64_t* first, int64_t* last);
 }
 }
 }
 
 using muduo::net::detail::parseRequest;
+using muduo::net::detail::parseByteRange;
 
 BOOST_AUTO_TEST_CASE(testParseRequestAllInOne)
 {
@@ -90,3 +96,314 @@ BOOST_AUTO_TEST_CASE(testParseRequestEmptyHeaderValue)
   BOOST_CHECK_EQUAL(request.getHeader("User-Agent"), string(""));
   BOOST_CHECK_EQUAL(request.getHeader("Accept-Encoding"), string(""));
 }
+
+BOOST_AUTO_TEST_CASE(testParseRequestContentLength)
+{
+  string all("POST /upload HTTP/1.1\r\n"
+       "Host: www.chenshuo.com\r\n"
+       "content-length: 11\r\n"
+       "\r\n"
+       "hello world"
+       "GET /next HTTP/1.1\r\n"
+       "\r\n");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    if (!context.gotAll())
+    {
+      BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+    }
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().method(), HttpRequest::kPost);
+    BOOST_CHECK_EQUAL(context.request().body(), string("hello world"));
+
+    // the body is consumed, the next request starts right after it
+    context.reset();
+    BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().path(), string("/next"));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestChunked)
+{
+  string all("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhello\r\n"
+       "6;name=value\r\n world\r\n"
+       "0\r\n"
+       "Trailer: yes\r\n"
+       "\r\n");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+    BOOST_CHECK(!context.gotAll());
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().body(), string("hello world"));
+    BOOST_CHECK_EQUAL(context.request().getHeader("Trailer"), string("yes"));
+    BOOST_CHECK_EQUAL(input.readableBytes(), 0u);
+  }
+}
+
+void appendSlice(string* body, const HttpRequest&, muduo::StringPiece slice)
+{
+  body->append(slice.data(), slice.size());
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBodyCallback)
+{
+  string body;
+  HttpContext context;
+  context.setBodyCallback(boost::bind(appendSlice, &body, _1, _2));
+  Buffer input;
+  input.append("PUT /file HTTP/1.1\r\n"
+       "Content-Length: 10\r\n"
+       "\r\n"
+       "01234");
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(!context.gotAll());
+  BOOST_CHECK_EQUAL(body, string("01234"));
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0u);
+
+  input.append("56789");
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(body, string("0123456789"));
+  BOOST_CHECK_EQUAL(context.request().body(), string(""));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBadBody)
+{
+  {
+  HttpContext context;
+  Buffer input;
+  input.append("POST / HTTP/1.1\r\n"
+       "Content-Length: 12x\r\n"
+       "\r\n");
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  }
+
+  {
+  HttpContext context;
+  Buffer input;
+  input.append("POST / HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "zz\r\n");
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  }
+
+  {
+  HttpContext context;
+  context.setMaxBodySize(4);
+  Buffer input;
+  input.append("POST / HTTP/1.1\r\n"
+       "Content-Length: 5\r\n"
+       "\r\n"
+       "12345");
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.bodyTooLarge());
+  }
+
+  {
+  // refused on the headers, the client is not asked to send the body
+  HttpContext context;
+  context.setMaxBodySize(4);
+  Buffer input;
+  input.append("POST / HTTP/1.1\r\n"
+       "Content-Length: 5\r\n"
+       "Expect: 100-continue\r\n"
+       "\r\n");
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.bodyTooLarge());
+  BOOST_CHECK(!context.takeExpectContinue());
+  }
+
+  {
+  HttpContext context;
+  context.setMaxBodySize(4);
+  Buffer input;
+  input.append("POST / HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "3\r\nabc\r\n"
+       "2\r\n");
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.bodyTooLarge());
+  }
+}
+
+// lines with no end in sight are not buffered forever
+BOOST_AUTO_TEST_CASE(testParseRequestChunkedTooLong)
+{
+  const string chunked("POST / HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n");
+
+  {
+  HttpContext context;
+  Buffer input;
+  input.append(chunked);
+  input.append("5;" + string(32*1024, 'x'));
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  input.append(string(40*1024, 'x'));
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  }
+
+  {
+  // one trailer line too long
+  HttpContext context;
+  Buffer input;
+  input.append(chunked + "0\r\nTrailer: ");
+  input.append(string(70*1024, 'x'));
+  BOOST_CHECK(!parseRequest(&input, &context, Timestamp::now()));
+  }
+
+  {
+  // many short trailer lines, too long in all
+  HttpContext context;
+  Buffer input;
+  input.append(chunked + "0\r\n");
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  bool ok = true;
+  for (int i = 0; i < 10000 && ok; ++i)
+  {
+    input.append("Trailer: yes\r\n");
+    ok = parseRequest(&input, &context, Timestamp::now());
+  }
+  BOOST_CHECK(!ok);
+  BOOST_CHECK(!context.gotAll());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestZeroCopy)
+{
+  HttpContext context;
+  context.setZeroCopy(true);
+  Buffer input;
+  input.append("POST /upload?id=1 HTTP/1.1\r\n"
+       "HOST: www.chenshuo.com\r\n"
+       "Content-Length: 5\r\n"
+       "\r\n"
+       "hello"
+       "GET /next HTTP/1.1\r\n"
+       "\r\n");
+  const char* begin = input.peek();
+  const char* end = input.beginWrite();
+
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  const HttpRequest& request = context.request();
+  BOOST_CHECK_EQUAL(request.pathView().as_string(), string("/upload"));
+  BOOST_CHECK_EQUAL(request.queryView().as_string(), string("?id=1"));
+  BOOST_CHECK_EQUAL(request.getHeader("Host"), string("www.chenshuo.com"));
+  BOOST_CHECK_EQUAL(request.bodyView().as_string(), string("hello"));
+  // views into the input buffer, nothing retrieved yet
+  BOOST_CHECK(request.pathView().data() > begin && request.pathView().data() < end);
+  BOOST_CHECK(request.bodyView().data() > begin && request.bodyView().data() < end);
+  BOOST_CHECK_EQUAL(input.peek(), begin);
+  // no strings without a copy
+  BOOST_CHECK(request.path().empty());
+  BOOST_CHECK(request.headers().empty());
+
+  // a copy owns its data
+  HttpRequest copy(request);
+  BOOST_CHECK(copy.pathView().data() < begin || copy.pathView().data() >= end);
+  BOOST_CHECK(copy.bodyView().data() < begin || copy.bodyView().data() >= end);
+  BOOST_CHECK_EQUAL(copy.path(), string("/upload"));
+  BOOST_CHECK_EQUAL(copy.getHeader("Host"), string("www.chenshuo.com"));
+  BOOST_CHECK_EQUAL(copy.body(), string("hello"));
+  BOOST_CHECK_EQUAL(copy.query(), string("?id=1"));
+  BOOST_CHECK_EQUAL(copy.headers().find("HOST")->second, string("www.chenshuo.com"));
+
+  input.retrieve(context.heldBytes());
+  context.reset();
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().pathView().as_string(), string("/next"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestManyHeaders)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET / HTTP/1.1\r\n");
+  for (int i = 0; i < 2 * HttpRequest::kInlineHeaders; ++i)
+  {
+    char buf[64];
+    snprintf(buf, sizeof buf, "X-Header-%d: value %d\r\n", i, i);
+    input.append(buf);
+  }
+  input.append("\r\n");
+
+  BOOST_CHECK(parseRequest(&input, &context, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  HttpRequest request(context.request());
+  context.reset();
+  BOOST_CHECK_EQUAL(request.headerCount(), 2 * HttpRequest::kInlineHeaders);
+  BOOST_CHECK_EQUAL(request.getHeader("x-header-0"), string("value 0"));
+  BOOST_CHECK_EQUAL(request.getHeader("X-HEADER-47"), string("value 47"));
+  BOOST_CHECK_EQUAL(request.header(30).field.as_string(), string("X-Header-30"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseByteRange)
+{
+  int64_t first = 0, last = 0;
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=0-499", 1000, &first, &last), 1);
+  BOOST_CHECK_EQUAL(first, 0);
+  BOOST_CHECK_EQUAL(last, 499);
+
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=500-", 1000, &first, &last), 1);
+  BOOST_CHECK_EQUAL(first, 500);
+  BOOST_CHECK_EQUAL(last, 999);
+
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=-300", 1000, &first, &last), 1);
+  BOOST_CHECK_EQUAL(first, 700);
+  BOOST_CHECK_EQUAL(last, 999);
+
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=-3000", 1000, &first, &last), 1);
+  BOOST_CHECK_EQUAL(first, 0);
+
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=900-2000", 1000, &first, &last), 1);
+  BOOST_CHECK_EQUAL(last, 999);
+
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=1000-", 1000, &first, &last), -1);
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=-0", 1000, &first, &last), -1);
+
+  // sent in full
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=0-1,5-9", 1000, &first, &last), 0);
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=9-5", 1000, &first, &last), 0);
+  BOOST_CHECK_EQUAL(parseByteRange("bytes=-", 1000, &first, &last), 0);
+  BOOST_CHECK_EQUAL(parseByteRange("items=0-5", 1000, &first, &last), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testNegotiateEncoding)
+{
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate(""), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip, deflate, br"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("GZip;q=0.5"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip;q=0, deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip; q=0.000"), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("br"), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("*"), HttpCompressor::kGzip);
+
+  HttpCompressor compressor;
+  BOOST_CHECK(!compressor.enabled());
+  BOOST_CHECK(compressor.worthCompressing("text/html", 4096));
+  BOOST_CHECK(compressor.worthCompressing("application/json", 4096));
+  BOOST_CHECK(!compressor.worthCompressing("image/png", 4096));
+  BOOST_CHECK(!compressor.worthCompressing("text/html", 100));
+}
@@ -0,0 +1,195 @@
+// Routes lookups over 1000 routes, against the nested std::map of
+// segments Inspector used to do, and from several threads at once.
+//
+// Usage: httprouter_bench [threads] [lookups]
+
+#include <muduo/net/http/HttpRouter.h>
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <map>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int kResources = 100;
+thread_local int t_calls = 0;
+
+void handler(const HttpRequest&, const HttpRouter::Params&, HttpResponse*)
+{
+  ++t_calls;
+}
+
+// ten routes per resource
+void addRoutes(HttpRouter* router)
+{
+  HttpRouter::Handler h = handler;
+  for (int i = 0; i < kResources; ++i)
+  {
+    char base[32];
+    snprintf(base, sizeof base, "/api/v1/res%d", i);
+    string r(base);
+    router->add(HttpRequest::kGet, r, h);
+    router->add(HttpRequest::kPost, r, h);
+    router->add(HttpRequest::kGet, r + "/count", h);
+    router->add(HttpRequest::kGet, r + "/:id", h);
+    router->add(HttpRequest::kPut, r + "/:id", h);
+    router->add(HttpRequest::kDelete, r + "/:id", h);
+    router->add(HttpRequest::kGet, r + "/:id/history", h);
+    router->add(HttpRequest::kGet, r + "/:id/items/:item", h);
+    router->add(HttpRequest::kGet, r + "/:id/files/*path", h);
+    router->add(HttpRequest::kGet, r + "/search", h);
+  }
+}
+
+std::vector<HttpRequest> makeRequests(std::vector<string>* paths, bool staticOnly)
+{
+  const char* const kShapes[] =
+  {
+    "/count", "/search", "", "/12345", "/12345/history", "/12345/items/678",
+    "/12345/files/a/b/c.txt",
+  };
+  const int kNumShapes = staticOnly ? 2 : sizeof kShapes / sizeof kShapes[0];
+  for (int i = 0; i < 1000; ++i)
+  {
+    char path[64];
+    snprintf(path, sizeof path, "/api/v1/res%d%s", (i * 37) % kResources, kShapes[i % kNumShapes]);
+    paths->push_back(path);
+  }
+  std::vector<HttpRequest> requests(paths->size());
+  for (size_t i = 0; i < paths->size(); ++i)
+  {
+    const char kGet[] = "GET";
+    requests[i].setMethod(kGet, kGet + 3);
+    requests[i].setPath((*paths)[i].data(), (*paths)[i].data() + (*paths)[i].size());
+  }
+  return requests;
+}
+
+void lookups(const HttpRouter* router, const std::vector<HttpRequest>* requests, int n)
+{
+  HttpResponse resp(false);
+  for (int i = 0; i < n; ++i)
+  {
+    router->route((*requests)[i % requests->size()], &resp);
+  }
+}
+
+// two levels of std::map, under a mutex, only for static paths
+class NestedMaps
+{
+ public:
+  typedef std::map<string, int> CommandList;
+
+  void add(const string& module, const string& command)
+  {
+    MutexLockGuard lock(mutex_);
+    modules_[module][command] = 1;
+  }
+
+  bool find(const string& path)
+  {
+    std::vector<string> parts;
+    size_t start = 1;
+    size_t pos;
+    while ((pos = path.find('/', start)) != string::npos)
+    {
+      parts.push_back(path.substr(start, pos - start));
+      start = pos + 1;
+    }
+    parts.push_back(path.substr(start));
+    MutexLockGuard lock(mutex_);
+    std::map<string, CommandList>::const_iterator it = modules_.find(parts[0]);
+    return it != modules_.end() && parts.size() > 1
+        && it->second.find(parts[1]) != it->second.end();
+  }
+
+ private:
+  MutexLock mutex_;
+  std::map<string, CommandList> modules_;
+};
+
+int main(int argc, char* argv[])
+{
+  int numThreads = argc > 1 ? atoi(argv[1]) : 4;
+  int n = argc > 2 ? atoi(argv[2]) : 10*1000*1000;
+  if (numThreads > 64) numThreads = 64;
+
+  HttpRouter router;
+  Timestamp start(Timestamp::now());
+  addRoutes(&router);
+  printf("%zd routes added in %.3f sec\n", router.size(), timeDifference(Timestamp::now(), start));
+
+  std::vector<string> paths;
+  std::vector<HttpRequest> requests(makeRequests(&paths, false));
+  lookups(&router, &requests, static_cast<int>(requests.size()));
+  if (t_calls != static_cast<int>(requests.size()))
+  {
+    printf("%d of %zd routed\n", t_calls, requests.size());
+    return 1;
+  }
+
+  start = Timestamp::now();
+  lookups(&router, &requests, n);
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("radix tree    %6.1f ns/lookup, 1 thread\n", seconds * 1e9 / n);
+
+  std::vector<string> staticPaths;
+  std::vector<HttpRequest> staticRequests(makeRequests(&staticPaths, true));
+  start = Timestamp::now();
+  lookups(&router, &staticRequests, n);
+  seconds = timeDifference(Timestamp::now(), start);
+  printf("radix tree    %6.1f ns/lookup, 1 thread, static paths only\n", seconds * 1e9 / n);
+
+  NestedMaps maps;
+  std::vector<string> modulePaths;
+  for (int i = 0; i < kResources; ++i)
+  {
+    char module[32];
+    snprintf(module, sizeof module, "res%d", i);
+    maps.add(module, "count");
+    maps.add(module, "search");
+    char path[64];
+    snprintf(path, sizeof path, "/res%d/%s", i, i % 2 ? "count" : "search");
+    modulePaths.push_back(path);
+  }
+  start = Timestamp::now();
+  int found = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    found += maps.find(modulePaths[i % modulePaths.size()]);
+  }
+  seconds = timeDifference(Timestamp::now(), start);
+  printf("nested maps   %6.1f ns/lookup, 1 thread, static paths only (%d)\n",
+         seconds * 1e9 / n, found == n);
+
+  boost::ptr_vector<Thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads.push_back(new Thread(boost::bind(lookups, &router, &requests, n)));
+  }
+  start = Timestamp::now();
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].start();
+  }
+  // a route changes while the others look up
+  router.add(HttpRequest::kGet, "/api/v2/ping", handler);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].join();
+  }
+  seconds = timeDifference(Timestamp::now(), start);
+  printf("radix tree    %6.1f ns/lookup, %d threads, %.1f M lookups/sec in all\n",
+         seconds * 1e9 / n, numThreads, n * numThreads / seconds / 1e6);
+}
@@ -0,0 +1,135 @@
+#include <muduo/net/http/HttpRouter.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <boost/bind.hpp>
+
+//#define BOOST_TEST_MODULE HttpRouterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::net::Buffer;
+using muduo::net::HttpRequest;
+using muduo::net::HttpResponse;
+using muduo::net::HttpRouter;
+
+namespace
+{
+
+string g_route;
+string g_params;
+
+void handler(const string& name,
+             const HttpRequest&,
+             const HttpRouter::Params& params,
+             HttpResponse*)
+{
+  g_route = name;
+  g_params.clear();
+  for (int i = 0; i < params.size(); ++i)
+  {
+    g_params += params.name(i).as_string() + "=" + params.value(i).as_string() + ";";
+  }
+}
+
+HttpRouter::Handler named(const string& name)
+{
+  return boost::bind(handler, name, _1, _2, _3);
+}
+
+// the route taken, "" if none
+string route(const HttpRouter& router, const char* method, const char* path)
+{
+  HttpRequest req;
+  string m(method);
+  req.setMethod(m.data(), m.data() + m.size());
+  string p(path);
+  req.setPath(p.data(), p.data() + p.size());
+  HttpResponse resp(false);
+  g_route.clear();
+  g_params.clear();
+  if (!router.route(req, &resp))
+  {
+    return "";
+  }
+  if (g_route.empty())
+  {
+    Buffer buf;
+    resp.appendToBuffer(&buf);
+    string response = buf.retrieveAllAsString();
+    BOOST_CHECK(response.find("405 Method Not Allowed") != string::npos);
+    size_t allow = response.find("Allow: ");
+    BOOST_REQUIRE(allow != string::npos);
+    return "405 " + response.substr(allow + 7, response.find('\r', allow) - allow - 7);
+  }
+  return g_route;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testStaticRoutes)
+{
+  HttpRouter router;
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/", named("root")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/users", named("users")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/user", named("user")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/usage", named("usage")));
+  BOOST_CHECK(router.add(HttpRequest::kPost, "/users", named("create")));
+
+  BOOST_CHECK_EQUAL(route(router, "GET", "/"), "root");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users"), "users");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/user"), "user");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/usage"), "usage");
+  BOOST_CHECK_EQUAL(route(router, "POST", "/users"), "create");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/us"), "");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/"), "");
+  BOOST_CHECK_EQUAL(route(router, "DELETE", "/users"), "405 GET, POST");
+  BOOST_CHECK_EQUAL(router.size(), 5u);
+
+  BOOST_CHECK(router.remove(HttpRequest::kGet, "/user"));
+  BOOST_CHECK(!router.remove(HttpRequest::kGet, "/user"));
+  BOOST_CHECK_EQUAL(route(router, "GET", "/user"), "");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users"), "users");
+}
+
+BOOST_AUTO_TEST_CASE(testParams)
+{
+  HttpRouter router;
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/users/:id", named("user")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/users/new", named("new")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/users/:id/posts/:post", named("post")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/static/*file", named("static")));
+  BOOST_CHECK(router.add(HttpRequest::kInvalid, "/any/:x", named("any")));
+
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/42"), "user");
+  BOOST_CHECK_EQUAL(g_params, "id=42;");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/new"), "new");
+  BOOST_CHECK_EQUAL(g_params, "");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/newer"), "user");
+  BOOST_CHECK_EQUAL(g_params, "id=newer;");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/7/posts/99"), "post");
+  BOOST_CHECK_EQUAL(g_params, "id=7;post=99;");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/7/posts"), "");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/"), "");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/static/css/a.css"), "static");
+  BOOST_CHECK_EQUAL(g_params, "file=css/a.css;");
+  BOOST_CHECK_EQUAL(route(router, "GET", "/static/"), "static");
+  BOOST_CHECK_EQUAL(g_params, "file=;");
+  BOOST_CHECK_EQUAL(route(router, "PUT", "/any/1"), "any");
+  BOOST_CHECK_EQUAL(route(router, "POST", "/users/1"), "405 GET");
+}
+
+BOOST_AUTO_TEST_CASE(testBadPatterns)
+{
+  HttpRouter router;
+  BOOST_CHECK(!router.add(HttpRequest::kGet, "", named("x")));
+  BOOST_CHECK(!router.add(HttpRequest::kGet, "users", named("x")));
+  BOOST_CHECK(!router.add(HttpRequest::kGet, "/users/:", named("x")));
+  BOOST_CHECK(!router.add(HttpRequest::kGet, "/files/*path/more", named("x")));
+  BOOST_CHECK(router.add(HttpRequest::kGet, "/users/:id", named("x")));
+  BOOST_CHECK(!router.add(HttpRequest::kGet, "/users/:name/posts", named("x")));
+  BOOST_CHECK_EQUAL(router.size(), 1u);
+  BOOST_CHECK_EQUAL(route(router, "GET", "/users/1"), "x");
+}
@@ -1,23 +1,31 @@
 #include <muduo/net/http/HttpServer.h>
+#include <muduo/net/http/HttpContext.h>
+#include <muduo/net/http/HttpFileHandler.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/base/Logging.h>
 
+#include <boost/scoped_ptr.hpp>
+
 #include <iostream>
 #include <map>
 
+#include <stdio.h>
+#include <string.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
 extern char favicon[555];
 bool benchmark = false;
+HttpFileHandler* g_files = NULL;
 
 void onRequest(const HttpRequest& req, HttpResponse* resp)
 {
-  std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
   if (!benchmark)
   {
+    std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
     const std::map<string, string>& headers = req.headers();
     for (std::map<string, string>::const_iterator it = headers.begin();
          it != headers.end();
@@ -27,7 +35,14 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
     }
   }
 
-  if (req.path() == "/")
+  if (g_files && g_files->handle(req, resp))
+  {
+    return;
+  }
+
+  // views, for the zero copy of -b too
+  StringPiece path = req.pathView();
+  if (path == "/")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
@@ -38,14 +53,14 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
         "<body><h1>Hello</h1>Now is " + now +
         "</body></html>");
   }
-  else if (req.path() == "/favicon.ico")
+  else if (path == "/favicon.ico")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("image/png");
     resp->setBody(string(favicon, sizeof favicon));
   }
-  else if (req.path() == "/hello")
+  else if (path == "/hello")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
@@ -53,6 +68,13 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
     resp->addHeader("Server", "Muduo");
     resp->setBody("hello, world!\n");
   }
+  else if (path == "/echo")
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("application/octet-stream");
+    resp->setBody(req.bodyView().as_string());
+  }
   else
   {
     resp->setStatusCode(HttpResponse::k404NotFound);
@@ -61,18 +83,118 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
   }
 }
 
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+bool parseRequest(Buffer* buf, HttpContext* context, Timestamp receiveTime);
+}
+}
+}
+
+// parse, handle and render in one thread, requests/sec on one core
+void benchRequests(bool zeroCopy)
+{
+  const char request[] =
+      "GET /hello HTTP/1.1\r\n"
+      "Host: 127.0.0.1:8000\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+      "Accept-Language: en-US,en;q=0.5\r\n"
+      "Accept-Encoding: gzip, deflate\r\n"
+      "Connection: keep-alive\r\n"
+      "Upgrade-Insecure-Requests: 1\r\n"
+      "Cache-Control: max-age=0\r\n"
+      "\r\n";
+  const int kRequests = 1000 * 1000;
+  const int kBatch = 100;
+
+  HttpContext context;
+  context.setZeroCopy(zeroCopy);
+  Buffer input;
+  Buffer output;
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < kRequests; i += kBatch)
+  {
+    for (int j = 0; j < kBatch; ++j)
+    {
+      input.append(request, sizeof request - 1);
+    }
+    Timestamp now(Timestamp::now());
+    while (input.readableBytes() > 0)
+    {
+      muduo::net::detail::parseRequest(&input, &context, now);
+      assert(context.gotAll());
+      HttpResponse response(false);
+      onRequest(context.request(), &response);
+      response.appendToBuffer(&output);
+      input.retrieve(context.heldBytes());
+      context.reset();
+    }
+    output.retrieveAll();
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("%s %.0f requests/sec/core\n",
+         zeroCopy ? "zero copy" : "copy     ", kRequests / seconds);
+}
+
+// render small responses into one buffer, responses/sec on one core
+void benchResponses()
+{
+  const int kResponses = 5 * 1000 * 1000;
+  const string body("hello, world!\n");
+  Buffer output;
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < kResponses; ++i)
+  {
+    HttpResponse response(false);
+    response.setStatusCode(HttpResponse::k200Ok);
+    response.setContentType("text/plain");
+    response.addHeader("Server", "Muduo");
+    response.setBody(body);
+    response.appendToBuffer(&output);
+    if (output.readableBytes() > 64 * 1024)
+    {
+      output.retrieveAll();
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("render    %.0f responses/sec/core\n", kResponses / seconds);
+}
+
 int main(int argc, char* argv[])
 {
   int numThreads = 0;
-  if (argc > 1)
+  if (argc > 1 && strcmp(argv[1], "-b") == 0)
+  {
+    benchmark = true;
+    benchRequests(false);
+    benchRequests(true);
+    benchResponses();
+    return 0;
+  }
+  else if (argc > 1)
   {
     benchmark = true;
     Logger::setLogLevel(Logger::kWARN);
     numThreads = atoi(argv[1]);
   }
+  // httpserver_test numThreads docroot [level], serves docroot under /files/
+  boost::scoped_ptr<HttpFileHandler> files;
+  int level = argc > 3 ? atoi(argv[3]) : 0;
+  if (argc > 2)
+  {
+    files.reset(new HttpFileHandler(argv[2], "/files/"));
+    files->setCompressionLevel(level);
+    g_files = files.get();
+  }
   EventLoop loop;
-  HttpServer server(&loop, InetAddress(8000), "dummy");
+  HttpServer server(&loop, InetAddress(AF_INET, 8000), "dummy");
   server.setHttpCallback(onRequest);
+  server.setZeroCopy(benchmark);
+  server.setCompressionLevel(level);
   server.setThreadNum(numThreads);
   server.start();
   loop.loop();
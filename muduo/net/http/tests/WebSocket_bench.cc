@@ -0,0 +1,341 @@
+// Benchmarks of the WebSocket support of HttpServer, against clients in the
+// same process.
+//
+// Usage: websocket_bench [clients] [messages] [size]
+//
+// mask       unmasking speed, bytewise vs websocket::applyMask()
+// echo       messages echoed per second, each client keeps 16 in flight
+// broadcast  each of messages sent to all clients, with WebSocketBroadcaster
+//            and with websocket::send() to every connection
+
+#include <muduo/net/http/HttpServer.h>
+#include <muduo/net/http/WebSocket.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18081;
+const int kEchoDepth = 16;
+const char kKey[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+EventLoop* g_loop;
+int g_ready = 0;
+int g_clients = 0;
+int64_t g_received = 0;
+int64_t g_expected = 0;
+
+// the server side, runs in the server loop
+WebSocketBroadcaster g_broadcaster;
+std::set<TcpConnectionPtr> g_connections;
+
+bool onUpgrade(const TcpConnectionPtr& conn, const HttpRequest&)
+{
+  g_broadcaster.add(conn);
+  g_connections.insert(conn);
+  return true;
+}
+
+void onWebSocketMessage(const TcpConnectionPtr& conn, websocket::Opcode opcode,
+                        StringPiece message, Timestamp)
+{
+  websocket::send(conn, opcode, message);
+}
+
+void onWebSocketClose(const TcpConnectionPtr& conn)
+{
+  g_broadcaster.remove(conn);
+  g_connections.erase(conn);
+}
+
+void sendToEach(const string& message)
+{
+  for (std::set<TcpConnectionPtr>::iterator it = g_connections.begin();
+       it != g_connections.end(); ++it)
+  {
+    websocket::send(*it, websocket::kBinary, message);
+  }
+}
+
+// the server must go away in its own loop
+void stopServer(HttpServer* server, CountDownLatch* stopped)
+{
+  delete server;
+  stopped->countDown();
+}
+
+// the client side, runs in the main loop
+class Client : boost::noncopyable
+{
+ public:
+  Client(EventLoop* loop, const InetAddress& serverAddr, const string& frame)
+    : client_(loop, serverAddr, "WebSocketBench"),
+      frame_(frame),
+      upgraded_(false),
+      echo_(false)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Client::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&Client::onMessage, this, _1, _2, _3));
+    client_.connect();
+  }
+
+  void startEcho()
+  {
+    echo_ = true;
+    for (int i = 0; i < kEchoDepth; ++i)
+    {
+      conn_->send(frame_);
+    }
+  }
+
+  void stopEcho()
+  {
+    echo_ = false;
+  }
+
+  void disconnect()
+  {
+    conn_->shutdown();
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn_ = conn;
+      conn->setTcpNoDelay(true);
+      conn->send("GET /ws HTTP/1.1\r\n"
+                 "Host: localhost\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                 "Sec-WebSocket-Version: 13\r\n\r\n");
+    }
+    else
+    {
+      client_.disconnect();  // no reconnecting
+      --g_ready;
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+  {
+    if (!upgraded_)
+    {
+      const char kCRLFCRLF[] = "\r\n\r\n";
+      const char* limit = buf->peek() + buf->readableBytes();
+      const char* end = std::search(buf->peek(), limit, kCRLFCRLF, kCRLFCRLF + 4);
+      if (end == limit)
+      {
+        return;
+      }
+      if (memcmp(buf->peek(), "HTTP/1.1 101", 12) != 0)
+      {
+        LOG_FATAL << "upgrade refused";
+      }
+      buf->retrieveUntil(end + 4);
+      upgraded_ = true;
+      ++g_ready;
+    }
+
+    while (buf->readableBytes() >= 2)
+    {
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(buf->peek());
+      size_t header = 2;
+      size_t len = p[1] & 0x7F;
+      if (len == 126)
+      {
+        header = 4;
+        len = buf->readableBytes() >= 4 ? (p[2] << 8 | p[3]) : 0;
+      }
+      else if (len == 127)
+      {
+        LOG_FATAL << "message too big for the bench";
+      }
+      if (buf->readableBytes() < header + len)
+      {
+        break;
+      }
+      buf->retrieve(header + len);
+      ++g_received;
+      if (echo_)
+      {
+        conn->send(frame_);
+      }
+    }
+    if (g_expected > 0 && g_received >= g_expected)
+    {
+      g_loop->quit();
+    }
+  }
+
+  TcpClient client_;
+  TcpConnectionPtr conn_;
+  const string frame_;
+  bool upgraded_;
+  bool echo_;
+};
+
+void waitFor(bool (*done)())
+{
+  while (!done())
+  {
+    g_loop->runAfter(0.01, boost::bind(&EventLoop::quit, g_loop));
+    g_loop->loop();
+  }
+}
+
+bool allReady()
+{
+  return g_ready == g_clients;
+}
+
+bool allClosed()
+{
+  return g_ready == 0;
+}
+
+void benchMask(size_t size)
+{
+  std::vector<char> data(size);
+  const int64_t kBytes = 1LL << 30;
+  int64_t rounds = kBytes / static_cast<int64_t>(size);
+
+  Timestamp start = Timestamp::now();
+  for (int64_t r = 0; r < rounds; ++r)
+  {
+    char* p = &data[0];
+    for (size_t i = 0; i < size; ++i)
+    {
+      p[i] ^= kKey[i & 3];
+    }
+    // keeps the compiler from folding the rounds
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+  }
+  double bytewise = timeDifference(Timestamp::now(), start);
+
+  start = Timestamp::now();
+  for (int64_t r = 0; r < rounds; ++r)
+  {
+    websocket::applyMask(&data[0], size, kKey);
+  }
+  double simd = timeDifference(Timestamp::now(), start);
+  printf("mask %6zu bytes   bytewise %6.2f GB/s   applyMask %6.2f GB/s\n",
+         size, 1.0 / bytewise, 1.0 / simd);
+}
+
+int main(int argc, char* argv[])
+{
+  g_clients = argc > 1 ? atoi(argv[1]) : 100;
+  int messages = argc > 2 ? atoi(argv[2]) : 10000;
+  size_t size = argc > 3 ? atoi(argv[3]) : 128;
+  Logger::setLogLevel(Logger::kWARN);
+
+  benchMask(125);
+  benchMask(4096);
+  benchMask(65536);
+
+  EventLoopThread serverThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  HttpServer* server =
+      new HttpServer(serverLoop, InetAddress(AF_INET, kPort, true), "WebSocketBench");
+  server->setWebSocketUpgradeCallback(onUpgrade);
+  server->setWebSocketMessageCallback(onWebSocketMessage);
+  server->setWebSocketCloseCallback(onWebSocketClose);
+  CountDownLatch started(1);
+  serverLoop->runInLoop(boost::bind(&HttpServer::start, server));
+  serverLoop->runInLoop(boost::bind(&CountDownLatch::countDown, &started));
+  started.wait();
+
+  // a masked binary frame as clients send it
+  string payload(size, 'x');
+  websocket::applyMask(&payload[0], payload.size(), kKey);
+  Buffer frameBuffer;
+  websocket::appendFrame(&frameBuffer, websocket::kBinary, payload.data(), payload.size());
+  string frame(frameBuffer.peek(), frameBuffer.readableBytes() - payload.size());
+  frame[1] = static_cast<char>(frame[1] | 0x80);
+  frame.append(kKey, 4);
+  frame += payload;
+
+  EventLoop loop;
+  g_loop = &loop;
+  boost::ptr_vector<Client> clients;
+  for (int i = 0; i < g_clients; ++i)
+  {
+    clients.push_back(new Client(&loop, InetAddress(AF_INET, kPort, true), frame));
+  }
+  waitFor(allReady);
+  printf("clients %d, messages %d, size %zu\n", g_clients, messages, size);
+
+  g_received = 0;
+  g_expected = static_cast<int64_t>(messages) * g_clients;
+  Timestamp start = Timestamp::now();
+  for (int i = 0; i < g_clients; ++i)
+  {
+    clients[i].startEcho();
+  }
+  loop.loop();
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("echo                %10.0f msg/s\n", static_cast<double>(g_received) / seconds);
+  for (int i = 0; i < g_clients; ++i)
+  {
+    clients[i].stopEcho();
+  }
+  // the echoes still in flight
+  g_expected = 0;
+  loop.runAfter(0.2, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  string message(size, 'y');
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    g_received = 0;
+    g_expected = static_cast<int64_t>(messages) * g_clients;
+    start = Timestamp::now();
+    for (int i = 0; i < messages; ++i)
+    {
+      if (pass == 0)
+      {
+        g_broadcaster.broadcast(websocket::kBinary, message);
+      }
+      else
+      {
+        serverLoop->runInLoop(boost::bind(sendToEach, message));
+      }
+    }
+    loop.loop();
+    seconds = timeDifference(Timestamp::now(), start);
+    printf("%-19s %10.0f msg/s delivered\n",
+           pass == 0 ? "broadcast" : "send to each", static_cast<double>(g_received) / seconds);
+  }
+
+  for (int i = 0; i < g_clients; ++i)
+  {
+    clients[i].disconnect();
+  }
+  waitFor(allClosed);
+  clients.clear();
+
+  CountDownLatch stopped(1);
+  serverLoop->runInLoop(boost::bind(stopServer, server, &stopped));
+  stopped.wait();
+}
@@ -0,0 +1,257 @@
+#include <muduo/net/http/WebSocket.h>
+#include <muduo/net/http/WebSocketContext.h>
+#include <muduo/net/Buffer.h>
+
+//#define BOOST_TEST_MODULE WebSocketTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+
+using muduo::string;
+using muduo::StringPiece;
+using muduo::net::Buffer;
+using muduo::net::WebSocketContext;
+namespace websocket = muduo::net::websocket;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+bool parseFrame(Buffer* buf, WebSocketContext* context);
+}
+}
+}
+
+using muduo::net::detail::parseFrame;
+
+namespace
+{
+
+const char kKey[4] = { 0x37, static_cast<char>(0xfa), 0x21, 0x3d };
+
+// a frame as a client sends it, masked
+void appendClientFrame(Buffer* buf, websocket::Opcode opcode, const string& payload,
+                       bool fin = true)
+{
+  Buffer frame;
+  websocket::appendFrame(&frame, opcode, payload.data(), payload.size(), fin);
+  size_t header = frame.readableBytes() - payload.size();
+  string bytes(frame.peek(), header);
+  bytes[1] = static_cast<char>(bytes[1] | 0x80);
+  bytes.append(kKey, 4);
+  string masked(payload);
+  for (size_t i = 0; i < masked.size(); ++i)
+  {
+    masked[i] ^= kKey[i % 4];
+  }
+  buf->append(bytes);
+  buf->append(masked);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testAcceptKey)
+{
+  // RFC 6455 1.3
+  BOOST_CHECK_EQUAL(websocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ=="),
+                    "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+BOOST_AUTO_TEST_CASE(testApplyMask)
+{
+  char data[300];
+  char expected[300];
+  for (size_t len = 0; len < 200; len += 7)
+  {
+    for (size_t offset = 0; offset < 4; ++offset)
+    {
+      for (size_t i = 0; i < len; ++i)
+      {
+        data[i] = expected[i] = static_cast<char>(rand());
+        expected[i] ^= kKey[(offset + i) % 4];
+      }
+      websocket::applyMask(data, len, kKey, offset);
+      BOOST_CHECK(memcmp(data, expected, len) == 0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseFrames)
+{
+  WebSocketContext context(1024);
+  Buffer input;
+  string big(300, 'x');
+  appendClientFrame(&input, websocket::kText, "hello");
+  appendClientFrame(&input, websocket::kBinary, big);
+  appendClientFrame(&input, websocket::kText, "frag", false);
+  appendClientFrame(&input, websocket::kPing, "p");
+  appendClientFrame(&input, websocket::kContinuation, "men", false);
+  appendClientFrame(&input, websocket::kContinuation, "ted");
+
+  // one byte at a time, then the rest
+  Buffer partial;
+  partial.append(input.peek(), 3);
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK(context.expectFrame());
+  partial.append(input.peek() + 3, input.readableBytes() - 3);
+
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK(context.gotMessage());
+  BOOST_CHECK_EQUAL(context.opcode(), websocket::kText);
+  BOOST_CHECK_EQUAL(context.payload().as_string(), "hello");
+  context.next(&partial);
+
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK_EQUAL(context.opcode(), websocket::kBinary);
+  BOOST_CHECK_EQUAL(context.payload().as_string(), big);
+  context.next(&partial);
+
+  // a control frame in the middle of a fragmented message
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK(context.gotControl());
+  BOOST_CHECK_EQUAL(context.opcode(), websocket::kPing);
+  BOOST_CHECK_EQUAL(context.payload().as_string(), "p");
+  context.next(&partial);
+
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK(context.gotMessage());
+  BOOST_CHECK_EQUAL(context.opcode(), websocket::kText);
+  BOOST_CHECK_EQUAL(context.payload().as_string(), "fragmented");
+  context.next(&partial);
+
+  BOOST_CHECK(parseFrame(&partial, &context));
+  BOOST_CHECK(context.expectFrame());
+  BOOST_CHECK_EQUAL(partial.readableBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(testParseErrors)
+{
+  {
+    // not masked
+    WebSocketContext context(1024);
+    Buffer input;
+    websocket::appendFrame(&input, websocket::kText, "hi", 2);
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kProtocolError);
+  }
+  {
+    // continuation without a start
+    WebSocketContext context(1024);
+    Buffer input;
+    appendClientFrame(&input, websocket::kContinuation, "x");
+    BOOST_CHECK(!parseFrame(&input, &context));
+  }
+  {
+    // fragmented control frame
+    WebSocketContext context(1024);
+    Buffer input;
+    appendClientFrame(&input, websocket::kPing, "x", false);
+    BOOST_CHECK(!parseFrame(&input, &context));
+  }
+  {
+    // too big, noticed from the header alone
+    WebSocketContext context(100);
+    Buffer input;
+    appendClientFrame(&input, websocket::kText, string(60, 'a'), false);
+    appendClientFrame(&input, websocket::kContinuation, string(60, 'a'));
+    input.unwrite(60);
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kMessageTooBig);
+  }
+  {
+    // a Text message that is not UTF-8, the code point split between frames
+    WebSocketContext context(1024);
+    Buffer input;
+    appendClientFrame(&input, websocket::kText, "caf\xC3", false);
+    appendClientFrame(&input, websocket::kContinuation, "\xA9");
+    BOOST_CHECK(parseFrame(&input, &context));
+    BOOST_CHECK(context.gotMessage());
+    context.next(&input);
+    appendClientFrame(&input, websocket::kText, "caf\xC3(");
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kInvalidPayload);
+  }
+  {
+    // anything goes in Binary
+    WebSocketContext context(1024);
+    Buffer input;
+    appendClientFrame(&input, websocket::kBinary, "\xFF\xFE");
+    BOOST_CHECK(parseFrame(&input, &context));
+  }
+  {
+    // a 64-bit length with the most significant bit set
+    WebSocketContext context(0);
+    Buffer input;
+    const char header[] = "\x82\xFF\x80\0\0\0\0\0\0\x10";
+    input.append(header, sizeof header - 1);
+    input.append(kKey, 4);
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kProtocolError);
+  }
+  {
+    // a 64-bit length too big for any buffer, even when unlimited
+    WebSocketContext context(0);
+    Buffer input;
+    const char header[] = "\x82\xFF\x7F\xFF\xFF\xFF\xFF\xFF\xFF\xFF";
+    input.append(header, sizeof header - 1);
+    input.append(kKey, 4);
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kMessageTooBig);
+  }
+  {
+    // Close with a status code cut short, or one not to be sent
+    const char* payloads[] = { "\x03", "\x03\xEE", "\x03\xED", "\x13\x88" };
+    for (size_t i = 0; i < sizeof payloads / sizeof payloads[0]; ++i)
+    {
+      WebSocketContext context(1024);
+      Buffer input;
+      appendClientFrame(&input, websocket::kClose, payloads[i]);
+      BOOST_CHECK(!parseFrame(&input, &context));
+      BOOST_CHECK_EQUAL(context.closeCode(), websocket::kProtocolError);
+    }
+  }
+  {
+    // Close with a reason that is not UTF-8
+    WebSocketContext context(1024);
+    Buffer input;
+    appendClientFrame(&input, websocket::kClose, "\x03\xE8\xC0\xAF");
+    BOOST_CHECK(!parseFrame(&input, &context));
+    BOOST_CHECK_EQUAL(context.closeCode(), websocket::kInvalidPayload);
+  }
+  {
+    // Close, empty or with a code and reason
+    const char* payloads[] = { "", "\x03\xE8", "\x0F\xA0bye" };
+    for (size_t i = 0; i < sizeof payloads / sizeof payloads[0]; ++i)
+    {
+      WebSocketContext context(1024);
+      Buffer input;
+      appendClientFrame(&input, websocket::kClose, payloads[i]);
+      BOOST_CHECK(parseFrame(&input, &context));
+      BOOST_CHECK(context.gotControl());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testValidUtf8)
+{
+  BOOST_CHECK(websocket::isValidUtf8(""));
+  BOOST_CHECK(websocket::isValidUtf8("plain ASCII, longer than eight bytes"));
+  BOOST_CHECK(websocket::isValidUtf8("\xC2\x80 \xDF\xBF \xE0\xA0\x80 \xED\x9F\xBF"));
+  BOOST_CHECK(websocket::isValidUtf8("\xEF\xBF\xBF \xF0\x90\x80\x80 \xF4\x8F\xBF\xBF"));
+  BOOST_CHECK(websocket::isValidUtf8("\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5"));
+
+  BOOST_CHECK(!websocket::isValidUtf8("\x80"));              // continuation first
+  BOOST_CHECK(!websocket::isValidUtf8("\xC0\xAF"));          // overlong '/'
+  BOOST_CHECK(!websocket::isValidUtf8("\xE0\x9F\xBF"));      // overlong
+  BOOST_CHECK(!websocket::isValidUtf8("\xF0\x8F\xBF\xBF"));  // overlong
+  BOOST_CHECK(!websocket::isValidUtf8("\xED\xA0\x80"));      // surrogate
+  BOOST_CHECK(!websocket::isValidUtf8("\xF4\x90\x80\x80"));  // beyond U+10FFFF
+  BOOST_CHECK(!websocket::isValidUtf8("\xF5\x80\x80\x80"));
+  BOOST_CHECK(!websocket::isValidUtf8("\xFF"));
+  BOOST_CHECK(!websocket::isValidUtf8("12345678\xE2\x82"));   // truncated
+  BOOST_CHECK(!websocket::isValidUtf8("\xE2\x28\xA1"));
+}
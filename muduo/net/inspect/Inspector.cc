@@ -12,6 +12,7 @@
 #include <muduo/base/Logging.h>
 #include <muduo/base/Thread.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/http/HttpCompressor.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
 #include <muduo/net/inspect/ProcessInspector.h>
@@ -56,6 +57,23 @@ std::vector<string> split(const string& str)
   return result;
 }
 
+string httpCompression(HttpRequest::Method, const Inspector::ArgList&)
+{
+  return HttpCompressor::stats();
+}
+
+void runCommand(const Inspector::Callback& cb,
+                const HttpRequest& req,
+                const HttpRouter::Params& params,
+                HttpResponse* resp)
+{
+  Inspector::ArgList args = split(params.get("args").as_string());
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  resp->setBody(cb(req.method(), args));
+}
+
 }
 
 extern char favicon[1743];
@@ -73,6 +91,7 @@ Inspector::Inspector(EventLoop* loop,
   server_.setHttpCallback(boost::bind(&Inspector::onRequest, this, _1, _2));
   processInspector_->registerCommands(this);
   systemInspector_->registerCommands(this);
+  add("http", "compression", httpCompression, "print HTTP compression stats");
 #ifdef HAVE_TCMALLOC
   performanceInspector_.reset(new PerformanceInspector);
   performanceInspector_->registerCommands(this);
@@ -91,19 +110,24 @@ void Inspector::add(const string& module,
                     const Callback& cb,
                     const string& help)
 {
+  string path = "/" + module + "/" + command;
+  HttpRouter::Handler handler(boost::bind(runCommand, cb, _1, _2, _3));
+  router_.add(HttpRequest::kInvalid, path, handler);
+  router_.add(HttpRequest::kInvalid, path + "/*args", handler);
   MutexLockGuard lock(mutex_);
-  modules_[module][command] = cb;
   helps_[module][command] = help;
 }
 
 void Inspector::remove(const string& module, const string& command)
 {
+  string path = "/" + module + "/" + command;
+  router_.remove(HttpRequest::kInvalid, path);
+  router_.remove(HttpRequest::kInvalid, path + "/*args");
   MutexLockGuard lock(mutex_);
-  std::map<string, CommandList>::iterator it = modules_.find(module);
-  if (it != modules_.end())
+  std::map<string, HelpList>::iterator it = helps_.find(module);
+  if (it != helps_.end())
   {
     it->second.erase(command);
-    helps_[module].erase(command);
   }
 }
 
@@ -141,66 +165,18 @@ void Inspector::onRequest(const HttpRequest& req, HttpResponse* resp)
     resp->setContentType("text/plain");
     resp->setBody(result);
   }
-  else
+  else if (req.path() == "/favicon.ico")
   {
-    std::vector<string> result = split(req.path());
-    // boost::split(result, req.path(), boost::is_any_of("/"));
-    //std::copy(result.begin(), result.end(), std::ostream_iterator<string>(std::cout, ", "));
-    //std::cout << "\n";
-    bool ok = false;
-    if (result.size() == 0)
-    {
-      LOG_DEBUG << req.path();
-    }
-    else if (result.size() == 1)
-    {
-      string module = result[0];
-      if (module == "favicon.ico")
-      {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("image/png");
-        resp->setBody(string(favicon, sizeof favicon));
-
-        ok = true;
-      }
-      else
-      {
-        LOG_ERROR << "Unimplemented " << module;
-      }
-    }
-    else
-    {
-      string module = result[0];
-      std::map<string, CommandList>::const_iterator commListI = modules_.find(module);
-      if (commListI != modules_.end())
-      {
-        string command = result[1];
-        const CommandList& commList = commListI->second;
-        CommandList::const_iterator it = commList.find(command);
-        if (it != commList.end())
-        {
-          ArgList args(result.begin()+2, result.end());
-          if (it->second)
-          {
-            resp->setStatusCode(HttpResponse::k200Ok);
-            resp->setStatusMessage("OK");
-            resp->setContentType("text/plain");
-            const Callback& cb = it->second;
-            resp->setBody(cb(req.method(), args));
-            ok = true;
-          }
-        }
-      }
-
-    }
-
-    if (!ok)
-    {
-      resp->setStatusCode(HttpResponse::k404NotFound);
-      resp->setStatusMessage("Not Found");
-    }
-    //resp->setCloseConnection(true);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("image/png");
+    resp->setBody(string(favicon, sizeof favicon));
+  }
+  else if (!router_.route(req, resp))
+  {
+    LOG_DEBUG << "Not found " << req.path();
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
   }
 }
 
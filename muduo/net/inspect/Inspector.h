@@ -13,6 +13,7 @@
 
 #include <muduo/base/Mutex.h>
 #include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpRouter.h>
 #include <muduo/net/http/HttpServer.h>
 
 #include <map>
@@ -41,7 +42,8 @@ class Inspector : boost::noncopyable
             const string& name);
   ~Inspector();
 
-  /// Add a Callback for handling the special uri : /mudule/command
+  /// Add a Callback for handling the special uri : /mudule/command,
+  /// the path segments after it are the args.
   void add(const string& module,
            const string& command,
            const Callback& cb,
@@ -49,7 +51,6 @@ class Inspector : boost::noncopyable
   void remove(const string& module, const string& command);
 
  private:
-  typedef std::map<string, Callback> CommandList;
   typedef std::map<string, string> HelpList;
 
   void start();
@@ -59,8 +60,8 @@ class Inspector : boost::noncopyable
   boost::scoped_ptr<ProcessInspector> processInspector_;
   boost::scoped_ptr<PerformanceInspector> performanceInspector_;
   boost::scoped_ptr<SystemInspector> systemInspector_;
+  HttpRouter router_;
   MutexLock mutex_;
-  std::map<string, CommandList> modules_;
   std::map<string, HelpList> helps_;
 };
 
@@ -7,17 +7,98 @@
 //
 // This is a public header file, it must only include public header files.
 #pragma once
+#include <muduo/base/Logging.h>
+#include <muduo/base/StringPiece.h>
 #include <muduo/net/Buffer.h>
 #include <google/protobuf/io/zero_copy_stream.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
 namespace muduo
 {
 namespace net
 {
 
-// FIXME:
-// class BufferInputStream : google::protobuf::io::ZeroCopyInputStream
-// {
-// };
+// Reads the readable bytes of a Buffer, or of a chain of them, in place.
+// Nothing is retrieved, the buffers must outlive the stream and stay as
+// they are.
+class BufferInputStream : public google::protobuf::io::ZeroCopyInputStream
+{
+ public:
+  explicit BufferInputStream(const Buffer* buf)
+    : piece_(0),
+      offset_(0),
+      byteCount_(0)
+  {
+    pieces_.push_back(CHECK_NOTNULL(buf)->toStringPiece());
+  }
+
+  explicit BufferInputStream(const std::deque<Buffer>& chain)
+    : piece_(0),
+      offset_(0),
+      byteCount_(0)
+  {
+    pieces_.reserve(chain.size());
+    for (std::deque<Buffer>::const_iterator it = chain.begin(); it != chain.end(); ++it)
+    {
+      pieces_.push_back(it->toStringPiece());
+    }
+  }
+
+  virtual bool Next(const void** data, int* size) // override
+  {
+    while (piece_ < pieces_.size() && offset_ == pieces_[piece_].size())
+    {
+      ++piece_;
+      offset_ = 0;
+    }
+    if (piece_ == pieces_.size())
+    {
+      return false;
+    }
+    *data = pieces_[piece_].data() + offset_;
+    *size = pieces_[piece_].size() - offset_;
+    offset_ = pieces_[piece_].size();
+    byteCount_ += *size;
+    return true;
+  }
+
+  virtual void BackUp(int count) // override
+  {
+    // within what the last Next() returned
+    assert(count >= 0 && count <= offset_);
+    offset_ -= count;
+    byteCount_ -= count;
+  }
+
+  virtual bool Skip(int count) // override
+  {
+    while (count > 0 && piece_ < pieces_.size())
+    {
+      int n = std::min(count, pieces_[piece_].size() - offset_);
+      offset_ += n;
+      byteCount_ += n;
+      count -= n;
+      if (offset_ == pieces_[piece_].size())
+      {
+        ++piece_;
+        offset_ = 0;
+      }
+    }
+    return count == 0;
+  }
+
+  virtual int64_t ByteCount() const // override
+  {
+    return byteCount_;
+  }
+
+ private:
+  std::vector<StringPiece> pieces_;
+  size_t piece_;
+  int offset_;
+  int64_t byteCount_;
+};
 
 class BufferOutputStream : public google::protobuf::io::ZeroCopyOutputStream
 {
@@ -7,16 +7,27 @@
 // Author: Shuo Chen (chenshuo at chenshuo dot com)
 
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
-// #include <muduo/net/protobuf/BufferStream.h>
+#include <muduo/net/protobuf/BufferStream.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/base/ThreadPool.h>
 #include <muduo/net/Endian.h>
+#include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpConnection.h>
 #include <muduo/net/protorpc/google-inl.h>
 
 #include <google/protobuf/message.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <zlib.h>
 
+#include <limits.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define MUDUO_PROTOBUF_SSE42 1
+#endif
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -30,25 +41,389 @@ namespace
   int dummy = ProtobufVersionCheck();
 }
 
+namespace
+{
+  // CRC32C (Castagnoli), reflected
+  struct Crc32cTable
+  {
+    uint32_t table[256];
+
+    Crc32cTable()
+    {
+      for (uint32_t i = 0; i < 256; ++i)
+      {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; ++k)
+        {
+          crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+        table[i] = crc;
+      }
+    }
+  };
+
+  const Crc32cTable g_crc32cTable;
+
+  // crc is the running value, before the final inversion
+  uint32_t crc32cScalar(uint32_t crc, const unsigned char* p, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      crc = g_crc32cTable.table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+  }
+
+#ifdef MUDUO_PROTOBUF_SSE42
+  __attribute__((target("sse4.2")))
+  uint32_t crc32cSse42(uint32_t crc, const unsigned char* p, size_t len)
+  {
+    uint64_t crc64 = crc;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+      uint64_t word;
+      memcpy(&word, p + i, sizeof word);
+      crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; i < len; ++i)
+    {
+      crc = _mm_crc32_u8(crc, p[i]);
+    }
+    return crc;
+  }
+#endif
+
+  typedef uint32_t (*Crc32cFunc)(uint32_t, const unsigned char*, size_t);
+
+  Crc32cFunc chooseCrc32c()
+  {
+#ifdef MUDUO_PROTOBUF_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+      return crc32cSse42;
+    }
+#endif
+    return crc32cScalar;
+  }
+
+  const Crc32cFunc g_crc32c = chooseCrc32c();
+
+  // xxHash32 with seed 0, https://github.com/Cyan4973/xxHash
+  const uint32_t kPrime1 = 2654435761U;
+  const uint32_t kPrime2 = 2246822519U;
+  const uint32_t kPrime3 = 3266489917U;
+  const uint32_t kPrime4 = 668265263U;
+  const uint32_t kPrime5 = 374761393U;
+
+  inline uint32_t rotl32(uint32_t x, int r)
+  {
+    return (x << r) | (x >> (32 - r));
+  }
+
+  // little endian, like the reference
+  inline uint32_t read32(const unsigned char* p)
+  {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+  }
+
+  inline uint32_t xxRound(uint32_t v, uint32_t input)
+  {
+    return rotl32(v + input * kPrime2, 13) * kPrime1;
+  }
+
+  // fed in pieces, for frames kept in a chain of buffers
+  class XxHash32
+  {
+   public:
+    XxHash32()
+      : total_(0),
+        memSize_(0)
+    {
+      v_[0] = kPrime1 + kPrime2;
+      v_[1] = kPrime2;
+      v_[2] = 0;
+      v_[3] = 0 - kPrime1;
+    }
+
+    void update(const unsigned char* p, size_t len)
+    {
+      const unsigned char* end = p + len;
+      total_ += len;
+      if (memSize_ > 0)
+      {
+        size_t n = std::min(len, sizeof mem_ - memSize_);
+        memcpy(mem_ + memSize_, p, n);
+        memSize_ += n;
+        p += n;
+        if (memSize_ < sizeof mem_)
+        {
+          return;
+        }
+        stripe(mem_);
+        memSize_ = 0;
+      }
+      for (; p + 16 <= end; p += 16)
+      {
+        stripe(p);
+      }
+      memSize_ = end - p;
+      memcpy(mem_, p, memSize_);
+    }
+
+    uint32_t digest() const
+    {
+      uint32_t h;
+      if (total_ >= 16)
+      {
+        h = rotl32(v_[0], 1) + rotl32(v_[1], 7) + rotl32(v_[2], 12) + rotl32(v_[3], 18);
+      }
+      else
+      {
+        h = kPrime5;
+      }
+      h += static_cast<uint32_t>(total_);
+      const unsigned char* p = mem_;
+      const unsigned char* end = mem_ + memSize_;
+      for (; p + 4 <= end; p += 4)
+      {
+        h = rotl32(h + read32(p) * kPrime3, 17) * kPrime4;
+      }
+      for (; p < end; ++p)
+      {
+        h = rotl32(h + *p * kPrime5, 11) * kPrime1;
+      }
+      h ^= h >> 15;
+      h *= kPrime2;
+      h ^= h >> 13;
+      h *= kPrime3;
+      h ^= h >> 16;
+      return h;
+    }
+
+   private:
+    void stripe(const unsigned char* p)
+    {
+      v_[0] = xxRound(v_[0], read32(p));
+      v_[1] = xxRound(v_[1], read32(p + 4));
+      v_[2] = xxRound(v_[2], read32(p + 8));
+      v_[3] = xxRound(v_[3], read32(p + 12));
+    }
+
+    uint32_t v_[4];
+    uint64_t total_;
+    unsigned char mem_[16];
+    size_t memSize_;
+  };
+
+  // any ChecksumType over data fed in pieces
+  class Checksum
+  {
+   public:
+    explicit Checksum(ProtobufCodecLite::ChecksumType type)
+      : type_(type),
+        value_(type == ProtobufCodecLite::kAdler32 ? 1 : 0xFFFFFFFF)
+    {
+    }
+
+    void update(const void* data, size_t len)
+    {
+      const unsigned char* p = static_cast<const unsigned char*>(data);
+      switch (type_)
+      {
+       case ProtobufCodecLite::kAdler32:
+         value_ = static_cast<uint32_t>(::adler32(value_, p, static_cast<uInt>(len)));
+         break;
+       case ProtobufCodecLite::kCrc32c:
+         value_ = g_crc32c(value_, p, len);
+         break;
+       case ProtobufCodecLite::kXxHash32:
+         xxHash_.update(p, len);
+         break;
+       default:
+         break;
+      }
+    }
+
+    int32_t value() const
+    {
+      switch (type_)
+      {
+       case ProtobufCodecLite::kAdler32:
+         return static_cast<int32_t>(value_);
+       case ProtobufCodecLite::kCrc32c:
+         return static_cast<int32_t>(~value_);
+       case ProtobufCodecLite::kXxHash32:
+         return static_cast<int32_t>(xxHash_.digest());
+       default:
+         return 0;
+      }
+    }
+
+   private:
+    ProtobufCodecLite::ChecksumType type_;
+    uint32_t value_;
+    XxHash32 xxHash_;
+  };
+
+  // the last character of the tag for each ChecksumType but adler32
+  const char kTagEnds[] = "?CXN";
+
+  // where messages sent to connections of other loops are serialized,
+  // a type of its own so that it is not shared with other Buffer singletons
+  struct SendScratch
+  {
+    Buffer buffer;
+  };
+
+  // from ByteSizeLong(), frames are sized in int
+  int checkedSize(size_t size)
+  {
+    if (size > static_cast<size_t>(INT_MAX))
+    {
+      LOG_FATAL << "message of " << size << " bytes is too large to serialize";
+    }
+    return static_cast<int>(size);
+  }
+}
+
 void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
                              const ::google::protobuf::Message& message)
 {
-  // FIXME: serialize to TcpConnection::outputBuffer()
-  muduo::net::Buffer buf;
-  fillEmptyBuffer(&buf, message);
-  conn->send(&buf);
+  if (conn->getLoop()->isInLoopThread())
+  {
+    // the whole frame straight into the output of the connection
+    GOOGLE_DCHECK(message.IsInitialized()) << InitializationErrorMessage("serialize", message);
+    int byte_size = checkedSize(message.ByteSizeLong());
+    size_t frameLen = kHeaderLen + tag_.size() + byte_size + kChecksumLen;
+    char* start = conn->reserveOutput(frameLen);
+    if (start)
+    {
+      fillFrame(start, message, byte_size);
+      conn->commitOutput(frameLen);
+      return;
+    }
+  }
+
+  // serialized here, then one copy which the connection writes from
+  Buffer* buf = &ThreadLocalSingleton<SendScratch>::instance().buffer;
+  buf->retrieveAll();
+  fillEmptyBuffer(buf, message);
+  boost::shared_ptr<const string> frame(new string(buf->peek(), buf->readableBytes()));
+  conn->send(frame);
+}
+
+void ProtobufCodecLite::sendEmbedded(const TcpConnectionPtr& conn,
+                                     const ::google::protobuf::Message& message,
+                                     int field,
+                                     const ::google::protobuf::Message& embedded)
+{
+  int embeddedSize = 0;
+  int byte_size = embeddedByteSize(message, field, embedded, &embeddedSize);
+  size_t frameLen = kHeaderLen + tag_.size() + byte_size + kChecksumLen;
+  if (conn->getLoop()->isInLoopThread())
+  {
+    char* start = conn->reserveOutput(frameLen);
+    if (start)
+    {
+      fillFrame(start, message, byte_size, &embedded, field, embeddedSize);
+      conn->commitOutput(frameLen);
+      return;
+    }
+  }
+
+  Buffer* buf = &ThreadLocalSingleton<SendScratch>::instance().buffer;
+  buf->retrieveAll();
+  buf->ensureWritableBytes(frameLen);
+  fillFrame(buf->beginWrite(), message, byte_size, &embedded, field, embeddedSize);
+  buf->hasWritten(frameLen);
+  boost::shared_ptr<const string> frame(new string(buf->peek(), buf->readableBytes()));
+  conn->send(frame);
+}
+
+void ProtobufCodecLite::appendEmbedded(Buffer* buf,
+                                       const ::google::protobuf::Message& message,
+                                       int field,
+                                       const ::google::protobuf::Message& embedded)
+{
+  int embeddedSize = 0;
+  int byte_size = embeddedByteSize(message, field, embedded, &embeddedSize);
+  size_t frameLen = kHeaderLen + tag_.size() + byte_size + kChecksumLen;
+  buf->ensureWritableBytes(frameLen);
+  fillFrame(buf->beginWrite(), message, byte_size, &embedded, field, embeddedSize);
+  buf->hasWritten(frameLen);
+}
+
+int ProtobufCodecLite::embeddedByteSize(const google::protobuf::Message& message,
+                                        int field,
+                                        const google::protobuf::Message& embedded,
+                                        int* embeddedSize)
+{
+  using google::protobuf::internal::WireFormatLite;
+  GOOGLE_DCHECK(message.IsInitialized()) << InitializationErrorMessage("serialize", message);
+  GOOGLE_DCHECK(embedded.IsInitialized()) << InitializationErrorMessage("serialize", embedded);
+  *embeddedSize = checkedSize(embedded.ByteSizeLong());
+  return checkedSize(message.ByteSizeLong()
+                     + WireFormatLite::TagSize(field, WireFormatLite::TYPE_BYTES)
+                     + google::protobuf::io::CodedOutputStream::VarintSize32(*embeddedSize)
+                     + *embeddedSize);
+}
+
+void ProtobufCodecLite::fillFrame(char* start,
+                                  const google::protobuf::Message& message,
+                                  int byte_size,
+                                  const google::protobuf::Message* embedded,
+                                  int field,
+                                  int embeddedSize)
+{
+  using google::protobuf::internal::WireFormatLite;
+  // read once, it may change in the loop meanwhile
+  ChecksumType type = checksumType();
+  char* tag = start + kHeaderLen;
+  memcpy(tag, tag_.data(), tag_.size());
+  if (type != kAdler32)
+  {
+    tag[tag_.size() - 1] = tagEnd(type);
+  }
+  uint8_t* payload = reinterpret_cast<uint8_t*>(tag + tag_.size());
+  uint8_t* end = message.SerializeWithCachedSizesToArray(payload);
+  if (embedded)
+  {
+    // fields may come in any order, the embedded one goes last
+    end = WireFormatLite::WriteTagToArray(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, end);
+    end = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(embeddedSize, end);
+    end = embedded->SerializeWithCachedSizesToArray(end);
+  }
+  if (end - payload != byte_size)
+  {
+    ByteSizeConsistencyError(byte_size, checkedSize(message.ByteSizeLong()), static_cast<int>(end - payload));
+  }
+
+  int32_t checkSum = sockets::hostToNetwork32(
+      checksum(type, tag, static_cast<int>(tag_.size()) + byte_size));
+  memcpy(end, &checkSum, sizeof checkSum);
+  int32_t len = sockets::hostToNetwork32(
+      static_cast<int32_t>(tag_.size() + byte_size + kChecksumLen));
+  memcpy(start, &len, sizeof len);
 }
 
 void ProtobufCodecLite::fillEmptyBuffer(muduo::net::Buffer* buf,
                                         const google::protobuf::Message& message)
 {
   assert(buf->readableBytes() == 0);
-  // FIXME: can we move serialization & checksum to other thread?
+  ChecksumType type = checksumType();
   buf->append(tag_);
+  if (type != kAdler32)
+  {
+    buf->beginWrite()[-1] = tagEnd(type);
+  }
 
   int byte_size = serializeToBuffer(message, buf);
 
-  int32_t checkSum = checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+  int32_t checkSum = checksum(type, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
   assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
   int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
@@ -59,6 +434,10 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
                                   Buffer* buf,
                                   Timestamp receiveTime)
 {
+  if (chainRemaining_ > 0 && !receiveChain(conn, buf, receiveTime))
+  {
+    return;
+  }
   while (buf->readableBytes() >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
   {
     const int32_t len = buf->peekInt32();
@@ -74,8 +453,16 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
         buf->retrieve(kHeaderLen+len);
         continue;
       }
+      if (offloads(len))
+      {
+        boost::shared_ptr<string> frame(new string(buf->peek()+kHeaderLen, len));
+        buf->retrieve(kHeaderLen+len);
+        offload(conn->getLoop(),
+                boost::bind(&ProtobufCodecLite::parseInPool, this,
+                            owner_.lock(), conn, frame, receiveTime));
+        continue;
+      }
       MessagePtr message(prototype_->New());
-      // FIXME: can we move deserialization & callback to other thread?
       ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get());
       if (errorCode == kNoError)
       {
@@ -89,6 +476,15 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
         break;
       }
     }
+    else if (streamingThreshold_ > 0 && len >= streamingThreshold_)
+    {
+      // collected as it comes rather than grown in buf
+      buf->retrieve(kHeaderLen);
+      chainLen_ = len;
+      chainRemaining_ = len;
+      receiveChain(conn, buf, receiveTime);
+      break;
+    }
     else
     {
       break;
@@ -96,11 +492,206 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
   }
 }
 
+// true if the frame is done and buf may hold more
+bool ProtobufCodecLite::receiveChain(const TcpConnectionPtr& conn,
+                                     Buffer* buf,
+                                     Timestamp receiveTime)
+{
+  size_t n = std::min(buf->readableBytes(), static_cast<size_t>(chainRemaining_));
+  if (n == buf->readableBytes() && (chain_.empty() || chain_.back().writableBytes() < n))
+  {
+    // all of buf is ours, take its storage instead of copying
+    chain_.push_back(Buffer(0));
+    chain_.back().swap(*buf);
+  }
+  else
+  {
+    if (chain_.empty() || chain_.back().writableBytes() < n)
+    {
+      chain_.push_back(Buffer(n));
+    }
+    chain_.back().append(buf->peek(), n);
+    buf->retrieve(n);
+  }
+  chainRemaining_ -= static_cast<int>(n);
+  if (chainRemaining_ > 0)
+  {
+    return false;
+  }
+
+  if (offloads(chainLen_))
+  {
+    ChainPtr chain(new std::deque<Buffer>);
+    chain->swap(chain_);
+    offload(conn->getLoop(),
+            boost::bind(&ProtobufCodecLite::parseChainInPool, this,
+                        owner_.lock(), conn, chain, chainLen_, receiveTime));
+    return true;
+  }
+
+  MessagePtr message(prototype_->New());
+  ErrorCode errorCode = parseChain(chain_, chainLen_, message.get());
+  chain_.clear();
+  if (errorCode == kNoError)
+  {
+    messageCallback_(conn, message, receiveTime);
+    return true;
+  }
+  else
+  {
+    errorCallback_(conn, buf, receiveTime, errorCode);
+    return false;
+  }
+}
+
+ProtobufCodecLite::ErrorCode ProtobufCodecLite::parseChain(const std::deque<Buffer>& chain,
+                                                           int len,
+                                                           ::google::protobuf::Message* message)
+{
+  // the first buffer has the tag and more, see onMessage()
+  ChecksumType type = checksumTypeOf(chain.front().peek());
+  if (!accepts(type))
+  {
+    return kUnknownMessageType;
+  }
+
+  if (type != kNoChecksum)
+  {
+    Checksum sum(type);
+    size_t left = len - kChecksumLen;
+    char expected[kChecksumLen];
+    size_t got = 0;
+    for (std::deque<Buffer>::const_iterator it = chain.begin(); it != chain.end(); ++it)
+    {
+      size_t n = std::min(left, it->readableBytes());
+      sum.update(it->peek(), n);
+      left -= n;
+      // the rest are checksum bytes
+      memcpy(expected + got, it->peek() + n, it->readableBytes() - n);
+      got += it->readableBytes() - n;
+    }
+    assert(got == sizeof expected);
+    if (sum.value() != asInt32(expected))
+    {
+      return kCheckSumError;
+    }
+  }
+
+  BufferInputStream input(chain);
+  input.Skip(static_cast<int>(tag_.size()));
+  int size = len - kChecksumLen - static_cast<int>(tag_.size());
+  return parseFromStream(&input, size, message) ? kNoError : kParseError;
+}
+
+// in the loop, for every frame while a pool is set, so without the lock;
+// only the loop sets and clears it, see endStrand()
+bool ProtobufCodecLite::offloading() const
+{
+  return strandRunning_.get() != 0;
+}
+
+// in the loop
+void ProtobufCodecLite::offload(EventLoop* loop, const Task& task)
+{
+  bool start = false;
+  {
+  MutexLockGuard lock(mutex_);
+  strand_.push_back(task);
+  start = strandRunning_.getAndSet(1) == 0;
+  }
+  if (start)
+  {
+    pool_->run(boost::bind(&ProtobufCodecLite::runStrand, this, owner_.lock(), loop));
+  }
+}
+
+// in the pool, one frame after another
+void ProtobufCodecLite::runStrand(const boost::shared_ptr<void>& owner, EventLoop* loop)
+{
+  for (;;)
+  {
+    Task task;
+    {
+    MutexLockGuard lock(mutex_);
+    if (strand_.empty())
+    {
+      break;
+    }
+    task.swap(strand_.front());
+    strand_.pop_front();
+    }
+    task();
+  }
+  // replies sent from the pool are queued to the loop, frames must keep
+  // going to the pool until those are written, or the reply to a small
+  // one handled in the loop would overtake them
+  loop->queueInLoop(boost::bind(&ProtobufCodecLite::endStrand, this, owner, loop));
+}
+
+// in the loop, behind what the strand has sent
+void ProtobufCodecLite::endStrand(const boost::shared_ptr<void>& owner, EventLoop* loop)
+{
+  {
+  MutexLockGuard lock(mutex_);
+  if (strand_.empty())
+  {
+    strandRunning_.getAndSet(0);
+    return;
+  }
+  }
+  // frames came in the meantime
+  pool_->run(boost::bind(&ProtobufCodecLite::runStrand, this, owner, loop));
+}
+
+void ProtobufCodecLite::parseInPool(const boost::shared_ptr<void>&,
+                                    const TcpConnectionPtr& conn,
+                                    const boost::shared_ptr<string>& frame,
+                                    Timestamp receiveTime)
+{
+  MessagePtr message(prototype_->New());
+  ErrorCode errorCode = parse(frame->data(), static_cast<int>(frame->size()), message.get());
+  deliver(conn, message, receiveTime, errorCode);
+}
+
+void ProtobufCodecLite::parseChainInPool(const boost::shared_ptr<void>&,
+                                         const TcpConnectionPtr& conn,
+                                         const ChainPtr& chain,
+                                         int len,
+                                         Timestamp receiveTime)
+{
+  MessagePtr message(prototype_->New());
+  ErrorCode errorCode = parseChain(*chain, len, message.get());
+  deliver(conn, message, receiveTime, errorCode);
+}
+
+void ProtobufCodecLite::deliver(const TcpConnectionPtr& conn,
+                                const MessagePtr& message,
+                                Timestamp receiveTime,
+                                ErrorCode errorCode)
+{
+  if (errorCode == kNoError)
+  {
+    messageCallback_(conn, message, receiveTime);
+  }
+  else
+  {
+    conn->getLoop()->runInLoop(
+        boost::bind(errorCallback_, conn, static_cast<Buffer*>(NULL), receiveTime, errorCode));
+  }
+}
+
 bool ProtobufCodecLite::parseFromBuffer(StringPiece buf, google::protobuf::Message* message)
 {
   return message->ParseFromArray(buf.data(), buf.size());
 }
 
+bool ProtobufCodecLite::parseFromStream(google::protobuf::io::ZeroCopyInputStream* input,
+                                        int size,
+                                        google::protobuf::Message* message)
+{
+  return message->ParseFromBoundedZeroCopyStream(input, size);
+}
+
 int ProtobufCodecLite::serializeToBuffer(const google::protobuf::Message& message, Buffer* buf)
 {
   // TODO: use BufferOutputStream
@@ -111,14 +702,14 @@ int ProtobufCodecLite::serializeToBuffer(const google::protobuf::Message& messag
   // code copied from MessageLite::SerializeToArray() and MessageLite::SerializePartialToArray().
   GOOGLE_DCHECK(message.IsInitialized()) << InitializationErrorMessage("serialize", message);
 
-  int byte_size = message.ByteSize();
+  int byte_size = checkedSize(message.ByteSizeLong());
   buf->ensureWritableBytes(byte_size + kChecksumLen);
 
   uint8_t* start = reinterpret_cast<uint8_t*>(buf->beginWrite());
   uint8_t* end = message.SerializeWithCachedSizesToArray(start);
   if (end - start != byte_size)
   {
-    ByteSizeConsistencyError(byte_size, message.ByteSize(), static_cast<int>(end - start));
+    ByteSizeConsistencyError(byte_size, checkedSize(message.ByteSizeLong()), static_cast<int>(end - start));
   }
   buf->hasWritten(byte_size);
   return byte_size;
@@ -181,41 +772,91 @@ int32_t ProtobufCodecLite::checksum(const void* buf, int len)
       ::adler32(1, static_cast<const Bytef*>(buf), len));
 }
 
+int32_t ProtobufCodecLite::checksum(ChecksumType type, const void* buf, int len)
+{
+  Checksum sum(type);
+  sum.update(buf, len);
+  return sum.value();
+}
+
 bool ProtobufCodecLite::validateChecksum(const char* buf, int len)
+{
+  return validateChecksum(kAdler32, buf, len);
+}
+
+bool ProtobufCodecLite::validateChecksum(ChecksumType type, const char* buf, int len)
 {
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
-ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
-                                                      int len,
-                                                      ::google::protobuf::Message* message)
+void ProtobufCodecLite::setChecksumType(ChecksumType type)
 {
-  ErrorCode error = kNoError;
+  assert(type >= kAdler32 && type < kNumChecksumTypes);
+  assert(type == kAdler32 || hasChecksumTypes());
+  checksumType_.getAndSet(type);
+}
+
+bool ProtobufCodecLite::hasChecksumTypes() const
+{
+  return !tag_.empty() && strchr(kTagEnds + 1, tag_[tag_.size() - 1]) == NULL;
+}
+
+bool ProtobufCodecLite::accepts(ChecksumType type) const
+{
+  return type != kNumChecksumTypes &&
+      (type != kNoChecksum || allowNoChecksum_ || checksumType() == kNoChecksum);
+}
+
+char ProtobufCodecLite::tagEnd(ChecksumType type) const
+{
+  return type == kAdler32 ? tag_[tag_.size() - 1] : kTagEnds[type];
+}
 
-  if (validateChecksum(buf, len))
+ProtobufCodecLite::ChecksumType ProtobufCodecLite::checksumTypeOf(const char* tag) const
+{
+  if (tag_.empty())
   {
-    if (memcmp(buf, tag_.data(), tag_.size()) == 0)
-    {
-      // parse from buffer
-      const char* data = buf + tag_.size();
-      int32_t dataLen = len - kChecksumLen - static_cast<int>(tag_.size());
-      if (parseFromBuffer(StringPiece(data, dataLen), message))
-      {
-        error = kNoError;
-      }
-      else
-      {
-        error = kParseError;
-      }
-    }
-    else
+    return kAdler32;
+  }
+  size_t last = tag_.size() - 1;
+  if (memcmp(tag, tag_.data(), last) != 0)
+  {
+    return kNumChecksumTypes;
+  }
+  if (tag[last] == tag_[last])
+  {
+    return kAdler32;
+  }
+  for (int type = kCrc32c; hasChecksumTypes() && type < kNumChecksumTypes; ++type)
+  {
+    if (tag[last] == kTagEnds[type])
     {
-      error = kUnknownMessageType;
+      return static_cast<ChecksumType>(type);
     }
   }
+  return kNumChecksumTypes;
+}
+
+ProtobufCodecLite::ErrorCode ProtobufCodecLite::payloadOf(const char* buf,
+                                                          int len,
+                                                          StringPiece* payload) const
+{
+  ErrorCode error = kNoError;
+  ChecksumType type = checksumTypeOf(buf);
+
+  if (!accepts(type))
+  {
+    error = kUnknownMessageType;
+  }
+  else if (type == kNoChecksum || validateChecksum(type, buf, len))
+  {
+    const char* data = buf + tag_.size();
+    int32_t dataLen = len - kChecksumLen - static_cast<int>(tag_.size());
+    payload->set(data, dataLen);
+  }
   else
   {
     error = kCheckSumError;
@@ -224,3 +865,16 @@ ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
   return error;
 }
 
+ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
+                                                      int len,
+                                                      ::google::protobuf::Message* message)
+{
+  StringPiece payload;
+  ErrorCode error = payloadOf(buf, len, &payload);
+  if (error == kNoError && !parseFromBuffer(payload, message))
+  {
+    error = kParseError;
+  }
+  return error;
+}
+
@@ -14,17 +14,23 @@
 #ifndef MUDUO_NET_PROTOBUF_CODEC_H
 #define MUDUO_NET_PROTOBUF_CODEC_H
 
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
 #include <muduo/base/StringPiece.h>
 #include <muduo/base/Timestamp.h>
 
+#include <muduo/net/Buffer.h>
 #include <muduo/net/Callbacks.h>
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <boost/bind.hpp>
 
+#include <deque>
+
 #ifndef NDEBUG
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_base_of.hpp>
@@ -35,15 +41,22 @@ namespace google
 namespace protobuf
 {
 class Message;
+namespace io
+{
+class ZeroCopyInputStream;
+}
 }
 }
 
 namespace muduo
 {
+
+class ThreadPool;
+
 namespace net
 {
 
-class Buffer;
+class EventLoop;
 class TcpConnection;
 typedef boost::shared_ptr<TcpConnection> TcpConnectionPtr;
 typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
@@ -57,6 +70,11 @@ typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
 // payload   N-byte
 // checksum  4-byte  adler32 of tag+payload
 //
+// The last character of the tag tells other checksums, "RPCC" is CRC32C,
+// "RPCX" is xxHash32, and "RPCN" has none, the 4 bytes are zero.  A codec
+// understands all of them, so a peer which only knows adler32 keeps
+// working, and one which gets a tag it doesn't know fails cleanly.
+//
 // This is an internal class, you should use ProtobufCodecT instead.
 class ProtobufCodecLite : boost::noncopyable
 {
@@ -65,6 +83,15 @@ class ProtobufCodecLite : boost::noncopyable
   const static int kChecksumLen = sizeof(int32_t);
   const static int kMaxMessageLen = 64*1024*1024; // same as codec_stream.h kDefaultTotalBytesLimit
 
+  enum ChecksumType
+  {
+    kAdler32,
+    kCrc32c,            // SSE4.2 where the CPU has it
+    kXxHash32,
+    kNoChecksum,        // trusted links only, see setAllowNoChecksum()
+    kNumChecksumTypes,
+  };
+
   enum ErrorCode
   {
     kNoError = 0,
@@ -99,7 +126,13 @@ class ProtobufCodecLite : boost::noncopyable
       messageCallback_(messageCb),
       rawCb_(rawCb),
       errorCallback_(errorCb),
-      kMinMessageLen(tagArg.size() + kChecksumLen)
+      kMinMessageLen(tagArg.size() + kChecksumLen),
+      allowNoChecksum_(false),
+      streamingThreshold_(0),
+      chainLen_(0),
+      chainRemaining_(0),
+      pool_(NULL),
+      poolThreshold_(0)
   {
   }
 
@@ -107,24 +140,100 @@ class ProtobufCodecLite : boost::noncopyable
 
   const string& tag() const { return tag_; }
 
+  /// What send() puts in the frames, adler32 by default.  It may change
+  /// while other threads send, each frame has the one or the other.  Tags
+  /// ending with C, X or N only have adler32.
+  void setChecksumType(ChecksumType type);
+  ChecksumType checksumType() const
+  { return static_cast<ChecksumType>(checksumType_.get()); }
+
+  /// Frames without a checksum are refused unless this is set, or the
+  /// codec sends them itself.
+  void setAllowNoChecksum(bool on) { allowNoChecksum_ = on; }
+  bool allowNoChecksum() const { return allowNoChecksum_; }
+
+  /// Frames of at least bytes are collected in a chain of buffers as they
+  /// come, taking over the input buffer rather than growing it, and parsed
+  /// from there with parseFromStream().  0 turns it off, the default.
+  /// The chain belongs to the codec, so it must only serve one connection,
+  /// like the one of RpcChannel.  Such frames skip the RawMessageCallback.
+  void setStreamingThreshold(int bytes) { streamingThreshold_ = bytes; }
+
+  /// Frames of at least bytes are parsed, and the ProtobufMessageCallback
+  /// run, in pool rather than in the loop, so one big message doesn't hold
+  /// up the other connections of the loop.  Frames after it wait for it,
+  /// even small ones, and go through the pool one at a time, so they are
+  /// handled in the order they came.  Replies sent from the callback are
+  /// serialized in the pool too, see send(), and frames keep going to the
+  /// pool until the loop has written those, so replies stay in order.
+  /// Errors are reported in the loop, with a NULL Buffer.
+  /// Like setStreamingThreshold(), for a codec of one connection.  The
+  /// pool must not block on a full queue, and pool work keeps what is
+  /// tied alive, see tie().
+  void setThreadPool(ThreadPool* pool, int bytes)
+  {
+    pool_ = pool;
+    poolThreshold_ = bytes;
+  }
+
+  /// The owner of the codec, kept alive while its frames are in the pool.
+  void tie(const boost::shared_ptr<void>& owner) { owner_ = owner; }
+
+  /// Whether a frame of len bytes, without its size, would go to the pool
+  /// now, for a RawMessageCallback which handles some frames itself.
+  bool offloads(int len) const
+  { return pool_ != NULL && (len >= poolThreshold_ || offloading()); }
+
+  /// The checksum of a frame from its tag, kNumChecksumTypes if the tag
+  /// is not ours.  tag points after the size field.
+  ChecksumType checksumTypeOf(const char* tag) const;
+
+  /// In the loop thread of conn, the message is serialized right into the
+  /// output of the connection, no serializeToBuffer() and no copy.  From
+  /// other threads it goes through fillEmptyBuffer() into a per-thread
+  /// buffer, then one copy is handed over to the loop.
   void send(const TcpConnectionPtr& conn,
             const ::google::protobuf::Message& message);
 
+  /// Like send(), with embedded appended to message as its bytes field of
+  /// number field, so an envelope carries a message without serializing it
+  /// into a string first.  That field of message must be left empty.
+  void sendEmbedded(const TcpConnectionPtr& conn,
+                    const ::google::protobuf::Message& message,
+                    int field,
+                    const ::google::protobuf::Message& embedded);
+
+  /// The frame sendEmbedded() would send, appended to buf, for a caller
+  /// which writes several frames at once.
+  void appendEmbedded(Buffer* buf,
+                      const ::google::protobuf::Message& message,
+                      int field,
+                      const ::google::protobuf::Message& embedded);
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
 
   virtual bool parseFromBuffer(StringPiece buf, google::protobuf::Message* message);
   virtual int serializeToBuffer(const google::protobuf::Message& message, Buffer* buf);
+  virtual bool parseFromStream(google::protobuf::io::ZeroCopyInputStream* input,
+                               int size,
+                               google::protobuf::Message* message);
 
   static const string& errorCodeToString(ErrorCode errorCode);
 
+  /// Checks the tag and checksum of a frame as parse() does, and points
+  /// payload at the serialized message inside it.
+  ErrorCode payloadOf(const char* buf, int len, StringPiece* payload) const;
+
   // public for unit tests
   ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message);
   void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
 
   static int32_t checksum(const void* buf, int len);
+  static int32_t checksum(ChecksumType type, const void* buf, int len);
   static bool validateChecksum(const char* buf, int len);
+  static bool validateChecksum(ChecksumType type, const char* buf, int len);
   static int32_t asInt32(const char* buf);
   static void defaultErrorCallback(const TcpConnectionPtr&,
                                    Buffer*,
@@ -132,12 +241,63 @@ class ProtobufCodecLite : boost::noncopyable
                                    ErrorCode);
 
  private:
+  // the whole wire format at start, byte_size is message.ByteSize() plus
+  // the embedded field, if any, whose message is embeddedSize bytes
+  void fillFrame(char* start, const google::protobuf::Message& message, int byte_size,
+                 const google::protobuf::Message* embedded = NULL,
+                 int field = 0,
+                 int embeddedSize = 0);
+  // message.ByteSize() with the embedded field
+  static int embeddedByteSize(const google::protobuf::Message& message,
+                              int field,
+                              const google::protobuf::Message& embedded,
+                              int* embeddedSize);
+  typedef boost::function<void ()> Task;
+  typedef boost::shared_ptr<std::deque<Buffer> > ChainPtr;
+
+  bool receiveChain(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime);
+  ErrorCode parseChain(const std::deque<Buffer>& chain, int len,
+                       google::protobuf::Message* message);
+  bool offloading() const;
+  void offload(EventLoop* loop, const Task& task);
+  void runStrand(const boost::shared_ptr<void>& owner, EventLoop* loop);
+  void endStrand(const boost::shared_ptr<void>& owner, EventLoop* loop);
+  void parseInPool(const boost::shared_ptr<void>& owner,
+                   const TcpConnectionPtr& conn,
+                   const boost::shared_ptr<string>& frame,
+                   Timestamp receiveTime);
+  void parseChainInPool(const boost::shared_ptr<void>& owner,
+                        const TcpConnectionPtr& conn,
+                        const ChainPtr& chain,
+                        int len,
+                        Timestamp receiveTime);
+  void deliver(const TcpConnectionPtr& conn,
+               const MessagePtr& message,
+               Timestamp receiveTime,
+               ErrorCode errorCode);
+  bool accepts(ChecksumType type) const;
+  bool hasChecksumTypes() const;
+  char tagEnd(ChecksumType type) const;
+
   const ::google::protobuf::Message* prototype_;
   const string tag_;
   ProtobufMessageCallback messageCallback_;
   RawMessageCallback rawCb_;
   ErrorCallback errorCallback_;
   const int kMinMessageLen;
+  mutable AtomicInt32 checksumType_;  // ChecksumType, kAdler32 is 0
+  bool allowNoChecksum_;
+  int streamingThreshold_;
+  std::deque<Buffer> chain_;  // the frame being collected, without its size
+  int chainLen_;
+  int chainRemaining_;
+
+  ThreadPool* pool_;
+  int poolThreshold_;
+  boost::weak_ptr<void> owner_;
+  mutable MutexLock mutex_;
+  std::deque<Task> strand_;   // guarded by mutex_, frames waiting for the pool
+  mutable AtomicInt32 strandRunning_;  // set in the loop under mutex_, read without it
 };
 
 template<typename MSG, const char* TAG, typename CODEC=ProtobufCodecLite>  // TAG must be a variable with external linkage, not a string literal
@@ -153,6 +313,8 @@ class ProtobufCodecLiteT
                                 Timestamp)> ProtobufMessageCallback;
   typedef ProtobufCodecLite::RawMessageCallback RawMessageCallback;
   typedef ProtobufCodecLite::ErrorCallback ErrorCallback;
+  typedef ProtobufCodecLite::ChecksumType ChecksumType;
+  typedef ProtobufCodecLite::ErrorCode ErrorCode;
 
   explicit ProtobufCodecLiteT(const ProtobufMessageCallback& messageCb,
                               const RawMessageCallback& rawCb = RawMessageCallback(),
@@ -168,12 +330,40 @@ class ProtobufCodecLiteT
 
   const string& tag() const { return codec_.tag(); }
 
+  void setChecksumType(ChecksumType type) { codec_.setChecksumType(type); }
+  ChecksumType checksumType() const { return codec_.checksumType(); }
+  void setAllowNoChecksum(bool on) { codec_.setAllowNoChecksum(on); }
+  void setStreamingThreshold(int bytes) { codec_.setStreamingThreshold(bytes); }
+  void setThreadPool(ThreadPool* pool, int bytes) { codec_.setThreadPool(pool, bytes); }
+  void tie(const boost::shared_ptr<void>& owner) { codec_.tie(owner); }
+  bool offloads(int len) const { return codec_.offloads(len); }
+  bool allowNoChecksum() const { return codec_.allowNoChecksum(); }
+  ChecksumType checksumTypeOf(const char* tag) const { return codec_.checksumTypeOf(tag); }
+  ErrorCode payloadOf(const char* buf, int len, StringPiece* payload) const
+  { return codec_.payloadOf(buf, len, payload); }
+
   void send(const TcpConnectionPtr& conn,
             const MSG& message)
   {
     codec_.send(conn, message);
   }
 
+  void sendEmbedded(const TcpConnectionPtr& conn,
+                    const MSG& message,
+                    int field,
+                    const ::google::protobuf::Message& embedded)
+  {
+    codec_.sendEmbedded(conn, message, field, embedded);
+  }
+
+  void appendEmbedded(Buffer* buf,
+                      const MSG& message,
+                      int field,
+                      const ::google::protobuf::Message& embedded)
+  {
+    codec_.appendEmbedded(buf, message, field, embedded);
+  }
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime)
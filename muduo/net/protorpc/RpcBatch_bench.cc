@@ -0,0 +1,254 @@
+// Small calls per second over one connection with many in flight, each
+// request written alone and in batches, with the responses written alone
+// and in batches.  Then the time of one call at a time, in a batch window
+// and through RpcChannel::unbatched().
+//
+// Usage: protobuf_rpc_batch_bench [seconds] [in flight] [batch calls]
+
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18088;
+
+class EchoService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    response->add_service_name(request->service_name());
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+};
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* serverLoop, EventLoop* clientLoop,
+        int batchCalls, int batchDelayUs, bool batchResponses)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      connected_(1),
+      disconnected_(1),
+      batchCalls_(batchCalls),
+      batchDelayUs_(batchDelayUs),
+      running_(false),
+      urgent_(false)
+  {
+    request_.set_service_name("hello");
+    serverLoop_->runInLoop(boost::bind(&Bench::startServer, this, batchResponses));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Bench::connect, this));
+    connected_.wait();
+  }
+
+  ~Bench()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, client_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Bench::stopClient, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Bench::stopServer, this, &stopped));
+    stopped.wait();
+  }
+
+  // calls per second, urgent ones through unbatched()
+  double run(double seconds, int inFlight, bool urgent)
+  {
+    urgent_ = urgent;
+    completed_.getAndSet(0);
+    outstanding_.getAndSet(inFlight);
+    running_ = true;
+    clientLoop_->runInLoop(boost::bind(&Bench::startRun, this, inFlight));
+    CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1e6));
+    int64_t completed = completed_.get();
+    running_ = false;
+    while (outstanding_.get() > 0)
+    {
+      CurrentThread::sleepUsec(1000);
+    }
+    return static_cast<double>(completed) / seconds;
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    CountDownLatch latch(1);
+    loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+    latch.wait();
+  }
+
+  void startServer(bool batchResponses)
+  {
+    server_.reset(new RpcServer(serverLoop_, InetAddress(AF_INET, kPort, true)));
+    server_->setBatchResponses(batchResponses);
+    server_->registerService(&service_);
+    server_->start();
+  }
+
+  void connect()
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcBatchBench"));
+    client_->setConnectionCallback(boost::bind(&Bench::onConnection, this, _1));
+    client_->connect();
+  }
+
+  void stopClient(CountDownLatch* stopped)
+  {
+    stub_.reset();
+    urgentStub_.reset();
+    channel_.reset();
+    client_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_.reset(new RpcChannel(conn));
+      channel_->setBatching(batchCalls_, 64 * 1024, batchDelayUs_);
+      conn->setMessageCallback(
+          boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+      stub_.reset(new RpcService::Stub(get_pointer(channel_)));
+      urgentStub_.reset(new RpcService::Stub(channel_->unbatched()));
+      connected_.countDown();
+    }
+    else
+    {
+      disconnected_.countDown();
+    }
+  }
+
+  // in the client loop from here on
+  void startRun(int inFlight)
+  {
+    for (int i = 0; i < inFlight; ++i)
+    {
+      call();
+    }
+  }
+
+  void call()
+  {
+    // the channel deletes the response after done
+    ListRpcResponse* response = new ListRpcResponse;
+    RpcService::Stub* stub = urgent_ ? get_pointer(urgentStub_) : get_pointer(stub_);
+    stub->listRpc(NULL, &request_, response,
+                  ::google::protobuf::NewCallback(this, &Bench::onResponse));
+  }
+
+  void onResponse()
+  {
+    completed_.increment();
+    if (running_)
+    {
+      call();
+    }
+    else
+    {
+      outstanding_.decrement();
+    }
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  EchoService service_;
+  boost::scoped_ptr<RpcServer> server_;
+  boost::scoped_ptr<TcpClient> client_;
+  RpcChannelPtr channel_;
+  boost::scoped_ptr<RpcService::Stub> stub_;
+  boost::scoped_ptr<RpcService::Stub> urgentStub_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  const int batchCalls_;
+  const int batchDelayUs_;
+
+  ListRpcRequest request_;
+  volatile bool running_;
+  bool urgent_;
+  AtomicInt64 completed_;
+  AtomicInt32 outstanding_;
+};
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int inFlight = argc > 2 ? atoi(argv[2]) : 256;
+  int batchCalls = argc > 3 ? atoi(argv[3]) : 64;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  printf("%d calls in flight, batches of %d calls\n", inFlight, batchCalls);
+
+  struct Case
+  {
+    const char* name;
+    int batchCalls;
+    bool batchResponses;
+  };
+  const Case kCases[] =
+  {
+    { "requests alone, responses alone", 0, false },
+    { "requests batched, responses alone", batchCalls, false },
+    { "requests batched, responses batched", batchCalls, true },
+  };
+  for (size_t i = 0; i < sizeof kCases / sizeof kCases[0]; ++i)
+  {
+    const Case& c = kCases[i];
+    Bench bench(serverLoop, clientLoop, c.batchCalls, 0, c.batchResponses);
+    bench.run(0.2, inFlight, false);
+    printf("%-38s %9.0f calls/s\n", c.name, bench.run(seconds, inFlight, false));
+  }
+
+  // one call at a time, a batch never fills up
+  const int kDelayUs = 1000;
+  {
+    Bench bench(serverLoop, clientLoop, batchCalls, kDelayUs, true);
+    double batched = bench.run(seconds, 1, false);
+    double urgent = bench.run(seconds, 1, true);
+    printf("one in flight, %d us window: batched %6.1f us   unbatched() %6.1f us per call\n",
+           kDelayUs, 1e6 / batched, 1e6 / urgent);
+  }
+
+  google::protobuf::ShutdownProtobufLibrary();
+}
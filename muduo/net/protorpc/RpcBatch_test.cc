@@ -0,0 +1,309 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18101;
+
+// the requests in the order they came, each answered with its own name
+class OrderService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    {
+    MutexLockGuard lock(mutex_);
+    received_.push_back(atoi(request->service_name().c_str()));
+    }
+    response->set_error(NO_ERROR);
+    response->add_service_name(request->service_name());
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+
+  std::vector<int> received()
+  {
+    MutexLockGuard lock(mutex_);
+    return received_;
+  }
+
+ private:
+  MutexLock mutex_;
+  std::vector<int> received_;
+};
+
+bool inOrder(const std::vector<int>& calls, int n)
+{
+  if (calls.size() != static_cast<size_t>(n))
+  {
+    return false;
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    if (calls[i] != i)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A server and a batching channel to it, calls made from the thread of
+// the test, not from the loop of the channel.
+class Fixture : boost::noncopyable
+{
+ public:
+  Fixture(EventLoop* serverLoop, EventLoop* clientLoop,
+          int batchCalls, int batchDelayUs, bool batchResponses)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      connected_(1),
+      disconnected_(1),
+      batchCalls_(batchCalls),
+      batchDelayUs_(batchDelayUs),
+      answered_(NULL)
+  {
+    serverLoop_->runInLoop(boost::bind(&Fixture::startServer, this, batchResponses));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Fixture::connect, this));
+    connected_.wait();
+  }
+
+  ~Fixture()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, client_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Fixture::stopClient, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Fixture::stopServer, this, &stopped));
+    stopped.wait();
+    // connections closed for good before the next fixture
+    sync(serverLoop_);
+    sync(clientLoop_);
+  }
+
+  void expect(CountDownLatch* answered)
+  {
+    answered_ = answered;
+  }
+
+  void call(int index)
+  {
+    char name[32];
+    snprintf(name, sizeof name, "%d", index);
+    ListRpcRequest request;
+    request.set_service_name(name);
+    Call* call = new Call;
+    call->index = index;
+    call->response = new ListRpcResponse;
+    stub_->listRpc(NULL, &request, call->response,
+                   ::google::protobuf::NewCallback(this, &Fixture::onResponse, call));
+  }
+
+  std::vector<int> received() { return service_.received(); }
+
+  std::vector<int> answered()
+  {
+    MutexLockGuard lock(mutex_);
+    return answers_;
+  }
+
+ private:
+  struct Call
+  {
+    int index;
+    ListRpcResponse* response;  // the channel deletes it after done
+  };
+
+  static void sync(EventLoop* loop)
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      CountDownLatch latch(1);
+      loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+      latch.wait();
+    }
+  }
+
+  void startServer(bool batchResponses)
+  {
+    server_.reset(new RpcServer(serverLoop_, InetAddress(AF_INET, kPort, true)));
+    server_->setBatchResponses(batchResponses);
+    server_->registerService(&service_);
+    server_->start();
+  }
+
+  void connect()
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcBatchTest"));
+    client_->setConnectionCallback(boost::bind(&Fixture::onConnection, this, _1));
+    client_->connect();
+  }
+
+  void stopClient(CountDownLatch* stopped)
+  {
+    stub_.reset();
+    channel_.reset();
+    client_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_.reset(new RpcChannel(conn));
+      channel_->setBatching(batchCalls_, 0, batchDelayUs_);
+      conn->setMessageCallback(
+          boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+      stub_.reset(new RpcService::Stub(get_pointer(channel_)));
+      connected_.countDown();
+    }
+    else
+    {
+      disconnected_.countDown();
+    }
+  }
+
+  void onResponse(Call* call)
+  {
+    assert(call->response->service_name_size() == 1);
+    assert(atoi(call->response->service_name(0).c_str()) == call->index);
+    {
+    MutexLockGuard lock(mutex_);
+    answers_.push_back(call->index);
+    }
+    delete call;
+    answered_->countDown();
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  OrderService service_;
+  boost::scoped_ptr<RpcServer> server_;
+  boost::scoped_ptr<TcpClient> client_;
+  RpcChannelPtr channel_;
+  boost::scoped_ptr<RpcService::Stub> stub_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  const int batchCalls_;
+  const int batchDelayUs_;
+  CountDownLatch* answered_;
+  MutexLock mutex_;
+  std::vector<int> answers_;  // @GuardedBy mutex_
+};
+
+// nothing goes until the batch is full, a delay far away
+void testMaxCalls(EventLoop* serverLoop, EventLoop* clientLoop)
+{
+  const int kBatchCalls = 4;
+  Fixture fixture(serverLoop, clientLoop, kBatchCalls, 10 * 1000 * 1000, false);
+  CountDownLatch answered(kBatchCalls);
+  fixture.expect(&answered);
+  for (int i = 0; i < kBatchCalls - 1; ++i)
+  {
+    fixture.call(i);
+  }
+  CurrentThread::sleepUsec(100 * 1000);
+  assert(fixture.received().empty());
+  assert(answered.getCount() == kBatchCalls);
+
+  fixture.call(kBatchCalls - 1);
+  answered.wait();
+  assert(inOrder(fixture.received(), kBatchCalls));
+  assert(inOrder(fixture.answered(), kBatchCalls));
+}
+
+// a batch which never fills up goes after the delay, armed from another
+// thread than the loop of the channel
+void testDelay(EventLoop* serverLoop, EventLoop* clientLoop)
+{
+  const int kDelayUs = 200 * 1000;
+  Fixture fixture(serverLoop, clientLoop, 64, kDelayUs, false);
+  for (int round = 0; round < 2; ++round)
+  {
+    CountDownLatch answered(2);
+    fixture.expect(&answered);
+    Timestamp start = Timestamp::now();
+    fixture.call(2 * round);
+    fixture.call(2 * round + 1);
+    CurrentThread::sleepUsec(kDelayUs / 4);
+    assert(fixture.received().size() == static_cast<size_t>(2 * round));
+    answered.wait();
+    double elapsed = timeDifference(Timestamp::now(), start);
+    assert(elapsed >= kDelayUs * 1e-6 * 0.9);
+    assert(elapsed < 5.0);
+  }
+  assert(inOrder(fixture.received(), 4));
+  assert(inOrder(fixture.answered(), 4));
+}
+
+// requests go in the order called, responses come back in it, batched
+// both ways
+void testOrder(EventLoop* serverLoop, EventLoop* clientLoop)
+{
+  const int kCalls = 1000;
+  Fixture fixture(serverLoop, clientLoop, 16, 1000, true);
+  CountDownLatch answered(kCalls);
+  fixture.expect(&answered);
+  for (int i = 0; i < kCalls; ++i)
+  {
+    fixture.call(i);
+  }
+  answered.wait();
+  assert(inOrder(fixture.received(), kCalls));
+  assert(inOrder(fixture.answered(), kCalls));
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::kWARN);
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+
+  testMaxCalls(serverLoop, clientLoop);
+  testDelay(serverLoop, clientLoop);
+  testOrder(serverLoop, clientLoop);
+  printf("All pass\n");
+  google::protobuf::ShutdownProtobufLibrary();
+}
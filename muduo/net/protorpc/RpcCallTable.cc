@@ -0,0 +1,169 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcCallTable.h>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int64_t RpcCallTable::kFree;
+const int64_t RpcCallTable::kBusy;
+
+namespace
+{
+  const int kRunBits = 4;
+  const int64_t kRunMask = (1 << kRunBits) - 1;
+}
+
+RpcCallTable::RpcCallTable(int capacity, int maxCalls)
+  : shift_(0),
+    maxCalls_(maxCalls)
+{
+  assert(capacity > 0 && maxCalls >= 0);
+  while ((1 << shift_) < capacity)
+  {
+    ++shift_;
+  }
+  mask_ = (1LL << shift_) - 1;
+  slots_.reset(new Slot[mask_ + 1]);
+}
+
+int64_t RpcCallTable::insert(const Call& call, int64_t deadline)
+{
+  int size = size_.incrementAndGet();
+  if (maxCalls_ > 0 && size > maxCalls_)
+  {
+    size_.decrement();
+    return 0;
+  }
+
+  // runs of consecutive calls share neighbouring slots, and the runs are
+  // scattered by Fibonacci hashing: with all calls in a row, the ones which
+  // stay outstanding would make one long run to probe through
+  int64_t seq = sequence_.incrementAndGet();
+  int64_t id = 0;
+  if (size - overflowSize_.get() <= capacity())
+  {
+    int64_t start = seq & kRunMask;
+    if (shift_ > kRunBits)
+    {
+      uint64_t run = static_cast<uint64_t>(seq >> kRunBits) * 0x9E3779B97F4A7C15ULL;
+      start |= static_cast<int64_t>(run >> (64 - shift_ + kRunBits)) << kRunBits;
+    }
+    for (int64_t i = 0; i <= mask_ && id == 0; ++i)
+    {
+      int64_t index = (start + i) & mask_;
+      Slot& slot = slots_[index];
+      if (slot.id.get() == kFree && slot.id.compareAndSet(kFree, kBusy))
+      {
+        id = (seq << shift_) | index;
+        slot.call = call;
+        slot.id.getAndSet(id);
+      }
+    }
+  }
+  if (id == 0)
+  {
+    // the slot of this id never has it, the sequence number is ours
+    id = seq << shift_;
+    MutexLockGuard lock(overflowMutex_);
+    overflow_[id] = call;
+    overflowSize_.increment();
+  }
+
+  if (deadline != 0)
+  {
+    MutexLockGuard lock(deadlineMutex_);
+    deadlines_.push(Deadline(deadline, id));
+  }
+  return id;
+}
+
+bool RpcCallTable::takeSlot(Slot* slot, int64_t id, Call* call)
+{
+  if (slot->id.compareAndSet(id, kBusy))
+  {
+    *call = slot->call;
+    slot->id.getAndSet(kFree);
+    size_.decrement();
+    return true;
+  }
+  return false;
+}
+
+bool RpcCallTable::takeOverflow(int64_t id, Call* call)
+{
+  MutexLockGuard lock(overflowMutex_);
+  std::map<int64_t, Call>::iterator it = overflow_.find(id);
+  if (it != overflow_.end())
+  {
+    *call = it->second;
+    overflow_.erase(it);
+    overflowSize_.decrement();
+    size_.decrement();
+    return true;
+  }
+  return false;
+}
+
+bool RpcCallTable::take(int64_t id, Call* call)
+{
+  return id > 0 &&
+      (takeSlot(&slots_[id & mask_], id, call) ||
+       (overflowSize_.get() > 0 && takeOverflow(id, call)));
+}
+
+void RpcCallTable::sweep(int64_t now, std::vector<Call>* expired)
+{
+  std::vector<int64_t> ids;
+  {
+  MutexLockGuard lock(deadlineMutex_);
+  while (!deadlines_.empty() && deadlines_.top().first <= now)
+  {
+    ids.push_back(deadlines_.top().second);
+    deadlines_.pop();
+  }
+  }
+  // those which got their responses meanwhile are not there
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    Call call;
+    if (take(ids[i], &call))
+    {
+      expired->push_back(call);
+    }
+  }
+}
+
+void RpcCallTable::takeAll(std::vector<Call>* calls)
+{
+  for (int64_t i = 0; i <= mask_; ++i)
+  {
+    Slot& slot = slots_[i];
+    int64_t id = slot.id.get();
+    Call call;
+    if (id > 0 && takeSlot(&slot, id, &call))
+    {
+      calls->push_back(call);
+    }
+  }
+  {
+  MutexLockGuard lock(overflowMutex_);
+  for (std::map<int64_t, Call>::iterator it = overflow_.begin(); it != overflow_.end(); ++it)
+  {
+    calls->push_back(it->second);
+    overflowSize_.decrement();
+    size_.decrement();
+  }
+  overflow_.clear();
+  }
+  MutexLockGuard lock(deadlineMutex_);
+  DeadlineHeap().swap(deadlines_);
+}
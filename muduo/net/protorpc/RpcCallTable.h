@@ -0,0 +1,119 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCALLTABLE_H
+#define MUDUO_NET_PROTORPC_RPCCALLTABLE_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <functional>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+
+class Closure;
+class Message;
+class MethodDescriptor;
+class RpcController;
+
+}  // namespace protobuf
+}  // namespace google
+
+namespace muduo
+{
+namespace net
+{
+
+// The calls of an RpcChannel waiting for their responses, in a fixed
+// number of slots, open-addressed by call id.  An id carries its slot in
+// the low bits and a sequence number above them, which is the generation
+// of the slot: a response which comes after its call timed out finds the
+// slot gone to another id.  A slot is claimed and released by one
+// compare-and-set on its id, so calls, responses and sweeps may run in
+// any threads at once, without a lock.  Calls which find no free slot
+// wait in a map under a mutex, unless the table is capped.  Deadlines are
+// kept in a heap under a mutex of their own, so a sweep only looks at the
+// calls whose deadline has passed.
+class RpcCallTable : boost::noncopyable
+{
+ public:
+  struct Call
+  {
+    ::google::protobuf::Message* response;
+    ::google::protobuf::Closure* done;
+    ::google::protobuf::RpcController* controller;
+    const ::google::protobuf::MethodDescriptor* method;
+  };
+
+  // capacity slots, rounded up to a power of 2.  maxCalls outstanding at
+  // most, 0 for no limit.
+  explicit RpcCallTable(int capacity, int maxCalls = 0);
+
+  // The id of the new call, 0 if maxCalls are outstanding already.
+  // deadline is in microseconds since epoch, 0 for none.
+  int64_t insert(const Call& call, int64_t deadline);
+
+  // false if id is not outstanding, it timed out or was never there
+  bool take(int64_t id, Call* call);
+
+  // takes out the calls whose deadline is not after now
+  void sweep(int64_t now, std::vector<Call>* expired);
+
+  void takeAll(std::vector<Call>* calls);
+
+  int size() { return size_.get(); }
+  int capacity() const { return static_cast<int>(mask_ + 1); }
+  int maxCalls() const { return maxCalls_; }
+
+ private:
+  static const int64_t kFree = 0;
+  static const int64_t kBusy = -1;  // being filled or emptied
+
+  struct Slot
+  {
+    AtomicInt64 id;  // kFree, kBusy or the call
+    Call call;
+  };
+
+  // deadline and id, the earliest on top; ids taken already stay there
+  // until their deadline, then go
+  typedef std::pair<int64_t, int64_t> Deadline;
+  typedef std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > DeadlineHeap;
+
+  bool takeSlot(Slot* slot, int64_t id, Call* call);
+  bool takeOverflow(int64_t id, Call* call);
+
+  int shift_;
+  int64_t mask_;
+  const int maxCalls_;
+  boost::scoped_array<Slot> slots_;
+  AtomicInt64 sequence_;
+  AtomicInt32 size_;
+
+  AtomicInt32 overflowSize_;
+  MutexLock overflowMutex_;
+  std::map<int64_t, Call> overflow_;  // @GuardedBy overflowMutex_
+
+  MutexLock deadlineMutex_;
+  DeadlineHeap deadlines_;            // @GuardedBy deadlineMutex_
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCCALLTABLE_H
@@ -0,0 +1,188 @@
+// The outstanding calls of RpcChannel, in the std::map under a mutex it
+// used to have and in RpcCallTable, with a million calls outstanding:
+// inserting them, taking them back in order and at random, taking with
+// threads calling and taking at once, and a sweep for the deadlines.
+//
+// Usage: protobuf_rpc_call_table_bench [outstanding calls] [threads]
+
+#include <muduo/net/protorpc/RpcCallTable.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+typedef RpcCallTable::Call Call;
+
+// what RpcChannel had
+class MapTable : boost::noncopyable
+{
+ public:
+  int64_t insert(const Call& call, int64_t)
+  {
+    int64_t id = id_.incrementAndGet();
+    MutexLockGuard lock(mutex_);
+    calls_[id] = call;
+    return id;
+  }
+
+  bool take(int64_t id, Call* call)
+  {
+    MutexLockGuard lock(mutex_);
+    std::map<int64_t, Call>::iterator it = calls_.find(id);
+    if (it != calls_.end())
+    {
+      *call = it->second;
+      calls_.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  AtomicInt64 id_;
+  MutexLock mutex_;
+  std::map<int64_t, Call> calls_;
+};
+
+const Call kCall = { NULL, NULL, NULL, NULL };
+
+double nanosPerCall(Timestamp start, size_t calls)
+{
+  return timeDifference(Timestamp::now(), start) * 1e9 / static_cast<double>(calls);
+}
+
+template<typename TABLE>
+void fill(TABLE* table, std::vector<int64_t>* ids, int n)
+{
+  ids->clear();
+  for (int i = 0; i < n; ++i)
+  {
+    int64_t id = table->insert(kCall, 0);
+    if (id == 0)
+    {
+      LOG_FATAL << "full";
+    }
+    ids->push_back(id);
+  }
+}
+
+template<typename TABLE>
+void takeAll(TABLE* table, const std::vector<int64_t>& ids)
+{
+  Call call;
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    if (!table->take(ids[i], &call))
+    {
+      LOG_FATAL << "lost " << ids[i];
+    }
+  }
+}
+
+// calls and their responses, one after the other, next to the others
+template<typename TABLE>
+void churn(TABLE* table, int rounds, CountDownLatch* latch)
+{
+  Call call;
+  for (int i = 0; i < rounds; ++i)
+  {
+    int64_t id = table->insert(kCall, 0);
+    if (!table->take(id, &call))
+    {
+      LOG_FATAL << "lost " << id;
+    }
+  }
+  latch->countDown();
+}
+
+template<typename TABLE>
+void bench(const char* name, TABLE* table, int n, int threads)
+{
+  std::vector<int64_t> ids;
+  ids.reserve(n);
+
+  Timestamp start = Timestamp::now();
+  fill(table, &ids, n);
+  double insert = nanosPerCall(start, n);
+
+  start = Timestamp::now();
+  takeAll(table, ids);
+  double inOrder = nanosPerCall(start, n);
+
+  fill(table, &ids, n);
+  std::random_shuffle(ids.begin(), ids.end());
+  start = Timestamp::now();
+  takeAll(table, ids);
+  double random = nanosPerCall(start, n);
+
+  // with n outstanding, threads come and go
+  fill(table, &ids, n);
+  const int kRounds = 1000000;
+  CountDownLatch latch(threads);
+  boost::ptr_vector<Thread> workers;
+  for (int i = 0; i < threads; ++i)
+  {
+    workers.push_back(new Thread(boost::bind(churn<TABLE>, table, kRounds, &latch)));
+  }
+  start = Timestamp::now();
+  for (int i = 0; i < threads; ++i)
+  {
+    workers[i].start();
+  }
+  latch.wait();
+  double contended = nanosPerCall(start, static_cast<size_t>(kRounds) * threads);
+  for (int i = 0; i < threads; ++i)
+  {
+    workers[i].join();
+  }
+  takeAll(table, ids);
+
+  printf("%-10s insert %6.0f ns  take in order %6.0f ns  at random %6.0f ns"
+         "  %d threads %6.0f ns per call\n",
+         name, insert, inOrder, random, threads, contended);
+}
+
+int main(int argc, char* argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  printf("%d calls outstanding\n", n);
+
+  {
+    MapTable table;
+    bench("std::map", &table, n, threads);
+  }
+
+  {
+    RpcCallTable table(2 * n);
+    bench("slots", &table, n, threads);
+
+    // half of them past their deadline
+    std::vector<int64_t> ids;
+    ids.reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+      ids.push_back(table.insert(kCall, i % 2 ? 1 : 3));
+    }
+    std::vector<Call> expired;
+    Timestamp start = Timestamp::now();
+    table.sweep(2, &expired);
+    printf("sweep of %d calls %.2f ms, %zu expired\n", n,
+           timeDifference(Timestamp::now(), start) * 1e3, expired.size());
+  }
+}
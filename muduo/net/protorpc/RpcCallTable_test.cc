@@ -0,0 +1,153 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcCallTable.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+typedef RpcCallTable::Call Call;
+
+// a call told apart by its done closure
+Call makeCall(intptr_t n)
+{
+  Call call = { NULL, reinterpret_cast< ::google::protobuf::Closure*>(n), NULL, NULL };
+  return call;
+}
+
+intptr_t numberOf(const Call& call)
+{
+  return reinterpret_cast<intptr_t>(call.done);
+}
+
+bool hasNumbers(std::vector<Call>* calls, intptr_t first, intptr_t last)
+{
+  std::vector<intptr_t> numbers;
+  for (size_t i = 0; i < calls->size(); ++i)
+  {
+    numbers.push_back(numberOf((*calls)[i]));
+  }
+  std::sort(numbers.begin(), numbers.end());
+  calls->clear();
+  for (intptr_t n = first; n <= last; ++n)
+  {
+    if (numbers.size() != static_cast<size_t>(last - first + 1) || numbers[n - first] != n)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  {
+  // insert and take
+  RpcCallTable table(8);
+  int64_t id1 = table.insert(makeCall(1), 0);
+  int64_t id2 = table.insert(makeCall(2), 0);
+  assert(id1 > 0 && id2 > 0 && id1 != id2);
+  assert(table.size() == 2);
+  Call call;
+  assert(table.take(id2, &call) && numberOf(call) == 2);
+  assert(!table.take(id2, &call));
+  assert(table.take(id1, &call) && numberOf(call) == 1);
+  assert(!table.take(0, &call));
+  assert(!table.take(12345, &call));
+  assert(table.size() == 0);
+  }
+
+  {
+  // a capped table is full, then has room again
+  RpcCallTable table(4, 4);
+  std::vector<int64_t> ids;
+  for (int i = 0; i < 4; ++i)
+  {
+    ids.push_back(table.insert(makeCall(i), 0));
+    assert(ids.back() > 0);
+  }
+  assert(table.insert(makeCall(4), 0) == 0);
+  assert(table.size() == 4);
+  Call call;
+  assert(table.take(ids[2], &call) && numberOf(call) == 2);
+  int64_t id = table.insert(makeCall(5), 0);
+  assert(id > 0);
+  assert(table.insert(makeCall(6), 0) == 0);
+  assert(table.take(id, &call) && numberOf(call) == 5);
+  }
+
+  {
+  // a stale id, its slot gone to the next call
+  RpcCallTable table(1, 1);
+  int64_t stale = table.insert(makeCall(1), 0);
+  Call call;
+  assert(table.take(stale, &call));
+  int64_t id = table.insert(makeCall(2), 0);
+  assert(id > 0 && id != stale);
+  assert((id & (table.capacity() - 1)) == (stale & (table.capacity() - 1)));
+  assert(!table.take(stale, &call));
+  assert(table.size() == 1);
+  assert(table.take(id, &call) && numberOf(call) == 2);
+  }
+
+  {
+  // unlimited, more calls than slots
+  RpcCallTable table(4);
+  std::vector<int64_t> ids;
+  for (int i = 0; i < 100; ++i)
+  {
+    ids.push_back(table.insert(makeCall(i), 0));
+    assert(ids.back() > 0);
+  }
+  assert(table.size() == 100);
+  std::vector<int64_t> sorted(ids);
+  std::sort(sorted.begin(), sorted.end());
+  assert(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+  Call call;
+  for (int i = 99; i >= 50; --i)
+  {
+    assert(table.take(ids[i], &call) && numberOf(call) == i);
+    assert(!table.take(ids[i], &call));
+  }
+  std::vector<Call> calls;
+  table.takeAll(&calls);
+  assert(hasNumbers(&calls, 0, 49));
+  assert(table.size() == 0);
+  }
+
+  {
+  // sweeps take the calls past their deadline, and only those
+  RpcCallTable table(4);
+  std::vector<int64_t> ids;
+  for (int i = 0; i < 10; ++i)
+  {
+    // two of each deadline, 10 to 50, some in the map
+    ids.push_back(table.insert(makeCall(i), 10 * (i / 2 + 1)));
+  }
+  int64_t forever = table.insert(makeCall(10), 0);
+  std::vector<Call> expired;
+  table.sweep(5, &expired);
+  assert(expired.empty());
+  table.sweep(20, &expired);
+  assert(hasNumbers(&expired, 0, 3));
+
+  // answered before its deadline, not swept
+  Call call;
+  assert(table.take(ids[4], &call));
+  assert(table.take(ids[5], &call));
+  table.sweep(30, &expired);
+  assert(expired.empty());
+  table.sweep(50, &expired);
+  assert(hasNumbers(&expired, 6, 9));
+  // its response comes too late
+  assert(!table.take(ids[9], &call));
+
+  table.sweep(1000, &expired);
+  assert(expired.empty());
+  assert(table.size() == 1);
+  assert(table.take(forever, &call) && numberOf(call) == 10);
+  }
+}
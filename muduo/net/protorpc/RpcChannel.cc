@@ -9,40 +9,246 @@
 #include <muduo/net/protorpc/RpcChannel.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/protorpc/RpcCallTable.h>
+#include <muduo/net/protorpc/RpcDispatcher.h>
 #include <muduo/net/protorpc/rpc.pb.h>
 
+#include <google/protobuf/arena.h>
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 
 #include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
 
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+  // a codec serves one channel, so big messages can be parsed in pieces
+  const int kStreamingThreshold = 1024 * 1024;
+
+  // the first block of the arena of a call, kept when it is recycled
+  const size_t kArenaBlockSize = 4096;
+  const size_t kMaxCachedCalls = 64;
+
+  // slots of the call table, more calls wait in its map
+  const int kCallSlots = 1024;
+}
+
+namespace
+{
+  // the controller, if any, is failed, then done runs with the response untouched
+  void failCall(const RpcCallTable::Call& call, const std::string& reason)
+  {
+    boost::scoped_ptr<google::protobuf::Message> d(call.response);
+    if (call.controller)
+    {
+      call.controller->SetFailed(reason);
+    }
+    if (call.done)
+    {
+      call.done->Run();
+    }
+  }
+}
+
+// An RpcMessage read in place, the fields point into the frame.
+struct RpcChannel::MessageView
+{
+  MessageView()
+    : type(0), id(0), methodId(0), checksum(0), error(NO_ERROR),
+      hasResponse(false), hasError(false), hasMethodId(false)
+  {
+  }
+
+  int type;
+  int64_t id;
+  uint32_t methodId;
+  uint32_t checksum;
+  int error;
+  StringPiece service;
+  StringPiece method;
+  StringPiece request;
+  StringPiece response;
+  bool hasResponse;
+  bool hasError;
+  bool hasMethodId;
+};
+
+// A request being served, its request and response messages are in the
+// arena of the call, and it is the done closure too.  Done calls go back to
+// a cache of the thread which finished them, with the first block of the
+// arena, so serving a small request allocates nothing once warmed up.
+struct RpcChannel::ServerCall : public ::google::protobuf::Closure
+{
+  ServerCall()
+    : channel(NULL),
+      id(0),
+      method(NULL),
+      tellMethodId(false),
+      response(NULL),
+      arena_(arenaOptions(block_))
+  {
+  }
+
+  virtual void Run()
+  {
+    channel->doneCallback(this);
+  }
+
+  google::protobuf::Arena* arena() { return &arena_; }
+
+  static ServerCall* take(RpcChannel* channel, int64_t id)
+  {
+    boost::ptr_vector<ServerCall>& cache =
+        ThreadLocalSingleton<boost::ptr_vector<ServerCall> >::instance();
+    ServerCall* call = cache.empty() ? new ServerCall : cache.pop_back().release();
+    call->channel = channel;
+    call->id = id;
+    return call;
+  }
+
+  static void give(ServerCall* call)
+  {
+    call->arena_.Reset();
+    call->channel = NULL;
+    call->method = NULL;
+    call->tellMethodId = false;
+    call->response = NULL;
+    boost::ptr_vector<ServerCall>& cache =
+        ThreadLocalSingleton<boost::ptr_vector<ServerCall> >::instance();
+    if (cache.size() < kMaxCachedCalls)
+    {
+      cache.push_back(call);
+    }
+    else
+    {
+      delete call;
+    }
+  }
+
+  RpcChannel* channel;
+  int64_t id;
+  const RpcDispatcher::Method* method;
+  bool tellMethodId;  // it was asked for
+  google::protobuf::Message* response;
+
+ private:
+  static google::protobuf::ArenaOptions arenaOptions(char* block)
+  {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = block;
+    options.initial_block_size = kArenaBlockSize;
+    return options;
+  }
+
+  char block_[kArenaBlockSize];
+  google::protobuf::Arena arena_;
+};
+
 RpcChannel::RpcChannel()
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
-    services_(NULL)
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRawMessage, this, _1, _2, _3)),
+    checksumType_(ProtobufCodecLite::kAdler32),
+    peerKnowsChecksums_(false),
+    calls_(new RpcCallTable(kCallSlots)),
+    callTimeout_(0),
+    sweepLoop_(NULL),
+    useMethodIds_(false),
+    dispatcher_(NULL),
+    batchCalls_(0),
+    batchBytes_(0),
+    batchDelayUs_(0),
+    batched_(0),
+    unbatched_(this),
+    batchResponses_(false),
+    collecting_(false)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
+  codec_.setStreamingThreshold(kStreamingThreshold);
 }
 
 RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRawMessage, this, _1, _2, _3)),
     conn_(conn),
-    services_(NULL)
+    checksumType_(ProtobufCodecLite::kAdler32),
+    peerKnowsChecksums_(false),
+    calls_(new RpcCallTable(kCallSlots)),
+    callTimeout_(0),
+    sweepLoop_(NULL),
+    useMethodIds_(false),
+    dispatcher_(NULL),
+    batchCalls_(0),
+    batchBytes_(0),
+    batchDelayUs_(0),
+    batched_(0),
+    unbatched_(this),
+    batchResponses_(false),
+    collecting_(false)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
+  codec_.setStreamingThreshold(kStreamingThreshold);
 }
 
 RpcChannel::~RpcChannel()
 {
   LOG_INFO << "RpcChannel::dtor - " << this;
-  for (std::map<int64_t, OutstandingCall>::iterator it = outstandings_.begin(); it != outstandings_.end(); ++it)
+  if (sweepLoop_)
+  {
+    sweepLoop_->cancel(sweepTimer_);
+  }
+  // no response will come, the callers hear so
+  std::vector<RpcCallTable::Call> calls;
+  calls_->takeAll(&calls);
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    failCall(calls[i], "connection closed");
+  }
+}
+
+void RpcChannel::setConnection(const TcpConnectionPtr& conn)
+{
+  conn_ = conn;
+  // the next peer may be an older one
+  peerKnowsChecksums_ = false;
+  codec_.setChecksumType(ProtobufCodecLite::kAdler32);
+  MutexLockGuard lock(mutex_);
+  methodIds_.clear();
+}
+
+void RpcChannel::setServices(const std::map<std::string, google::protobuf::Service*>* services)
+{
+  ownDispatcher_.reset(new RpcDispatcher);
+  for (std::map<std::string, google::protobuf::Service*>::const_iterator it = services->begin();
+       it != services->end(); ++it)
   {
-    OutstandingCall out = it->second;
-    delete out.response;
-    delete out.done;
+    ownDispatcher_->registerService(it->second, 0, 0);
   }
+  dispatcher_ = get_pointer(ownDispatcher_);
+}
+
+void RpcChannel::setBatching(int maxCalls, int maxBytes, int maxDelayUs)
+{
+  assert(maxCalls >= 0 && maxBytes >= 0 && maxDelayUs >= 0);
+  batchCalls_ = maxCalls;
+  batchBytes_ = maxBytes;
+  batchDelayUs_ = maxDelayUs;
+}
+
+void RpcChannel::setMaxOutstandingCalls(int n)
+{
+  assert(calls_->size() == 0 && n > 0);
+  calls_.reset(new RpcCallTable(n, n));
 }
 
   // Call the given method of the remote service.  The signature of this
@@ -56,59 +262,402 @@ void RpcChannel::CallMethod(const ::google::protobuf::MethodDescriptor* method,
                             ::google::protobuf::Message* response,
                             ::google::protobuf::Closure* done)
 {
+  call(method, controller, request, response, done, true);
+}
+
+void RpcChannel::Unbatched::CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                                       google::protobuf::RpcController* controller,
+                                       const ::google::protobuf::Message* request,
+                                       ::google::protobuf::Message* response,
+                                       ::google::protobuf::Closure* done)
+{
+  owner_->call(method, controller, request, response, done, false);
+}
+
+void RpcChannel::call(const ::google::protobuf::MethodDescriptor* method,
+                      google::protobuf::RpcController* controller,
+                      const ::google::protobuf::Message* request,
+                      ::google::protobuf::Message* response,
+                      ::google::protobuf::Closure* done,
+                      bool batched)
+{
+  RpcCallTable::Call call = { response, done, controller, method };
+  int64_t deadline = 0;
+  if (callTimeout_ > 0)
+  {
+    deadline = addTime(Timestamp::now(), callTimeout_).microSecondsSinceEpoch();
+    if (sweeping_.get() == 0 && sweeping_.compareAndSet(0, 1))
+    {
+      startSweeping();
+    }
+  }
+  int64_t id = calls_->insert(call, deadline);
+  if (id == 0)
+  {
+    LOG_ERROR << "RpcChannel::CallMethod - " << calls_->maxCalls()
+              << " calls outstanding already";
+    failCall(call, "too many outstanding calls");
+    return;
+  }
+
   RpcMessage message;
   message.set_type(REQUEST);
-  int64_t id = id_.incrementAndGet();
   message.set_id(id);
-  message.set_service(method->service()->name());
-  message.set_method(method->name());
-  message.set_request(request->SerializeAsString()); // FIXME: error check
+  uint32_t methodId = useMethodIds_ ? methodIdOf(method) : 0;
+  if (methodId > 0)
+  {
+    message.set_method_id(methodId);
+  }
+  else
+  {
+    message.set_service(method->service()->name());
+    message.set_method(method->name());
+    if (useMethodIds_)
+    {
+      message.set_method_id(0);
+    }
+  }
+  askChecksum(&message);
+  if (batchCalls_ > 0)
+  {
+    batchRequest(message, *request, !batched);
+  }
+  else
+  {
+    codec_.sendEmbedded(conn_, message, RpcMessage::kRequestFieldNumber, *request);
+  }
+}
+
+void RpcChannel::batchRequest(const RpcMessage& message,
+                              const google::protobuf::Message& request,
+                              bool urgent)
+{
+  bool alone = false;
+  bool full = false;
+  bool first = false;
+  {
+  MutexLockGuard lock(batchMutex_);
+  if (urgent && batched_ == 0)
+  {
+    alone = true;
+  }
+  else
+  {
+    codec_.appendEmbedded(&batch_, message, RpcMessage::kRequestFieldNumber, request);
+    first = ++batched_ == 1;
+    full = urgent || batched_ >= batchCalls_
+           || (batchBytes_ > 0 && batch_.readableBytes() >= static_cast<size_t>(batchBytes_));
+  }
+  }
+
+  EventLoop* loop = conn_->getLoop();
+  if (alone)
+  {
+    codec_.sendEmbedded(conn_, message, RpcMessage::kRequestFieldNumber, request);
+  }
+  else if (full)
+  {
+    loop->runInLoop(boost::bind(&RpcChannel::flushBatch, boost::weak_ptr<RpcChannel>(shared_from_this())));
+  }
+  else if (first)
+  {
+    boost::weak_ptr<RpcChannel> weakChannel(shared_from_this());
+    if (batchDelayUs_ > 0)
+    {
+      // the timer queue of the loop is not thread safe
+      loop->runInLoop(boost::bind(&RpcChannel::armBatch, weakChannel));
+    }
+    else
+    {
+      loop->queueInLoop(boost::bind(&RpcChannel::flushBatch, weakChannel));
+    }
+  }
+}
 
-  OutstandingCall out = { response, done };
+void RpcChannel::armBatch(const boost::weak_ptr<RpcChannel>& weakChannel)
+{
+  RpcChannelPtr channel(weakChannel.lock());
+  if (channel)
+  {
+    channel->conn_->getLoop()->runAfter(
+        channel->batchDelayUs_ * 1e-6, boost::bind(&RpcChannel::flushBatch, weakChannel));
+  }
+}
+
+// in loop, a timer of an earlier batch may flush this one a bit early
+void RpcChannel::flushBatch(const boost::weak_ptr<RpcChannel>& weakChannel)
+{
+  RpcChannelPtr channel(weakChannel.lock());
+  if (channel)
   {
+    {
+    MutexLockGuard lock(channel->batchMutex_);
+    channel->flushing_.swap(channel->batch_);
+    channel->batched_ = 0;
+    }
+    if (channel->flushing_.readableBytes() > 0)
+    {
+      channel->conn_->send(&channel->flushing_);
+      channel->flushing_.retrieveAll();
+    }
+  }
+}
+
+uint32_t RpcChannel::methodIdOf(const google::protobuf::MethodDescriptor* method)
+{
   MutexLockGuard lock(mutex_);
-  outstandings_[id] = out;
+  std::map<const google::protobuf::MethodDescriptor*, uint32_t>::const_iterator it =
+      methodIds_.find(method);
+  return it != methodIds_.end() ? it->second : 0;
+}
+
+void RpcChannel::learnMethodId(const google::protobuf::MethodDescriptor* method, uint32_t id)
+{
+  MutexLockGuard lock(mutex_);
+  methodIds_[method] = id;
+}
+
+void RpcChannel::startSweeping()
+{
+  // the timer queue of the loop is not thread safe
+  conn_->getLoop()->runInLoop(
+      boost::bind(&RpcChannel::armSweeping, boost::weak_ptr<RpcChannel>(shared_from_this())));
+}
+
+void RpcChannel::armSweeping(const boost::weak_ptr<RpcChannel>& weakChannel)
+{
+  RpcChannelPtr channel(weakChannel.lock());
+  if (channel)
+  {
+    // a quarter of the timeout late at most, but not too busy
+    double interval = std::max(0.01, std::min(1.0, channel->callTimeout_ / 4));
+    channel->sweepLoop_ = channel->conn_->getLoop();
+    channel->sweepTimer_ = channel->sweepLoop_->runEvery(
+        interval, boost::bind(&RpcChannel::sweepCalls, weakChannel));
+  }
+}
+
+void RpcChannel::sweepCalls(const boost::weak_ptr<RpcChannel>& weakChannel)
+{
+  RpcChannelPtr channel(weakChannel.lock());
+  if (channel)
+  {
+    std::vector<RpcCallTable::Call> expired;
+    channel->calls_->sweep(Timestamp::now().microSecondsSinceEpoch(), &expired);
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      failCall(expired[i], ErrorCode_Name(TIMEOUT));
+    }
   }
-  codec_.send(conn_, message);
 }
 
 void RpcChannel::onMessage(const TcpConnectionPtr& conn,
                            Buffer* buf,
                            Timestamp receiveTime)
 {
-  codec_.onMessage(conn, buf, receiveTime);
+  if (batchResponses_)
+  {
+    collecting_ = true;
+    codec_.onMessage(conn, buf, receiveTime);
+    collecting_ = false;
+    if (responses_.readableBytes() > 0)
+    {
+      conn->send(&responses_);
+      responses_.retrieveAll();
+    }
+  }
+  else
+  {
+    codec_.onMessage(conn, buf, receiveTime);
+  }
 }
 
-void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
-                              const RpcMessagePtr& messagePtr,
+bool RpcChannel::onRawMessage(const TcpConnectionPtr& conn,
+                              StringPiece frame,
                               Timestamp receiveTime)
 {
-  assert(conn == conn_);
-  //printf("%s\n", message.DebugString().c_str());
-  RpcMessage& message = *messagePtr;
-  if (message.type() == RESPONSE)
+  const char* tag = frame.data() + ProtobufCodecLite::kHeaderLen;
+  int len = frame.size() - ProtobufCodecLite::kHeaderLen;
+  // read in place, the request or response is parsed from the frame itself;
+  // anything odd goes the usual way, which reports it
+  StringPiece payload;
+  MessageView view;
+  if (!codec_.offloads(len) &&
+      codec_.payloadOf(tag, len, &payload) == ProtobufCodecLite::kNoError &&
+      parseView(payload, &view))
   {
-    int64_t id = message.id();
-    assert(message.has_response() || message.has_error());
+    assert(conn == conn_);
+    learnChecksum(codec_.checksumTypeOf(tag), view);
+    handleMessage(view);
+    return false;
+  }
+  return true;
+}
+
+void RpcChannel::askChecksum(RpcMessage* message) const
+{
+  if (checksumType_ != ProtobufCodecLite::kAdler32 &&
+      codec_.checksumType() == ProtobufCodecLite::kAdler32)
+  {
+    message->set_checksum(checksumType_);
+  }
+}
 
-    OutstandingCall out = { NULL, NULL };
+// In loop, from a frame whose checksum holds.  Frames the pool or the
+// chain parse teach nothing, the small ones around them do.
+void RpcChannel::learnChecksum(ProtobufCodecLite::ChecksumType type, const MessageView& message)
+{
+  if (peerKnowsChecksums_)
+  {
+    return;
+  }
+  if (type == ProtobufCodecLite::kAdler32 &&
+      message.checksum > ProtobufCodecLite::kAdler32 &&
+      message.checksum < ProtobufCodecLite::kNumChecksumTypes)
+  {
+    type = static_cast<ProtobufCodecLite::ChecksumType>(message.checksum);
+  }
+  if (type != ProtobufCodecLite::kAdler32)
+  {
+    // ours if we have one, the peer takes every type
+    peerKnowsChecksums_ = true;
+    if (checksumType_ != ProtobufCodecLite::kAdler32)
+    {
+      type = checksumType_;
+    }
+    if (type != ProtobufCodecLite::kNoChecksum || codec_.allowNoChecksum() ||
+        checksumType_ == ProtobufCodecLite::kNoChecksum)
+    {
+      codec_.setChecksumType(type);
+    }
+  }
+}
 
+// Only the fields of RpcMessage, with the wire types protoc gives them.
+bool RpcChannel::parseView(StringPiece payload, MessageView* view)
+{
+  using google::protobuf::internal::WireFormatLite;
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(payload.data());
+  google::protobuf::io::CodedInputStream input(data, payload.size());
+  bool hasType = false;
+  bool hasId = false;
+  uint32_t tag = 0;
+  while ((tag = input.ReadTag()) != 0)
+  {
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    WireFormatLite::WireType wireType = WireFormatLite::GetTagWireType(tag);
+    uint32_t value = 0;
+    bool ok = true;
+    if (field == RpcMessage::kTypeFieldNumber && wireType == WireFormatLite::WIRETYPE_VARINT)
+    {
+      ok = input.ReadVarint32(&value) && MessageType_IsValid(value);
+      view->type = value;
+      hasType = true;
+    }
+    else if (field == RpcMessage::kIdFieldNumber && wireType == WireFormatLite::WIRETYPE_FIXED64)
+    {
+      uint64_t id = 0;
+      ok = input.ReadLittleEndian64(&id);
+      view->id = static_cast<int64_t>(id);
+      hasId = true;
+    }
+    else if (field == RpcMessage::kErrorFieldNumber && wireType == WireFormatLite::WIRETYPE_VARINT)
+    {
+      ok = input.ReadVarint32(&value);
+      view->error = value;
+      view->hasError = true;
+    }
+    else if (field == RpcMessage::kMethodIdFieldNumber && wireType == WireFormatLite::WIRETYPE_VARINT)
     {
-      MutexLockGuard lock(mutex_);
-      std::map<int64_t, OutstandingCall>::iterator it = outstandings_.find(id);
-      if (it != outstandings_.end())
+      ok = input.ReadVarint32(&value);
+      view->methodId = value;
+      view->hasMethodId = true;
+    }
+    else if (field == RpcMessage::kChecksumFieldNumber && wireType == WireFormatLite::WIRETYPE_VARINT)
+    {
+      ok = input.ReadVarint32(&view->checksum);
+    }
+    else if (field >= RpcMessage::kServiceFieldNumber && field <= RpcMessage::kResponseFieldNumber
+             && wireType == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+    {
+      ok = input.ReadVarint32(&value) && input.Skip(value);
+      StringPiece piece(payload.data() + input.CurrentPosition() - value, value);
+      switch (field)
       {
-        out = it->second;
-        outstandings_.erase(it);
+        case RpcMessage::kServiceFieldNumber:
+          view->service = piece;
+          break;
+        case RpcMessage::kMethodFieldNumber:
+          view->method = piece;
+          break;
+        case RpcMessage::kRequestFieldNumber:
+          view->request = piece;
+          break;
+        default:
+          view->response = piece;
+          view->hasResponse = true;
       }
     }
+    else
+    {
+      ok = WireFormatLite::SkipField(&input, tag);
+    }
+    if (!ok)
+    {
+      return false;
+    }
+  }
+  return hasType && hasId && input.ConsumedEntireMessage();
+}
+
+void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
+                              const RpcMessagePtr& messagePtr,
+                              Timestamp receiveTime)
+{
+  assert(conn == conn_);
+  //printf("%s\n", message.DebugString().c_str());
+  const RpcMessage& message = *messagePtr;
+  MessageView view;
+  view.type = message.type();
+  view.id = message.id();
+  view.service = message.service();
+  view.method = message.method();
+  view.request = message.request();
+  view.response = message.response();
+  view.hasResponse = message.has_response();
+  view.error = message.error();
+  view.hasError = message.has_error();
+  view.methodId = message.method_id();
+  view.hasMethodId = message.has_method_id();
+  handleMessage(view);
+}
+
+void RpcChannel::handleMessage(const MessageView& message)
+{
+  if (message.type == RESPONSE)
+  {
+    int64_t id = message.id;
+    assert(message.hasResponse || message.hasError);
 
-    if (out.response)
+    // not there if it timed out already
+    RpcCallTable::Call out = { NULL, NULL, NULL, NULL };
+    if (calls_->take(id, &out))
     {
       boost::scoped_ptr<google::protobuf::Message> d(out.response);
-      if (message.has_response())
+      if (message.hasMethodId && message.methodId > 0 && useMethodIds_)
+      {
+        learnMethodId(out.method, message.methodId);
+      }
+      if (message.hasResponse)
       {
-        out.response->ParseFromString(message.response());
+        out.response->ParseFromArray(message.response.data(), message.response.size());
+      }
+      if (message.error != NO_ERROR && out.controller)
+      {
+        // a newer peer may have more codes
+        out.controller->SetFailed(ErrorCode_IsValid(message.error)
+                                  ? ErrorCode_Name(static_cast<ErrorCode>(message.error))
+                                  : "error");
       }
       if (out.done)
       {
@@ -116,72 +665,96 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
       }
     }
   }
-  else if (message.type() == REQUEST)
+  else if (message.type == REQUEST)
   {
-    // FIXME: extract to a function
-    ErrorCode error = WRONG_PROTO;
-    if (services_)
+    ErrorCode error = NO_SERVICE;
+    const RpcDispatcher::Method* method = NULL;
+    if (dispatcher_)
+    {
+      if (message.methodId > 0)
+      {
+        method = dispatcher_->find(message.methodId);
+        error = NO_METHOD;
+      }
+      else
+      {
+        method = dispatcher_->find(message.service, message.method, &error);
+      }
+    }
+    if (method)
     {
-      std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
-      if (it != services_->end())
+      // request and response live in the arena of the call until it is done
+      google::protobuf::Service* service = method->service;
+      ServerCall* call = ServerCall::take(this, message.id);
+      google::protobuf::Message* request =
+          service->GetRequestPrototype(method->descriptor).New(call->arena());
+      if (request->ParseFromArray(message.request.data(), message.request.size()))
       {
-        google::protobuf::Service* service = it->second;
-        assert(service != NULL);
-        const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
-        const google::protobuf::MethodDescriptor* method
-          = desc->FindMethodByName(message.method());
-        if (method)
+        call->method = method;
+        call->tellMethodId = message.hasMethodId && message.methodId == 0;
+        call->response = service->GetResponsePrototype(method->descriptor).New(call->arena());
+        error = NO_ERROR;
+        if (dispatcher_->pooled())
         {
-          boost::scoped_ptr<google::protobuf::Message> request(service->GetRequestPrototype(method).New());
-          if (request->ParseFromString(message.request()))
-          {
-            google::protobuf::Message* response = service->GetResponsePrototype(method).New();
-            // response is deleted in doneCallback
-            int64_t id = message.id();
-            service->CallMethod(method, NULL, get_pointer(request), response,
-                                NewCallback(this, &RpcChannel::doneCallback, response, id));
-            error = NO_ERROR;
-          }
-          else
+          // the task keeps the channel alive until the method has run
+          if (!dispatcher_->dispatch(method,
+                  boost::bind(&RpcChannel::callService, shared_from_this(), call, request)))
           {
-            error = INVALID_REQUEST;
+            ServerCall::give(call);
+            error = OVERLOADED;
           }
         }
         else
         {
-          error = NO_METHOD;
+          callService(call, request);
         }
       }
       else
       {
-        error = NO_SERVICE;
+        ServerCall::give(call);
+        error = INVALID_REQUEST;
       }
     }
-    else
-    {
-      error = NO_SERVICE;
-    }
     if (error != NO_ERROR)
     {
       RpcMessage response;
       response.set_type(RESPONSE);
-      response.set_id(message.id());
+      response.set_id(message.id);
       response.set_error(error);
+      askChecksum(&response);
       codec_.send(conn_, response);
     }
   }
-  else if (message.type() == ERROR)
+  else if (message.type == ERROR)
   {
   }
 }
 
-void RpcChannel::doneCallback(::google::protobuf::Message* response, int64_t id)
+void RpcChannel::callService(ServerCall* call, google::protobuf::Message* request)
+{
+  const RpcDispatcher::Method* method = call->method;
+  method->service->CallMethod(method->descriptor, NULL, request, call->response, call);
+}
+
+void RpcChannel::doneCallback(ServerCall* call)
 {
-  boost::scoped_ptr<google::protobuf::Message> d(response);
   RpcMessage message;
   message.set_type(RESPONSE);
-  message.set_id(id);
-  message.set_response(response->SerializeAsString()); // FIXME: error check
-  codec_.send(conn_, message);
+  message.set_id(call->id);
+  if (call->tellMethodId)
+  {
+    message.set_method_id(call->method->id);
+  }
+  askChecksum(&message);
+  if (conn_->getLoop()->isInLoopThread() && collecting_)
+  {
+    codec_.appendEmbedded(&responses_, message, RpcMessage::kResponseFieldNumber, *call->response);
+  }
+  else
+  {
+    codec_.sendEmbedded(conn_, message, RpcMessage::kResponseFieldNumber, *call->response);
+  }
+  const RpcDispatcher::Method* method = call->method;
+  ServerCall::give(call);
+  dispatcher_->done(method);
 }
-
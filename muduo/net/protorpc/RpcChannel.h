@@ -13,10 +13,13 @@
 
 #include <muduo/base/Atomic.h>
 #include <muduo/base/Mutex.h>
+#include <muduo/net/TimerId.h>
 #include <muduo/net/protorpc/RpcCodec.h>
 
 #include <google/protobuf/service.h>
 
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <map>
@@ -81,6 +84,10 @@ namespace muduo
 namespace net
 {
 
+class EventLoop;
+class RpcCallTable;
+class RpcDispatcher;
+
 // Abstract interface for an RPC channel.  An RpcChannel represents a
 // communication line to a Service which can be used to call that Service's
 // methods.  The Service may be running on another machine.  Normally, you
@@ -90,23 +97,98 @@ namespace net
 //   RpcChannel* channel = new MyRpcChannel("remotehost.example.com:1234");
 //   MyService* service = new MyService::Stub(channel);
 //   service->MyMethod(request, &response, callback);
-class RpcChannel : public ::google::protobuf::RpcChannel
+class RpcChannel : public ::google::protobuf::RpcChannel,
+                   public boost::enable_shared_from_this<RpcChannel>
 {
  public:
   RpcChannel();
 
   explicit RpcChannel(const TcpConnectionPtr& conn);
 
+  // The calls outstanding fail with "connection closed", their done runs.
   ~RpcChannel();
 
-  void setConnection(const TcpConnectionPtr& conn)
+  // The method ids learnt are forgotten, the next server may number its
+  // methods otherwise.
+  void setConnection(const TcpConnectionPtr& conn);
+
+  // Serves these services, as they are now.
+  void setServices(const std::map<std::string, ::google::protobuf::Service*>* services);
+
+  // Serves the services of an RpcServer, shared by its channels.
+  void setDispatcher(RpcDispatcher* dispatcher)
+  {
+    dispatcher_ = dispatcher;
+  }
+
+  // Calls a method by name the first time, asking the server for its id,
+  // then by that id alone.  A server which knows no ids is called by name.
+  // Set it before calling.
+  void setMethodIds(bool on)
+  {
+    useMethodIds_ = on;
+  }
+
+  // Requests are written a batch at a time rather than one by one.  A batch
+  // goes once it has maxCalls calls or maxBytes bytes, or maxDelayUs
+  // microseconds after its first call, 0 being the end of the current
+  // iteration of the loop; the timers of the loop count in milliseconds.
+  // maxCalls 0, the default, writes each request at once.  The channel
+  // must be owned by an RpcChannelPtr.  Set it before calling.
+  void setBatching(int maxCalls, int maxBytes, int maxDelayUs);
+
+  // Calls through it skip the batch window: the batch so far, if any, goes
+  // out with the call right away.  For a stub of latency sensitive calls.
+  ::google::protobuf::RpcChannel* unbatched()
+  {
+    return &unbatched_;
+  }
+
+  // The responses of the requests read together are written together, if
+  // their methods are done by then.
+  void setBatchResponses(bool on)
+  {
+    batchResponses_ = on;
+  }
+
+  // The checksum of the frames sent, adler32 by default, set it before
+  // calling.  Frames stay adler32, asking for this one, until the peer
+  // shows it knows checksum types; a peer that asks, or sends another
+  // checksum, is answered with it, so a server speaks what each client
+  // speaks and an older peer keeps getting adler32.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    checksumType_ = type;
+  }
+
+  // Whether frames without a checksum are taken, for trusted links.
+  void setAllowNoChecksum(bool on)
   {
-    conn_ = conn;
+    codec_.setAllowNoChecksum(on);
   }
 
-  void setServices(const std::map<std::string, ::google::protobuf::Service*>* services)
+  // Requests and responses of at least bytes are parsed in the pool, and
+  // the service method or the done closure runs there too, so a big message
+  // does not hold up the loop of the connection.  Messages after it stay in
+  // order, they wait for it and run in the pool as well.  The channel must be
+  // owned by an RpcChannelPtr, the pool keeps it alive while parsing.
+  void setThreadPool(ThreadPool* pool, int bytes)
   {
-    services_ = services;
+    codec_.setThreadPool(pool, bytes);
+    codec_.tie(shared_from_this());
+  }
+
+  // At most n calls wait for their responses, a call beyond that fails at
+  // once.  No limit by default.  Set it before calling.
+  void setMaxOutstandingCalls(int n);
+
+  // Calls without a response after seconds fail with TIMEOUT: the
+  // controller, if any, is failed and done runs in the loop of the
+  // connection.  A timer there sweeps the outstanding calls, so the channel
+  // must be owned by an RpcChannelPtr.  0, the default, waits forever.
+  void setCallTimeout(double seconds)
+  {
+    callTimeout_ = seconds;
   }
 
   // Call the given method of the remote service.  The signature of this
@@ -125,26 +207,91 @@ class RpcChannel : public ::google::protobuf::RpcChannel
                  Timestamp receiveTime);
 
  private:
+  struct MessageView;
+  struct ServerCall;
+
+  class Unbatched : public ::google::protobuf::RpcChannel
+  {
+   public:
+    explicit Unbatched(muduo::net::RpcChannel* owner)
+      : owner_(owner)
+    {
+    }
+
+    virtual void CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                            ::google::protobuf::RpcController* controller,
+                            const ::google::protobuf::Message* request,
+                            ::google::protobuf::Message* response,
+                            ::google::protobuf::Closure* done);
+
+   private:
+    muduo::net::RpcChannel* owner_;
+  };
+
+  void call(const ::google::protobuf::MethodDescriptor* method,
+            ::google::protobuf::RpcController* controller,
+            const ::google::protobuf::Message* request,
+            ::google::protobuf::Message* response,
+            ::google::protobuf::Closure* done,
+            bool batched);
+  void batchRequest(const RpcMessage& message,
+                    const ::google::protobuf::Message& request,
+                    bool urgent);
+  static void armBatch(const boost::weak_ptr<RpcChannel>& weakChannel);
+  static void flushBatch(const boost::weak_ptr<RpcChannel>& weakChannel);
+
+  bool onRawMessage(const TcpConnectionPtr& conn,
+                    StringPiece frame,
+                    Timestamp receiveTime);
+
   void onRpcMessage(const TcpConnectionPtr& conn,
                     const RpcMessagePtr& messagePtr,
                     Timestamp receiveTime);
 
-  void doneCallback(::google::protobuf::Message* response, int64_t id);
+  static bool parseView(StringPiece payload, MessageView* view);
+  void askChecksum(RpcMessage* message) const;
+  void learnChecksum(ProtobufCodecLite::ChecksumType type, const MessageView& message);
+  void handleMessage(const MessageView& message);
+  void callService(ServerCall* call, ::google::protobuf::Message* request);
+  void doneCallback(ServerCall* call);
 
-  struct OutstandingCall
-  {
-    ::google::protobuf::Message* response;
-    ::google::protobuf::Closure* done;
-  };
+  uint32_t methodIdOf(const ::google::protobuf::MethodDescriptor* method);
+  void learnMethodId(const ::google::protobuf::MethodDescriptor* method, uint32_t id);
+
+  void startSweeping();
+  static void armSweeping(const boost::weak_ptr<RpcChannel>& weakChannel);
+  static void sweepCalls(const boost::weak_ptr<RpcChannel>& weakChannel);
 
   RpcCodec codec_;
   TcpConnectionPtr conn_;
-  AtomicInt64 id_;
+  ProtobufCodecLite::ChecksumType checksumType_;
+  bool peerKnowsChecksums_;  // in loop
+
+  boost::scoped_ptr<RpcCallTable> calls_;
+  double callTimeout_;
+  AtomicInt32 sweeping_;
+  EventLoop* sweepLoop_;     // in loop
+  TimerId sweepTimer_;       // in loop
 
+  bool useMethodIds_;
   MutexLock mutex_;
-  std::map<int64_t, OutstandingCall> outstandings_;
+  std::map<const ::google::protobuf::MethodDescriptor*, uint32_t> methodIds_;  // @GuardedBy mutex_
+
+  boost::scoped_ptr<RpcDispatcher> ownDispatcher_;
+  RpcDispatcher* dispatcher_;
+
+  int batchCalls_;
+  int batchBytes_;
+  int batchDelayUs_;
+  MutexLock batchMutex_;
+  Buffer batch_;             // @GuardedBy batchMutex_
+  int batched_;              // @GuardedBy batchMutex_, calls in batch_
+  Buffer flushing_;          // in loop
+  Unbatched unbatched_;
 
-  const std::map<std::string, ::google::protobuf::Service*>* services_;
+  bool batchResponses_;
+  bool collecting_;          // in loop, responses go to responses_ meanwhile
+  Buffer responses_;         // in loop
 };
 typedef boost::shared_ptr<RpcChannel> RpcChannelPtr;
 
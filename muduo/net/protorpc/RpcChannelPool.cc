@@ -0,0 +1,380 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcChannelPool.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <muduo/net/TcpClient.h>
+
+#include <google/protobuf/message.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+  __thread uint32_t t_random = 0;
+
+  // xorshift, good enough to pick connections
+  uint32_t nextRandom()
+  {
+    if (t_random == 0)
+    {
+      t_random = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&t_random)) | 1;
+    }
+    t_random ^= t_random << 13;
+    t_random ^= t_random >> 17;
+    t_random ^= t_random << 5;
+    return t_random;
+  }
+
+  // as RpcChannel does with a call it cannot make
+  void failCall(::google::protobuf::RpcController* controller,
+                ::google::protobuf::Message* response,
+                ::google::protobuf::Closure* done,
+                const char* reason)
+  {
+    boost::scoped_ptr< ::google::protobuf::Message> d(response);
+    if (controller)
+    {
+      controller->SetFailed(reason);
+    }
+    if (done)
+    {
+      done->Run();
+    }
+  }
+
+  void callInLoop(const RpcChannelPtr& channel,
+                  const ::google::protobuf::MethodDescriptor* method,
+                  ::google::protobuf::RpcController* controller,
+                  const boost::shared_ptr< ::google::protobuf::Message>& request,
+                  ::google::protobuf::Message* response,
+                  ::google::protobuf::Closure* done)
+  {
+    channel->CallMethod(method, controller, request.get(), response, done);
+  }
+}
+
+struct RpcChannelPool::Connection : boost::noncopyable
+{
+  explicit Connection(EventLoop* ioLoop)
+    : loop(ioLoop)
+  {
+  }
+
+  EventLoop* loop;
+  boost::scoped_ptr<TcpClient> client;  // in loop
+  RpcChannelPtr channel;                // @GuardedBy RpcChannelPool::mutex_
+  AtomicInt32 outstanding;
+};
+
+// The done of a call in flight, counted out when it is run.  The RpcChannel
+// of a connection which went down fails its calls, and runs them.
+class RpcChannelPool::PendingCall : public ::google::protobuf::Closure
+{
+ public:
+  PendingCall(RpcChannelPool* pool, Connection* connection, ::google::protobuf::Closure* done)
+    : pool_(pool),
+      connection_(connection),
+      done_(done)
+  {
+    connection_->outstanding.increment();
+  }
+
+  virtual void Run()
+  {
+    if (done_)
+    {
+      done_->Run();
+    }
+    connection_->outstanding.decrement();
+    pool_->doneCalls(1);
+    delete this;
+  }
+
+ private:
+  RpcChannelPool* pool_;
+  Connection* connection_;
+  ::google::protobuf::Closure* done_;
+};
+
+RpcChannelPool::RpcChannelPool(EventLoop* loop,
+                               const std::vector<InetAddress>& servers,
+                               const string& name)
+  : loop_(CHECK_NOTNULL(loop)),
+    servers_(servers),
+    name_(name),
+    connectionsPerServer_(1),
+    balance_(kLeastOutstanding),
+    callTimeout_(0),
+    maxOutstandingCalls_(0),
+    methodIds_(false),
+    threadPool_(new EventLoopThreadPool(loop)),
+    connected_(0),
+    closing_(false)
+{
+}
+
+RpcChannelPool::~RpcChannelPool()
+{
+  // clients go away in their own loops
+  CountDownLatch latch(static_cast<int>(connections_.size()));
+  for (size_t i = 0; i < connections_.size(); ++i)
+  {
+    Connection* connection = &connections_[i];
+    connection->loop->runInLoop(
+        boost::bind(&RpcChannelPool::stopConnection, this, connection, &latch));
+  }
+  latch.wait();
+}
+
+void RpcChannelPool::setThreadNum(int numThreads)
+{
+  assert(0 <= numThreads);
+  threadPool_->setThreadNum(numThreads);
+}
+
+void RpcChannelPool::start()
+{
+  loop_->assertInLoopThread();
+  threadPool_->start();
+  for (size_t i = 0; i < servers_.size(); ++i)
+  {
+    for (int k = 0; k < connectionsPerServer_; ++k)
+    {
+      Connection* connection = new Connection(threadPool_->getNextLoop());
+      connections_.push_back(connection);
+      char buf[64];
+      snprintf(buf, sizeof buf, ":%s#%d", servers_[i].toIpPort().c_str(), k);
+      connection->loop->runInLoop(
+          boost::bind(&RpcChannelPool::startConnection, this, connection, servers_[i], name_ + buf));
+    }
+  }
+}
+
+void RpcChannelPool::startConnection(Connection* connection,
+                                     const InetAddress& serverAddr,
+                                     const string& name)
+{
+  connection->client.reset(new TcpClient(connection->loop, serverAddr, name));
+  connection->client->setConnectionCallback(
+      boost::bind(&RpcChannelPool::onConnection, this, connection, _1));
+  connection->client->enableRetry();
+  connection->client->connect();
+}
+
+void RpcChannelPool::stopConnection(Connection* connection, CountDownLatch* latch)
+{
+  {
+  MutexLockGuard lock(mutex_);
+  connection->channel.reset();
+  }
+  connection->client.reset();
+  latch->countDown();
+}
+
+// no more retries, and the connection closed if it is up
+void RpcChannelPool::closeConnection(Connection* connection)
+{
+  connection->client->stop();
+  connection->client->disconnect();
+}
+
+void RpcChannelPool::onConnection(Connection* connection, const TcpConnectionPtr& conn)
+{
+  LOG_INFO << "RpcChannelPool - " << conn->localAddress().toIpPort() << " -> "
+           << conn->peerAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    RpcChannelPtr channel(new muduo::net::RpcChannel(conn));
+    channel->setCallTimeout(callTimeout_);
+    if (maxOutstandingCalls_ > 0)
+    {
+      channel->setMaxOutstandingCalls(maxOutstandingCalls_);
+    }
+    channel->setMethodIds(methodIds_);
+    conn->setMessageCallback(
+        boost::bind(&muduo::net::RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
+    MutexLockGuard lock(mutex_);
+    connection->channel = channel;
+    ++connected_;
+  }
+  else
+  {
+    // the calls outstanding on it are counted out as the channel goes
+    RpcChannelPtr channel;
+    bool none = false;
+    {
+    MutexLockGuard lock(mutex_);
+    if (connection->channel)
+    {
+      channel.swap(connection->channel);
+      none = --connected_ == 0;
+    }
+    }
+    channel.reset();
+    if (none && draining_.get())
+    {
+      loop_->runInLoop(boost::bind(&RpcChannelPool::drained, this));
+    }
+  }
+}
+
+int RpcChannelPool::connectedCount() const
+{
+  MutexLockGuard lock(mutex_);
+  return connected_;
+}
+
+RpcChannelPool::Connection* RpcChannelPool::pick(RpcChannelPtr* channel)
+{
+  MutexLockGuard lock(mutex_);
+  Connection* best = NULL;
+  if (connected_ == 0)
+  {
+    return NULL;
+  }
+  const size_t n = connections_.size();
+  if (balance_ == kPowerOfTwoChoices && connected_ > 2)
+  {
+    // two of those up, the first from a random start, the second from another
+    for (int choice = 0; choice < 2; ++choice)
+    {
+      size_t start = nextRandom() % n;
+      for (size_t i = 0; i < n; ++i)
+      {
+        Connection* c = &connections_[(start + i) % n];
+        if (c->channel && c != best)
+        {
+          if (best == NULL || c->outstanding.get() < best->outstanding.get())
+          {
+            best = c;
+          }
+          break;
+        }
+      }
+    }
+  }
+  else
+  {
+    // from a random start, so that ties are spread
+    size_t start = nextRandom() % n;
+    for (size_t i = 0; i < n; ++i)
+    {
+      Connection* c = &connections_[(start + i) % n];
+      if (c->channel && (best == NULL || c->outstanding.get() < best->outstanding.get()))
+      {
+        best = c;
+      }
+    }
+  }
+  if (best)
+  {
+    *channel = best->channel;
+  }
+  return best;
+}
+
+void RpcChannelPool::CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                                ::google::protobuf::RpcController* controller,
+                                const ::google::protobuf::Message* request,
+                                ::google::protobuf::Message* response,
+                                ::google::protobuf::Closure* done)
+{
+  // counted first, so that drain() either waits for it or it sees draining
+  outstanding_.increment();
+  if (draining_.get())
+  {
+    doneCalls(1);
+    failCall(controller, response, done, "draining");
+    return;
+  }
+
+  RpcChannelPtr channel;
+  Connection* connection = pick(&channel);
+  if (connection == NULL)
+  {
+    doneCalls(1);
+    failCall(controller, response, done, "no connection");
+    return;
+  }
+  ::google::protobuf::Closure* pending = new PendingCall(this, connection, done);
+  if (connection->loop->isInLoopThread())
+  {
+    channel->CallMethod(method, controller, request, response, pending);
+  }
+  else
+  {
+    // made in the loop of the connection, like the calls of its responses,
+    // with a copy of the request, the caller may let it go on return
+    boost::shared_ptr< ::google::protobuf::Message> copy(request->New());
+    copy->CopyFrom(*request);
+    connection->loop->queueInLoop(
+        boost::bind(callInLoop, channel, method, controller, copy, response, pending));
+  }
+}
+
+void RpcChannelPool::doneCalls(int calls)
+{
+  if (calls > 0 && outstanding_.addAndGet(-calls) == 0 && draining_.get())
+  {
+    loop_->runInLoop(boost::bind(&RpcChannelPool::closeAll, this));
+  }
+}
+
+void RpcChannelPool::drain(const DrainCallback& cb)
+{
+  drainCallback_ = cb;
+  if (draining_.getAndSet(1) == 0 && outstanding_.get() == 0)
+  {
+    loop_->runInLoop(boost::bind(&RpcChannelPool::closeAll, this));
+  }
+}
+
+void RpcChannelPool::closeAll()
+{
+  loop_->assertInLoopThread();
+  if (closing_)
+  {
+    return;
+  }
+  closing_ = true;
+  LOG_INFO << "RpcChannelPool::closeAll - " << name_;
+  for (size_t i = 0; i < connections_.size(); ++i)
+  {
+    Connection* connection = &connections_[i];
+    connection->loop->runInLoop(
+        boost::bind(&RpcChannelPool::closeConnection, this, connection));
+  }
+  if (connectedCount() == 0)
+  {
+    drained();
+  }
+}
+
+void RpcChannelPool::drained()
+{
+  loop_->assertInLoopThread();
+  if (closing_ && drainCallback_)
+  {
+    DrainCallback cb;
+    cb.swap(drainCallback_);
+    cb();
+  }
+}
@@ -0,0 +1,133 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
+#define MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <google/protobuf/service.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+
+class CountDownLatch;
+
+namespace net
+{
+
+class EventLoop;
+class EventLoopThreadPool;
+
+// An RpcChannel over a number of connections to one or more servers, for a
+// client which is too busy for one connection.  Each connection is an
+// RpcChannel of its own; a call goes to the one with the fewest calls
+// outstanding, or the better of two picked at random.  Lost connections
+// come back by themselves.
+//
+// CallMethod() is thread safe, the setters must be called before start().
+class RpcChannelPool : public ::google::protobuf::RpcChannel,
+                       boost::noncopyable
+{
+ public:
+  enum Balance
+  {
+    kLeastOutstanding,   // looks at every connection
+    kPowerOfTwoChoices,  // looks at two, for many connections
+  };
+
+  typedef boost::function<void ()> DrainCallback;
+
+  RpcChannelPool(EventLoop* loop,
+                 const std::vector<InetAddress>& servers,
+                 const string& name);
+  ~RpcChannelPool();  // force out-line dtor, for scoped_ptr members.
+
+  // Connections to each server, 1 by default.
+  void setConnectionsPerServer(int n) { connectionsPerServer_ = n; }
+
+  // Connections are spread over numThreads loops of their own, like
+  // TcpServer::setThreadNum(), 0 keeps them all in loop.
+  void setThreadNum(int numThreads);
+
+  void setBalance(Balance balance) { balance_ = balance; }
+
+  // For the channel of each connection, see RpcChannel.
+  void setCallTimeout(double seconds) { callTimeout_ = seconds; }
+  void setMaxOutstandingCalls(int n) { maxOutstandingCalls_ = n; }
+  void setMethodIds(bool on) { methodIds_ = on; }
+
+  // Connects, in the loop thread.
+  void start();
+
+  // New calls fail at once, the outstanding ones go on until done, then
+  // the connections are closed and cb runs in the loop.
+  void drain(const DrainCallback& cb);
+
+  int connectedCount() const;
+  int outstandingCalls() { return outstanding_.get(); }
+
+  // Calls fail at once, with the controller failed and done run, when no
+  // connection is up or while draining.  A call is made in the loop of its
+  // connection, from other threads with a copy of the request, and fails
+  // with "connection closed" if that goes down before the response.
+  virtual void CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                          ::google::protobuf::RpcController* controller,
+                          const ::google::protobuf::Message* request,
+                          ::google::protobuf::Message* response,
+                          ::google::protobuf::Closure* done);
+
+ private:
+  struct Connection;
+  class PendingCall;
+
+  void startConnection(Connection* connection, const InetAddress& serverAddr, const string& name);
+  void stopConnection(Connection* connection, CountDownLatch* latch);
+  void closeConnection(Connection* connection);
+  void onConnection(Connection* connection, const TcpConnectionPtr& conn);
+  Connection* pick(RpcChannelPtr* channel);
+  void doneCalls(int calls);
+  void closeAll();
+  void drained();
+
+  EventLoop* loop_;
+  const std::vector<InetAddress> servers_;
+  const string name_;
+  int connectionsPerServer_;
+  Balance balance_;
+  double callTimeout_;
+  int maxOutstandingCalls_;
+  bool methodIds_;
+  boost::scoped_ptr<EventLoopThreadPool> threadPool_;
+  boost::ptr_vector<Connection> connections_;
+
+  mutable MutexLock mutex_;
+  int connected_;            // @GuardedBy mutex_
+  AtomicInt32 outstanding_;
+  AtomicInt32 draining_;
+  bool closing_;             // in loop
+  DrainCallback drainCallback_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
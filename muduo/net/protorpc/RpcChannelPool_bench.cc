@@ -0,0 +1,239 @@
+// Calls per second through RpcChannelPool, by the number of connections,
+// against RpcServers in the same process, one per I/O thread on ports of
+// their own.  The connections of the pool are spread over the servers and
+// get a loop each, up to the client threads, and a fixed number of calls
+// are kept in flight over all of them.
+//
+// Usage: protobuf_rpc_channel_pool_bench [seconds] [server threads] [client threads] [in flight]
+
+#include <muduo/net/protorpc/RpcChannelPool.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18086;
+
+class EchoService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    response->add_service_name(request->service_name());
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+};
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* loop, int numServers, int connections, int threads,
+        RpcChannelPool::Balance balance)
+    : loop_(loop),
+      stub_(NULL),
+      running_(false)
+  {
+    // connections / servers to each server
+    std::vector<InetAddress> servers;
+    for (int i = 0; i < std::min(connections, numServers); ++i)
+    {
+      servers.push_back(InetAddress(AF_INET, static_cast<uint16_t>(kPort + i), true));
+    }
+    int perServer = connections / static_cast<int>(servers.size());
+    pool_.reset(new RpcChannelPool(loop, servers, "RpcChannelPoolBench"));
+    pool_->setConnectionsPerServer(perServer);
+    pool_->setThreadNum(std::min(connections, threads));
+    pool_->setBalance(balance);
+    stub_.reset(new RpcService::Stub(get_pointer(pool_)));
+    request_.set_service_name("hello");
+
+    runInLoop(boost::bind(&RpcChannelPool::start, get_pointer(pool_)));
+    while (pool_->connectedCount() < perServer * static_cast<int>(servers.size()))
+    {
+      CurrentThread::sleepUsec(10 * 1000);
+    }
+  }
+
+  ~Bench()
+  {
+    CountDownLatch drained(1);
+    pool_->drain(boost::bind(&CountDownLatch::countDown, &drained));
+    drained.wait();
+    runInLoop(boost::bind(&Bench::destroyPool, this));
+  }
+
+  // calls per second
+  double run(double seconds, int inFlight)
+  {
+    completed_.getAndSet(0);
+    running_ = true;
+    for (int i = 0; i < inFlight; ++i)
+    {
+      call();
+    }
+    CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1e6));
+    int64_t completed = completed_.get();
+    running_ = false;
+    while (pool_->outstandingCalls() > 0)
+    {
+      CurrentThread::sleepUsec(1000);
+    }
+    return static_cast<double>(completed) / seconds;
+  }
+
+ private:
+  void runInLoop(const boost::function<void ()>& f)
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(&Bench::runAndCountDown, f, &latch));
+    latch.wait();
+  }
+
+  static void runAndCountDown(const boost::function<void ()>& f, CountDownLatch* latch)
+  {
+    f();
+    latch->countDown();
+  }
+
+  void destroyPool()
+  {
+    stub_.reset();
+    pool_.reset();
+  }
+
+  void call()
+  {
+    // the channel deletes the response after done
+    ListRpcResponse* response = new ListRpcResponse;
+    stub_->listRpc(NULL, &request_, response,
+                   ::google::protobuf::NewCallback(this, &Bench::onResponse));
+  }
+
+  // in the loop of the connection
+  void onResponse()
+  {
+    completed_.increment();
+    if (running_)
+    {
+      call();
+    }
+  }
+
+  EventLoop* loop_;
+  boost::scoped_ptr<RpcChannelPool> pool_;
+  boost::scoped_ptr<RpcService::Stub> stub_;
+  ListRpcRequest request_;
+  volatile bool running_;
+  AtomicInt64 completed_;
+};
+
+// an RpcServer in a loop of its own
+class EchoServer : boost::noncopyable
+{
+ public:
+  EchoServer(EchoService* service, uint16_t port)
+    : loop_(thread_.startLoop())
+  {
+    CountDownLatch started(1);
+    loop_->runInLoop(boost::bind(&EchoServer::start, this, service, port, &started));
+    started.wait();
+  }
+
+  ~EchoServer()
+  {
+    CountDownLatch stopped(1);
+    loop_->runInLoop(boost::bind(&EchoServer::stop, this, &stopped));
+    stopped.wait();
+  }
+
+ private:
+  void start(EchoService* service, uint16_t port, CountDownLatch* started)
+  {
+    server_.reset(new RpcServer(loop_, InetAddress(AF_INET, port, true)));
+    server_->registerService(service);
+    server_->start();
+    started->countDown();
+  }
+
+  void stop(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  boost::scoped_ptr<RpcServer> server_;
+};
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int serverThreads = argc > 2 ? atoi(argv[2]) : 4;
+  int clientThreads = argc > 3 ? atoi(argv[3]) : 4;
+  int inFlight = argc > 4 ? atoi(argv[4]) : 256;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EchoService service;
+  boost::ptr_vector<EchoServer> servers;
+  for (int i = 0; i < serverThreads; ++i)
+  {
+    servers.push_back(new EchoServer(&service, static_cast<uint16_t>(kPort + i)));
+  }
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  printf("server threads %d, client threads %d, %d calls in flight\n",
+         serverThreads, clientThreads, inFlight);
+
+  const int kConnections[] = { 1, 2, 4, 8 };
+  for (size_t i = 0; i < sizeof kConnections / sizeof kConnections[0]; ++i)
+  {
+    int n = kConnections[i];
+    double least = 0;
+    double p2c = 0;
+    {
+      Bench bench(clientLoop, serverThreads, n, clientThreads, RpcChannelPool::kLeastOutstanding);
+      least = bench.run(seconds, inFlight);
+    }
+    {
+      Bench bench(clientLoop, serverThreads, n, clientThreads, RpcChannelPool::kPowerOfTwoChoices);
+      p2c = bench.run(seconds, inFlight);
+    }
+    printf("%d connections   least outstanding %9.0f calls/s   two choices %9.0f calls/s\n",
+           n, least, p2c);
+  }
+
+  servers.clear();
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -0,0 +1,265 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcChannelPool.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18097;
+const int kServers = 3;
+
+// holds the calls until released, to see where they went
+class HoldService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    MutexLockGuard lock(mutex_);
+    held_.push_back(done);
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+
+  int held()
+  {
+    MutexLockGuard lock(mutex_);
+    return static_cast<int>(held_.size());
+  }
+
+  // in the loop of the server
+  void release()
+  {
+    std::vector< ::google::protobuf::Closure*> held;
+    {
+    MutexLockGuard lock(mutex_);
+    held.swap(held_);
+    }
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+      held[i]->Run();
+    }
+  }
+
+  // their server is gone, and the channels their done would answer on
+  void forget()
+  {
+    MutexLockGuard lock(mutex_);
+    held_.clear();
+  }
+
+ private:
+  MutexLock mutex_;
+  std::vector< ::google::protobuf::Closure*> held_;
+};
+
+class Controller : public ::google::protobuf::RpcController
+{
+ public:
+  virtual void Reset() { reason_.clear(); }
+  virtual bool Failed() const { return !reason_.empty(); }
+  virtual std::string ErrorText() const { return reason_; }
+  virtual void StartCancel() { }
+  virtual void SetFailed(const std::string& reason) { reason_ = reason; }
+  virtual bool IsCanceled() const { return false; }
+  virtual void NotifyOnCancel(::google::protobuf::Closure* callback) { }
+
+ private:
+  std::string reason_;
+};
+
+struct Result
+{
+  Controller controller;
+  ListRpcResponse* response;  // the channel deletes it after done
+  bool ok;
+};
+
+void onResponse(Result* result, CountDownLatch* latch)
+{
+  result->ok = !result->controller.Failed() && result->response->error() == NO_ERROR;
+  latch->countDown();
+}
+
+void runAndCountDown(const boost::function<void ()>& f, CountDownLatch* latch)
+{
+  f();
+  latch->countDown();
+}
+
+void runInLoop(EventLoop* loop, const boost::function<void ()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, f, &latch));
+  latch.wait();
+}
+
+typedef boost::scoped_ptr<RpcServer> RpcServerPtr;
+
+void startServer(RpcServerPtr* server, EventLoop* loop, HoldService* service, uint16_t port)
+{
+  server->reset(new RpcServer(loop, InetAddress(AF_INET, port, true)));
+  (*server)->registerService(service);
+  (*server)->start();
+}
+
+void stopServer(RpcServerPtr* server)
+{
+  server->reset();
+}
+
+void call(RpcService::Stub* stub, boost::ptr_vector<Result>* results, CountDownLatch* latch)
+{
+  ListRpcRequest request;
+  Result* result = new Result;
+  result->response = new ListRpcResponse;
+  result->ok = false;
+  results->push_back(result);
+  stub->listRpc(&result->controller, &request, result->response,
+                ::google::protobuf::NewCallback(onResponse, result, latch));
+}
+
+template<typename PRED>
+void waitFor(PRED pred)
+{
+  for (int i = 0; i < 5000 && !pred(); ++i)
+  {
+    CurrentThread::sleepUsec(1000);
+  }
+  assert(pred());
+}
+
+bool allConnected(RpcChannelPool* pool, int n)
+{
+  return pool->connectedCount() == n;
+}
+
+// counted out once their done returns
+bool noneOutstanding(RpcChannelPool* pool)
+{
+  return pool->outstandingCalls() == 0;
+}
+
+bool allHeld(HoldService* services, int n)
+{
+  int held = 0;
+  for (int i = 0; i < kServers; ++i)
+  {
+    held += services[i].held();
+  }
+  return held == n;
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::kWARN);
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+
+  HoldService services[kServers];
+  RpcServerPtr servers[kServers];
+  std::vector<InetAddress> addrs;
+  for (int i = 0; i < kServers; ++i)
+  {
+    uint16_t port = static_cast<uint16_t>(kPort + i);
+    runInLoop(serverLoop, boost::bind(startServer, &servers[i], serverLoop, &services[i], port));
+    addrs.push_back(InetAddress(AF_INET, port, true));
+  }
+
+  {
+  RpcChannelPool pool(clientLoop, addrs, "RpcChannelPoolTest");
+  runInLoop(clientLoop, boost::bind(&RpcChannelPool::start, &pool));
+  waitFor(boost::bind(allConnected, &pool, kServers));
+  RpcService::Stub stub(&pool);
+  boost::ptr_vector<Result> results;
+
+  {
+  // held calls are outstanding, so each connection gets its share
+  const int kCalls = 10 * kServers;
+  CountDownLatch latch(kCalls);
+  for (int i = 0; i < kCalls; ++i)
+  {
+    call(&stub, &results, &latch);
+  }
+  waitFor(boost::bind(allHeld, services, kCalls));
+  for (int i = 0; i < kServers; ++i)
+  {
+    assert(services[i].held() == 10);
+  }
+  assert(pool.outstandingCalls() == kCalls);
+  for (int i = 0; i < kServers; ++i)
+  {
+    runInLoop(serverLoop, boost::bind(&HoldService::release, &services[i]));
+  }
+  latch.wait();
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    assert(results[i].ok);
+  }
+  waitFor(boost::bind(noneOutstanding, &pool));
+  results.clear();
+  }
+
+  {
+  // the calls of a connection which goes down fail, the others go on
+  const int kCalls = 2 * kServers;
+  CountDownLatch latch(kCalls);
+  for (int i = 0; i < kCalls; ++i)
+  {
+    call(&stub, &results, &latch);
+  }
+  waitFor(boost::bind(allHeld, services, kCalls));
+  services[0].forget();
+  runInLoop(serverLoop, boost::bind(stopServer, &servers[0]));
+  waitFor(boost::bind(allConnected, &pool, kServers - 1));
+  for (int i = 1; i < kServers; ++i)
+  {
+    runInLoop(serverLoop, boost::bind(&HoldService::release, &services[i]));
+  }
+  latch.wait();
+  int failed = 0;
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    if (!results[i].ok)
+    {
+      assert(results[i].controller.ErrorText() == "connection closed");
+      ++failed;
+    }
+  }
+  assert(failed == 2);
+  waitFor(boost::bind(noneOutstanding, &pool));
+  }
+  }
+
+  for (int i = 1; i < kServers; ++i)
+  {
+    runInLoop(serverLoop, boost::bind(stopServer, &servers[i]));
+  }
+}
@@ -0,0 +1,252 @@
+// Heap allocations per call of RpcChannel, counted by operator new in the
+// loop thread of the client and in the loop thread of the server, with the
+// rate of calls, one call in flight.
+//
+// Usage: protobuf_rpc_channel_bench [calls]
+
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+__thread int64_t t_allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++t_allocations;
+  void* p = malloc(size);
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) throw()
+{
+  free(p);
+}
+
+const uint16_t kPort = 18084;
+
+// echoes the name back
+class EchoService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    response->add_service_name(request->service_name());
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+};
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* serverLoop, EventLoop* clientLoop)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      connected_(1),
+      disconnected_(1),
+      total_(0),
+      done_(0),
+      clientAllocations_(0)
+  {
+    serverLoop_->runInLoop(boost::bind(&Bench::startServer, this));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Bench::connect, this));
+    connected_.wait();
+  }
+
+  void stop()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, client_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Bench::stopClient, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Bench::stopServer, this, &stopped));
+    stopped.wait();
+  }
+
+  void run(size_t size, int64_t total)
+  {
+    request_.set_service_name(std::string(size, 'x'));
+    total_ = total;
+    done_ = 0;
+    finished_.reset(new CountDownLatch(1));
+
+    int64_t serverStart = serverAllocations();
+    Timestamp start = Timestamp::now();
+    clientLoop_->runInLoop(boost::bind(&Bench::startRun, this));
+    finished_->wait();
+    double seconds = timeDifference(Timestamp::now(), start);
+    int64_t server = serverAllocations() - serverStart;
+    printf("%6zu bytes   client %5.2f   server %5.2f allocations per call   %8.0f calls/s\n",
+           size,
+           static_cast<double>(clientAllocations_) / static_cast<double>(total),
+           static_cast<double>(server) / static_cast<double>(total),
+           static_cast<double>(total) / seconds);
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    CountDownLatch latch(1);
+    loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+    latch.wait();
+  }
+
+  static void readAllocations(int64_t* allocations, CountDownLatch* latch)
+  {
+    *allocations = t_allocations;
+    latch->countDown();
+  }
+
+  int64_t serverAllocations()
+  {
+    int64_t allocations = 0;
+    CountDownLatch latch(1);
+    serverLoop_->runInLoop(boost::bind(&Bench::readAllocations, &allocations, &latch));
+    latch.wait();
+    return allocations;
+  }
+
+  void startServer()
+  {
+    server_.reset(new RpcServer(serverLoop_, InetAddress(AF_INET, kPort, true)));
+    server_->registerService(&service_);
+    server_->start();
+  }
+
+  void connect()
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcChannelBench"));
+    client_->setConnectionCallback(boost::bind(&Bench::onConnection, this, _1));
+    client_->connect();
+  }
+
+  void stopClient(CountDownLatch* stopped)
+  {
+    stub_.reset();
+    channel_.reset();
+    client_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_.reset(new RpcChannel(conn));
+      conn->setMessageCallback(
+          boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+      stub_.reset(new RpcService::Stub(get_pointer(channel_)));
+      connected_.countDown();
+    }
+    else
+    {
+      disconnected_.countDown();
+    }
+  }
+
+  // in the client loop from here on
+  void startRun()
+  {
+    clientAllocations_ = t_allocations;
+    call();
+  }
+
+  void call()
+  {
+    // the channel deletes the response after done
+    ListRpcResponse* response = new ListRpcResponse;
+    stub_->listRpc(NULL, &request_, response,
+                   ::google::protobuf::NewCallback(this, &Bench::onResponse, response));
+  }
+
+  void onResponse(ListRpcResponse* response)
+  {
+    assert(response->service_name(0).size() == request_.service_name().size());
+    if (++done_ < total_)
+    {
+      call();
+    }
+    else
+    {
+      clientAllocations_ = t_allocations - clientAllocations_;
+      finished_->countDown();
+    }
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  EchoService service_;
+  boost::scoped_ptr<RpcServer> server_;
+  boost::scoped_ptr<TcpClient> client_;
+  RpcChannelPtr channel_;
+  boost::scoped_ptr<RpcService::Stub> stub_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  boost::scoped_ptr<CountDownLatch> finished_;
+
+  ListRpcRequest request_;
+  int64_t total_;
+  int64_t done_;
+  int64_t clientAllocations_;
+};
+
+int main(int argc, char* argv[])
+{
+  int64_t calls = argc > 1 ? atoll(argv[1]) : 100000;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  Bench bench(serverThread.startLoop(), clientThread.startLoop());
+
+  const size_t kSizes[] = { 8, 1024, 64 * 1024 };
+  for (size_t i = 0; i < sizeof kSizes / sizeof kSizes[0]; ++i)
+  {
+    // warms up the caches, then the real one
+    bench.run(kSizes[i], 1000);
+    bench.run(kSizes[i], calls);
+  }
+  bench.stop();
+  google::protobuf::ShutdownProtobufLibrary();
+}
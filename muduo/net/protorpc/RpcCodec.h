@@ -40,6 +40,9 @@ extern const char rpctag[];// = "RPC0";
 // payload   N-byte
 // checksum  4-byte  adler32 of "RPC0"+payload
 //
+// or "RPCC" with CRC32C, "RPCX" with xxHash32, "RPCN" with none,
+// see ProtobufCodecLite::ChecksumType.
+//
 
 typedef ProtobufCodecLiteT<RpcMessage, rpctag> RpcCodec;
 
@@ -0,0 +1,330 @@
+// Head-of-line blocking in one loop, with and without
+// ProtobufCodecLite::setThreadPool().  A bulk client keeps big requests in
+// flight to a server with one loop, while a probe client ping-pongs small
+// ones on another connection of the same loop.  Reports the round trip of
+// the probes, p50 and p99, and the bulk throughput.
+//
+// Usage: protobuf_rpc_codec_pool_bench [probes] [bulk MiB] [pool threads]
+
+#include <muduo/net/protorpc/RpcCodec.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18083;
+const int kBulkWindow = 2;
+const int kPoolThreshold = 64 * 1024;
+const int kStreamingThreshold = 1024 * 1024;
+
+typedef boost::shared_ptr<RpcCodec> RpcCodecPtr;
+
+// one loop, a codec per connection
+class Server : boost::noncopyable
+{
+ public:
+  Server(EventLoop* loop, uint16_t port, ThreadPool* pool)
+    : server_(loop, InetAddress(AF_INET, port, true), "RpcCodecPoolBench"),
+      replyCodec_(boost::bind(&Server::onRpcMessage, this, _1, _2, _3)),
+      pool_(pool)
+  {
+    server_.setConnectionCallback(
+        boost::bind(&Server::onConnection, this, _1));
+    server_.start();
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      RpcCodecPtr codec(new RpcCodec(boost::bind(&Server::onRpcMessage, this, _1, _2, _3),
+                                     ProtobufCodecLite::RawMessageCallback(),
+                                     boost::bind(&Server::onError, this, _1, _2, _3, _4)));
+      codec->setStreamingThreshold(kStreamingThreshold);
+      if (pool_)
+      {
+        codec->setThreadPool(pool_, kPoolThreshold);
+        codec->tie(codec);
+      }
+      conn->setMessageCallback(
+          boost::bind(&RpcCodec::onMessage, get_pointer(codec), _1, _2, _3));
+      conn->setContext(codec);
+    }
+    else
+    {
+      conn->setContext(RpcCodecPtr());
+    }
+  }
+
+  // in the loop, or in the pool for big requests and what follows them;
+  // the probes are echoed, the bulk requests get a short answer
+  void onRpcMessage(const TcpConnectionPtr& conn, const RpcMessagePtr& message, Timestamp)
+  {
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(message->id());
+    if (message->request().size() < static_cast<size_t>(kPoolThreshold))
+    {
+      response.set_response(message->request());
+    }
+    replyCodec_.send(conn, response);
+  }
+
+  void onError(const TcpConnectionPtr&, Buffer*, Timestamp,
+               ProtobufCodecLite::ErrorCode errorCode)
+  {
+    LOG_FATAL << ProtobufCodecLite::errorCodeToString(errorCode);
+  }
+
+  TcpServer server_;
+  RpcCodec replyCodec_;  // for send() only
+  ThreadPool* pool_;
+};
+
+// both clients in the client loop
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* serverLoop, EventLoop* clientLoop, uint16_t port, ThreadPool* pool)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      port_(port),
+      pool_(pool),
+      bulkCodec_(boost::bind(&Bench::onBulkResponse, this, _1, _2, _3)),
+      probeCodec_(boost::bind(&Bench::onProbeResponse, this, _1, _2, _3)),
+      connected_(2),
+      disconnected_(2),
+      probes_(0),
+      bulkRunning_(false)
+  {
+    serverLoop_->runInLoop(boost::bind(&Bench::startServer, this));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Bench::connect, this));
+    connected_.wait();
+  }
+
+  void stop()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, bulk_.get()));
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, probe_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Bench::stopClients, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Bench::stopServer, this, &stopped));
+    stopped.wait();
+  }
+
+  void run(int probes, size_t bulkSize)
+  {
+    bulkMessage_.set_type(REQUEST);
+    bulkMessage_.set_id(1);
+    bulkMessage_.mutable_request()->assign(bulkSize, 'b');
+    probeMessage_.set_type(REQUEST);
+    probeMessage_.set_id(2);
+    probeMessage_.mutable_request()->assign(64, 'p');
+    probes_ = probes;
+    rtts_.clear();
+    rtts_.reserve(probes);
+    bulkBytes_.getAndSet(0);
+    done_.reset(new CountDownLatch(1));
+
+    Timestamp start = Timestamp::now();
+    clientLoop_->runInLoop(boost::bind(&Bench::startRun, this));
+    done_->wait();
+    double seconds = timeDifference(Timestamp::now(), start);
+    // the bulk requests still in flight
+    clientLoop_->runInLoop(boost::bind(&Bench::stopBulk, this));
+    sync(clientLoop_);
+    while (bulkInFlight_.get() > 0)
+    {
+      sync(serverLoop_);
+      sync(clientLoop_);
+    }
+
+    std::sort(rtts_.begin(), rtts_.end());
+    printf("%-16s probe rtt p50 %8.0f us  p99 %8.0f us  max %8.0f us   bulk %7.1f MB/s\n",
+           pool_ ? "thread pool" : "loop only",
+           rtts_[rtts_.size() / 2] * 1e6,
+           rtts_[rtts_.size() * 99 / 100] * 1e6,
+           rtts_.back() * 1e6,
+           static_cast<double>(bulkBytes_.get()) / seconds / 1e6);
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    CountDownLatch latch(1);
+    loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+    latch.wait();
+  }
+
+  void startServer()
+  {
+    server_.reset(new Server(serverLoop_, port_, pool_));
+  }
+
+  void connect()
+  {
+    bulk_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, port_, true), "Bulk"));
+    bulk_->setConnectionCallback(boost::bind(&Bench::onConnection, this, &bulkConn_, _1));
+    bulk_->setMessageCallback(boost::bind(&RpcCodec::onMessage, &bulkCodec_, _1, _2, _3));
+    bulk_->connect();
+    probe_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, port_, true), "Probe"));
+    probe_->setConnectionCallback(boost::bind(&Bench::onConnection, this, &probeConn_, _1));
+    probe_->setMessageCallback(boost::bind(&RpcCodec::onMessage, &probeCodec_, _1, _2, _3));
+    probe_->connect();
+  }
+
+  void stopClients(CountDownLatch* stopped)
+  {
+    bulk_.reset();
+    probe_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(TcpConnectionPtr* saved, const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      *saved = conn;
+      connected_.countDown();
+    }
+    else
+    {
+      saved->reset();
+      disconnected_.countDown();
+    }
+  }
+
+  // in the client loop from here on
+  void startRun()
+  {
+    bulkRunning_ = true;
+    for (int i = 0; i < kBulkWindow; ++i)
+    {
+      sendBulk();
+    }
+    sendProbe();
+  }
+
+  void stopBulk()
+  {
+    bulkRunning_ = false;
+  }
+
+  void sendBulk()
+  {
+    bulkInFlight_.increment();
+    bulkCodec_.send(bulkConn_, bulkMessage_);
+  }
+
+  void sendProbe()
+  {
+    probeSent_ = Timestamp::now();
+    probeCodec_.send(probeConn_, probeMessage_);
+  }
+
+  void onBulkResponse(const TcpConnectionPtr&, const RpcMessagePtr&, Timestamp)
+  {
+    bulkInFlight_.decrement();
+    if (bulkRunning_)
+    {
+      bulkBytes_.add(bulkMessage_.request().size());
+      sendBulk();
+    }
+  }
+
+  void onProbeResponse(const TcpConnectionPtr&, const RpcMessagePtr&, Timestamp)
+  {
+    rtts_.push_back(timeDifference(Timestamp::now(), probeSent_));
+    if (static_cast<int>(rtts_.size()) < probes_)
+    {
+      sendProbe();
+    }
+    else
+    {
+      done_->countDown();
+    }
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  const uint16_t port_;
+  ThreadPool* pool_;
+  boost::scoped_ptr<Server> server_;
+  RpcCodec bulkCodec_;
+  RpcCodec probeCodec_;
+  boost::scoped_ptr<TcpClient> bulk_;
+  boost::scoped_ptr<TcpClient> probe_;
+  TcpConnectionPtr bulkConn_;
+  TcpConnectionPtr probeConn_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  boost::scoped_ptr<CountDownLatch> done_;
+
+  RpcMessage bulkMessage_;
+  RpcMessage probeMessage_;
+  int probes_;
+  bool bulkRunning_;
+  AtomicInt32 bulkInFlight_;
+  AtomicInt64 bulkBytes_;
+  Timestamp probeSent_;
+  std::vector<double> rtts_;
+};
+
+int main(int argc, char* argv[])
+{
+  int probes = argc > 1 ? atoi(argv[1]) : 2000;
+  size_t bulkSize = (argc > 2 ? atoi(argv[2]) : 8) * 1024 * 1024;
+  int threads = argc > 3 ? atoi(argv[3]) : 2;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  printf("probes %d, bulk %zu bytes, %d in flight\n", probes, bulkSize, kBulkWindow);
+
+  {
+    Bench bench(serverLoop, clientLoop, kPort, NULL);
+    bench.run(probes, bulkSize);
+    bench.stop();
+  }
+
+  ThreadPool pool("codec");
+  pool.start(threads);
+  {
+    Bench bench(serverLoop, clientLoop, kPort + 1, &pool);
+    bench.run(probes, bulkSize);
+    bench.stop();
+  }
+  pool.stop();
+  google::protobuf::ShutdownProtobufLibrary();
+}
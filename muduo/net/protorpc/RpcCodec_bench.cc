@@ -0,0 +1,303 @@
+// Throughput of ProtobufCodecLite, first encoding and parsing in memory
+// with each ChecksumType, then messages per second through send() over
+// loopback, with the frame serialized into a temporary Buffer and copied by
+// TcpConnection::send(Buffer*), as send() used to do, and with send() itself.
+// Each is timed from the loop thread of the connection and from another
+// thread.
+//
+// Usage: protobuf_rpc_codec_bench [seconds]
+
+#include <muduo/net/protorpc/RpcCodec.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Condition.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18082;
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* serverLoop, EventLoop* clientLoop)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      server_(new TcpServer(serverLoop, InetAddress(AF_INET, kPort, true), "RpcCodecBench")),
+      serverCodec_(boost::bind(&Bench::onRpcMessage, this, _1, _2, _3),
+                   ProtobufCodecLite::RawMessageCallback(),
+                   boost::bind(&Bench::onError, this, _1, _2, _3, _4)),
+      clientCodec_(boost::bind(&Bench::onRpcMessage, this, _1, _2, _3)),
+      connected_(1),
+      disconnected_(1),
+      cond_(mutex_),
+      byBuffer_(false),
+      otherThread_(false),
+      total_(0),
+      window_(0),
+      sent_(0)
+  {
+    server_->setMessageCallback(
+        boost::bind(&RpcCodec::onMessage, &serverCodec_, _1, _2, _3));
+    serverLoop_->runInLoop(boost::bind(&TcpServer::start, server_.get()));
+    sync(serverLoop_);
+
+    clientLoop_->runInLoop(boost::bind(&Bench::connect, this));
+    connected_.wait();
+  }
+
+  // connections go away in their own loops
+  void stop()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, client_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Bench::stopClient, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Bench::stopServer, this, &stopped));
+    stopped.wait();
+  }
+
+  // messages per second
+  double run(size_t size, bool byBuffer, bool otherThread, int64_t total)
+  {
+    message_.set_type(REQUEST);
+    message_.set_id(1);
+    message_.mutable_request()->assign(size, 'x');
+    byBuffer_ = byBuffer;
+    otherThread_ = otherThread;
+    total_ = total;
+    // at most 4 MiB in flight
+    window_ = std::max<int64_t>(8, std::min<int64_t>(1024, (4 << 20) / size));
+    sent_ = 0;
+    received_.getAndSet(0);
+    done_.reset(new CountDownLatch(1));
+
+    Timestamp start = Timestamp::now();
+    if (otherThread)
+    {
+      while (sent_ < total_)
+      {
+        {
+          MutexLockGuard lock(mutex_);
+          while (sent_ - received_.get() >= window_)
+          {
+            cond_.wait();
+          }
+        }
+        sendOne();
+      }
+    }
+    else
+    {
+      clientLoop_->runInLoop(boost::bind(&Bench::refill, this));
+    }
+    done_->wait();
+    double seconds = timeDifference(Timestamp::now(), start);
+    // refills queued before the end must not run into the next run
+    sync(serverLoop_);
+    sync(clientLoop_);
+    return static_cast<double>(total) / seconds;
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    CountDownLatch latch(1);
+    loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+    latch.wait();
+  }
+
+  void connect()
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcCodecBench"));
+    client_->setConnectionCallback(boost::bind(&Bench::onConnection, this, _1));
+    client_->connect();
+  }
+
+  void stopClient(CountDownLatch* stopped)
+  {
+    client_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn_ = conn;
+      connected_.countDown();
+    }
+    else
+    {
+      conn_.reset();
+      disconnected_.countDown();
+    }
+  }
+
+  void sendOne()
+  {
+    if (byBuffer_)
+    {
+      Buffer buf;
+      clientCodec_.fillEmptyBuffer(&buf, message_);
+      conn_->send(&buf);
+    }
+    else
+    {
+      clientCodec_.send(conn_, message_);
+    }
+    ++sent_;
+  }
+
+  // in the client loop
+  void refill()
+  {
+    while (sent_ < total_ && sent_ - received_.get() < window_)
+    {
+      sendOne();
+    }
+  }
+
+  // in the server loop
+  void onRpcMessage(const TcpConnectionPtr&, const RpcMessagePtr&, Timestamp)
+  {
+    int64_t received = received_.incrementAndGet();
+    if (received == total_)
+    {
+      done_->countDown();
+    }
+    else if (received % (window_ / 2) == 0)
+    {
+      if (otherThread_)
+      {
+        MutexLockGuard lock(mutex_);
+        cond_.notify();
+      }
+      else
+      {
+        clientLoop_->runInLoop(boost::bind(&Bench::refill, this));
+      }
+    }
+  }
+
+  void onError(const TcpConnectionPtr&, Buffer*, Timestamp,
+               ProtobufCodecLite::ErrorCode errorCode)
+  {
+    LOG_FATAL << ProtobufCodecLite::errorCodeToString(errorCode);
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  boost::scoped_ptr<TcpServer> server_;
+  RpcCodec serverCodec_;
+  RpcCodec clientCodec_;
+  boost::scoped_ptr<TcpClient> client_;
+  TcpConnectionPtr conn_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  boost::scoped_ptr<CountDownLatch> done_;
+  MutexLock mutex_;
+  Condition cond_;
+
+  RpcMessage message_;
+  bool byBuffer_;
+  bool otherThread_;
+  int64_t total_;
+  int64_t window_;
+  int64_t sent_;
+  AtomicInt64 received_;
+};
+
+void onParsed(const TcpConnectionPtr&, const MessagePtr&, Timestamp)
+{
+}
+
+// MB/s of fillEmptyBuffer() and parse() for each checksum, about 1 GiB each
+void benchChecksums(size_t size)
+{
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(1);
+  message.mutable_request()->assign(size, 'x');
+  RpcMessage parsed;
+  const int64_t rounds = std::max<int64_t>(16, (1 << 30) / size);
+
+  printf("%7zu bytes", size);
+  for (int type = ProtobufCodecLite::kAdler32; type < ProtobufCodecLite::kNumChecksumTypes; ++type)
+  {
+    ProtobufCodecLite codec(&RpcMessage::default_instance(), rpctag, onParsed);
+    codec.setChecksumType(static_cast<ProtobufCodecLite::ChecksumType>(type));
+    Buffer buf;
+    Timestamp start = Timestamp::now();
+    for (int64_t r = 0; r < rounds; ++r)
+    {
+      buf.retrieveAll();
+      codec.fillEmptyBuffer(&buf, message);
+      if (codec.parse(buf.peek() + ProtobufCodecLite::kHeaderLen,
+                      static_cast<int>(buf.readableBytes()) - ProtobufCodecLite::kHeaderLen,
+                      &parsed) != ProtobufCodecLite::kNoError)
+      {
+        LOG_FATAL << "parse";
+      }
+    }
+    double seconds = timeDifference(Timestamp::now(), start);
+    const char* names[] = { "adler32", "crc32c", "xxhash32", "none" };
+    printf("   %-8s %7.0f MB/s", names[type],
+           static_cast<double>(size) * static_cast<double>(rounds) / seconds / 1e6);
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+  Logger::setLogLevel(Logger::kWARN);
+
+  benchChecksums(1024);
+  benchChecksums(64 * 1024);
+  benchChecksums(1024 * 1024);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  Bench bench(serverThread.startLoop(), clientThread.startLoop());
+
+  const size_t kSizes[] = { 100, 100 * 1024 };
+  for (size_t i = 0; i < sizeof kSizes / sizeof kSizes[0]; ++i)
+  {
+    size_t size = kSizes[i];
+    // a short run to size the real ones
+    double rate = bench.run(size, false, false, 1000);
+    int64_t total = std::max<int64_t>(1000, static_cast<int64_t>(rate * seconds));
+    for (int otherThread = 0; otherThread < 2; ++otherThread)
+    {
+      double byBuffer = bench.run(size, true, otherThread, total);
+      double direct = bench.run(size, false, otherThread, total);
+      printf("%6zu bytes %-14s temporary Buffer %9.0f msg/s   send() %9.0f msg/s\n",
+             size, otherThread ? "other thread" : "loop thread", byBuffer, direct);
+    }
+  }
+  bench.stop();
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -1,10 +1,26 @@
 #undef NDEBUG
 #include <muduo/net/protorpc/RpcCodec.h>
 #include <muduo/net/protorpc/rpc.pb.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/protobuf/BufferStream.h>
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
 #include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
 
 #include <stdio.h>
+#include <string.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -23,6 +39,238 @@ void messageCallback(const TcpConnectionPtr&,
   g_msgptr = msg;
 }
 
+const uint16_t kPort = 18104;
+
+// a frame of the request with id, padded to size bytes
+void appendRequest(Buffer* buf, ProtobufCodecLite* codec, int id, size_t size)
+{
+  RpcMessage m;
+  m.set_type(REQUEST);
+  m.set_id(id);
+  m.set_request(std::string(size, 'x'));
+  Buffer frame;
+  codec->fillEmptyBuffer(&frame, m);
+  buf->append(frame.peek(), frame.readableBytes());
+}
+
+// The server end of one connection, fed frames by hand in its loop, and
+// the client end, which collects the replies.  Every request is answered
+// by a response of the same id, sent from where the request is handled.
+class Fixture : boost::noncopyable
+{
+ public:
+  Fixture(EventLoop* serverLoop, EventLoop* clientLoop, ThreadPool* pool)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      serverCodec_(&RpcMessage::default_instance(), "RPC0",
+                   boost::bind(&Fixture::onRequest, this, _1, _2, _3)),
+      clientCodec_(&RpcMessage::default_instance(), "RPC0",
+                   boost::bind(&Fixture::onResponse, this, _1, _2, _3)),
+      connected_(2),
+      disconnected_(1),
+      handled_(NULL),
+      replied_(NULL)
+  {
+    serverCodec_.setStreamingThreshold(64 * 1024);
+    serverCodec_.setThreadPool(pool, 1024);
+    serverLoop_->runInLoop(boost::bind(&Fixture::startServer, this));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Fixture::connect, this));
+    connected_.wait();
+  }
+
+  ~Fixture()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, get_pointer(client_)));
+    disconnected_.wait();
+    clientLoop_->runInLoop(boost::bind(&Fixture::stopClient, this));
+    serverLoop_->runInLoop(boost::bind(&Fixture::stopServer, this));
+    // the strand ended and the connections closed for good
+    sync(serverLoop_);
+    sync(clientLoop_);
+  }
+
+  ProtobufCodecLite* codec() { return &serverCodec_; }
+
+  void expect(CountDownLatch* handled, CountDownLatch* replied)
+  {
+    handled_ = handled;
+    replied_ = replied;
+  }
+
+  // f runs in the loop of the server with its end of the connection
+  void runInServer(const boost::function<void (const TcpConnectionPtr&)>& f)
+  {
+    CountDownLatch done(1);
+    serverLoop_->runInLoop(boost::bind(&Fixture::runWithConn, this, f, &done));
+    done.wait();
+  }
+
+  std::vector<int64_t> requests()
+  {
+    MutexLockGuard lock(mutex_);
+    return requests_;
+  }
+
+  std::vector<int64_t> responses()
+  {
+    MutexLockGuard lock(mutex_);
+    return responses_;
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      CountDownLatch latch(1);
+      loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+      latch.wait();
+    }
+  }
+
+  void startServer()
+  {
+    server_.reset(new TcpServer(serverLoop_, InetAddress(AF_INET, kPort, true), "RpcCodecTest"));
+    server_->setConnectionCallback(boost::bind(&Fixture::onServerConnection, this, _1));
+    server_->start();
+  }
+
+  void connect()
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcCodecTest"));
+    client_->setConnectionCallback(boost::bind(&Fixture::onClientConnection, this, _1));
+    client_->setMessageCallback(
+        boost::bind(&ProtobufCodecLite::onMessage, &clientCodec_, _1, _2, _3));
+    client_->connect();
+  }
+
+  void stopClient()
+  {
+    client_.reset();
+  }
+
+  void stopServer()
+  {
+    serverConn_.reset();
+    server_.reset();
+  }
+
+  void runWithConn(const boost::function<void (const TcpConnectionPtr&)>& f,
+                   CountDownLatch* done)
+  {
+    f(serverConn_);
+    done->countDown();
+  }
+
+  void onServerConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      serverConn_ = conn;
+      connected_.countDown();
+    }
+  }
+
+  void onClientConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      connected_.countDown();
+    }
+    else
+    {
+      disconnected_.countDown();
+    }
+  }
+
+  void onRequest(const TcpConnectionPtr& conn, const MessagePtr& msg, Timestamp)
+  {
+    int64_t id = static_cast<RpcMessage*>(get_pointer(msg))->id();
+    {
+    MutexLockGuard lock(mutex_);
+    requests_.push_back(id);
+    }
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(id);
+    serverCodec_.send(conn, response);
+    handled_->countDown();
+  }
+
+  void onResponse(const TcpConnectionPtr&, const MessagePtr& msg, Timestamp)
+  {
+    {
+    MutexLockGuard lock(mutex_);
+    responses_.push_back(static_cast<RpcMessage*>(get_pointer(msg))->id());
+    }
+    replied_->countDown();
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  ProtobufCodecLite serverCodec_;
+  ProtobufCodecLite clientCodec_;
+  boost::scoped_ptr<TcpServer> server_;
+  boost::scoped_ptr<TcpClient> client_;
+  TcpConnectionPtr serverConn_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+  CountDownLatch* handled_;
+  CountDownLatch* replied_;
+  MutexLock mutex_;
+  std::vector<int64_t> requests_;   // @GuardedBy mutex_
+  std::vector<int64_t> responses_;  // @GuardedBy mutex_
+};
+
+bool inOrder(const std::vector<int64_t>& ids, int n)
+{
+  if (ids.size() != static_cast<size_t>(n))
+  {
+    return false;
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    if (ids[i] != i)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// in the loop, in chunks as they would be read
+void feed(ProtobufCodecLite* codec, const Buffer* frames, const TcpConnectionPtr& conn)
+{
+  Buffer input;
+  for (size_t sent = 0; sent < frames->readableBytes(); )
+  {
+    size_t n = std::min<size_t>(frames->readableBytes() - sent, 100000);
+    input.append(frames->peek() + sent, n);
+    sent += n;
+    codec->onMessage(conn, &input, Timestamp::now());
+  }
+  assert(input.readableBytes() == 0);
+}
+
+// in the loop, a big frame, then a small one once the pool is done with
+// it but before the loop has written its reply
+void feedBigThenSmall(ProtobufCodecLite* codec,
+                      CountDownLatch* handled,
+                      const TcpConnectionPtr& conn)
+{
+  Buffer input;
+  appendRequest(&input, codec, 0, 3 * 1024 * 1024);
+  codec->onMessage(conn, &input, Timestamp::now());
+  while (handled->getCount() > 1)
+  {
+    CurrentThread::sleepUsec(1000);
+  }
+  CurrentThread::sleepUsec(100 * 1000);
+  appendRequest(&input, codec, 1, 10);
+  codec->onMessage(conn, &input, Timestamp::now());
+}
+
 void print(const Buffer& buf)
 {
   printf("encoded to %zd bytes\n", buf.readableBytes());
@@ -77,5 +325,188 @@ int main()
   assert(g_msgptr->DebugString() == message.DebugString());
   }
 
+  {
+  // the payload of a frame, in place
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  StringPiece payload;
+  assert(codec.payloadOf(expected.data() + ProtobufCodecLite::kHeaderLen,
+                         static_cast<int>(expected.size()) - ProtobufCodecLite::kHeaderLen,
+                         &payload) == ProtobufCodecLite::kNoError);
+  assert(payload == message.SerializeAsString());
+  string bad(expected);
+  bad[10] ^= 1;
+  assert(codec.payloadOf(bad.data() + ProtobufCodecLite::kHeaderLen,
+                         static_cast<int>(bad.size()) - ProtobufCodecLite::kHeaderLen,
+                         &payload) == ProtobufCodecLite::kCheckSumError);
+  }
+
+  {
+  // check values of CRC32C and xxHash32
+  assert(ProtobufCodecLite::checksum(ProtobufCodecLite::kCrc32c, "123456789", 9)
+         == static_cast<int32_t>(0xE3069283));
+  assert(ProtobufCodecLite::checksum(ProtobufCodecLite::kXxHash32, "", 0)
+         == static_cast<int32_t>(0x02CC5D05));
+  const char kSpam[] = "Nobody inspects the spammish repetition";
+  assert(ProtobufCodecLite::checksum(ProtobufCodecLite::kXxHash32, kSpam, sizeof(kSpam)-1)
+         == static_cast<int32_t>(0xE2293B2F));
+  }
+
+  {
+  ProtobufCodecLite adler32(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  const char* tags[] = { "RPC0", "RPCC", "RPCX", "RPCN" };
+  for (int type = ProtobufCodecLite::kAdler32; type < ProtobufCodecLite::kNumChecksumTypes; ++type)
+  {
+    Buffer buf;
+    ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+    codec.setChecksumType(static_cast<ProtobufCodecLite::ChecksumType>(type));
+    codec.fillEmptyBuffer(&buf, message);
+    print(buf);
+    assert(memcmp(buf.peek() + ProtobufCodecLite::kHeaderLen, tags[type], 4) == 0);
+    assert(codec.checksumTypeOf(buf.peek() + ProtobufCodecLite::kHeaderLen) == type);
+
+    // one which sends adler32 takes them all, but no checksum at all
+    ProtobufCodecLite::ErrorCode errorCode =
+        adler32.parse(buf.peek() + ProtobufCodecLite::kHeaderLen,
+                      static_cast<int>(buf.readableBytes()) - ProtobufCodecLite::kHeaderLen,
+                      get_pointer(g_msgptr = MessagePtr(new RpcMessage)));
+    if (type == ProtobufCodecLite::kNoChecksum)
+    {
+      assert(errorCode == ProtobufCodecLite::kUnknownMessageType);
+      adler32.setAllowNoChecksum(true);
+    }
+    else
+    {
+      assert(errorCode == ProtobufCodecLite::kNoError);
+    }
+    adler32.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+    assert(buf.readableBytes() == 0);
+    assert(g_msgptr->DebugString() == message.DebugString());
+
+    // a flipped bit is caught
+    if (type != ProtobufCodecLite::kNoChecksum)
+    {
+      codec.fillEmptyBuffer(&buf, message);
+      const_cast<char*>(buf.peek())[buf.readableBytes() - 6] ^= 1;
+      errorCode = adler32.parse(buf.peek() + ProtobufCodecLite::kHeaderLen,
+                                static_cast<int>(buf.readableBytes()) - ProtobufCodecLite::kHeaderLen,
+                                get_pointer(g_msgptr));
+      assert(errorCode == ProtobufCodecLite::kCheckSumError);
+    }
+  }
+  g_msgptr.reset();
+  }
+
+  {
+  // BufferInputStream over a chain, with an empty buffer in it
+  std::deque<Buffer> chain(3);
+  chain[0].append("ab");
+  chain[2].append("cdef");
+  BufferInputStream input(chain);
+  const void* data = NULL;
+  int size = 0;
+  assert(input.Next(&data, &size) && size == 2 && memcmp(data, "ab", 2) == 0);
+  input.BackUp(1);
+  assert(input.ByteCount() == 1);
+  assert(input.Next(&data, &size) && size == 1 && memcmp(data, "b", 1) == 0);
+  assert(input.Skip(2));
+  assert(input.Next(&data, &size) && size == 2 && memcmp(data, "ef", 2) == 0);
+  assert(!input.Next(&data, &size));
+  assert(input.ByteCount() == 6);
+  assert(!input.Skip(1));
+  }
+
+  {
+  // a big message parsed from the pieces it comes in, then a small one
+  RpcMessage big;
+  big.set_type(REQUEST);
+  big.set_id(3);
+  big.set_request(std::string(3 * 1024 * 1024, 'x'));
+  const ProtobufCodecLite::ChecksumType types[] = { ProtobufCodecLite::kAdler32, ProtobufCodecLite::kXxHash32 };
+  for (size_t t = 0; t < sizeof types / sizeof types[0]; ++t)
+  {
+    ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+    codec.setChecksumType(types[t]);
+    codec.setStreamingThreshold(64 * 1024);
+    Buffer stream;
+    codec.fillEmptyBuffer(&stream, big);
+    Buffer small;
+    codec.fillEmptyBuffer(&small, message);
+    stream.append(small.peek(), small.readableBytes());
+
+    Buffer input;
+    for (size_t sent = 0; sent < stream.readableBytes(); )
+    {
+      size_t n = std::min<size_t>(stream.readableBytes() - sent, 65536 - 7);
+      input.append(stream.peek() + sent, n);
+      sent += n;
+      codec.onMessage(TcpConnectionPtr(), &input, Timestamp::now());
+      if (g_msgptr && g_msgptr->ByteSizeLong() > 1000)
+      {
+        assert(g_msgptr->DebugString() == big.DebugString());
+        g_msgptr.reset();
+        assert(sent < stream.readableBytes());
+      }
+      // never grown to hold the big one
+      assert(input.internalCapacity() < 1024 * 1024);
+    }
+    assert(g_msgptr && g_msgptr->DebugString() == message.DebugString());
+    assert(input.readableBytes() == 0);
+    g_msgptr.reset();
+
+    // a flipped bit in the middle is caught
+    const_cast<char*>(stream.peek())[1024 * 1024] ^= 1;
+    for (size_t sent = 0; sent < stream.readableBytes() - small.readableBytes(); sent += 4096)
+    {
+      input.append(stream.peek() + sent, std::min<size_t>(4096, stream.readableBytes() - small.readableBytes() - sent));
+      codec.onMessage(TcpConnectionPtr(), &input, Timestamp::now());
+    }
+    assert(!g_msgptr);
+  }
+  }
+
+  {
+  Logger::setLogLevel(Logger::kWARN);
+  ThreadPool pool;
+  pool.start(2);
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  {
+  // frames in the pool stay in order, small ones after a big one wait,
+  // and so do the replies
+  Fixture fixture(serverLoop, clientLoop, &pool);
+  const size_t sizes[] = { 10, 3 * 1024 * 1024, 10, 10, 4096, 10, 2 * 1024 * 1024, 10 };
+  const int kFrames = sizeof sizes / sizeof sizes[0];
+  Buffer frames;
+  for (int i = 0; i < kFrames; ++i)
+  {
+    appendRequest(&frames, fixture.codec(), i, sizes[i]);
+  }
+  CountDownLatch handled(kFrames);
+  CountDownLatch replied(kFrames);
+  fixture.expect(&handled, &replied);
+  fixture.runInServer(boost::bind(feed, fixture.codec(), &frames, _1));
+  handled.wait();
+  replied.wait();
+  assert(inOrder(fixture.requests(), kFrames));
+  assert(inOrder(fixture.responses(), kFrames));
+  }
+  {
+  // the reply to a small frame doesn't overtake the one to a big frame
+  // which the pool has sent but the loop not yet written
+  Fixture fixture(serverLoop, clientLoop, &pool);
+  CountDownLatch handled(2);
+  CountDownLatch replied(2);
+  fixture.expect(&handled, &replied);
+  fixture.runInServer(boost::bind(feedBigThenSmall, fixture.codec(), &handled, _1));
+  handled.wait();
+  replied.wait();
+  assert(inOrder(fixture.requests(), 2));
+  assert(inOrder(fixture.responses(), 2));
+  }
+  pool.stop();
+  }
+
   google::protobuf::ShutdownProtobufLibrary();
 }
@@ -0,0 +1,153 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcDispatcher.h>
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadPool.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/service.h>
+
+#include <deque>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+struct RpcDispatcher::Limit : boost::noncopyable
+{
+  Limit(int maxRunning, int maxWaitingCalls)
+    : max(maxRunning),
+      maxWaiting(maxWaitingCalls),
+      running(0)
+  {
+  }
+
+  const int max;
+  const size_t maxWaiting;
+  MutexLock mutex;
+  int running;                // @GuardedBy mutex
+  std::deque<Task> waiting;   // @GuardedBy mutex
+};
+
+RpcDispatcher::RpcDispatcher()
+  : pool_(NULL)
+{
+}
+
+RpcDispatcher::~RpcDispatcher()
+{
+}
+
+void RpcDispatcher::registerService(google::protobuf::Service* service,
+                                    int maxConcurrency,
+                                    int maxWaiting)
+{
+  assert(maxConcurrency >= 0);
+  assert(maxWaiting >= 0);
+  const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
+  if (desc->method_count() == 0)
+  {
+    return;
+  }
+  Limit* limit = NULL;
+  if (maxConcurrency > 0)
+  {
+    limit = new Limit(maxConcurrency, maxWaiting);
+    limits_.push_back(limit);
+  }
+  uint32_t first = static_cast<uint32_t>(methods_.size() + 1);
+  services_[desc->name()] = first;
+  for (int i = 0; i < desc->method_count(); ++i)
+  {
+    Method method = { first + i, service, desc->method(i), limit };
+    methods_.push_back(method);
+  }
+}
+
+const RpcDispatcher::Method* RpcDispatcher::find(StringPiece service,
+                                                 StringPiece method,
+                                                 ErrorCode* error) const
+{
+  std::map<std::string, uint32_t>::const_iterator it =
+      services_.find(std::string(service.data(), service.size()));
+  if (it == services_.end())
+  {
+    *error = NO_SERVICE;
+    return NULL;
+  }
+  const Method& first = methods_[it->second - 1];
+  const google::protobuf::MethodDescriptor* desc =
+      first.descriptor->service()->FindMethodByName(std::string(method.data(), method.size()));
+  if (desc == NULL)
+  {
+    *error = NO_METHOD;
+    return NULL;
+  }
+  return &methods_[it->second - 1 + desc->index()];
+}
+
+const RpcDispatcher::Method* RpcDispatcher::find(uint32_t id) const
+{
+  return id > 0 && id <= methods_.size() ? &methods_[id - 1] : NULL;
+}
+
+bool RpcDispatcher::dispatch(const Method* method, const Task& task)
+{
+  if (pool_ == NULL)
+  {
+    task();
+    return true;
+  }
+  Limit* limit = method->limit;
+  if (limit)
+  {
+    MutexLockGuard lock(limit->mutex);
+    if (limit->running >= limit->max)
+    {
+      if (limit->waiting.size() >= limit->maxWaiting)
+      {
+        return false;
+      }
+      limit->waiting.push_back(task);
+      return true;
+    }
+    ++limit->running;
+  }
+  pool_->run(task);
+  return true;
+}
+
+void RpcDispatcher::done(const Method* method)
+{
+  Limit* limit = method->limit;
+  if (pool_ == NULL || limit == NULL)
+  {
+    return;
+  }
+  // the slot goes to the next call, if any
+  Task next;
+  {
+  MutexLockGuard lock(limit->mutex);
+  if (limit->waiting.empty())
+  {
+    --limit->running;
+  }
+  else
+  {
+    next.swap(limit->waiting.front());
+    limit->waiting.pop_front();
+  }
+  }
+  if (next)
+  {
+    pool_->run(next);
+  }
+}
@@ -0,0 +1,97 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_PROTORPC_RPCDISPATCHER_H
+#define MUDUO_NET_PROTORPC_RPCDISPATCHER_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <map>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+
+class MethodDescriptor;
+class Service;
+
+}  // namespace protobuf
+}  // namespace google
+
+namespace muduo
+{
+
+class ThreadPool;
+
+namespace net
+{
+
+// The services of an RpcServer, shared by its channels.  Each method has
+// a numeric id, its index in a flat table plus one, so a request by id is
+// one array lookup rather than two by name.  With a thread pool, service
+// methods run there, at most a given number per service at once, and at
+// most so many more waiting for them.
+//
+// Services are registered before serving, after that it is thread safe.
+class RpcDispatcher : boost::noncopyable
+{
+ public:
+  typedef boost::function<void ()> Task;
+
+  struct Limit;
+
+  struct Method
+  {
+    uint32_t id;
+    ::google::protobuf::Service* service;
+    const ::google::protobuf::MethodDescriptor* descriptor;
+    Limit* limit;  // of the service, NULL for none
+  };
+
+  RpcDispatcher();
+  ~RpcDispatcher();
+
+  // maxConcurrency and maxWaiting are for the pool, maxConcurrency 0 for
+  // no limit
+  void registerService(::google::protobuf::Service* service,
+                       int maxConcurrency,
+                       int maxWaiting);
+
+  void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+  bool pooled() const { return pool_ != NULL; }
+
+  // NULL with error set if there is no such service or method
+  const Method* find(StringPiece service, StringPiece method, ErrorCode* error) const;
+  const Method* find(uint32_t id) const;
+
+  // Runs the call of method in the pool, or queues it while the service
+  // has as many calls running as it may.  Without a pool it runs now.
+  // False, and task not run, if the queue of the service is full.
+  bool dispatch(const Method* method, const Task& task);
+
+  // A call of method is done, the next one queued, if any, goes to the pool.
+  void done(const Method* method);
+
+ private:
+  ThreadPool* pool_;
+  std::map<std::string, uint32_t> services_;  // name to the id of the first method
+  std::vector<Method> methods_;
+  boost::ptr_vector<Limit> limits_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCDISPATCHER_H
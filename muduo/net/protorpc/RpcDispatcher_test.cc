@@ -0,0 +1,423 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcDispatcher.h>
+#include <muduo/net/protorpc/RpcChannelPool.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <google/protobuf/descriptor.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <set>
+#include <vector>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18100;
+
+// counts the calls of each method, and holds those of listRpc if asked to
+class CountService : public RpcService
+{
+ public:
+  CountService()
+    : hold_(false),
+      listCalls_(0),
+      getCalls_(0)
+  {
+  }
+
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    {
+    MutexLockGuard lock(mutex_);
+    ++listCalls_;
+    threads_.insert(CurrentThread::tid());
+    if (hold_)
+    {
+      held_.push_back(done);
+      return;
+    }
+    }
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    {
+    MutexLockGuard lock(mutex_);
+    ++getCalls_;
+    }
+    done->Run();
+  }
+
+  void setHold(bool on)
+  {
+    MutexLockGuard lock(mutex_);
+    hold_ = on;
+  }
+
+  int held()
+  {
+    MutexLockGuard lock(mutex_);
+    return static_cast<int>(held_.size());
+  }
+
+  // runs those held so far, those they let in may be held in turn
+  void release()
+  {
+    std::vector< ::google::protobuf::Closure*> held;
+    {
+    MutexLockGuard lock(mutex_);
+    held.swap(held_);
+    }
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+      held[i]->Run();
+    }
+  }
+
+  int listCalls()
+  {
+    MutexLockGuard lock(mutex_);
+    return listCalls_;
+  }
+
+  int getCalls()
+  {
+    MutexLockGuard lock(mutex_);
+    return getCalls_;
+  }
+
+  std::set<int> threads()
+  {
+    MutexLockGuard lock(mutex_);
+    return threads_;
+  }
+
+ private:
+  MutexLock mutex_;
+  bool hold_;
+  int listCalls_;
+  int getCalls_;
+  std::set<int> threads_;
+  std::vector< ::google::protobuf::Closure*> held_;
+};
+
+class Controller : public ::google::protobuf::RpcController
+{
+ public:
+  virtual void Reset() { reason_.clear(); }
+  virtual bool Failed() const { return !reason_.empty(); }
+  virtual std::string ErrorText() const { return reason_; }
+  virtual void StartCancel() { }
+  virtual void SetFailed(const std::string& reason) { reason_ = reason; }
+  virtual bool IsCanceled() const { return false; }
+  virtual void NotifyOnCancel(::google::protobuf::Closure* callback) { }
+
+ private:
+  std::string reason_;
+};
+
+void runAndCountDown(const boost::function<void ()>& f, CountDownLatch* latch)
+{
+  f();
+  latch->countDown();
+}
+
+void runInLoop(EventLoop* loop, const boost::function<void ()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, f, &latch));
+  latch.wait();
+}
+
+template<typename PRED>
+void waitFor(PRED pred)
+{
+  for (int i = 0; i < 5000 && !pred(); ++i)
+  {
+    CurrentThread::sleepUsec(1000);
+  }
+  assert(pred());
+}
+
+bool atLeast(AtomicInt32* n, int value)
+{
+  return n->get() >= value;
+}
+
+bool held(CountService* service, int n)
+{
+  return service->held() == n;
+}
+
+bool pending(CountDownLatch* latch, int n)
+{
+  return latch->getCount() == n;
+}
+
+void noop()
+{
+}
+
+void getTid(int* tid)
+{
+  *tid = CurrentThread::tid();
+}
+
+void testFind()
+{
+  CountService service;
+  RpcDispatcher dispatcher;
+  dispatcher.registerService(&service, 0, 0);
+  const std::string name = service.GetDescriptor()->name();
+
+  ErrorCode error = NO_ERROR;
+  const RpcDispatcher::Method* list = dispatcher.find(name, "listRpc", &error);
+  const RpcDispatcher::Method* get = dispatcher.find(name, "getService", &error);
+  assert(list != NULL && get != NULL);
+  assert(list->service == &service);
+  assert(list->descriptor->name() == "listRpc");
+  assert(get->descriptor->name() == "getService");
+  assert(list->limit == NULL);
+  // ids from 1, in the order of the service
+  assert(list->id == static_cast<uint32_t>(list->descriptor->index()) + 1);
+  assert(get->id == static_cast<uint32_t>(get->descriptor->index()) + 1);
+  assert(dispatcher.find(list->id) == list);
+  assert(dispatcher.find(get->id) == get);
+  assert(dispatcher.find(0) == NULL);
+  assert(dispatcher.find(3) == NULL);
+
+  assert(dispatcher.find(name, "noMethod", &error) == NULL);
+  assert(error == NO_METHOD);
+  assert(dispatcher.find("NoService", "listRpc", &error) == NULL);
+  assert(error == NO_SERVICE);
+
+  // without a pool calls run right away
+  assert(!dispatcher.pooled());
+  AtomicInt32 ran;
+  assert(dispatcher.dispatch(list, boost::bind(&AtomicInt32::increment, &ran)));
+  assert(ran.get() == 1);
+}
+
+struct Gate
+{
+  Gate() : open(1) { }
+
+  CountDownLatch open;
+  AtomicInt32 started;
+  AtomicInt32 finished;
+};
+
+void gatedCall(RpcDispatcher* dispatcher, const RpcDispatcher::Method* method, Gate* gate)
+{
+  gate->started.increment();
+  gate->open.wait();
+  gate->finished.increment();
+  dispatcher->done(method);
+}
+
+void testLimit()
+{
+  const int kConcurrency = 2;
+  const int kWaiting = 3;
+  CountService service;
+  ThreadPool pool("RpcDispatcherTest");
+  pool.start(kConcurrency + kWaiting);
+  RpcDispatcher dispatcher;
+  dispatcher.setThreadPool(&pool);
+  dispatcher.registerService(&service, kConcurrency, kWaiting);
+  assert(dispatcher.pooled());
+  ErrorCode error = NO_ERROR;
+  const RpcDispatcher::Method* list =
+      dispatcher.find(service.GetDescriptor()->name(), "listRpc", &error);
+  assert(list->limit != NULL);
+
+  Gate gate;
+  for (int i = 0; i < kConcurrency + kWaiting; ++i)
+  {
+    assert(dispatcher.dispatch(list, boost::bind(gatedCall, &dispatcher, list, &gate)));
+  }
+  // the pool has threads for all, the others wait in the queue of the service
+  waitFor(boost::bind(atLeast, &gate.started, kConcurrency));
+  CurrentThread::sleepUsec(10 * 1000);
+  assert(gate.started.get() == kConcurrency);
+  // the queue is full
+  assert(!dispatcher.dispatch(list, boost::bind(gatedCall, &dispatcher, list, &gate)));
+
+  gate.open.countDown();
+  waitFor(boost::bind(atLeast, &gate.finished, kConcurrency + kWaiting));
+  assert(gate.started.get() == kConcurrency + kWaiting);
+  // room again
+  assert(dispatcher.dispatch(list, boost::bind(gatedCall, &dispatcher, list, &gate)));
+  waitFor(boost::bind(atLeast, &gate.finished, kConcurrency + kWaiting + 1));
+  pool.stop();
+}
+
+struct Result
+{
+  Controller controller;
+  ::google::protobuf::Message* response;  // the channel deletes it after done
+  bool done;
+};
+
+void onResponse(Result* result, CountDownLatch* latch)
+{
+  result->done = true;
+  latch->countDown();
+}
+
+void startServer(boost::scoped_ptr<RpcServer>* server, EventLoop* loop,
+                 ThreadPool* pool, CountService* service, int maxConcurrency, int maxWaiting)
+{
+  server->reset(new RpcServer(loop, InetAddress(AF_INET, kPort, true)));
+  (*server)->setServiceThreadPool(pool);
+  (*server)->registerService(service, maxConcurrency, maxWaiting);
+  (*server)->start();
+}
+
+void stopServer(boost::scoped_ptr<RpcServer>* server)
+{
+  server->reset();
+}
+
+void listRpc(RpcService::Stub* stub, Result* result, CountDownLatch* latch)
+{
+  ListRpcRequest request;
+  result->response = new ListRpcResponse;
+  result->done = false;
+  stub->listRpc(&result->controller, &request, static_cast<ListRpcResponse*>(result->response),
+                ::google::protobuf::NewCallback(onResponse, result, latch));
+}
+
+void getService(RpcService::Stub* stub, Result* result, CountDownLatch* latch)
+{
+  GetServiceRequest request;
+  request.set_service_name("RpcService");
+  result->response = new GetServiceResponse;
+  result->done = false;
+  stub->getService(&result->controller, &request, static_cast<GetServiceResponse*>(result->response),
+                   ::google::protobuf::NewCallback(onResponse, result, latch));
+}
+
+bool connected(RpcChannelPool* pool)
+{
+  return pool->connectedCount() == 1;
+}
+
+// over a connection, methods by id, served in the pool, the rest overloaded
+void testServer()
+{
+  const int kConcurrency = 2;
+  const int kWaiting = 1;
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  ThreadPool threadPool("RpcDispatcherTest");
+  threadPool.start(4);
+  CountService service;
+  boost::scoped_ptr<RpcServer> server;
+  runInLoop(serverLoop, boost::bind(startServer, &server, serverLoop, &threadPool,
+                                    &service, kConcurrency, kWaiting));
+  {
+  std::vector<InetAddress> addrs(1, InetAddress(AF_INET, kPort, true));
+  RpcChannelPool pool(clientLoop, addrs, "RpcDispatcherTest");
+  pool.setMethodIds(true);
+  runInLoop(clientLoop, boost::bind(&RpcChannelPool::start, &pool));
+  waitFor(boost::bind(connected, &pool));
+  RpcService::Stub stub(&pool);
+
+  {
+  // by name the first time, the response tells the id, by id after that
+  const int kRounds = 3;
+  for (int i = 0; i < kRounds; ++i)
+  {
+    CountDownLatch latch(2);
+    Result list;
+    Result get;
+    listRpc(&stub, &list, &latch);
+    getService(&stub, &get, &latch);
+    latch.wait();
+    assert(!list.controller.Failed() && !get.controller.Failed());
+    assert(service.listCalls() == i + 1);
+    assert(service.getCalls() == i + 1);
+  }
+  // in the pool, not in the loop
+  int loopThread = 0;
+  runInLoop(serverLoop, boost::bind(getTid, &loopThread));
+  std::set<int> threads = service.threads();
+  assert(!threads.empty());
+  assert(threads.count(loopThread) == 0);
+  }
+
+  {
+  // as many running as may, as many waiting, those after fail
+  service.setHold(true);
+  const int kCalls = kConcurrency + kWaiting + 2;
+  CountDownLatch latch(kCalls);
+  Result results[kCalls];
+  for (int i = 0; i < kCalls; ++i)
+  {
+    listRpc(&stub, &results[i], &latch);
+  }
+  waitFor(boost::bind(held, &service, kConcurrency));
+  waitFor(boost::bind(pending, &latch, kConcurrency + kWaiting));
+  service.setHold(false);
+  int overloaded = 0;
+  for (int i = 0; i < kCalls; ++i)
+  {
+    if (results[i].done)
+    {
+      assert(results[i].controller.ErrorText() == "OVERLOADED");
+      ++overloaded;
+    }
+  }
+  assert(overloaded == kCalls - kConcurrency - kWaiting);
+  service.release();
+  latch.wait();
+  for (int i = 0; i < kCalls; ++i)
+  {
+    assert(results[i].done);
+  }
+  assert(service.listCalls() == 3 + kConcurrency + kWaiting);
+  }
+  }
+  runInLoop(serverLoop, boost::bind(stopServer, &server));
+  threadPool.stop();
+  // connections closed for good before the loops go
+  for (int i = 0; i < 2; ++i)
+  {
+    runInLoop(serverLoop, noop);
+    runInLoop(clientLoop, noop);
+  }
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::kWARN);
+  testFind();
+  testLimit();
+  testServer();
+  printf("All pass\n");
+}
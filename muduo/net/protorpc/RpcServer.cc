@@ -10,6 +10,7 @@
 
 #include <muduo/base/Logging.h>
 #include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcDispatcher.h>
 
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/service.h>
@@ -21,7 +22,12 @@ using namespace muduo::net;
 
 RpcServer::RpcServer(EventLoop* loop,
                      const InetAddress& listenAddr)
-  : server_(loop, listenAddr, "RpcServer")
+  : server_(loop, listenAddr, "RpcServer"),
+    dispatcher_(new RpcDispatcher),
+    allowNoChecksum_(false),
+    batchResponses_(false),
+    pool_(NULL),
+    poolThreshold_(0)
 {
   server_.setConnectionCallback(
       boost::bind(&RpcServer::onConnection, this, _1));
@@ -29,10 +35,20 @@ RpcServer::RpcServer(EventLoop* loop,
 //       boost::bind(&RpcServer::onMessage, this, _1, _2, _3));
 }
 
-void RpcServer::registerService(google::protobuf::Service* service)
+RpcServer::~RpcServer()
 {
-  const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
-  services_[desc->name()] = service;
+}
+
+void RpcServer::setServiceThreadPool(ThreadPool* pool)
+{
+  dispatcher_->setThreadPool(pool);
+}
+
+void RpcServer::registerService(google::protobuf::Service* service,
+                                int maxConcurrency,
+                                int maxWaiting)
+{
+  dispatcher_->registerService(service, maxConcurrency, maxWaiting);
 }
 
 void RpcServer::start()
@@ -48,7 +64,13 @@ void RpcServer::onConnection(const TcpConnectionPtr& conn)
   if (conn->connected())
   {
     RpcChannelPtr channel(new RpcChannel(conn));
-    channel->setServices(&services_);
+    channel->setDispatcher(get_pointer(dispatcher_));
+    channel->setAllowNoChecksum(allowNoChecksum_);
+    channel->setBatchResponses(batchResponses_);
+    if (pool_)
+    {
+      channel->setThreadPool(pool_, poolThreshold_);
+    }
     conn->setMessageCallback(
         boost::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
     conn->setContext(channel);
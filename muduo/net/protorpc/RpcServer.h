@@ -13,6 +13,8 @@
 
 #include <muduo/net/TcpServer.h>
 
+#include <boost/scoped_ptr.hpp>
+
 namespace google {
 namespace protobuf {
 
@@ -23,21 +25,58 @@ class Service;
 
 namespace muduo
 {
+
+class ThreadPool;
+
 namespace net
 {
 
+class RpcDispatcher;
+
 class RpcServer
 {
  public:
   RpcServer(EventLoop* loop,
             const InetAddress& listenAddr);
+  ~RpcServer();  // force out-line dtor, for scoped_ptr members.
 
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
   }
 
-  void registerService(::google::protobuf::Service*);
+  // Frames without a checksum are taken from clients, for trusted links.
+  void setAllowNoChecksum(bool on)
+  {
+    allowNoChecksum_ = on;
+  }
+
+  // See RpcChannel::setBatchResponses().
+  void setBatchResponses(bool on)
+  {
+    batchResponses_ = on;
+  }
+
+  // Big requests are parsed and served in the pool, see
+  // RpcChannel::setThreadPool().
+  void setThreadPool(ThreadPool* pool, int bytes)
+  {
+    pool_ = pool;
+    poolThreshold_ = bytes;
+  }
+
+  // Service methods run in the pool rather than in the loop of the
+  // connection, for methods which block or take long.  The pool must not
+  // bound its queue.  Set it before start().
+  void setServiceThreadPool(ThreadPool* pool);
+
+  // With a service thread pool, at most maxConcurrency calls of the service
+  // run at once, until their done closures run, and at most maxWaiting
+  // others wait for them.  Calls beyond fail with OVERLOADED.
+  // maxConcurrency 0 is no limit.
+  void registerService(::google::protobuf::Service*,
+                       int maxConcurrency = 0,
+                       int maxWaiting = 1024);
   void start();
 
  private:
@@ -48,7 +87,11 @@ class RpcServer
   //                Timestamp time);
 
   TcpServer server_;
-  std::map<std::string, ::google::protobuf::Service*> services_;
+  boost::scoped_ptr<RpcDispatcher> dispatcher_;
+  bool allowNoChecksum_;
+  bool batchResponses_;
+  ThreadPool* pool_;
+  int poolThreshold_;
 };
 
 }
@@ -0,0 +1,279 @@
+// Small calls per second of RpcServer: methods by name and by their ids,
+// run in the loop of the connection and in a thread pool, with and
+// without a limit on the calls of the service at once.  One connection
+// with a number of calls in flight.  Also the lookup of a method alone,
+// by name and by id.
+//
+// Usage: protobuf_rpc_server_bench [seconds] [pool threads] [in flight]
+
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcDispatcher.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <google/protobuf/descriptor.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18087;
+
+class EchoService : public RpcService
+{
+ public:
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    response->add_service_name(request->service_name());
+    done->Run();
+  }
+
+  virtual void getService(::google::protobuf::RpcController* controller,
+                          const GetServiceRequest* request,
+                          GetServiceResponse* response,
+                          ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_SERVICE);
+    done->Run();
+  }
+};
+
+class Bench : boost::noncopyable
+{
+ public:
+  Bench(EventLoop* serverLoop, EventLoop* clientLoop,
+        ThreadPool* pool, int maxConcurrency, bool methodIds)
+    : serverLoop_(serverLoop),
+      clientLoop_(clientLoop),
+      connected_(1),
+      disconnected_(1),
+      running_(false)
+  {
+    request_.set_service_name("hello");
+    serverLoop_->runInLoop(boost::bind(&Bench::startServer, this, pool, maxConcurrency));
+    sync(serverLoop_);
+    clientLoop_->runInLoop(boost::bind(&Bench::connect, this, methodIds));
+    connected_.wait();
+  }
+
+  ~Bench()
+  {
+    clientLoop_->runInLoop(boost::bind(&TcpClient::disconnect, client_.get()));
+    disconnected_.wait();
+    CountDownLatch stopped(2);
+    clientLoop_->runInLoop(boost::bind(&Bench::stopClient, this, &stopped));
+    serverLoop_->runInLoop(boost::bind(&Bench::stopServer, this, &stopped));
+    stopped.wait();
+  }
+
+  // calls per second
+  double run(double seconds, int inFlight)
+  {
+    completed_.getAndSet(0);
+    outstanding_.getAndSet(inFlight);
+    running_ = true;
+    clientLoop_->runInLoop(boost::bind(&Bench::startRun, this, inFlight));
+    CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1e6));
+    int64_t completed = completed_.get();
+    running_ = false;
+    while (outstanding_.get() > 0)
+    {
+      CurrentThread::sleepUsec(1000);
+    }
+    return static_cast<double>(completed) / seconds;
+  }
+
+ private:
+  static void sync(EventLoop* loop)
+  {
+    CountDownLatch latch(1);
+    loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+    latch.wait();
+  }
+
+  void startServer(ThreadPool* pool, int maxConcurrency)
+  {
+    server_.reset(new RpcServer(serverLoop_, InetAddress(AF_INET, kPort, true)));
+    if (pool)
+    {
+      server_->setServiceThreadPool(pool);
+    }
+    server_->registerService(&service_, maxConcurrency);
+    server_->start();
+  }
+
+  void connect(bool methodIds)
+  {
+    client_.reset(new TcpClient(clientLoop_, InetAddress(AF_INET, kPort, true), "RpcServerBench"));
+    client_->setConnectionCallback(boost::bind(&Bench::onConnection, this, methodIds, _1));
+    client_->connect();
+  }
+
+  void stopClient(CountDownLatch* stopped)
+  {
+    stub_.reset();
+    channel_.reset();
+    client_.reset();
+    stopped->countDown();
+  }
+
+  void stopServer(CountDownLatch* stopped)
+  {
+    server_.reset();
+    stopped->countDown();
+  }
+
+  void onConnection(bool methodIds, const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_.reset(new RpcChannel(conn));
+      channel_->setMethodIds(methodIds);
+      conn->setMessageCallback(
+          boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+      stub_.reset(new RpcService::Stub(get_pointer(channel_)));
+      connected_.countDown();
+    }
+    else
+    {
+      disconnected_.countDown();
+    }
+  }
+
+  // in the client loop from here on
+  void startRun(int inFlight)
+  {
+    for (int i = 0; i < inFlight; ++i)
+    {
+      call();
+    }
+  }
+
+  void call()
+  {
+    // the channel deletes the response after done
+    ListRpcResponse* response = new ListRpcResponse;
+    stub_->listRpc(NULL, &request_, response,
+                   ::google::protobuf::NewCallback(this, &Bench::onResponse));
+  }
+
+  void onResponse()
+  {
+    completed_.increment();
+    if (running_)
+    {
+      call();
+    }
+    else
+    {
+      outstanding_.decrement();
+    }
+  }
+
+  EventLoop* serverLoop_;
+  EventLoop* clientLoop_;
+  EchoService service_;
+  boost::scoped_ptr<RpcServer> server_;
+  boost::scoped_ptr<TcpClient> client_;
+  RpcChannelPtr channel_;
+  boost::scoped_ptr<RpcService::Stub> stub_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+
+  ListRpcRequest request_;
+  volatile bool running_;
+  AtomicInt64 completed_;
+  AtomicInt32 outstanding_;
+};
+
+// nanoseconds per lookup of a method, by name and by id
+void lookups(int n)
+{
+  EchoService service;
+  RpcDispatcher dispatcher;
+  dispatcher.registerService(&service, 0, 0);
+  const google::protobuf::MethodDescriptor* method = service.GetDescriptor()->FindMethodByName("listRpc");
+  // as they come in a frame
+  std::string serviceName = method->service()->name();
+  std::string methodName = method->name();
+  ErrorCode error = NO_ERROR;
+  uint32_t id = dispatcher.find(serviceName, methodName, &error)->id;
+
+  int64_t found = 0;
+  Timestamp start = Timestamp::now();
+  for (int i = 0; i < n; ++i)
+  {
+    found += dispatcher.find(serviceName, methodName, &error)->id;
+  }
+  double byName = timeDifference(Timestamp::now(), start) * 1e9 / n;
+
+  start = Timestamp::now();
+  for (int i = 0; i < n; ++i)
+  {
+    found += dispatcher.find(id)->id;
+  }
+  double byId = timeDifference(Timestamp::now(), start) * 1e9 / n;
+  printf("lookup by name %6.1f ns   by id %6.1f ns   (%lld)\n",
+         byName, byId, static_cast<long long>(found));
+}
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int poolThreads = argc > 2 ? atoi(argv[2]) : 4;
+  int inFlight = argc > 3 ? atoi(argv[3]) : 64;
+  Logger::setLogLevel(Logger::kWARN);
+
+  lookups(10 * 1000 * 1000);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  ThreadPool pool("RpcServerBench");
+  pool.start(poolThreads);
+  printf("%d calls in flight, %d pool threads\n", inFlight, poolThreads);
+
+  struct Case
+  {
+    const char* name;
+    bool pooled;
+    int maxConcurrency;
+    bool methodIds;
+  };
+  const Case kCases[] =
+  {
+    { "by name, in loop", false, 0, false },
+    { "by id, in loop", false, 0, true },
+    { "by id, in pool", true, 0, true },
+    { "by id, in pool, 2 at once", true, 2, true },
+  };
+  for (size_t i = 0; i < sizeof kCases / sizeof kCases[0]; ++i)
+  {
+    const Case& c = kCases[i];
+    Bench bench(serverLoop, clientLoop, c.pooled ? &pool : NULL, c.maxConcurrency, c.methodIds);
+    bench.run(0.2, inFlight);  // warms up, and learns the method id
+    printf("%-28s %9.0f calls/s\n", c.name, bench.run(seconds, inFlight));
+  }
+
+  pool.stop();
+  google::protobuf::ShutdownProtobufLibrary();
+}
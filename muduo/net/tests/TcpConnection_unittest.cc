@@ -0,0 +1,164 @@
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+
+#include <boost/bind.hpp>
+
+//#define BOOST_TEST_MODULE TcpConnectionTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::Timestamp;
+using muduo::net::Buffer;
+using muduo::net::EventLoop;
+using muduo::net::InetAddress;
+using muduo::net::TcpClient;
+using muduo::net::TcpConnectionPtr;
+using muduo::net::TcpServer;
+
+const uint16_t kPort = 18092;
+
+// far more than the socket buffers take at once
+const size_t kLargeFrame = 16 * 1024 * 1024;
+const int kSmallFrames = 100;
+
+// every byte of the stream from its offset
+char streamByte(size_t offset)
+{
+  return static_cast<char>(offset % 251);
+}
+
+class Sender
+{
+ public:
+  Sender()
+    : sent_(0),
+      partial_(false)
+  {
+  }
+
+  size_t sent() const { return sent_; }
+  bool partial() const { return partial_; }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (!conn->connected())
+    {
+      return;
+    }
+    // any bytes left to uv_write() once commitOutput() returns
+    conn->setHighWaterMarkCallback(boost::bind(&Sender::onHighWaterMark, this), 1);
+    commit(conn, kLargeFrame);
+    // while the large one is being written
+    for (int i = 0; i < kSmallFrames; ++i)
+    {
+      commit(conn, 1 + i * 97);
+    }
+    string message(1000, '\0');
+    for (size_t i = 0; i < message.size(); ++i)
+    {
+      message[i] = streamByte(sent_ + i);
+    }
+    conn->send(message);
+    sent_ += message.size();
+    commit(conn, kLargeFrame / 16);
+  }
+
+ private:
+  // a few bytes more reserved than used
+  void commit(const TcpConnectionPtr& conn, size_t len)
+  {
+    char* start = conn->reserveOutput(len + 64);
+    BOOST_REQUIRE(start != NULL);
+    for (size_t i = 0; i < len; ++i)
+    {
+      start[i] = streamByte(sent_ + i);
+    }
+    conn->commitOutput(len);
+    sent_ += len;
+  }
+
+  void onHighWaterMark()
+  {
+    partial_ = true;
+  }
+
+  size_t sent_;
+  bool partial_;
+};
+
+class Receiver
+{
+ public:
+  Receiver(EventLoop* loop, const Sender* sender)
+    : loop_(loop),
+      sender_(sender),
+      received_(0),
+      mismatch_(false)
+  {
+  }
+
+  size_t received() const { return received_; }
+  bool mismatch() const { return mismatch_; }
+
+  // done once both ends are closed
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (!conn->connected())
+    {
+      loop_->queueInLoop(boost::bind(&EventLoop::quit, loop_));
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+  {
+    const char* data = buf->peek();
+    for (size_t i = 0; i < buf->readableBytes() && !mismatch_; ++i)
+    {
+      mismatch_ = data[i] != streamByte(received_ + i);
+    }
+    received_ += buf->readableBytes();
+    buf->retrieveAll();
+    if (mismatch_ || (sender_->sent() > 0 && received_ >= sender_->sent()))
+    {
+      conn->shutdown();
+    }
+  }
+
+ private:
+  EventLoop* loop_;
+  const Sender* sender_;
+  size_t received_;
+  bool mismatch_;
+};
+
+BOOST_AUTO_TEST_CASE(testCommitOutputAcrossPartialWrite)
+{
+  EventLoop loop;
+  InetAddress addr(AF_INET, kPort, true);
+  Sender sender;
+  Receiver receiver(&loop, &sender);
+
+  TcpServer server(&loop, addr, "TcpConnectionTest");
+  server.setConnectionCallback(boost::bind(&Sender::onConnection, &sender, _1));
+  server.start();
+
+  TcpClient client(&loop, addr, "TcpConnectionTest");
+  client.setConnectionCallback(boost::bind(&Receiver::onConnection, &receiver, _1));
+  client.setMessageCallback(boost::bind(&Receiver::onMessage, &receiver, _1, _2, _3));
+  client.connect();
+
+  loop.runAfter(30.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK(sender.partial());
+  BOOST_CHECK(!receiver.mismatch());
+  BOOST_CHECK_EQUAL(receiver.received(), sender.sent());
+  BOOST_CHECK_EQUAL(sender.sent(), kLargeFrame + kLargeFrame / 16 + 1000 +
+                    static_cast<size_t>(kSmallFrames) + 97 * kSmallFrames * (kSmallFrames - 1) / 2);
+}
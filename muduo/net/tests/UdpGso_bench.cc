@@ -0,0 +1,313 @@
+// A stream of datagrams over loopback: one by one, batched with
+// recvmmsg/sendmmsg, and with segmentation and receive offload, UDP_SEGMENT
+// on the sender and UDP_GRO on the receiver.  The receiver acknowledges
+// every so many bytes, the sender keeps a window of bytes unacknowledged.
+// Datagrams per second and CPU seconds of the process per GB received.
+//
+// Usage: udpgso_bench [seconds] [datagram size] [window KiB]
+
+#include <muduo/net/UdpServer.h>
+#include <muduo/net/UdpSocket.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18090;
+const int64_t kAckBytes = 32 * 1024;
+const int kSegments = 64;  // datagrams per send with UDP_SEGMENT
+
+enum Mode
+{
+  kOneByOne,
+  kBatched,
+  kOffload,
+};
+
+void runAndCountDown(const boost::function<void ()>& f, CountDownLatch* latch)
+{
+  f();
+  latch->countDown();
+}
+
+void runInLoop(EventLoop* loop, const boost::function<void ()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, f, &latch));
+  latch.wait();
+}
+
+// seconds of CPU of the process, user and system
+double cpuTime()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+class Receiver : boost::noncopyable
+{
+ public:
+  Receiver(EventLoop* loop, Mode mode)
+    : loop_(loop),
+      bytes_(0),
+      datagrams_(0),
+      acked_(0),
+      coalesced_(0)
+  {
+    runInLoop(loop_, boost::bind(&Receiver::start, this, mode));
+  }
+
+  ~Receiver()
+  {
+    runInLoop(loop_, boost::bind(&Receiver::stop, this));
+  }
+
+  void counts(int64_t* bytes, int64_t* datagrams, int64_t* coalesced)
+  {
+    runInLoop(loop_, boost::bind(&Receiver::getCounts, this, bytes, datagrams, coalesced));
+  }
+
+ private:
+  void start(Mode mode)
+  {
+    server_.reset(new UdpServer(loop_, InetAddress(AF_INET, kPort, true), "UdpGsoBench"));
+    server_->setMessageCallback(
+        boost::bind(&Receiver::onMessage, this, _1, _2, _3, _4));
+    if (mode == kBatched)
+    {
+      server_->setBatching(64);
+      server_->setBatchMessageCallback(
+          boost::bind(&Receiver::onBatch, this, _1, _2, _3, _4));
+    }
+    else if (mode == kOffload)
+    {
+      server_->setGro(true);
+      server_->setSegmentMessageCallback(
+          boost::bind(&Receiver::onSegments, this, _1, _2, _3, _4, _5));
+    }
+    server_->start();
+  }
+
+  void stop()
+  {
+    server_->stop();
+    server_.reset();
+  }
+
+  void getCounts(int64_t* bytes, int64_t* datagrams, int64_t* coalesced)
+  {
+    *bytes = bytes_;
+    *datagrams = datagrams_;
+    *coalesced = coalesced_;
+  }
+
+  void onMessage(const UdpSocketPtr& socket, Buffer* buf, const InetAddress& src, Timestamp)
+  {
+    received(socket, src, buf->readableBytes(), 1);
+    buf->retrieveAll();
+  }
+
+  void onBatch(const UdpSocketPtr& socket, const UdpDatagram* datagrams, int count, Timestamp)
+  {
+    size_t bytes = 0;
+    for (int i = 0; i < count; ++i)
+    {
+      bytes += datagrams[i].data.size();
+    }
+    received(socket, datagrams[0].peerAddr, bytes, count);
+  }
+
+  void onSegments(const UdpSocketPtr& socket, Buffer* buf, size_t segmentSize,
+                  const InetAddress& src, Timestamp)
+  {
+    size_t bytes = buf->readableBytes();
+    int count = static_cast<int>((bytes + segmentSize - 1) / segmentSize);
+    if (count > 1)
+    {
+      ++coalesced_;
+    }
+    received(socket, src, bytes, count);
+    buf->retrieveAll();
+  }
+
+  void received(const UdpSocketPtr& socket, const InetAddress& src, size_t bytes, int count)
+  {
+    bytes_ += static_cast<int64_t>(bytes);
+    datagrams_ += count;
+    if (bytes_ - acked_ >= kAckBytes)
+    {
+      acked_ = bytes_;
+      socket->send(src, &acked_, static_cast<int>(sizeof acked_));
+    }
+  }
+
+  EventLoop* loop_;
+  boost::scoped_ptr<UdpServer> server_;
+  int64_t bytes_;
+  int64_t datagrams_;
+  int64_t acked_;
+  int64_t coalesced_;  // reads of more than one datagram
+};
+
+class Sender : boost::noncopyable
+{
+ public:
+  Sender(EventLoop* loop, Mode mode, int size, int64_t window)
+    : loop_(loop),
+      mode_(mode),
+      receiverAddr_(AF_INET, kPort, true),
+      size_(size),
+      chunk_(static_cast<size_t>(size * kSegments), 'x'),
+      window_(window),
+      sent_(0),
+      acked_(0),
+      lastAcked_(0),
+      running_(false)
+  {
+    runInLoop(loop_, boost::bind(&Sender::start, this));
+  }
+
+  ~Sender()
+  {
+    runInLoop(loop_, boost::bind(&Sender::stop, this));
+  }
+
+  void run(double seconds)
+  {
+    runInLoop(loop_, boost::bind(&Sender::begin, this));
+    CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1e6));
+    runInLoop(loop_, boost::bind(&Sender::end, this));
+  }
+
+ private:
+  void start()
+  {
+    socket_.reset(new UdpSocket(loop_, InetAddress(AF_INET, 0, true), false));
+    socket_->setMessageCallback(
+        boost::bind(&Sender::onAck, this, _1, _2, _3, _4));
+    if (mode_ == kBatched)
+    {
+      socket_->setBatching(64);
+    }
+    socket_->startRecv();
+    timer_ = loop_->runEvery(0.05, boost::bind(&Sender::onTimer, this));
+  }
+
+  void stop()
+  {
+    loop_->cancel(timer_);
+    socket_->stopRecv();
+    socket_.reset();
+  }
+
+  void begin()
+  {
+    running_ = true;
+    pump();
+  }
+
+  void end()
+  {
+    running_ = false;
+  }
+
+  void pump()
+  {
+    while (running_ && sent_ - acked_ < window_)
+    {
+      if (mode_ == kOffload)
+      {
+        socket_->sendSegments(receiverAddr_, chunk_, size_);
+      }
+      else
+      {
+        for (int i = 0; i < kSegments; ++i)
+        {
+          socket_->send(receiverAddr_, StringPiece(chunk_.data(), static_cast<int>(size_)));
+        }
+      }
+      sent_ += static_cast<int64_t>(chunk_.size());
+    }
+  }
+
+  void onAck(const UdpSocketPtr&, Buffer* buf, const InetAddress&, Timestamp)
+  {
+    if (buf->readableBytes() == sizeof acked_)
+    {
+      memcpy(&acked_, buf->peek(), sizeof acked_);
+    }
+    buf->retrieveAll();
+    pump();
+  }
+
+  // again those lost, no acknowledgement for a while
+  void onTimer()
+  {
+    if (running_ && acked_ == lastAcked_)
+    {
+      sent_ = acked_;
+      pump();
+    }
+    lastAcked_ = acked_;
+  }
+
+  EventLoop* loop_;
+  const Mode mode_;
+  const InetAddress receiverAddr_;
+  const size_t size_;
+  const string chunk_;
+  const int64_t window_;
+  UdpSocketPtr socket_;
+  TimerId timer_;
+  int64_t sent_;
+  int64_t acked_;       // bytes received, as the receiver tells
+  int64_t lastAcked_;
+  bool running_;
+};
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int size = argc > 2 ? atoi(argv[2]) : 1200;
+  int64_t window = (argc > 3 ? atoi(argv[3]) : 128) * 1024;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread receiverThread;
+  EventLoopThread senderThread;
+  EventLoop* receiverLoop = receiverThread.startLoop();
+  EventLoop* senderLoop = senderThread.startLoop();
+  printf("datagrams of %d bytes, window of %lld KiB\n", size, static_cast<long long>(window / 1024));
+
+  const char* kNames[] = { "one by one", "batched", "GSO/GRO" };
+  const Mode kModes[] = { kOneByOne, kBatched, kOffload };
+  for (size_t i = 0; i < sizeof kModes / sizeof kModes[0]; ++i)
+  {
+    Receiver receiver(receiverLoop, kModes[i]);
+    Sender sender(senderLoop, kModes[i], size, window);
+    double cpu = cpuTime();
+    sender.run(seconds);
+    cpu = cpuTime() - cpu;
+    int64_t bytes = 0;
+    int64_t datagrams = 0;
+    int64_t coalesced = 0;
+    receiver.counts(&bytes, &datagrams, &coalesced);
+    double gbytes = static_cast<double>(bytes) / 1e9;
+    printf("%-12s %9.0f datagrams/s  %6.2f Gbit/s  %6.2f CPU s per GB  (%lld reads coalesced)\n",
+           kNames[i], static_cast<double>(datagrams) / seconds, gbytes * 8 / seconds,
+           gbytes > 0 ? cpu / gbytes : 0.0, static_cast<long long>(coalesced));
+  }
+}
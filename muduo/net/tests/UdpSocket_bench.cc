@@ -0,0 +1,250 @@
+// Datagrams per second echoed over loopback by a UdpServer, one datagram
+// at a time and batched with recvmmsg/sendmmsg, the client batched alike.
+// The client keeps a number of datagrams in flight, topped up when some
+// are lost.
+//
+// Usage: udpsocket_bench [seconds] [in flight] [size] [batch]
+
+#include <muduo/net/UdpServer.h>
+#include <muduo/net/UdpSocket.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const uint16_t kPort = 18089;
+
+void runAndCountDown(const boost::function<void ()>& f, CountDownLatch* latch)
+{
+  f();
+  latch->countDown();
+}
+
+void runInLoop(EventLoop* loop, const boost::function<void ()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, f, &latch));
+  latch.wait();
+}
+
+// seconds of CPU of the process, user and system
+double cpuTime()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+class EchoServer : boost::noncopyable
+{
+ public:
+  EchoServer(EventLoop* loop, int batch)
+    : loop_(loop)
+  {
+    runInLoop(loop_, boost::bind(&EchoServer::start, this, batch));
+  }
+
+  ~EchoServer()
+  {
+    runInLoop(loop_, boost::bind(&EchoServer::stop, this));
+  }
+
+ private:
+  void start(int batch)
+  {
+    server_.reset(new UdpServer(loop_, InetAddress(AF_INET, kPort, true), "UdpSocketBench"));
+    server_->setMessageCallback(
+        boost::bind(&EchoServer::onMessage, this, _1, _2, _3, _4));
+    if (batch > 0)
+    {
+      server_->setBatching(batch);
+      server_->setBatchMessageCallback(
+          boost::bind(&EchoServer::onBatch, this, _1, _2, _3, _4));
+    }
+    server_->start();
+  }
+
+  void stop()
+  {
+    server_->stop();
+    server_.reset();
+  }
+
+  void onMessage(const UdpSocketPtr& socket, Buffer* buf, const InetAddress& src, Timestamp)
+  {
+    socket->send(src, buf);
+  }
+
+  void onBatch(const UdpSocketPtr& socket, const UdpDatagram* datagrams, int count, Timestamp)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      socket->send(datagrams[i].peerAddr, datagrams[i].data);
+    }
+  }
+
+  EventLoop* loop_;
+  boost::scoped_ptr<UdpServer> server_;
+};
+
+class Client : boost::noncopyable
+{
+ public:
+  Client(EventLoop* loop, int batch, int inFlight, int size)
+    : loop_(loop),
+      serverAddr_(AF_INET, kPort, true),
+      message_(size, 'x'),
+      inFlight_(inFlight),
+      outstanding_(0),
+      running_(false),
+      received_(0)
+  {
+    runInLoop(loop_, boost::bind(&Client::start, this, batch));
+  }
+
+  ~Client()
+  {
+    runInLoop(loop_, boost::bind(&Client::stop, this));
+  }
+
+  // datagrams echoed per second
+  double run(double seconds)
+  {
+    runInLoop(loop_, boost::bind(&Client::begin, this));
+    CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1e6));
+    int64_t received = 0;
+    runInLoop(loop_, boost::bind(&Client::end, this, &received));
+    // the last ones come back, or are lost
+    CurrentThread::sleepUsec(100 * 1000);
+    return static_cast<double>(received) / seconds;
+  }
+
+ private:
+  void start(int batch)
+  {
+    socket_.reset(new UdpSocket(loop_, InetAddress(AF_INET, 0, true), false));
+    socket_->setMessageCallback(
+        boost::bind(&Client::onMessage, this, _1, _2, _3, _4));
+    if (batch > 0)
+    {
+      socket_->setBatching(batch);
+      socket_->setBatchMessageCallback(
+          boost::bind(&Client::onBatch, this, _1, _2, _3, _4));
+    }
+    socket_->startRecv();
+    timer_ = loop_->runEvery(0.1, boost::bind(&Client::topUp, this));
+  }
+
+  void stop()
+  {
+    loop_->cancel(timer_);
+    socket_->stopRecv();
+    socket_.reset();
+  }
+
+  void begin()
+  {
+    running_ = true;
+    received_ = 0;
+    outstanding_ = 0;
+    topUp();
+  }
+
+  void end(int64_t* received)
+  {
+    running_ = false;
+    *received = received_;
+  }
+
+  // again those lost
+  void topUp()
+  {
+    while (running_ && outstanding_ < inFlight_)
+    {
+      send();
+    }
+    outstanding_ = 0;
+  }
+
+  void send()
+  {
+    ++outstanding_;
+    socket_->send(serverAddr_, message_);
+  }
+
+  void onEcho()
+  {
+    ++received_;
+    if (running_)
+    {
+      send();
+    }
+  }
+
+  void onMessage(const UdpSocketPtr&, Buffer* buf, const InetAddress&, Timestamp)
+  {
+    buf->retrieveAll();
+    onEcho();
+  }
+
+  void onBatch(const UdpSocketPtr&, const UdpDatagram*, int count, Timestamp)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      onEcho();
+    }
+  }
+
+  EventLoop* loop_;
+  const InetAddress serverAddr_;
+  const string message_;
+  const int inFlight_;
+  UdpSocketPtr socket_;
+  TimerId timer_;
+  int outstanding_;  // sent since the last top up
+  bool running_;
+  int64_t received_;
+};
+
+int main(int argc, char* argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int inFlight = argc > 2 ? atoi(argv[2]) : 256;
+  int size = argc > 3 ? atoi(argv[3]) : 64;
+  int batch = argc > 4 ? atoi(argv[4]) : 64;
+  Logger::setLogLevel(Logger::kWARN);
+
+  EventLoopThread serverThread;
+  EventLoopThread clientThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EventLoop* clientLoop = clientThread.startLoop();
+  printf("%d datagrams of %d bytes in flight, batches of %d\n", inFlight, size, batch);
+
+  const int kBatches[] = { 0, batch };
+  for (size_t i = 0; i < sizeof kBatches / sizeof kBatches[0]; ++i)
+  {
+    EchoServer server(serverLoop, kBatches[i]);
+    Client client(clientLoop, kBatches[i], inFlight, size);
+    client.run(0.2);
+    double cpu = cpuTime();
+    double pps = client.run(seconds);
+    cpu = cpuTime() - cpu;
+    // both ways, server and client
+    printf("%-12s %9.0f echoes/s   %6.2f us CPU per echo\n",
+           kBatches[i] > 0 ? "batched" : "one by one", pps,
+           cpu * 1e6 / (pps * seconds));
+  }
+}
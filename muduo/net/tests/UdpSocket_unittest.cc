@@ -0,0 +1,215 @@
+#include <muduo/net/UdpSocket.h>
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+
+//#define BOOST_TEST_MODULE UdpSocketTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::Timestamp;
+using muduo::net::Buffer;
+using muduo::net::EventLoop;
+using muduo::net::InetAddress;
+using muduo::net::UdpDatagram;
+using muduo::net::UdpSocket;
+using muduo::net::UdpSocketPtr;
+
+const uint16_t kPort = 18102;
+
+// the index of a datagram, then its size in all
+string datagram(int index, size_t size)
+{
+  char head[32];
+  snprintf(head, sizeof head, "%d:", index);
+  string message(head);
+  message.resize(size, static_cast<char>('a' + index % 26));
+  return message;
+}
+
+// the datagrams as they come, the loop quits once it has all it expects
+class Receiver
+{
+ public:
+  Receiver(EventLoop* loop, int expected)
+    : loop_(loop),
+      expected_(expected),
+      largestBatch_(0),
+      socket_(new UdpSocket(loop, InetAddress(AF_INET, kPort, true), true))
+  {
+  }
+
+  ~Receiver()
+  {
+    socket_->stopRecv();
+  }
+
+  const std::vector<string>& received() const { return received_; }
+  int largestBatch() const { return largestBatch_; }
+
+  void receiveOneByOne()
+  {
+    socket_->setMessageCallback(boost::bind(&Receiver::onMessage, this, _1, _2, _3, _4));
+    socket_->startRecv();
+  }
+
+  void receiveBatched(int maxDatagrams)
+  {
+    socket_->setMessageCallback(boost::bind(&Receiver::onMessage, this, _1, _2, _3, _4));
+    socket_->setBatching(maxDatagrams);
+    socket_->setBatchMessageCallback(boost::bind(&Receiver::onBatch, this, _1, _2, _3, _4));
+    socket_->startRecv();
+  }
+
+  // no segment message callback, false without UDP_GRO
+  bool receiveGro()
+  {
+    socket_->setMessageCallback(boost::bind(&Receiver::onMessage, this, _1, _2, _3, _4));
+    bool on = socket_->setGro(true);
+    socket_->startRecv();
+    return on;
+  }
+
+ private:
+  void onMessage(const UdpSocketPtr&, Buffer* buf, const InetAddress&, Timestamp)
+  {
+    largestBatch_ = std::max(largestBatch_, 1);
+    add(buf->retrieveAllAsString());
+  }
+
+  void onBatch(const UdpSocketPtr&, const UdpDatagram* datagrams, int count, Timestamp)
+  {
+    largestBatch_ = std::max(largestBatch_, count);
+    for (int i = 0; i < count; ++i)
+    {
+      add(datagrams[i].data.as_string());
+    }
+  }
+
+  void add(const string& message)
+  {
+    received_.push_back(message);
+    if (static_cast<int>(received_.size()) == expected_)
+    {
+      loop_->quit();
+    }
+  }
+
+  EventLoop* loop_;
+  const int expected_;
+  int largestBatch_;
+  UdpSocketPtr socket_;
+  std::vector<string> received_;
+};
+
+void onWriteComplete(std::vector<int>* ids, const UdpSocketPtr&, int messageId)
+{
+  ids->push_back(messageId);
+}
+
+// those waiting behind the one libuv reads come with it, in one batch
+BOOST_AUTO_TEST_CASE(testBatchReceive)
+{
+  const int kDatagrams = 10;
+  EventLoop loop;
+  Receiver receiver(&loop, kDatagrams);
+  receiver.receiveBatched(16);
+
+  // written at once, before the loop reads any
+  UdpSocketPtr sender(new UdpSocket(&loop, InetAddress(AF_INET, 0, true), false));
+  InetAddress receiverAddr(AF_INET, kPort, true);
+  for (int i = 0; i < kDatagrams; ++i)
+  {
+    sender->send(receiverAddr, datagram(i, 100 + i));
+  }
+
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_REQUIRE_EQUAL(receiver.received().size(), static_cast<size_t>(kDatagrams));
+  for (int i = 0; i < kDatagrams; ++i)
+  {
+    BOOST_CHECK_EQUAL(receiver.received()[i], datagram(i, 100 + i));
+  }
+  BOOST_CHECK_EQUAL(receiver.largestBatch(), kDatagrams);
+}
+
+// A datagram too big for UDP in the middle of a batch: sendmmsg(2) writes
+// those before it, fails on it, and the rest go with the next call.
+// Loopback never makes it block, so this is the partial write there is.
+BOOST_AUTO_TEST_CASE(testPartialSendmmsg)
+{
+  const int kDatagrams = 10;
+  const int kTooBig = 5;
+  EventLoop loop;
+  Receiver receiver(&loop, kDatagrams - 1);
+  receiver.receiveOneByOne();
+
+  UdpSocketPtr sender(new UdpSocket(&loop, InetAddress(AF_INET, 0, true), false));
+  sender->setBatching(16);
+  std::vector<int> completed;
+  sender->setWriteCompleteCallback(boost::bind(onWriteComplete, &completed, _1, _2));
+  InetAddress receiverAddr(AF_INET, kPort, true);
+  // queued in the loop, one flush for all
+  std::vector<int> ids;
+  for (int i = 0; i < kDatagrams; ++i)
+  {
+    ids.push_back(sender->send(receiverAddr, datagram(i, i == kTooBig ? 70000 : 100)));
+  }
+
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_REQUIRE_EQUAL(receiver.received().size(), static_cast<size_t>(kDatagrams - 1));
+  for (int i = 0, k = 0; i < kDatagrams; ++i)
+  {
+    if (i != kTooBig)
+    {
+      BOOST_CHECK_EQUAL(receiver.received()[k++], datagram(i, 100));
+    }
+  }
+  // all but the one dropped, in order
+  ids.erase(ids.begin() + kTooBig);
+  BOOST_CHECK(completed == ids);
+}
+
+// Sent with UDP_SEGMENT, read with UDP_GRO at once, where the kernel has
+// them, and cut back into the datagrams sent for the message callback.
+BOOST_AUTO_TEST_CASE(testGroWithoutSegmentCallback)
+{
+  const int kSegments = 8;
+  const size_t kSegmentSize = 1000;
+  EventLoop loop;
+  Receiver receiver(&loop, kSegments + 1);
+  bool gro = receiver.receiveGro();
+  BOOST_TEST_MESSAGE("UDP_GRO " << (gro ? "on" : "not supported"));
+
+  string message;
+  for (int i = 0; i < kSegments; ++i)
+  {
+    message += datagram(i, kSegmentSize);
+  }
+  // the last one shorter
+  message += datagram(kSegments, kSegmentSize / 2);
+  UdpSocketPtr sender(new UdpSocket(&loop, InetAddress(AF_INET, 0, true), false));
+  sender->sendSegments(InetAddress(AF_INET, kPort, true), message, kSegmentSize);
+
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_REQUIRE_EQUAL(receiver.received().size(), static_cast<size_t>(kSegments + 1));
+  for (int i = 0; i < kSegments; ++i)
+  {
+    BOOST_CHECK_EQUAL(receiver.received()[i], datagram(i, kSegmentSize));
+  }
+  BOOST_CHECK_EQUAL(receiver.received()[kSegments], datagram(kSegments, kSegmentSize / 2));
+}
@@ -89,3 +89,43 @@ BOOST_AUTO_TEST_CASE(testZlibOutputStream5)
   printf("total %zd\n", output.readableBytes());
   BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_STREAM_END);
 }
+
+namespace
+{
+
+muduo::string gunzip(const muduo::net::Buffer& input)
+{
+  z_stream zs;
+  bzero(&zs, sizeof zs);
+  inflateInit2(&zs, 15 + 16);
+  char buf[65536];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.peek()));
+  zs.avail_in = static_cast<uInt>(input.readableBytes());
+  zs.next_out = reinterpret_cast<Bytef*>(buf);
+  zs.avail_out = sizeof buf;
+  int err = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  return err == Z_STREAM_END ? muduo::string(buf, sizeof buf - zs.avail_out) : "";
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testZlibOutputStreamGzipReset)
+{
+  muduo::net::Buffer output;
+  muduo::net::ZlibOutputStream stream(&output, 6, 15 + 16);
+  BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_OK);
+  muduo::string input(10000, 'x');
+  for (int i = 0; i < 3; ++i)
+  {
+    muduo::net::Buffer another;
+    BOOST_CHECK(stream.reset(&another));
+    BOOST_CHECK(stream.write(input));
+    BOOST_CHECK(stream.finishStream());
+    BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_STREAM_END);
+    BOOST_CHECK(another.readableBytes() < input.size());
+    BOOST_CHECK(gunzip(another) == input);
+  }
+  BOOST_CHECK(stream.finish());
+  BOOST_CHECK(!stream.reset(&output));
+}